@@ -29,6 +29,34 @@ function(ahrimq_add_cc_test)
   add_test(NAME ${cc_test_target_name} COMMAND ${cc_test_target_name})
 endfunction(ahrimq_add_cc_test)
 
+# cmake helper function to add benchmark binary, not run by ctest
+function(ahrimq_add_cc_benchmark)
+  if (NOT BUILD_BENCHMARKS)
+    return()
+  endif()
+
+  cmake_parse_arguments(AHRIMQ_CC_BENCH
+    ""
+    "NAME"
+    "SRCS;LINKS"
+    ${ARGN}
+  )
+
+  set(cc_bench_target_name "${AHRIMQ_CC_BENCH_NAME}")
+  set(cc_bench_srcs "${AHRIMQ_CC_BENCH_SRCS}")
+  set(cc_bench_links "${AHRIMQ_CC_BENCH_LINKS}")
+
+  add_executable(${cc_bench_target_name} ${cc_bench_srcs})
+  set_property(TARGET ${cc_bench_target_name} PROPERTY LINKER_LANGUAGE "CXX")
+
+  target_link_libraries(
+    ${cc_bench_target_name}
+  PRIVATE
+    benchmark::benchmark
+    ${cc_bench_links}
+  )
+endfunction(ahrimq_add_cc_benchmark)
+
 function(ahrimq_add_cc_executable)
   cmake_parse_arguments(AHRIMQ_CC_EXEC
     ""
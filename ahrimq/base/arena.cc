@@ -0,0 +1,119 @@
+#include "base/arena.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <utility>
+
+namespace ahrimq {
+
+Arena::Arena(size_t block_size) : block_size_(block_size) {}
+
+Arena::Arena(Arena&& other) noexcept
+    : block_size_(other.block_size_),
+      blocks_(std::exchange(other.blocks_, nullptr)),
+      ptr_(std::exchange(other.ptr_, nullptr)),
+      end_(std::exchange(other.end_, nullptr)),
+      used_(std::exchange(other.used_, 0)) {}
+
+Arena& Arena::operator=(Arena&& other) noexcept {
+  if (this != &other) {
+    FreeBlocks(blocks_);
+    block_size_ = other.block_size_;
+    blocks_ = std::exchange(other.blocks_, nullptr);
+    ptr_ = std::exchange(other.ptr_, nullptr);
+    end_ = std::exchange(other.end_, nullptr);
+    used_ = std::exchange(other.used_, 0);
+  }
+  return *this;
+}
+
+Arena::~Arena() {
+  FreeBlocks(blocks_);
+}
+
+void Arena::FreeBlocks(Block* from) {
+  while (from != nullptr) {
+    Block* next = from->next;
+    free(from);
+    from = next;
+  }
+}
+
+void Arena::NewBlock(size_t n) {
+  size_t size = n > block_size_ ? n : block_size_;
+  Block* b = static_cast<Block*>(malloc(sizeof(Block) + size));
+  if (b == nullptr) {
+    throw std::bad_alloc();
+  }
+  b->next = blocks_;
+  b->size = size;
+  blocks_ = b;
+  ptr_ = reinterpret_cast<char*>(b + 1);
+  end_ = ptr_ + size;
+}
+
+void* Arena::Allocate(size_t n, size_t align) {
+  uintptr_t p = (reinterpret_cast<uintptr_t>(ptr_) + align - 1) & ~(align - 1);
+  if (ptr_ == nullptr || p + n > reinterpret_cast<uintptr_t>(end_)) {
+    if (blocks_ != nullptr && n > block_size_ / 2) {
+      // a dedicated block behind the current one, which stays in use
+      Block* b = static_cast<Block*>(malloc(sizeof(Block) + n + align));
+      if (b == nullptr) {
+        throw std::bad_alloc();
+      }
+      b->next = blocks_->next;
+      b->size = n + align;
+      blocks_->next = b;
+      used_ += n;
+      p = (reinterpret_cast<uintptr_t>(b + 1) + align - 1) & ~(align - 1);
+      return reinterpret_cast<void*>(p);
+    }
+    NewBlock(n + align);
+    p = (reinterpret_cast<uintptr_t>(ptr_) + align - 1) & ~(align - 1);
+  }
+  ptr_ = reinterpret_cast<char*>(p + n);
+  used_ += n;
+  return reinterpret_cast<void*>(p);
+}
+
+std::string_view Arena::Copy(std::string_view s) {
+  if (s.empty()) {
+    return {};
+  }
+  char* p = AllocateChars(s.size());
+  memcpy(p, s.data(), s.size());
+  return std::string_view(p, s.size());
+}
+
+void Arena::Reset() {
+  // keep the oldest block of block_size_, bigger ones were only needed by bigger
+  // rounds and dedicated blocks may sit anywhere in the list
+  Block* keep = nullptr;
+  Block* b = blocks_;
+  while (b != nullptr) {
+    Block* next = b->next;
+    if (b->size == block_size_) {
+      if (keep != nullptr) {
+        free(keep);
+      }
+      keep = b;
+    } else {
+      free(b);
+    }
+    b = next;
+  }
+  blocks_ = keep;
+  if (keep == nullptr) {
+    ptr_ = nullptr;
+    end_ = nullptr;
+  } else {
+    keep->next = nullptr;
+    ptr_ = reinterpret_cast<char*>(keep + 1);
+    end_ = ptr_ + keep->size;
+  }
+  used_ = 0;
+}
+
+}  // namespace ahrimq
@@ -0,0 +1,94 @@
+#ifndef _AHRIMQ_BASE_ARENA_H_
+#define _AHRIMQ_BASE_ARENA_H_
+
+#include <cstddef>
+#include <memory_resource>
+#include <string_view>
+
+#include "base/nocopyable.h"
+
+namespace ahrimq {
+
+/// @brief Arena is a monotonic allocator for data sharing one lifetime, e.g. the
+/// strings parsed out of one request. Allocation bumps a pointer, nothing is freed
+/// individually, and Reset() releases everything at once while keeping the first
+/// regular block for the next round. Not thread safe.
+///
+/// Arena is a std::pmr::memory_resource, so pmr containers can draw from it.
+/// Containers must give their storage back (e.g. by being assigned an empty
+/// container) before Reset(), deallocation itself is a no-op.
+class Arena : public std::pmr::memory_resource, public NoCopyable {
+ public:
+  constexpr static size_t kDefaultBlockSize = 4096;
+
+  /// @brief Construct an arena, no memory is taken before the first allocation.
+  /// @param block_size size of the blocks requested from the system
+  explicit Arena(size_t block_size = kDefaultBlockSize);
+
+  Arena(Arena&& other) noexcept;
+
+  Arena& operator=(Arena&& other) noexcept;
+
+  ~Arena() override;
+
+  /// @brief Allocate n bytes aligned to align, which must be a power of two.
+  /// @param n
+  /// @param align
+  /// @return never nullptr, std::bad_alloc is thrown like operator new does
+  void* Allocate(size_t n, size_t align = alignof(std::max_align_t));
+
+  /// @brief Allocate n bytes for characters.
+  /// @param n
+  /// @return
+  char* AllocateChars(size_t n) {
+    return static_cast<char*>(Allocate(n, 1));
+  }
+
+  /// @brief Copy s into the arena.
+  /// @param s
+  /// @return a view of the copy, valid until Reset()
+  std::string_view Copy(std::string_view s);
+
+  /// @brief Release all allocations, the first block of block_size bytes is kept
+  /// and blocks taken for bigger allocations are freed.
+  void Reset();
+
+  /// @brief Bytes handed out since the last Reset().
+  size_t Used() const {
+    return used_;
+  }
+
+ protected:
+  void* do_allocate(size_t bytes, size_t alignment) override {
+    return Allocate(bytes, alignment);
+  }
+
+  void do_deallocate(void*, size_t, size_t) override {}
+
+  bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+    return this == &other;
+  }
+
+ private:
+  struct Block {
+    Block* next;
+    size_t size;
+  };
+
+  // make a block of at least n usable bytes the current one
+  void NewBlock(size_t n);
+
+  void FreeBlocks(Block* from);
+
+ private:
+  size_t block_size_;
+  // the newest block first, the first block is the last of the list
+  Block* blocks_ = nullptr;
+  char* ptr_ = nullptr;
+  char* end_ = nullptr;
+  size_t used_ = 0;
+};
+
+}  // namespace ahrimq
+
+#endif  // _AHRIMQ_BASE_ARENA_H_
@@ -0,0 +1,63 @@
+#include "ahrimq/base/arena.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace ahrimq;
+
+TEST(ArenaTest, AllocateTest) {
+  Arena arena(256);
+  std::vector<std::string_view> views;
+  for (int i = 0; i < 100; i++) {
+    views.push_back(arena.Copy(std::to_string(i)));
+  }
+  // a big allocation takes its own block and does not disturb the others
+  void* big = arena.Allocate(4096, 64);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(big) % 64, 0u);
+  for (int i = 0; i < 100; i++) {
+    EXPECT_EQ(views[i], std::to_string(i));
+  }
+  for (size_t align : {1, 2, 8, 16}) {
+    void* p = arena.Allocate(3, align);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(p) % align, 0u);
+  }
+  EXPECT_GT(arena.Used(), 4096u);
+
+  // the first block is reused after a reset
+  arena.Reset();
+  EXPECT_EQ(arena.Used(), 0u);
+  std::string_view a = arena.Copy("a");
+  arena.Reset();
+  EXPECT_EQ(arena.Copy("b").data(), a.data());
+
+  Arena moved(std::move(arena));
+  EXPECT_EQ(moved.Copy("hello"), "hello");
+}
+
+TEST(ArenaTest, ResetAfterLargeAllocationTest) {
+  Arena arena(256);
+  std::string_view a = arena.Copy("a");
+  // the dedicated block is linked behind the first one, so it is the last one
+  arena.Allocate(4096);
+  arena.Reset();
+  EXPECT_EQ(arena.Copy("b").data(), a.data());
+
+  // an arena whose only block is a large one keeps nothing
+  Arena large(256);
+  large.Allocate(4096);
+  large.Reset();
+  EXPECT_EQ(large.Used(), 0u);
+  std::string_view c = large.Copy("c");
+  EXPECT_EQ(c, "c");
+  large.Allocate(1000);
+  large.Reset();
+  EXPECT_EQ(large.Copy("d").data(), c.data());
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,100 @@
+#include "base/crc32c.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#define AHRIMQ_CRC32C_X86
+#endif
+
+namespace ahrimq {
+
+// reflected Castagnoli polynomial
+constexpr static uint32_t kCrc32cPoly = 0x82f63b78;
+
+namespace {
+
+// table[k][b] is the crc of byte b followed by k zero bytes, so that 8 bytes are
+// folded with 8 independent lookups
+struct Crc32cTable {
+  uint32_t table[8][256];
+
+  Crc32cTable() {
+    for (uint32_t b = 0; b < 256; b++) {
+      uint32_t crc = b;
+      for (int i = 0; i < 8; i++) {
+        crc = (crc >> 1) ^ (kCrc32cPoly & (0u - (crc & 1)));
+      }
+      table[0][b] = crc;
+    }
+    for (uint32_t b = 0; b < 256; b++) {
+      for (int k = 1; k < 8; k++) {
+        table[k][b] = (table[k - 1][b] >> 8) ^ table[0][table[k - 1][b] & 0xff];
+      }
+    }
+  }
+};
+
+}  // namespace
+
+static const Crc32cTable kTable;
+
+static uint32_t Crc32cSoftware(uint32_t crc, const unsigned char* p, size_t len) {
+  const auto& t = kTable.table;
+  while (len >= 8) {
+    uint32_t lo, hi;
+    memcpy(&lo, p, 4);
+    memcpy(&hi, p + 4, 4);
+    // little endian
+    lo ^= crc;
+    crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^ t[5][(lo >> 16) & 0xff] ^
+          t[4][lo >> 24] ^ t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^
+          t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+    p += 8;
+    len -= 8;
+  }
+  while (len-- > 0) {
+    crc = (crc >> 8) ^ t[0][(crc ^ *p++) & 0xff];
+  }
+  return crc;
+}
+
+#ifdef AHRIMQ_CRC32C_X86
+__attribute__((target("sse4.2"))) static uint32_t Crc32cHardware(
+    uint32_t crc, const unsigned char* p, size_t len) {
+#ifdef __x86_64__
+  uint64_t crc64 = crc;
+  while (len >= 8) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    crc64 = _mm_crc32_u64(crc64, v);
+    p += 8;
+    len -= 8;
+  }
+  crc = static_cast<uint32_t>(crc64);
+#endif
+  while (len-- > 0) {
+    crc = _mm_crc32_u8(crc, *p++);
+  }
+  return crc;
+}
+
+// the cpu model may not be known yet when static objects are initialized
+static const bool kHaveSSE42 = []() {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("sse4.2") != 0;
+}();
+#endif
+
+uint32_t Crc32cExtend(uint32_t crc, const char* data, size_t len) {
+  const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+  crc = ~crc;
+#ifdef AHRIMQ_CRC32C_X86
+  if (kHaveSSE42) {
+    return ~Crc32cHardware(crc, p, len);
+  }
+#endif
+  return ~Crc32cSoftware(crc, p, len);
+}
+
+}  // namespace ahrimq
@@ -0,0 +1,28 @@
+#ifndef _AHRIMQ_BASE_CRC32C_H_
+#define _AHRIMQ_BASE_CRC32C_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace ahrimq {
+
+/// @brief Extend a CRC-32C (Castagnoli) checksum with more data. The crc32
+/// instruction of SSE4.2 is used when the cpu has it, detected at runtime, and a
+/// slicing-by-8 table otherwise.
+/// @param crc the checksum of the data before, 0 to start
+/// @param data
+/// @param len
+/// @return
+uint32_t Crc32cExtend(uint32_t crc, const char* data, size_t len);
+
+/// @brief Compute the CRC-32C checksum of data.
+/// @param data
+/// @param len
+/// @return
+inline uint32_t Crc32c(const char* data, size_t len) {
+  return Crc32cExtend(0, data, len);
+}
+
+}  // namespace ahrimq
+
+#endif  // _AHRIMQ_BASE_CRC32C_H_
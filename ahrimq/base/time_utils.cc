@@ -25,6 +25,11 @@ std::string UTCTimePoint::ToFormatString() const {
   return std::string(buf, std::strlen(buf));
 }
 
+time_t UTCTimePoint::ToTimeT() const {
+  struct tm copy = impl_;
+  return timegm(&copy);
+}
+
 UTCTimePoint UTCTimePoint::Now() {
   timespec tspec;
   timespec_get(&tspec, TIME_UTC);
@@ -96,6 +101,104 @@ std::string GMTTimeNowString() {
   return std::string(buf, std::strlen(buf));
 }
 
+static const char* kWeekdayNames[7] = {"Sun", "Mon", "Tue", "Wed",
+                                       "Thu", "Fri", "Sat"};
+static const char* kMonthNames[12] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                      "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+static inline char* Put2Digits(char* p, int v) {
+  p[0] = '0' + v / 10;
+  p[1] = '0' + v % 10;
+  return p + 2;
+}
+
+size_t FormatGMTTime(time_t t, char* out) {
+  struct tm tmv;
+  gmtime_r(&t, &tmv);
+  char* p = out;
+  memcpy(p, kWeekdayNames[tmv.tm_wday], 3);
+  p += 3;
+  *p++ = ',';
+  *p++ = ' ';
+  p = Put2Digits(p, tmv.tm_mday);
+  *p++ = ' ';
+  memcpy(p, kMonthNames[tmv.tm_mon], 3);
+  p += 3;
+  *p++ = ' ';
+  int year = tmv.tm_year + 1900;
+  p = Put2Digits(p, year / 100);
+  p = Put2Digits(p, year % 100);
+  *p++ = ' ';
+  p = Put2Digits(p, tmv.tm_hour);
+  *p++ = ':';
+  p = Put2Digits(p, tmv.tm_min);
+  *p++ = ':';
+  p = Put2Digits(p, tmv.tm_sec);
+  memcpy(p, " GMT", 4);
+  p += 4;
+  return p - out;
+}
+
+static inline bool Get2Digits(const char* p, int& v) {
+  if (p[0] < '0' || p[0] > '9' || p[1] < '0' || p[1] > '9') {
+    return false;
+  }
+  v = (p[0] - '0') * 10 + (p[1] - '0');
+  return true;
+}
+
+bool ParseGMTTime(const char* s, size_t len, time_t& out) {
+  // "Sun, 06 Nov 1994 08:49:37 GMT"
+  //  0    5  8   12   17 20 23 26
+  if (len != kGMTTimeStringLen || s[3] != ',' || s[4] != ' ' || s[7] != ' ' ||
+      s[11] != ' ' || s[16] != ' ' || s[19] != ':' || s[22] != ':' ||
+      memcmp(s + 25, " GMT", 4) != 0) {
+    return false;
+  }
+  struct tm tmv;
+  memset(&tmv, 0, sizeof(tmv));
+  int month = -1;
+  for (int i = 0; i < 12; i++) {
+    if (memcmp(s + 8, kMonthNames[i], 3) == 0) {
+      month = i;
+      break;
+    }
+  }
+  int century = 0;
+  int year = 0;
+  if (month == -1 || !Get2Digits(s + 5, tmv.tm_mday) ||
+      !Get2Digits(s + 12, century) || !Get2Digits(s + 14, year) ||
+      !Get2Digits(s + 17, tmv.tm_hour) || !Get2Digits(s + 20, tmv.tm_min) ||
+      !Get2Digits(s + 23, tmv.tm_sec)) {
+    return false;
+  }
+  if (tmv.tm_mday < 1 || tmv.tm_mday > 31 || tmv.tm_hour > 23 || tmv.tm_min > 59 ||
+      tmv.tm_sec > 60) {
+    return false;
+  }
+  tmv.tm_mon = month;
+  tmv.tm_year = century * 100 + year - 1900;
+  out = timegm(&tmv);
+  return true;
+}
+
+GMTDateCache::GMTDateCache() {
+  memset(buf_, 0, sizeof(buf_));
+  Refresh();
+}
+
+void GMTDateCache::Refresh() {
+  Refresh(std::time(nullptr));
+}
+
+void GMTDateCache::Refresh(time_t now) {
+  if (now == sec_) {
+    return;
+  }
+  FormatGMTTime(now, buf_);
+  sec_ = now;
+}
+
 struct UTCTimeZoneIniter {
   UTCTimeZoneIniter() {
     SetUTCTimeZone();
@@ -31,6 +31,10 @@ class UTCTimePoint {
 
   std::string ToFormatString() const;
 
+  /// @brief Seconds since epoch of this time point.
+  /// @return
+  time_t ToTimeT() const;
+
   static UTCTimePoint Now();
 
   static std::string NowFormatString();
@@ -94,6 +98,55 @@ void SetUTCTimeZone();
 
 std::string GMTTimeNowString();
 
+/// @brief Length of an IMF-fixdate string like "Sun, 06 Nov 1994 08:49:37 GMT".
+constexpr static size_t kGMTTimeStringLen = 29;
+
+/// @brief Render t as IMF-fixdate into out without calling strftime. out must have
+/// room for at least kGMTTimeStringLen bytes, no terminating '\0' is written.
+/// @param t seconds since epoch
+/// @param out output buffer
+/// @return the number of bytes written
+size_t FormatGMTTime(time_t t, char* out);
+
+/// @brief Parse an IMF-fixdate string like "Sun, 06 Nov 1994 08:49:37 GMT". The
+/// obsolete RFC 850 and asctime formats are not accepted.
+/// @param s input string
+/// @param len length of s
+/// @param out seconds since epoch
+/// @return false if s is not a valid IMF-fixdate
+bool ParseGMTTime(const char* s, size_t len, time_t& out);
+
+/// @brief GMTDateCache keeps a pre-rendered IMF-fixdate string, which is only
+/// re-rendered when the second changes. It is not thread safe, every eventloop
+/// should own one and refresh it from its own timer.
+class GMTDateCache {
+ public:
+  GMTDateCache();
+
+  /// @brief Re-render the cached string from current time.
+  void Refresh();
+
+  /// @brief Re-render the cached string from given time if needed.
+  /// @param now seconds since epoch
+  void Refresh(time_t now);
+
+  const char* Data() const {
+    return buf_;
+  }
+
+  size_t Size() const {
+    return kGMTTimeStringLen;
+  }
+
+  time_t Second() const {
+    return sec_;
+  }
+
+ private:
+  time_t sec_ = -1;
+  char buf_[kGMTTimeStringLen + 1];
+};
+
 static uint64_t GetCurrentSec() {
   struct timeval tv {};
   gettimeofday(&tv, nullptr);
@@ -50,6 +50,50 @@ TEST(TimeUtilsTest, BasicTest) {
   std::cout << now.ToFormatString() << '\n';
 }
 
+TEST(TimeUtilsTest, FormatGMTTimeTest) {
+  std::vector<time_t> cases{0,          784111777,  951782400,  1234567890,
+                            1672531199, 1709164800, 2147483647, 4102444800};
+  for (auto t : cases) {
+    struct tm tmv;
+    gmtime_r(&t, &tmv);
+    char expect[48];
+    std::strftime(expect, sizeof(expect), "%a, %d %b %Y %H:%M:%S GMT", &tmv);
+    char have[48] = {0};
+    size_t n = time::FormatGMTTime(t, have);
+    EXPECT_EQ(n, time::kGMTTimeStringLen);
+    EXPECT_STREQ(have, expect);
+  }
+}
+
+TEST(TimeUtilsTest, ParseGMTTimeTest) {
+  std::vector<time_t> cases{0, 784111777, 951782400, 1709164800, 2147483647};
+  for (auto t : cases) {
+    char buf[48] = {0};
+    size_t n = time::FormatGMTTime(t, buf);
+    time_t have = -1;
+    EXPECT_TRUE(time::ParseGMTTime(buf, n, have));
+    EXPECT_EQ(have, t);
+  }
+  time_t out;
+  std::vector<std::string> invalid{"", "Sunday, 06-Nov-94 08:49:37 GMT",
+                                   "Sun Nov  6 08:49:37 1994",
+                                   "Sun, 06 Xyz 1994 08:49:37 GMT",
+                                   "Sun, 06 Nov 1994 28:49:37 GMT",
+                                   "Sun, 0a Nov 1994 08:49:37 GMT"};
+  for (const auto& s : invalid) {
+    EXPECT_FALSE(time::ParseGMTTime(s.data(), s.size(), out)) << s;
+  }
+}
+
+TEST(TimeUtilsTest, GMTDateCacheTest) {
+  time::GMTDateCache cache;
+  cache.Refresh(784111777);
+  EXPECT_EQ(std::string(cache.Data(), cache.Size()), "Sun, 06 Nov 1994 08:49:37 GMT");
+  EXPECT_EQ(cache.Second(), 784111777);
+  cache.Refresh(784111778);
+  EXPECT_EQ(std::string(cache.Data(), cache.Size()), "Sun, 06 Nov 1994 08:49:38 GMT");
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
@@ -0,0 +1,152 @@
+#include "broker/broker_server.h"
+
+#include <sys/socket.h>
+
+namespace ahrimq {
+namespace broker {
+
+Dispatcher::Dispatcher(uint32_t max_body) : max_body_(max_body) {
+  Handle(Opcode::Ping,
+         [](TCPConn* conn, const Frame& request, FrameWriter& response) {
+           response.WriteRaw(request.body.data(), request.body.size());
+           return ErrorCode::None;
+         });
+}
+
+void Dispatcher::Handle(Opcode opcode, Handler handler) {
+  uint8_t i = static_cast<uint8_t>(opcode) & ~kResponseFlag;
+  handlers_[i] = std::move(handler);
+  deferred_handlers_[i] = nullptr;
+}
+
+void Dispatcher::HandleDeferred(Opcode opcode, DeferredHandler handler) {
+  uint8_t i = static_cast<uint8_t>(opcode) & ~kResponseFlag;
+  deferred_handlers_[i] = std::move(handler);
+  handlers_[i] = nullptr;
+}
+
+bool Dispatcher::Dispatch(const TCPConnPtr& conn, Buffer& in, Buffer& out,
+                          bool* deferred) {
+  Frame frame;
+  while (!in.Empty()) {
+    DecodeStatus status =
+        DecodeFrame(in.BeginReadPointer(), in.Size(), max_body_, &frame);
+    if (status == DecodeStatus::Partial) {
+      break;
+    }
+    if (status == DecodeStatus::Invalid || frame.header.IsResponse()) {
+      return false;
+    }
+    const DeferredHandler& handler = deferred_handlers_[frame.header.opcode];
+    if (handler != nullptr && deferred != nullptr && sink_ != nullptr) {
+      handler(conn.get(), frame, Responder(conn, frame.header, &sink_));
+      in.ReaderIdxForward(frame.Size());
+      *deferred = true;
+      return true;
+    }
+    // the body stays in in until the handler returns
+    HandleFrame(conn.get(), frame, out);
+    in.ReaderIdxForward(frame.Size());
+  }
+  if (in.Empty()) {
+    // start over at the front instead of moving bytes around on the next read
+    in.Reset();
+  }
+  if (deferred != nullptr) {
+    *deferred = false;
+  }
+  return true;
+}
+
+void Dispatcher::HandleFrame(TCPConn* conn, const Frame& request, Buffer& out) {
+  FrameWriter response(out, request.header.opcode | kResponseFlag,
+                       request.header.correlation_id);
+  response.WriteUInt16(static_cast<uint16_t>(ErrorCode::None));
+  const Handler& handler = handlers_[request.header.opcode];
+  ErrorCode err = ErrorCode::UnsupportedOpcode;
+  if (handler != nullptr) {
+    err = handler(conn, request, response);
+  }
+  FinishResponse(conn, response, err);
+}
+
+void Dispatcher::WriteResponse(TCPConn* conn, const FrameHeader& request,
+                               ErrorCode err, const BodyWriter& body, Buffer& out) {
+  FrameWriter response(out, request.opcode | kResponseFlag, request.correlation_id);
+  response.WriteUInt16(static_cast<uint16_t>(ErrorCode::None));
+  if (err == ErrorCode::None && body != nullptr) {
+    body(response);
+  }
+  FinishResponse(conn, response, err);
+}
+
+void Dispatcher::FinishResponse(TCPConn* conn, FrameWriter& response,
+                                ErrorCode err) {
+  if (err != ErrorCode::None) {
+    response.TruncateBody(2);
+    response.PatchUInt16(0, static_cast<uint16_t>(err));
+  }
+  response.Finish();
+  for (const FileRegion& file : response.Files()) {
+    conn->AppendFileRegion(file.fd, file.offset, file.length, file.holder);
+  }
+}
+
+BrokerServer::BrokerServer(const BrokerServer::Config& config)
+    : TCPServer(config), dispatcher_(config.max_frame_body) {
+  dispatcher_.SetResponderSink([this](const TCPConnPtr& conn,
+                                      const FrameHeader& request, ErrorCode err,
+                                      BodyWriter body) {
+    // the connection is suspended until then, so it is still open
+    conn->GetLoop()->QueueInLoop([this, conn, request, err, body = std::move(body)] {
+      FinishDeferred(conn, request, err, body);
+    });
+  });
+}
+
+// frames are decoded as soon as they are complete, a read event may carry part of
+// a frame or many frames
+void BrokerServer::OnStreamReached(ReactorConn* conn, bool allread,
+                                   bool& close_after) {
+  TCPConnPtr tcpconn = FindTCPConn(conn);
+  if (tcpconn == nullptr) {
+    close_after = true;
+    return;
+  }
+  bool deferred = false;
+  if (!DispatchFrames(tcpconn, &deferred)) {
+    close_after = true;
+  }
+}
+
+bool BrokerServer::DispatchFrames(const TCPConnPtr& conn, bool* deferred) {
+  if (!dispatcher_.Dispatch(conn, conn->GetReadBuffer(), conn->GetWriteBuffer(),
+                            deferred)) {
+    return false;
+  }
+  if (*deferred) {
+    // responses leave in the order of their requests, nothing is read or handled
+    // until this one is answered, the answers before it are sent meanwhile
+    conn->Suspend();
+  }
+  return true;
+}
+
+void BrokerServer::FinishDeferred(const TCPConnPtr& conn, const FrameHeader& request,
+                                  ErrorCode err, const BodyWriter& body) {
+  if (conn->ConnClosed()) {
+    return;
+  }
+  dispatcher_.WriteResponse(conn.get(), request, err, body, conn->GetWriteBuffer());
+  bool deferred = false;
+  if (!DispatchFrames(conn, &deferred)) {
+    // the connection is dropped once it is watched again
+    shutdown(conn->GetFd(), SHUT_RDWR);
+  }
+  if (!deferred) {
+    conn->Resume();
+  }
+}
+
+}  // namespace broker
+}  // namespace ahrimq
@@ -0,0 +1,181 @@
+#ifndef _AHRIMQ_BROKER_BROKER_SERVER_H_
+#define _AHRIMQ_BROKER_BROKER_SERVER_H_
+
+#include <functional>
+
+#include "broker/protocol.h"
+#include "net/tcp/tcp_server.h"
+
+namespace ahrimq {
+namespace broker {
+
+/// @brief Handler of a request opcode. The response frame is already started with
+/// the opcode and correlation id of the request and a placeholder error code, the
+/// handler writes the rest of the body. If it returns an error, what it wrote is
+/// dropped and the response only carries the error code. Files the handler ends
+/// the body with are sent from the file system after the response header, the
+/// handler keeps them open until they were written.
+typedef std::function<ErrorCode(TCPConn* conn, const Frame& request,
+                                FrameWriter& response)>
+    Handler;
+
+/// @brief Writes the body of a response which was deferred, see Responder.
+typedef std::function<void(FrameWriter& response)> BodyWriter;
+
+/// @brief Responder answers a request whose handler deferred it, once the work the
+/// request waits for is done, from any thread. The frames the connection sent
+/// after the request are held back until it is answered, so it must be answered
+/// exactly once.
+class Responder {
+ public:
+  /// @brief Delivers the answer of a deferred request to its connection.
+  typedef std::function<void(const TCPConnPtr& conn, const FrameHeader& request,
+                             ErrorCode err, BodyWriter body)>
+      Sink;
+
+  Responder(TCPConnPtr conn, const FrameHeader& request, const Sink* sink)
+      : conn_(std::move(conn)), request_(request), sink_(sink) {}
+
+  /// @brief Answer the request.
+  /// @param err
+  /// @param body writes the body after the error code, only called without an
+  /// error, in the eventloop of the connection
+  void Respond(ErrorCode err, BodyWriter body = nullptr) const {
+    (*sink_)(conn_, request_, err, std::move(body));
+  }
+
+  const FrameHeader& Request() const {
+    return request_;
+  }
+
+ private:
+  TCPConnPtr conn_;
+  FrameHeader request_;
+  // owned by the dispatcher
+  const Sink* sink_;
+};
+
+/// @brief Handler of a request opcode which answers through responder after it
+/// returned, e.g. once a write was synced to the disk. The body of the request
+/// is only valid until the handler returns.
+typedef std::function<void(TCPConn* conn, const Frame& request, Responder responder)>
+    DeferredHandler;
+
+/// @brief Dispatcher decodes the frames a connection received and hands them to the
+/// handler of their opcode. Every frame complete in the read buffer is handled in
+/// one go, in order, and the responses are appended to the write buffer so that
+/// they leave in a single write. Files ending a response are queued on the
+/// connection right behind it, so responses keep their order when some are sent
+/// from files. A deferred request stops the dispatch, the frames after it are
+/// handled once it was answered.
+class Dispatcher {
+ public:
+  /// @brief Construct a dispatcher which answers Ping by echoing its body.
+  /// @param max_body the largest frame body accepted
+  explicit Dispatcher(uint32_t max_body = kDefaultMaxFrameBody);
+
+  /// @brief Set the handler of an opcode.
+  /// @param opcode
+  /// @param handler
+  void Handle(Opcode opcode, Handler handler);
+
+  /// @brief Set the handler of an opcode whose requests are answered later.
+  /// @param opcode
+  /// @param handler
+  void HandleDeferred(Opcode opcode, DeferredHandler handler);
+
+  /// @brief Set how the answers of deferred requests reach their connections,
+  /// requests are only deferred once it is set.
+  /// @param sink
+  void SetResponderSink(Responder::Sink sink) {
+    sink_ = std::move(sink);
+  }
+
+  /// @brief Handle the complete frames in in and consume them, a partial frame is
+  /// left for the next call.
+  /// @param conn
+  /// @param in
+  /// @param out
+  /// @param deferred output arg, set if the dispatch stopped at a deferred request,
+  /// without it deferred handlers are not called
+  /// @return false if in does not hold frames of this protocol, the connection
+  /// must be dropped
+  bool Dispatch(const TCPConnPtr& conn, Buffer& in, Buffer& out,
+                bool* deferred = nullptr);
+
+  /// @brief Write the answer of a deferred request.
+  /// @param conn
+  /// @param request
+  /// @param err
+  /// @param body
+  /// @param out
+  void WriteResponse(TCPConn* conn, const FrameHeader& request, ErrorCode err,
+                     const BodyWriter& body, Buffer& out);
+
+ private:
+  void HandleFrame(TCPConn* conn, const Frame& request, Buffer& out);
+
+  // replace the body of a failed response by its error and queue its files
+  void FinishResponse(TCPConn* conn, FrameWriter& response, ErrorCode err);
+
+ private:
+  uint32_t max_body_;
+  // indexed by opcode, responses have the highest bit set and no handler
+  Handler handlers_[kResponseFlag];
+  DeferredHandler deferred_handlers_[kResponseFlag];
+  Responder::Sink sink_;
+};
+
+/// @brief BrokerServer is a TCPServer speaking the binary broker protocol of
+/// protocol.h. Handlers run in the eventloop of the connection. While a request is
+/// deferred the connection is suspended, the answer is written in its eventloop
+/// and the frames received after the request are handled then.
+class BrokerServer : public TCPServer {
+ public:
+  /// @brief Broker server configuration
+  class Config : public TCPServer::Config {
+   public:
+    // frames with a larger body drop the connection
+    uint32_t max_frame_body = kDefaultMaxFrameBody;
+  };
+
+ public:
+  explicit BrokerServer(const BrokerServer::Config& config);
+
+  /// @brief Set the handler of an opcode, before the server is run.
+  /// @param opcode
+  /// @param handler
+  void Handle(Opcode opcode, Handler handler) {
+    dispatcher_.Handle(opcode, std::move(handler));
+  }
+
+  /// @brief Set the handler of an opcode whose requests are answered later, before
+  /// the server is run.
+  /// @param opcode
+  /// @param handler
+  void HandleDeferred(Opcode opcode, DeferredHandler handler) {
+    dispatcher_.HandleDeferred(opcode, std::move(handler));
+  }
+
+ protected:
+  void OnStreamReached(ReactorConn* conn, bool allread, bool& close_after) override;
+
+ private:
+  // dispatch the frames conn received, suspending it at a deferred request
+  bool DispatchFrames(const TCPConnPtr& conn, bool* deferred);
+
+  // write the answer of a deferred request and go on with the frames after it, in
+  // the eventloop of the connection
+  void FinishDeferred(const TCPConnPtr& conn, const FrameHeader& request,
+                      ErrorCode err, const BodyWriter& body);
+
+ private:
+  Dispatcher dispatcher_;
+};
+
+typedef BrokerServer::Config BrokerServerConfig;
+
+}  // namespace broker
+}  // namespace ahrimq
+
+#endif  // _AHRIMQ_BROKER_BROKER_SERVER_H_
@@ -0,0 +1,71 @@
+#include "broker/fetch_waiters.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace ahrimq {
+namespace broker {
+
+bool FetchWaiters::Wait(EventLoop* loop, uint64_t seen, size_t min_bytes,
+                        uint64_t max_wait_ms, Completion done) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  if (appended_.load(std::memory_order_relaxed) >= seen + min_bytes) {
+    return false;
+  }
+  Key key(seen + min_bytes, next_id_++);
+  Waiter& waiter = waiters_[key];
+  waiter.loop = loop;
+  waiter.done = std::move(done);
+  // the timer fires in this thread, after the lock is released
+  waiter.timer = loop->RunAfter(max_wait_ms, [this, key]() { Expire(key); });
+  return true;
+}
+
+void FetchWaiters::Notify(size_t bytes, uint64_t end_offset) {
+  std::vector<Waiter> ready;
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    uint64_t appended = appended_.load(std::memory_order_relaxed) + bytes;
+    appended_.store(appended, std::memory_order_release);
+    end_offset_ = std::max(end_offset_, end_offset);
+    auto it = waiters_.begin();
+    while (it != waiters_.end() && it->first.first <= appended) {
+      ready.push_back(std::move(it->second));
+      it = waiters_.erase(it);
+    }
+  }
+  for (Waiter& waiter : ready) {
+    EventLoop* loop = waiter.loop;
+    TimerId timer = waiter.timer;
+    loop->QueueInLoop([loop, timer]() { loop->CancelTimer(timer); });
+    waiter.done(false);
+  }
+}
+
+void FetchWaiters::Expire(const Key& key) {
+  Completion done;
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    auto it = waiters_.find(key);
+    if (it == waiters_.end()) {
+      return;
+    }
+    done = std::move(it->second.done);
+    waiters_.erase(it);
+  }
+  done(true);
+}
+
+uint64_t FetchWaiters::Appended(uint64_t* end_offset) const {
+  std::lock_guard<std::mutex> lock(mtx_);
+  *end_offset = end_offset_;
+  return appended_.load(std::memory_order_relaxed);
+}
+
+size_t FetchWaiters::Size() const {
+  std::lock_guard<std::mutex> lock(mtx_);
+  return waiters_.size();
+}
+
+}  // namespace broker
+}  // namespace ahrimq
@@ -0,0 +1,98 @@
+#ifndef _AHRIMQ_BROKER_FETCH_WAITERS_H_
+#define _AHRIMQ_BROKER_FETCH_WAITERS_H_
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <utility>
+
+#include "base/nocopyable.h"
+#include "net/eventloop.h"
+
+namespace ahrimq {
+namespace broker {
+
+/// @brief FetchWaiters parks the fetches of a partition which found less data than
+/// they asked for, until enough is appended to it or they waited long enough.
+///
+/// The append path reports every batch appended with Notify(), from any thread,
+/// which completes the fetches waiting for fewer bytes than were appended since
+/// they looked. A fetch nothing is appended for is completed by a timer of the
+/// eventloop it was parked from. Either way it is completed once, and nothing runs
+/// while no fetch waits.
+///
+/// Notify() also moves the end of the batches fetches may see. A fetch reads both
+/// with Appended() and reads the partition up to that end only, so that a batch is
+/// counted either by what the fetch found or by the bytes notified after it looked,
+/// never by both.
+///
+/// The waiters must outlive the eventloops fetches are parked from.
+class FetchWaiters : public NoCopyable {
+ public:
+  /// @brief Called once per parked fetch, on the thread which notified enough bytes
+  /// or in the eventloop of the fetch when it timed out.
+  typedef std::function<void(bool timed_out)> Completion;
+
+  /// @brief Construct the waiters of a partition.
+  /// @param end_offset offset after the batches fetches may see
+  explicit FetchWaiters(uint64_t end_offset = 0) : end_offset_(end_offset) {}
+
+  /// @brief Park a fetch, in the thread running loop.
+  /// @param loop eventloop of the fetch
+  /// @param seen Appended() before the fetch read the partition
+  /// @param min_bytes bytes the fetch still misses
+  /// @param max_wait_ms
+  /// @param done
+  /// @return false if the bytes were appended already, done is not called then
+  bool Wait(EventLoop* loop, uint64_t seen, size_t min_bytes, uint64_t max_wait_ms,
+            Completion done);
+
+  /// @brief Report a batch appended to the partition, once readers may see it.
+  /// Batches are reported in the order of their offsets.
+  /// @param bytes
+  /// @param end_offset offset after the batch
+  void Notify(size_t bytes, uint64_t end_offset);
+
+  /// @brief Bytes notified so far.
+  /// @return
+  uint64_t Appended() const {
+    return appended_.load(std::memory_order_acquire);
+  }
+
+  /// @brief Bytes notified so far, along with the end of the batches notified.
+  /// @param end_offset output arg, fetches read the partition up to it
+  /// @return
+  uint64_t Appended(uint64_t* end_offset) const;
+
+  /// @brief Number of parked fetches.
+  /// @return
+  size_t Size() const;
+
+ private:
+  struct Waiter {
+    EventLoop* loop = nullptr;
+    TimerId timer = 0;
+    Completion done;
+  };
+
+  // waiters by the value of appended_ they wait for, then by id
+  typedef std::pair<uint64_t, uint64_t> Key;
+
+  // complete a waiter which timed out, unless enough bytes came first
+  void Expire(const Key& key);
+
+ private:
+  mutable std::mutex mtx_;
+  std::atomic<uint64_t> appended_{0};
+  // guarded by mtx_, so that it is read along with appended_
+  uint64_t end_offset_;
+  std::map<Key, Waiter> waiters_;
+  uint64_t next_id_ = 1;
+};
+
+}  // namespace broker
+}  // namespace ahrimq
+
+#endif  // _AHRIMQ_BROKER_FETCH_WAITERS_H_
@@ -0,0 +1,168 @@
+#include "ahrimq/broker/fetch_waiters.h"
+
+#include <dirent.h>
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ahrimq/storage/commit_log.h"
+
+using namespace ahrimq;
+using namespace ahrimq::broker;
+
+// runs an eventloop in its own thread
+class LoopThread {
+ public:
+  LoopThread() : thread_([this]() { loop_.Loop(); }) {}
+
+  ~LoopThread() {
+    loop_.QueueInLoop([this]() { loop_.Stop(); });
+    thread_.join();
+  }
+
+  // park a fetch from the loop thread, the future is set once it completes
+  bool Wait(FetchWaiters& waiters, uint64_t seen, size_t min_bytes,
+            uint64_t max_wait_ms, std::promise<bool>* timed_out) {
+    std::promise<bool> parked;
+    auto done = [timed_out](bool t) { timed_out->set_value(t); };
+    loop_.QueueInLoop([&]() {
+      parked.set_value(waiters.Wait(&loop_, seen, min_bytes, max_wait_ms, done));
+    });
+    return parked.get_future().get();
+  }
+
+ private:
+  EventLoop loop_;
+  std::thread thread_;
+};
+
+TEST(FetchWaitersTest, NotifyTest) {
+  FetchWaiters waiters;
+  LoopThread loop;
+  std::promise<bool> small, large;
+  ASSERT_TRUE(loop.Wait(waiters, 0, 100, 10000, &small));
+  ASSERT_TRUE(loop.Wait(waiters, 0, 300, 10000, &large));
+  EXPECT_EQ(waiters.Size(), 2u);
+
+  waiters.Notify(60, 1);
+  EXPECT_EQ(waiters.Size(), 2u);
+  waiters.Notify(60, 2);
+  EXPECT_EQ(waiters.Size(), 1u);
+  EXPECT_FALSE(small.get_future().get());
+  waiters.Notify(200, 3);
+  EXPECT_FALSE(large.get_future().get());
+  EXPECT_EQ(waiters.Size(), 0u);
+  EXPECT_EQ(waiters.Appended(), 320u);
+
+  // bytes appended between the read and the wait count
+  std::promise<bool> late;
+  EXPECT_FALSE(loop.Wait(waiters, 200, 100, 10000, &late));
+  EXPECT_EQ(waiters.Size(), 0u);
+}
+
+TEST(FetchWaitersTest, TimeoutTest) {
+  FetchWaiters waiters;
+  LoopThread loop;
+  std::promise<bool> timed_out;
+  auto start = std::chrono::steady_clock::now();
+  ASSERT_TRUE(loop.Wait(waiters, 0, 100, 50, &timed_out));
+  waiters.Notify(10, 1);
+  EXPECT_TRUE(timed_out.get_future().get());
+  EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(45));
+  EXPECT_EQ(waiters.Size(), 0u);
+  // a late append finds nothing to complete
+  waiters.Notify(100, 2);
+}
+
+TEST(FetchWaitersTest, ConcurrentTest) {
+  FetchWaiters waiters;
+  LoopThread loop;
+  constexpr int kFetches = 100;
+  std::promise<bool> fetches[kFetches];
+  for (int i = 0; i < kFetches; i++) {
+    uint64_t seen = waiters.Appended();
+    ASSERT_TRUE(loop.Wait(waiters, seen, 1 + i % 7, 10000, &fetches[i]));
+  }
+  std::thread notifier([&]() {
+    for (int i = 0; i < 10; i++) {
+      waiters.Notify(1, i + 1);
+    }
+  });
+  notifier.join();
+  for (int i = 0; i < kFetches; i++) {
+    EXPECT_FALSE(fetches[i].get_future().get());
+  }
+}
+
+// the log directory only holds files
+static void RemoveDir(const std::string& path) {
+  DIR* d = opendir(path.c_str());
+  if (d == nullptr) {
+    return;
+  }
+  while (struct dirent* entry = readdir(d)) {
+    if (entry->d_name[0] != '.') {
+      unlink((path + "/" + entry->d_name).c_str());
+    }
+  }
+  closedir(d);
+  rmdir(path.c_str());
+}
+
+TEST(FetchWaitersTest, UnreportedBatchTest) {
+  char tmpl[] = "/tmp/ahrimq_waiters_XXXXXX";
+  ASSERT_NE(mkdtemp(tmpl), nullptr);
+  std::string dir = tmpl;
+  {
+    storage::LogConfig config;
+    config.fsync_interval_ms = 0;
+    storage::CommitLog log(dir, config);
+    ASSERT_TRUE(log.Open());
+    FetchWaiters waiters(log.NextOffset());
+    LoopThread loop;
+    uint64_t offset = 0;
+    ASSERT_TRUE(log.Append(0, "", std::string(100, 'a'), &offset));
+    size_t bytes = log.Size();
+
+    // the batch is written but not reported yet, a fetch for two must not see it
+    uint64_t end_offset = 0;
+    uint64_t seen = waiters.Appended(&end_offset);
+    std::vector<storage::LogSlice> slices;
+    ASSERT_TRUE(log.ReadSlices(0, 1 << 20, &slices, end_offset));
+    EXPECT_TRUE(slices.empty());
+    std::promise<bool> fetch;
+    ASSERT_TRUE(loop.Wait(waiters, seen, 2 * bytes, 10000, &fetch));
+    waiters.Notify(bytes, offset + 1);
+    EXPECT_EQ(waiters.Size(), 1u);
+
+    ASSERT_TRUE(log.Append(0, "", std::string(100, 'b'), &offset));
+    waiters.Notify(bytes, offset + 1);
+    EXPECT_FALSE(fetch.get_future().get());
+    seen = waiters.Appended(&end_offset);
+    EXPECT_EQ(seen, 2 * bytes);
+    ASSERT_TRUE(log.ReadSlices(0, 1 << 20, &slices, end_offset));
+    ASSERT_EQ(slices.size(), 1u);
+    EXPECT_EQ(slices[0].length, 2 * bytes);
+
+    // a batch written later stays out of the slices
+    ASSERT_TRUE(log.Append(0, "", std::string(100, 'c'), &offset));
+    slices.clear();
+    ASSERT_TRUE(log.ReadSlices(1, 1 << 20, &slices, end_offset));
+    ASSERT_EQ(slices.size(), 1u);
+    EXPECT_EQ(slices[0].position, bytes);
+    EXPECT_EQ(slices[0].length, bytes);
+  }
+  RemoveDir(dir);
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,410 @@
+#include "broker/group_coordinator.h"
+
+#include <algorithm>
+
+#include "base/time_utils.h"
+
+namespace ahrimq {
+namespace broker {
+
+GroupCoordinator::GroupCoordinator(storage::OffsetStore* offsets,
+                                   PartitionCounter partitions, const Config& config)
+    : offsets_(offsets), partitions_(std::move(partitions)), config_(config) {}
+
+std::map<std::string, std::set<TopicPartition>> GroupCoordinator::Assign(
+    AssignmentStrategy strategy,
+    const std::map<std::string, std::vector<std::string>>& subscriptions,
+    const PartitionCounter& partitions) {
+  std::map<std::string, std::set<TopicPartition>> assignment;
+  // members subscribed to each topic, by id
+  std::map<std::string, std::set<std::string>> subscribers;
+  for (const auto& subscription : subscriptions) {
+    assignment[subscription.first];
+    for (const std::string& topic : subscription.second) {
+      subscribers[topic].insert(subscription.first);
+    }
+  }
+  if (strategy == AssignmentStrategy::Range) {
+    for (const auto& entry : subscribers) {
+      uint32_t n = partitions(entry.first);
+      size_t m = entry.second.size();
+      uint32_t partition = 0;
+      size_t i = 0;
+      for (const std::string& member : entry.second) {
+        size_t count = n / m + (i < n % m ? 1 : 0);
+        for (size_t k = 0; k < count; k++) {
+          assignment[member].insert({entry.first, partition++});
+        }
+        i++;
+      }
+    }
+    return assignment;
+  }
+  // the turn goes on across topics, so that topics with a single partition do not
+  // all land on the first member
+  std::vector<const std::string*> members;
+  for (const auto& subscription : subscriptions) {
+    members.push_back(&subscription.first);
+  }
+  size_t turn = 0;
+  for (const auto& entry : subscribers) {
+    uint32_t n = partitions(entry.first);
+    for (uint32_t partition = 0; partition < n; partition++) {
+      while (entry.second.count(*members[turn % members.size()]) == 0) {
+        turn++;
+      }
+      assignment[*members[turn % members.size()]].insert({entry.first, partition});
+      turn++;
+    }
+  }
+  return assignment;
+}
+
+void GroupCoordinator::Rebalance(Group& group) {
+  group.generation++;
+  std::map<std::string, std::vector<std::string>> subscriptions;
+  for (const auto& entry : group.members) {
+    subscriptions[entry.first] = entry.second.topics;
+  }
+  auto assignment = Assign(group.strategy, subscriptions, partitions_);
+  for (auto& entry : group.members) {
+    entry.second.target = std::move(assignment[entry.first]);
+  }
+}
+
+void GroupCoordinator::RemoveMember(Group& group, const std::string& member_id) {
+  auto it = group.members.find(member_id);
+  if (it == group.members.end()) {
+    return;
+  }
+  for (const TopicPartition& tp : it->second.owned) {
+    group.owners.erase(tp);
+  }
+  group.members.erase(it);
+  if (!group.members.empty()) {
+    Rebalance(group);
+  }
+}
+
+bool GroupCoordinator::Expire(Group& group, uint64_t now_ms) {
+  std::vector<std::string> expired;
+  for (const auto& entry : group.members) {
+    if (now_ms >= entry.second.last_seen_ms + entry.second.session_timeout_ms) {
+      expired.push_back(entry.first);
+    }
+  }
+  for (const std::string& member_id : expired) {
+    RemoveMember(group, member_id);
+  }
+  return !expired.empty();
+}
+
+bool GroupCoordinator::NeedSync(const Group& group, const std::string& member_id,
+                                const Member& member) {
+  for (const TopicPartition& tp : member.owned) {
+    if (member.target.count(tp) == 0) {
+      return true;
+    }
+  }
+  for (const TopicPartition& tp : member.target) {
+    if (member.owned.count(tp) == 0 && group.owners.count(tp) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+ErrorCode GroupCoordinator::FindMember(const std::string& group_id,
+                                       const std::string& member_id, Group** group,
+                                       Member** member) {
+  auto it = groups_.find(group_id);
+  if (it == groups_.end()) {
+    return ErrorCode::UnknownMember;
+  }
+  uint64_t now = time::GetCurrentMs();
+  Expire(it->second, now);
+  auto m = it->second.members.find(member_id);
+  if (m == it->second.members.end()) {
+    return ErrorCode::UnknownMember;
+  }
+  m->second.last_seen_ms = now;
+  *group = &it->second;
+  *member = &m->second;
+  return ErrorCode::None;
+}
+
+ErrorCode GroupCoordinator::Join(const std::string& group_id,
+                                 const std::string& member_id,
+                                 const std::vector<std::string>& topics,
+                                 AssignmentStrategy strategy,
+                                 uint64_t session_timeout_ms,
+                                 std::string* assigned_id, uint32_t* generation) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  uint64_t now = time::GetCurrentMs();
+  Group& group = groups_[group_id];
+  Expire(group, now);
+  bool rejoin = !member_id.empty();
+  if (rejoin && group.members.count(member_id) == 0) {
+    return ErrorCode::UnknownMember;
+  }
+  bool changed = !rejoin || strategy != group.strategy;
+  if (group.members.empty() || (rejoin && group.members.size() == 1)) {
+    group.strategy = strategy;
+  } else if (strategy != group.strategy) {
+    return ErrorCode::InconsistentStrategy;
+  }
+  std::string id =
+      rejoin ? member_id : group_id + "-" + std::to_string(next_member_id_++);
+  Member& member = group.members[id];
+  std::vector<std::string> sorted(topics);
+  std::sort(sorted.begin(), sorted.end());
+  sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+  member.session_timeout_ms =
+      session_timeout_ms == 0
+          ? config_.default_session_timeout_ms
+          : std::min(session_timeout_ms, config_.max_session_timeout_ms);
+  member.last_seen_ms = now;
+  // joining again with the same subscription changes nothing
+  if (changed || member.topics != sorted) {
+    member.topics = std::move(sorted);
+    Rebalance(group);
+  }
+  *assigned_id = id;
+  *generation = group.generation;
+  return ErrorCode::None;
+}
+
+ErrorCode GroupCoordinator::Sync(const std::string& group_id,
+                                 const std::string& member_id, uint32_t* generation,
+                                 std::vector<TopicPartition>* assignment) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  Group* group = nullptr;
+  Member* member = nullptr;
+  ErrorCode err = FindMember(group_id, member_id, &group, &member);
+  if (err != ErrorCode::None) {
+    return err;
+  }
+  // give up what moved elsewhere, then take what nobody owns anymore
+  for (auto it = member->owned.begin(); it != member->owned.end();) {
+    if (member->target.count(*it) == 0) {
+      group->owners.erase(*it);
+      it = member->owned.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  for (const TopicPartition& tp : member->target) {
+    if (member->owned.count(tp) == 0 && group->owners.count(tp) == 0) {
+      member->owned.insert(tp);
+      group->owners[tp] = member_id;
+    }
+  }
+  *generation = group->generation;
+  assignment->assign(member->owned.begin(), member->owned.end());
+  return ErrorCode::None;
+}
+
+ErrorCode GroupCoordinator::Heartbeat(const std::string& group_id,
+                                      const std::string& member_id) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  Group* group = nullptr;
+  Member* member = nullptr;
+  ErrorCode err = FindMember(group_id, member_id, &group, &member);
+  if (err != ErrorCode::None) {
+    return err;
+  }
+  return NeedSync(*group, member_id, *member) ? ErrorCode::RebalanceInProgress
+                                              : ErrorCode::None;
+}
+
+ErrorCode GroupCoordinator::Leave(const std::string& group_id,
+                                  const std::string& member_id) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  Group* group = nullptr;
+  Member* member = nullptr;
+  ErrorCode err = FindMember(group_id, member_id, &group, &member);
+  if (err != ErrorCode::None) {
+    return err;
+  }
+  RemoveMember(*group, member_id);
+  return ErrorCode::None;
+}
+
+ErrorCode GroupCoordinator::CommitOffset(const std::string& group_id,
+                                         const std::string& member_id,
+                                         const std::string& topic,
+                                         uint32_t partition, uint64_t offset) {
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (member_id.empty()) {
+      auto it = groups_.find(group_id);
+      if (it != groups_.end()) {
+        Expire(it->second, time::GetCurrentMs());
+        if (!it->second.members.empty()) {
+          return ErrorCode::UnknownMember;
+        }
+      }
+    } else {
+      Group* group = nullptr;
+      Member* member = nullptr;
+      ErrorCode err = FindMember(group_id, member_id, &group, &member);
+      if (err != ErrorCode::None) {
+        return err;
+      }
+      auto it = group->owners.find({topic, partition});
+      if (it == group->owners.end() || it->second != member_id) {
+        return ErrorCode::NotPartitionOwner;
+      }
+    }
+  }
+  // a commit may wait for a sync of the offsets, the other group requests do not
+  if (!offsets_->Commit(group_id, topic, partition, offset)) {
+    return ErrorCode::InternalError;
+  }
+  return ErrorCode::None;
+}
+
+ErrorCode GroupCoordinator::FetchOffset(const std::string& group_id,
+                                        const std::string& topic,
+                                        uint32_t partition, uint64_t* offset) {
+  // the store is thread safe, and may be held up by a sync
+  if (!offsets_->Fetch(group_id, topic, partition, offset)) {
+    *offset = kNoOffset;
+  }
+  return ErrorCode::None;
+}
+
+void GroupCoordinator::Tick() {
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    uint64_t now = time::GetCurrentMs();
+    for (auto it = groups_.begin(); it != groups_.end();) {
+      Expire(it->second, now);
+      if (it->second.members.empty()) {
+        it = groups_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+  // syncs and compactions wait for the disk, group requests go on meanwhile
+  offsets_->Tick();
+}
+
+void HandleGroupRequests(BrokerServer* server, GroupCoordinator* coordinator) {
+  server->Handle(Opcode::JoinGroup, [coordinator](TCPConn* conn,
+                                                  const Frame& request,
+                                                  FrameWriter& response) {
+    FrameReader reader(request.body);
+    std::string_view group, member_id, topic;
+    uint8_t strategy = 0;
+    uint32_t session_timeout_ms = 0, n = 0;
+    if (!reader.ReadString(&group) || !reader.ReadString(&member_id) ||
+        !reader.ReadUInt8(&strategy) || !reader.ReadUInt32(&session_timeout_ms) ||
+        !reader.ReadUInt32(&n) ||
+        strategy > static_cast<uint8_t>(AssignmentStrategy::RoundRobin)) {
+      return ErrorCode::InvalidRequest;
+    }
+    std::vector<std::string> topics;
+    for (uint32_t i = 0; i < n; i++) {
+      if (!reader.ReadString(&topic)) {
+        return ErrorCode::InvalidRequest;
+      }
+      topics.emplace_back(topic);
+    }
+    std::string assigned_id;
+    uint32_t generation = 0;
+    ErrorCode err = coordinator->Join(
+        std::string(group), std::string(member_id), topics,
+        static_cast<AssignmentStrategy>(strategy), session_timeout_ms,
+        &assigned_id, &generation);
+    if (err == ErrorCode::None) {
+      response.WriteString(assigned_id);
+      response.WriteUInt32(generation);
+    }
+    return err;
+  });
+
+  server->Handle(Opcode::SyncGroup, [coordinator](TCPConn* conn,
+                                                  const Frame& request,
+                                                  FrameWriter& response) {
+    FrameReader reader(request.body);
+    std::string_view group, member_id;
+    if (!reader.ReadString(&group) || !reader.ReadString(&member_id)) {
+      return ErrorCode::InvalidRequest;
+    }
+    uint32_t generation = 0;
+    std::vector<TopicPartition> assignment;
+    ErrorCode err = coordinator->Sync(std::string(group), std::string(member_id),
+                                      &generation, &assignment);
+    if (err == ErrorCode::None) {
+      response.WriteUInt32(generation);
+      response.WriteUInt32(static_cast<uint32_t>(assignment.size()));
+      for (const TopicPartition& tp : assignment) {
+        response.WriteString(tp.topic);
+        response.WriteUInt32(tp.partition);
+      }
+    }
+    return err;
+  });
+
+  server->Handle(Opcode::Heartbeat, [coordinator](TCPConn* conn,
+                                                  const Frame& request,
+                                                  FrameWriter& response) {
+    FrameReader reader(request.body);
+    std::string_view group, member_id;
+    if (!reader.ReadString(&group) || !reader.ReadString(&member_id)) {
+      return ErrorCode::InvalidRequest;
+    }
+    return coordinator->Heartbeat(std::string(group), std::string(member_id));
+  });
+
+  server->Handle(Opcode::LeaveGroup, [coordinator](TCPConn* conn,
+                                                   const Frame& request,
+                                                   FrameWriter& response) {
+    FrameReader reader(request.body);
+    std::string_view group, member_id;
+    if (!reader.ReadString(&group) || !reader.ReadString(&member_id)) {
+      return ErrorCode::InvalidRequest;
+    }
+    return coordinator->Leave(std::string(group), std::string(member_id));
+  });
+
+  server->Handle(Opcode::CommitOffset, [coordinator](TCPConn* conn,
+                                                     const Frame& request,
+                                                     FrameWriter& response) {
+    FrameReader reader(request.body);
+    std::string_view group, member_id, topic;
+    uint32_t partition = 0;
+    uint64_t offset = 0;
+    if (!reader.ReadString(&group) || !reader.ReadString(&member_id) ||
+        !reader.ReadString(&topic) || !reader.ReadUInt32(&partition) ||
+        !reader.ReadUInt64(&offset)) {
+      return ErrorCode::InvalidRequest;
+    }
+    return coordinator->CommitOffset(std::string(group), std::string(member_id),
+                                     std::string(topic), partition, offset);
+  });
+
+  server->Handle(Opcode::FetchOffset, [coordinator](TCPConn* conn,
+                                                    const Frame& request,
+                                                    FrameWriter& response) {
+    FrameReader reader(request.body);
+    std::string_view group, topic;
+    uint32_t partition = 0;
+    if (!reader.ReadString(&group) || !reader.ReadString(&topic) ||
+        !reader.ReadUInt32(&partition)) {
+      return ErrorCode::InvalidRequest;
+    }
+    uint64_t offset = 0;
+    ErrorCode err = coordinator->FetchOffset(std::string(group), std::string(topic),
+                                             partition, &offset);
+    if (err == ErrorCode::None) {
+      response.WriteUInt64(offset);
+    }
+    return err;
+  });
+}
+
+}  // namespace broker
+}  // namespace ahrimq
@@ -0,0 +1,220 @@
+#ifndef _AHRIMQ_BROKER_GROUP_COORDINATOR_H_
+#define _AHRIMQ_BROKER_GROUP_COORDINATOR_H_
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "base/nocopyable.h"
+#include "broker/broker_server.h"
+#include "broker/protocol.h"
+#include "storage/offset_store.h"
+
+namespace ahrimq {
+namespace broker {
+
+/// @brief How the partitions of the topics a group subscribed to are spread over
+/// its members.
+enum class AssignmentStrategy : uint8_t {
+  // every member gets a contiguous range of the partitions of each topic
+  Range = 0,
+  // the partitions of all topics are dealt out to the members in turn
+  RoundRobin = 1,
+};
+
+/// @brief A partition of a topic.
+struct TopicPartition {
+  std::string topic;
+  uint32_t partition = 0;
+
+  bool operator<(const TopicPartition& other) const {
+    return topic != other.topic ? topic < other.topic : partition < other.partition;
+  }
+
+  bool operator==(const TopicPartition& other) const {
+    return topic == other.topic && partition == other.partition;
+  }
+};
+
+/// @brief Returned by FetchOffset when a group committed no offset.
+constexpr static uint64_t kNoOffset = UINT64_MAX;
+
+/// @brief GroupCoordinator lets the members of consumer groups share the
+/// partitions of the topics they subscribed to, and keeps the offsets they
+/// committed in an OffsetStore so that they resume there after a restart.
+///
+/// A consumer joins its group and syncs to get the partitions it owns, then
+/// heartbeats to stay a member. Every join, leave and expired session moves the
+/// group to a new generation with a new target assignment. Rebalances are
+/// incremental: a member keeps consuming the partitions it keeps, and a partition
+/// moving to another member is only handed to it once its previous owner synced
+/// and gave it up. A heartbeat answered with RebalanceInProgress tells a member
+/// to sync, members the rebalance does not affect are not told anything.
+///
+/// The coordinator is thread safe, it is called from every eventloop.
+class GroupCoordinator : public NoCopyable {
+ public:
+  /// @brief Number of partitions of a topic, 0 if it does not exist.
+  typedef std::function<uint32_t(const std::string& topic)> PartitionCounter;
+
+  /// @brief Configuration of a coordinator.
+  struct Config {
+    // session timeout of members which join without one
+    uint64_t default_session_timeout_ms = 10000;
+    // session timeouts members ask for are capped to this
+    uint64_t max_session_timeout_ms = 300000;
+  };
+
+  /// @brief Construct a coordinator.
+  /// @param offsets opened store of the committed offsets
+  /// @param partitions
+  /// @param config
+  GroupCoordinator(storage::OffsetStore* offsets, PartitionCounter partitions,
+                   const Config& config);
+
+  /// @brief Join a group, creating it if it has no members.
+  /// @param group
+  /// @param member_id empty for a new member, which gets an id
+  /// @param topics topics the member subscribes to
+  /// @param strategy must match the strategy of the other members
+  /// @param session_timeout_ms the member is dropped if it is not heard from for
+  /// this long, 0 for the default
+  /// @param assigned_id output arg, id of the member
+  /// @param generation output arg
+  /// @return
+  ErrorCode Join(const std::string& group, const std::string& member_id,
+                 const std::vector<std::string>& topics,
+                 AssignmentStrategy strategy, uint64_t session_timeout_ms,
+                 std::string* assigned_id, uint32_t* generation);
+
+  /// @brief Get the partitions a member owns now: those of its target assignment
+  /// it kept and those released by their previous owners. Partitions it lost are
+  /// released.
+  /// @param group
+  /// @param member_id
+  /// @param generation output arg
+  /// @param assignment output arg, sorted
+  /// @return
+  ErrorCode Sync(const std::string& group, const std::string& member_id,
+                 uint32_t* generation, std::vector<TopicPartition>* assignment);
+
+  /// @brief Keep the session of a member alive.
+  /// @param group
+  /// @param member_id
+  /// @return RebalanceInProgress if the member should sync
+  ErrorCode Heartbeat(const std::string& group, const std::string& member_id);
+
+  /// @brief Leave a group, releasing the partitions of the member.
+  /// @param group
+  /// @param member_id
+  /// @return
+  ErrorCode Leave(const std::string& group, const std::string& member_id);
+
+  /// @brief Commit the offset a group consumed a partition up to.
+  /// @param group
+  /// @param member_id empty for consumers which are not members, only allowed
+  /// while the group has no members
+  /// @param topic
+  /// @param partition
+  /// @param offset
+  /// @return NotPartitionOwner if the member does not own the partition
+  ErrorCode CommitOffset(const std::string& group, const std::string& member_id,
+                         const std::string& topic, uint32_t partition,
+                         uint64_t offset);
+
+  /// @brief Fetch the offset a group committed for a partition.
+  /// @param group
+  /// @param topic
+  /// @param partition
+  /// @param offset output arg, kNoOffset if none was committed
+  /// @return
+  ErrorCode FetchOffset(const std::string& group, const std::string& topic,
+                        uint32_t partition, uint64_t* offset);
+
+  /// @brief Drop the members whose session expired, then sync and compact the
+  /// offsets as needed. Called periodically from a thread which may wait for the
+  /// disk, expired members of a group are also dropped whenever it is accessed.
+  void Tick();
+
+  /// @brief Spread the partitions of the topics members subscribed to over them.
+  /// @param strategy
+  /// @param subscriptions topics by member id
+  /// @param partitions
+  /// @return partitions by member id, every member has an entry
+  static std::map<std::string, std::set<TopicPartition>> Assign(
+      AssignmentStrategy strategy,
+      const std::map<std::string, std::vector<std::string>>& subscriptions,
+      const PartitionCounter& partitions);
+
+ private:
+  struct Member {
+    std::vector<std::string> topics;
+    uint64_t session_timeout_ms = 0;
+    uint64_t last_seen_ms = 0;
+    // partitions the member owns, as of its last sync
+    std::set<TopicPartition> owned;
+    // partitions of the current generation
+    std::set<TopicPartition> target;
+  };
+
+  struct Group {
+    AssignmentStrategy strategy = AssignmentStrategy::Range;
+    uint32_t generation = 0;
+    std::map<std::string, Member> members;
+    // member owning a partition, until it gives it up
+    std::map<TopicPartition, std::string> owners;
+  };
+
+  // compute the target assignment of a new generation
+  void Rebalance(Group& group);
+
+  // drop a member and rebalance the others
+  void RemoveMember(Group& group, const std::string& member_id);
+
+  // drop expired members, true if any was
+  bool Expire(Group& group, uint64_t now_ms);
+
+  // the member should sync to give up or take partitions
+  static bool NeedSync(const Group& group, const std::string& member_id,
+                       const Member& member);
+
+  // find a live member, refreshing its session
+  ErrorCode FindMember(const std::string& group_id, const std::string& member_id,
+                       Group** group, Member** member);
+
+ private:
+  storage::OffsetStore* offsets_;
+  PartitionCounter partitions_;
+  Config config_;
+  std::mutex mtx_;
+  std::unordered_map<std::string, Group> groups_;
+  uint64_t next_member_id_ = 1;
+};
+
+typedef GroupCoordinator::Config GroupCoordinatorConfig;
+
+/// @brief Answer the group requests of a broker with a coordinator:
+///
+///   JoinGroup: group(string) member id(string) strategy(u8) session timeout
+///     ms(u32) topic count(u32) topic(string)... -> member id(string)
+///     generation(u32)
+///   SyncGroup: group(string) member id(string) -> generation(u32) partition
+///     count(u32) (topic(string) partition(u32))...
+///   Heartbeat, LeaveGroup: group(string) member id(string) -> nothing
+///   CommitOffset: group(string) member id(string) topic(string) partition(u32)
+///     offset(u64) -> nothing
+///   FetchOffset: group(string) topic(string) partition(u32) -> offset(u64)
+///
+/// @param server
+/// @param coordinator must outlive the server
+void HandleGroupRequests(BrokerServer* server, GroupCoordinator* coordinator);
+
+}  // namespace broker
+}  // namespace ahrimq
+
+#endif  // _AHRIMQ_BROKER_GROUP_COORDINATOR_H_
@@ -0,0 +1,180 @@
+#include "ahrimq/broker/group_coordinator.h"
+
+#include <dirent.h>
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <memory>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace ahrimq;
+using namespace ahrimq::broker;
+
+static uint32_t CountPartitions(const std::string& topic) {
+  return topic == "a" ? 4 : topic == "b" ? 1 : topic == "c" ? 3 : 0;
+}
+
+TEST(AssignTest, RangeTest) {
+  auto assignment = GroupCoordinator::Assign(
+      AssignmentStrategy::Range, {{"m1", {"a", "b"}}, {"m2", {"a"}}, {"m3", {"x"}}},
+      CountPartitions);
+  ASSERT_EQ(assignment.size(), 3u);
+  std::set<TopicPartition> m1 = {{"a", 0}, {"a", 1}, {"b", 0}};
+  std::set<TopicPartition> m2 = {{"a", 2}, {"a", 3}};
+  EXPECT_EQ(assignment["m1"], m1);
+  EXPECT_EQ(assignment["m2"], m2);
+  EXPECT_TRUE(assignment["m3"].empty());
+}
+
+TEST(AssignTest, RoundRobinTest) {
+  auto assignment = GroupCoordinator::Assign(
+      AssignmentStrategy::RoundRobin, {{"m1", {"a", "b", "c"}}, {"m2", {"a", "c"}}},
+      CountPartitions);
+  std::set<TopicPartition> m1 = {{"a", 0}, {"a", 2}, {"b", 0}, {"c", 1}};
+  std::set<TopicPartition> m2 = {{"a", 1}, {"a", 3}, {"c", 0}, {"c", 2}};
+  EXPECT_EQ(assignment["m1"], m1);
+  EXPECT_EQ(assignment["m2"], m2);
+}
+
+class GroupCoordinatorTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    char tmpl[] = "/tmp/ahrimq_groups_XXXXXX";
+    char* dir = mkdtemp(tmpl);
+    ASSERT_NE(dir, nullptr);
+    dir_ = dir;
+    storage::OffsetStoreConfig config;
+    config.log.fsync_interval_ms = 0;
+    offsets_ = std::make_unique<storage::OffsetStore>(dir_ + "/offsets", config);
+    ASSERT_TRUE(offsets_->Open());
+    coordinator_ = std::make_unique<GroupCoordinator>(
+        offsets_.get(), CountPartitions, GroupCoordinatorConfig());
+  }
+
+  void TearDown() override {
+    coordinator_.reset();
+    offsets_.reset();
+    RemoveDir(dir_);
+  }
+
+  static void RemoveDir(const std::string& path) {
+    DIR* d = opendir(path.c_str());
+    if (d == nullptr) {
+      unlink(path.c_str());
+      return;
+    }
+    while (struct dirent* entry = readdir(d)) {
+      std::string name = entry->d_name;
+      if (name != "." && name != "..") {
+        RemoveDir(path + "/" + name);
+      }
+    }
+    closedir(d);
+    rmdir(path.c_str());
+  }
+
+  std::string Join(const std::vector<std::string>& topics,
+                   uint64_t session_timeout_ms = 0) {
+    std::string id;
+    uint32_t generation = 0;
+    EXPECT_EQ(coordinator_->Join("g", "", topics, AssignmentStrategy::Range,
+                                 session_timeout_ms, &id, &generation),
+              ErrorCode::None);
+    return id;
+  }
+
+  std::vector<TopicPartition> Sync(const std::string& id) {
+    uint32_t generation = 0;
+    std::vector<TopicPartition> assignment;
+    EXPECT_EQ(coordinator_->Sync("g", id, &generation, &assignment),
+              ErrorCode::None);
+    return assignment;
+  }
+
+  std::string dir_;
+  std::unique_ptr<storage::OffsetStore> offsets_;
+  std::unique_ptr<GroupCoordinator> coordinator_;
+};
+
+TEST_F(GroupCoordinatorTest, RebalanceTest) {
+  std::string m1 = Join({"a"});
+  EXPECT_EQ(Sync(m1).size(), 4u);
+  EXPECT_EQ(coordinator_->Heartbeat("g", m1), ErrorCode::None);
+
+  // a2 and a3 move to m2, which only gets them once m1 gave them up
+  std::string m2 = Join({"a"});
+  EXPECT_TRUE(Sync(m2).empty());
+  EXPECT_EQ(coordinator_->Heartbeat("g", m1), ErrorCode::RebalanceInProgress);
+  std::vector<TopicPartition> kept = {{"a", 0}, {"a", 1}};
+  EXPECT_EQ(Sync(m1), kept);
+  EXPECT_EQ(coordinator_->Heartbeat("g", m1), ErrorCode::None);
+  EXPECT_EQ(coordinator_->Heartbeat("g", m2), ErrorCode::RebalanceInProgress);
+  std::vector<TopicPartition> moved = {{"a", 2}, {"a", 3}};
+  EXPECT_EQ(Sync(m2), moved);
+
+  // m1 subscribing to another topic does not touch m2
+  std::string id;
+  uint32_t generation = 0;
+  EXPECT_EQ(coordinator_->Join("g", m1, {"a", "b"}, AssignmentStrategy::Range, 0,
+                               &id, &generation),
+            ErrorCode::None);
+  EXPECT_EQ(id, m1);
+  EXPECT_EQ(coordinator_->Heartbeat("g", m2), ErrorCode::None);
+  EXPECT_EQ(coordinator_->Heartbeat("g", m1), ErrorCode::RebalanceInProgress);
+  EXPECT_EQ(Sync(m1).size(), 3u);
+
+  EXPECT_EQ(coordinator_->Join("g", "", {"a"}, AssignmentStrategy::RoundRobin, 0,
+                               &id, &generation),
+            ErrorCode::InconsistentStrategy);
+
+  // partitions of a member which left are free at once
+  EXPECT_EQ(coordinator_->Leave("g", m1), ErrorCode::None);
+  EXPECT_EQ(coordinator_->Heartbeat("g", m1), ErrorCode::UnknownMember);
+  EXPECT_EQ(coordinator_->Heartbeat("g", m2), ErrorCode::RebalanceInProgress);
+  EXPECT_EQ(Sync(m2).size(), 4u);
+}
+
+TEST_F(GroupCoordinatorTest, CommitTest) {
+  std::string m1 = Join({"a"});
+  std::string m2 = Join({"a"});
+  Sync(m1);
+  Sync(m1);
+  Sync(m2);
+  EXPECT_EQ(coordinator_->CommitOffset("g", m1, "a", 0, 10), ErrorCode::None);
+  EXPECT_EQ(coordinator_->CommitOffset("g", m2, "a", 0, 11),
+            ErrorCode::NotPartitionOwner);
+  EXPECT_EQ(coordinator_->CommitOffset("g", m2, "a", 3, 12), ErrorCode::None);
+  EXPECT_EQ(coordinator_->CommitOffset("g", "", "a", 3, 13),
+            ErrorCode::UnknownMember);
+  EXPECT_EQ(coordinator_->CommitOffset("h", "", "a", 3, 14), ErrorCode::None);
+
+  uint64_t offset = 0;
+  EXPECT_EQ(coordinator_->FetchOffset("g", "a", 0, &offset), ErrorCode::None);
+  EXPECT_EQ(offset, 10u);
+  EXPECT_EQ(coordinator_->FetchOffset("g", "a", 3, &offset), ErrorCode::None);
+  EXPECT_EQ(offset, 12u);
+  EXPECT_EQ(coordinator_->FetchOffset("g", "a", 1, &offset), ErrorCode::None);
+  EXPECT_EQ(offset, kNoOffset);
+  EXPECT_EQ(coordinator_->FetchOffset("h", "a", 3, &offset), ErrorCode::None);
+  EXPECT_EQ(offset, 14u);
+}
+
+TEST_F(GroupCoordinatorTest, ExpireTest) {
+  std::string m1 = Join({"a"}, 50);
+  std::string m2 = Join({"a"});
+  Sync(m1);
+  Sync(m2);
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  coordinator_->Tick();
+  EXPECT_EQ(coordinator_->Heartbeat("g", m1), ErrorCode::UnknownMember);
+  EXPECT_EQ(Sync(m2).size(), 4u);
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,226 @@
+#include "broker/protocol.h"
+
+#include <cassert>
+#include <cstring>
+
+namespace ahrimq {
+namespace broker {
+
+static inline uint16_t ReadUInt16BE(const char* p) {
+  const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+  return static_cast<uint16_t>((u[0] << 8) | u[1]);
+}
+
+static inline uint32_t ReadUInt32BE(const char* p) {
+  const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+  return (uint32_t(u[0]) << 24) | (uint32_t(u[1]) << 16) | (uint32_t(u[2]) << 8) |
+         uint32_t(u[3]);
+}
+
+static inline void WriteUInt16BE(char* p, uint16_t v) {
+  p[0] = static_cast<char>(v >> 8);
+  p[1] = static_cast<char>(v);
+}
+
+static inline void WriteUInt32BE(char* p, uint32_t v) {
+  p[0] = static_cast<char>(v >> 24);
+  p[1] = static_cast<char>(v >> 16);
+  p[2] = static_cast<char>(v >> 8);
+  p[3] = static_cast<char>(v);
+}
+
+DecodeStatus DecodeFrame(const char* data, size_t len, uint32_t max_body,
+                         Frame* frame) {
+  // a stray byte is refused as soon as it arrives, not once 12 bytes are there
+  if ((len >= 1 && static_cast<uint8_t>(data[0]) != (kProtocolMagic >> 8)) ||
+      (len >= 2 && ReadUInt16BE(data) != kProtocolMagic) ||
+      (len >= 3 && static_cast<uint8_t>(data[2]) != kProtocolVersion)) {
+    return DecodeStatus::Invalid;
+  }
+  if (len < kFrameHeaderSize) {
+    return DecodeStatus::Partial;
+  }
+  uint32_t body_len = ReadUInt32BE(data + 8);
+  if (body_len > max_body) {
+    return DecodeStatus::Invalid;
+  }
+  if (len - kFrameHeaderSize < body_len) {
+    return DecodeStatus::Partial;
+  }
+  frame->header.version = static_cast<uint8_t>(data[2]);
+  frame->header.opcode = static_cast<uint8_t>(data[3]);
+  frame->header.correlation_id = ReadUInt32BE(data + 4);
+  frame->header.length = body_len;
+  frame->body = std::string_view(data + kFrameHeaderSize, body_len);
+  return DecodeStatus::Complete;
+}
+
+const char* FrameReader::Take(size_t n) {
+  if (failed_ || Remaining() < n) {
+    failed_ = true;
+    return nullptr;
+  }
+  const char* p = data_.data() + pos_;
+  pos_ += n;
+  return p;
+}
+
+bool FrameReader::ReadUInt8(uint8_t* v) {
+  const char* p = Take(1);
+  if (p == nullptr) {
+    return false;
+  }
+  *v = static_cast<uint8_t>(*p);
+  return true;
+}
+
+bool FrameReader::ReadUInt16(uint16_t* v) {
+  const char* p = Take(2);
+  if (p == nullptr) {
+    return false;
+  }
+  *v = ReadUInt16BE(p);
+  return true;
+}
+
+bool FrameReader::ReadUInt32(uint32_t* v) {
+  const char* p = Take(4);
+  if (p == nullptr) {
+    return false;
+  }
+  *v = ReadUInt32BE(p);
+  return true;
+}
+
+bool FrameReader::ReadUInt64(uint64_t* v) {
+  const char* p = Take(8);
+  if (p == nullptr) {
+    return false;
+  }
+  *v = (uint64_t(ReadUInt32BE(p)) << 32) | ReadUInt32BE(p + 4);
+  return true;
+}
+
+bool FrameReader::ReadBytes(std::string_view* v) {
+  uint32_t n = 0;
+  if (!ReadUInt32(&n)) {
+    return false;
+  }
+  const char* p = Take(n);
+  if (p == nullptr) {
+    return false;
+  }
+  *v = std::string_view(p, n);
+  return true;
+}
+
+bool FrameReader::ReadString(std::string_view* v) {
+  uint16_t n = 0;
+  if (!ReadUInt16(&n)) {
+    return false;
+  }
+  const char* p = Take(n);
+  if (p == nullptr) {
+    return false;
+  }
+  *v = std::string_view(p, n);
+  return true;
+}
+
+std::string_view FrameReader::ReadRest() {
+  if (failed_) {
+    return {};
+  }
+  std::string_view rest = data_.substr(pos_);
+  pos_ = data_.size();
+  return rest;
+}
+
+FrameWriter::FrameWriter(Buffer& out, uint8_t opcode, uint32_t correlation_id)
+    : out_(out), start_(out.Size()) {
+  char header[kFrameHeaderSize];
+  WriteUInt16BE(header, kProtocolMagic);
+  header[2] = static_cast<char>(kProtocolVersion);
+  header[3] = static_cast<char>(opcode);
+  WriteUInt32BE(header + 4, correlation_id);
+  // filled in by Finish()
+  WriteUInt32BE(header + 8, 0);
+  out_.Append(header, kFrameHeaderSize);
+}
+
+FrameWriter::~FrameWriter() {
+  if (!finished_) {
+    Finish();
+  }
+}
+
+void FrameWriter::WriteUInt8(uint8_t v) {
+  char p = static_cast<char>(v);
+  out_.Append(&p, 1);
+}
+
+void FrameWriter::WriteUInt16(uint16_t v) {
+  char p[2];
+  WriteUInt16BE(p, v);
+  out_.Append(p, sizeof(p));
+}
+
+void FrameWriter::WriteUInt32(uint32_t v) {
+  char p[4];
+  WriteUInt32BE(p, v);
+  out_.Append(p, sizeof(p));
+}
+
+void FrameWriter::WriteUInt64(uint64_t v) {
+  char p[8];
+  WriteUInt32BE(p, static_cast<uint32_t>(v >> 32));
+  WriteUInt32BE(p + 4, static_cast<uint32_t>(v));
+  out_.Append(p, sizeof(p));
+}
+
+void FrameWriter::WriteBytes(std::string_view v) {
+  WriteUInt32(static_cast<uint32_t>(v.size()));
+  out_.Append(v.data(), v.size());
+}
+
+void FrameWriter::WriteString(std::string_view v) {
+  assert(v.size() <= 0xffff);
+  WriteUInt16(static_cast<uint16_t>(v.size()));
+  out_.Append(v.data(), v.size());
+}
+
+void FrameWriter::WriteRaw(const char* data, size_t len) {
+  out_.Append(data, len);
+}
+
+void FrameWriter::WriteFile(int fd, size_t offset, size_t length,
+                            std::shared_ptr<const void> holder) {
+  files_.push_back(FileRegion{fd, offset, length, std::move(holder)});
+  file_bytes_ += length;
+}
+
+size_t FrameWriter::BodySize() const {
+  return out_.Size() - start_ - kFrameHeaderSize;
+}
+
+void FrameWriter::TruncateBody(size_t n) {
+  size_t size = BodySize();
+  if (n < size) {
+    out_.WriterIdxBackward(size - n);
+  }
+  files_.clear();
+  file_bytes_ = 0;
+}
+
+void FrameWriter::PatchUInt16(size_t offset, uint16_t v) {
+  assert(offset + 2 <= BodySize());
+  WriteUInt16BE(FrameFront() + kFrameHeaderSize + offset, v);
+}
+
+void FrameWriter::Finish() {
+  WriteUInt32BE(FrameFront() + 8, static_cast<uint32_t>(BodySize() + file_bytes_));
+  finished_ = true;
+}
+
+}  // namespace broker
+}  // namespace ahrimq
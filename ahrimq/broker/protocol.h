@@ -0,0 +1,258 @@
+#ifndef _AHRIMQ_BROKER_PROTOCOL_H_
+#define _AHRIMQ_BROKER_PROTOCOL_H_
+
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include "base/nocopyable.h"
+#include "buffer/buffer.h"
+
+namespace ahrimq {
+namespace broker {
+
+/// @brief Every frame starts with a fixed header, all integers are big-endian:
+///
+///   magic(2) version(1) opcode(1) correlation id(4) body length(4)
+///
+/// A response carries the opcode of its request with kResponseFlag set and the
+/// correlation id of its request, its body starts with a 2-byte ErrorCode.
+constexpr static size_t kFrameHeaderSize = 12;
+constexpr static uint16_t kProtocolMagic = 0xa14d;
+constexpr static uint8_t kProtocolVersion = 1;
+constexpr static uint8_t kResponseFlag = 0x80;
+/// @brief Bodies larger than this are refused unless configured otherwise.
+constexpr static uint32_t kDefaultMaxFrameBody = 16 << 20;
+
+/// @brief Request opcodes.
+enum class Opcode : uint8_t {
+  Ping = 0x0,
+  Produce = 0x1,
+  Fetch = 0x2,
+  Ack = 0x3,
+  // consumer groups, see group_coordinator.h
+  JoinGroup = 0x4,
+  SyncGroup = 0x5,
+  Heartbeat = 0x6,
+  LeaveGroup = 0x7,
+  CommitOffset = 0x8,
+  FetchOffset = 0x9,
+};
+
+/// @brief Error codes every response body starts with.
+enum class ErrorCode : uint16_t {
+  None = 0,
+  // the opcode has no handler
+  UnsupportedOpcode = 1,
+  // the body of the request could not be decoded
+  InvalidRequest = 2,
+  UnknownTopic = 3,
+  OffsetOutOfRange = 4,
+  InternalError = 5,
+  // the topic has no such partition
+  UnknownPartition = 6,
+  // the member left its group or its session expired, it has to join again
+  UnknownMember = 7,
+  // the assignment of the member changed, it has to sync
+  RebalanceInProgress = 8,
+  // the member asked for another assignment strategy than its group uses
+  InconsistentStrategy = 9,
+  // the member committed an offset of a partition it does not own
+  NotPartitionOwner = 10,
+};
+
+/// @brief The fixed header of a frame.
+struct FrameHeader {
+  uint8_t version = kProtocolVersion;
+  uint8_t opcode = 0;
+  uint32_t correlation_id = 0;
+  uint32_t length = 0;
+
+  /// @brief Check if the frame is a response.
+  /// @return
+  bool IsResponse() const {
+    return (opcode & kResponseFlag) != 0;
+  }
+};
+
+/// @brief A decoded frame, body points into the buffer it was decoded from.
+struct Frame {
+  FrameHeader header;
+  std::string_view body;
+
+  /// @brief Size of the frame on the wire.
+  /// @return
+  size_t Size() const {
+    return kFrameHeaderSize + body.size();
+  }
+};
+
+/// @brief Result of decoding a frame.
+enum class DecodeStatus {
+  // a whole frame was decoded
+  Complete,
+  // more bytes are needed
+  Partial,
+  // not a frame of this protocol, or too large, the connection must be dropped
+  Invalid,
+};
+
+/// @brief Decode the frame at the front of data, without copying its body.
+/// @param data
+/// @param len
+/// @param max_body the largest body accepted
+/// @param frame output arg, set when Complete is returned
+/// @return
+DecodeStatus DecodeFrame(const char* data, size_t len, uint32_t max_body,
+                         Frame* frame);
+
+/// @brief FrameReader decodes the fields of a frame body in order. Reads past the
+/// end fail and leave the reader failed, so that a body can be decoded field by
+/// field and checked once at the end.
+class FrameReader {
+ public:
+  explicit FrameReader(std::string_view body) : data_(body) {}
+
+  bool ReadUInt8(uint8_t* v);
+
+  bool ReadUInt16(uint16_t* v);
+
+  bool ReadUInt32(uint32_t* v);
+
+  bool ReadUInt64(uint64_t* v);
+
+  /// @brief Read bytes prefixed with their 4-byte length, without copying them.
+  /// @param v points into the body
+  /// @return
+  bool ReadBytes(std::string_view* v);
+
+  /// @brief Read bytes prefixed with their 2-byte length, without copying them.
+  /// @param v points into the body
+  /// @return
+  bool ReadString(std::string_view* v);
+
+  /// @brief Take everything left in the body.
+  /// @return
+  std::string_view ReadRest();
+
+  /// @brief Bytes left in the body.
+  /// @return
+  size_t Remaining() const {
+    return data_.size() - pos_;
+  }
+
+  /// @brief Check if a read went past the end of the body.
+  /// @return
+  bool Failed() const {
+    return failed_;
+  }
+
+ private:
+  // the next n bytes, nullptr if the body is shorter
+  const char* Take(size_t n);
+
+ private:
+  std::string_view data_;
+  size_t pos_ = 0;
+  bool failed_ = false;
+};
+
+/// @brief A range of a file which ends the body of a frame.
+struct FileRegion {
+  int fd = -1;
+  size_t offset = 0;
+  size_t length = 0;
+  // keeps the file open until the region was sent
+  std::shared_ptr<const void> holder;
+};
+
+/// @brief FrameWriter encodes a frame straight into a buffer. The header is
+/// reserved when the writer is constructed and its length is filled in by
+/// Finish(), so a body is written without knowing its size in advance and without
+/// intermediate strings.
+class FrameWriter : public NoCopyable {
+ public:
+  /// @brief Start a frame at the end of out.
+  /// @param out
+  /// @param opcode
+  /// @param correlation_id
+  FrameWriter(Buffer& out, uint8_t opcode, uint32_t correlation_id);
+
+  /// @brief Finish the frame if it was not finished yet.
+  ~FrameWriter();
+
+  void WriteUInt8(uint8_t v);
+
+  void WriteUInt16(uint16_t v);
+
+  void WriteUInt32(uint32_t v);
+
+  void WriteUInt64(uint64_t v);
+
+  /// @brief Write bytes prefixed with their 4-byte length.
+  /// @param v
+  void WriteBytes(std::string_view v);
+
+  /// @brief Write bytes prefixed with their 2-byte length, at most 65535 of them.
+  /// @param v
+  void WriteString(std::string_view v);
+
+  /// @brief Write bytes as they are.
+  /// @param data
+  /// @param len
+  void WriteRaw(const char* data, size_t len);
+
+  /// @brief End the body with bytes [offset, offset + length) of a file, which are
+  /// sent from the file instead of being copied into the buffer. Only more files
+  /// may be written afterwards, they have to be queued on the connection right
+  /// after the frame.
+  /// @param fd
+  /// @param offset
+  /// @param length
+  /// @param holder kept until the bytes were sent, e.g. the owner of fd keeping
+  /// it open
+  void WriteFile(int fd, size_t offset, size_t length,
+                 std::shared_ptr<const void> holder = nullptr);
+
+  /// @brief Files ending the body, in order.
+  /// @return
+  const std::vector<FileRegion>& Files() const {
+    return files_;
+  }
+
+  /// @brief Size of the body written to the buffer so far, without files.
+  /// @return
+  size_t BodySize() const;
+
+  /// @brief Drop the body written after its first n bytes, and the files.
+  /// @param n
+  void TruncateBody(size_t n);
+
+  /// @brief Overwrite a 2-byte field at offset of the body.
+  /// @param offset
+  /// @param v
+  void PatchUInt16(size_t offset, uint16_t v);
+
+  /// @brief Fill in the length of the frame, nothing may be written afterwards.
+  void Finish();
+
+ private:
+  // the frame starts this many bytes after the reader index of out_, which stays
+  // put while the frame is written even if out_ moves its bytes around
+  char* FrameFront() {
+    return out_.BufferFront() + out_.BeginRead() + start_;
+  }
+
+ private:
+  Buffer& out_;
+  size_t start_;
+  bool finished_ = false;
+  std::vector<FileRegion> files_;
+  size_t file_bytes_ = 0;
+};
+
+}  // namespace broker
+}  // namespace ahrimq
+
+#endif  // _AHRIMQ_BROKER_PROTOCOL_H_
@@ -0,0 +1,317 @@
+#include "ahrimq/broker/protocol.h"
+
+#include <arpa/inet.h>
+#include <gtest/gtest.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ahrimq/broker/broker_server.h"
+
+using namespace ahrimq;
+using namespace ahrimq::broker;
+
+static std::string Request(Opcode opcode, uint32_t correlation_id,
+                           const std::string& body) {
+  Buffer buf;
+  {
+    FrameWriter writer(buf, static_cast<uint8_t>(opcode), correlation_id);
+    writer.WriteRaw(body.data(), body.size());
+  }
+  return buf.ReadAllAsString();
+}
+
+TEST(ProtocolTest, CodecTest) {
+  Buffer buf(16);
+  FrameWriter writer(buf, static_cast<uint8_t>(Opcode::Produce), 0x01020304);
+  writer.WriteUInt8(7);
+  writer.WriteUInt16(0xbeef);
+  writer.WriteUInt32(0xdeadbeef);
+  writer.WriteUInt64(0x0102030405060708);
+  writer.WriteString("topic");
+  // large enough for the buffer to grow under the writer
+  writer.WriteBytes(std::string(1000, 'v'));
+  writer.Finish();
+  std::string wire = buf.ReadAllAsString();
+  ASSERT_EQ(wire.size(), kFrameHeaderSize + 1 + 2 + 4 + 8 + 7 + 1004);
+  EXPECT_EQ(wire.substr(0, kFrameHeaderSize),
+            std::string("\xa1\x4d\x01\x01\x01\x02\x03\x04\x00\x00\x04\x02", 12));
+
+  Frame frame;
+  // every proper prefix is partial
+  for (size_t n = 0; n < wire.size(); n++) {
+    ASSERT_EQ(DecodeFrame(wire.data(), n, kDefaultMaxFrameBody, &frame),
+              DecodeStatus::Partial)
+        << n;
+  }
+  ASSERT_EQ(DecodeFrame(wire.data(), wire.size(), kDefaultMaxFrameBody, &frame),
+            DecodeStatus::Complete);
+  EXPECT_EQ(frame.header.opcode, static_cast<uint8_t>(Opcode::Produce));
+  EXPECT_EQ(frame.header.correlation_id, 0x01020304u);
+  EXPECT_EQ(frame.Size(), wire.size());
+  // the body is not copied
+  EXPECT_EQ(frame.body.data(), wire.data() + kFrameHeaderSize);
+
+  FrameReader reader(frame.body);
+  uint8_t u8;
+  uint16_t u16;
+  uint32_t u32;
+  uint64_t u64;
+  std::string_view topic, value;
+  ASSERT_TRUE(reader.ReadUInt8(&u8) && reader.ReadUInt16(&u16) &&
+              reader.ReadUInt32(&u32) && reader.ReadUInt64(&u64) &&
+              reader.ReadString(&topic) && reader.ReadBytes(&value));
+  EXPECT_EQ(u8, 7);
+  EXPECT_EQ(u16, 0xbeef);
+  EXPECT_EQ(u32, 0xdeadbeefu);
+  EXPECT_EQ(u64, 0x0102030405060708u);
+  EXPECT_EQ(topic, "topic");
+  EXPECT_EQ(value, std::string(1000, 'v'));
+  EXPECT_EQ(reader.Remaining(), 0u);
+  EXPECT_FALSE(reader.ReadUInt8(&u8));
+  EXPECT_TRUE(reader.Failed());
+
+  // a bad magic or version is refused at once, a large body as soon as its length
+  // is known
+  EXPECT_EQ(DecodeFrame("G", 1, kDefaultMaxFrameBody, &frame),
+            DecodeStatus::Invalid);
+  EXPECT_EQ(DecodeFrame("\xa1\x4d\x02", 3, kDefaultMaxFrameBody, &frame),
+            DecodeStatus::Invalid);
+  EXPECT_EQ(DecodeFrame(wire.data(), kFrameHeaderSize, 1000, &frame),
+            DecodeStatus::Invalid);
+}
+
+TEST(ProtocolTest, FileTest) {
+  Buffer buf;
+  {
+    FrameWriter writer(buf, static_cast<uint8_t>(Opcode::Fetch) | kResponseFlag, 9);
+    writer.WriteUInt16(0);
+    writer.WriteFile(3, 100, 1000);
+    writer.WriteFile(4, 0, 24);
+    ASSERT_EQ(writer.Files().size(), 2u);
+    EXPECT_EQ(writer.Files()[1].fd, 4);
+    writer.Finish();
+  }
+  // the files count in the length but are not in the buffer
+  std::string wire = buf.ReadAllAsString();
+  ASSERT_EQ(wire.size(), kFrameHeaderSize + 2);
+  EXPECT_EQ(wire.substr(8, 4), std::string("\0\0\x04\x02", 4));
+
+  // dropping the body drops the files
+  FrameWriter writer(buf, static_cast<uint8_t>(Opcode::Fetch) | kResponseFlag, 9);
+  writer.WriteUInt16(0);
+  writer.WriteFile(3, 0, 10);
+  writer.TruncateBody(2);
+  writer.Finish();
+  EXPECT_TRUE(writer.Files().empty());
+  EXPECT_EQ(buf.ReadAllAsString().substr(8, 4), std::string("\0\0\0\x02", 4));
+}
+
+TEST(ProtocolTest, DispatchTest) {
+  Dispatcher dispatcher(1024);
+  dispatcher.Handle(Opcode::Produce,
+                    [](TCPConn* conn, const Frame& request, FrameWriter& response) {
+                      FrameReader reader(request.body);
+                      uint32_t n = 0;
+                      if (!reader.ReadUInt32(&n)) {
+                        return ErrorCode::InvalidRequest;
+                      }
+                      response.WriteUInt32(n + 1);
+                      return ErrorCode::None;
+                    });
+  Buffer in, out;
+  std::string produce = Request(Opcode::Produce, 2, std::string("\0\0\0\x29", 4));
+  std::string ping = Request(Opcode::Ping, 1, "hi");
+  // coalesced frames and a partial one
+  std::string wire = ping + produce + Request(Opcode::Produce, 3, "") +
+                     Request(Opcode::Fetch, 4, "") + produce;
+  in.Append(wire.substr(0, wire.size() - 5));
+  ASSERT_TRUE(dispatcher.Dispatch(nullptr, in, out));
+  EXPECT_EQ(in.Size(), produce.size() - 5);
+
+  Frame frame;
+  std::string responses = out.ReadAllAsString();
+  const char* p = responses.data();
+  size_t left = responses.size();
+  struct {
+    uint8_t opcode;
+    uint32_t correlation_id;
+    std::string body;
+  } expected[] = {
+      {0x80, 1, std::string("\0\0hi", 4)},
+      {0x81, 2, std::string("\0\0\0\0\0\x2a", 6)},
+      {0x81, 3, std::string("\0\x02", 2)},
+      {0x82, 4, std::string("\0\x01", 2)},
+  };
+  for (const auto& e : expected) {
+    ASSERT_EQ(DecodeFrame(p, left, 1024, &frame), DecodeStatus::Complete);
+    EXPECT_TRUE(frame.header.IsResponse());
+    EXPECT_EQ(frame.header.opcode, e.opcode);
+    EXPECT_EQ(frame.header.correlation_id, e.correlation_id);
+    EXPECT_EQ(frame.body, e.body);
+    p += frame.Size();
+    left -= frame.Size();
+  }
+  EXPECT_EQ(left, 0u);
+
+  // the rest of the partial frame
+  in.Append(wire.substr(wire.size() - 5));
+  ASSERT_TRUE(dispatcher.Dispatch(nullptr, in, out));
+  EXPECT_TRUE(in.Empty());
+  EXPECT_EQ(out.Size(), kFrameHeaderSize + 6);
+
+  // responses are not accepted from clients
+  std::string response = Request(Opcode::Ping, 5, "");
+  response[3] |= kResponseFlag;
+  in.Append(response);
+  EXPECT_FALSE(dispatcher.Dispatch(nullptr, in, out));
+}
+
+TEST(ProtocolTest, DeferredTest) {
+  Dispatcher dispatcher(1024);
+  std::vector<Responder> pending;
+  dispatcher.HandleDeferred(Opcode::Produce,
+                            [&](TCPConn* conn, const Frame& request, Responder r) {
+                              EXPECT_EQ(request.body, "later");
+                              pending.push_back(r);
+                            });
+  Buffer in, out;
+  std::string wire = Request(Opcode::Ping, 1, "a") +
+                     Request(Opcode::Produce, 2, "later") +
+                     Request(Opcode::Ping, 3, "b");
+  // not deferred without a sink or when the caller can not wait
+  in.Append(wire);
+  ASSERT_TRUE(dispatcher.Dispatch(nullptr, in, out));
+  EXPECT_TRUE(in.Empty());
+  EXPECT_TRUE(pending.empty());
+  out.Reset();
+
+  dispatcher.SetResponderSink([&](const TCPConnPtr& conn, const FrameHeader& request,
+                                  ErrorCode err, BodyWriter body) {
+    dispatcher.WriteResponse(conn.get(), request, err, body, out);
+  });
+  bool deferred = false;
+  in.Append(wire);
+  ASSERT_TRUE(dispatcher.Dispatch(nullptr, in, out, &deferred));
+  EXPECT_TRUE(deferred);
+  ASSERT_EQ(pending.size(), 1u);
+  EXPECT_EQ(pending[0].Request().correlation_id, 2u);
+  // the frames after the deferred one wait for its answer
+  EXPECT_EQ(in.Size(), kFrameHeaderSize + 1);
+  pending[0].Respond(ErrorCode::None,
+                     [](FrameWriter& response) { response.WriteUInt32(7); });
+  ASSERT_TRUE(dispatcher.Dispatch(nullptr, in, out, &deferred));
+  EXPECT_FALSE(deferred);
+  EXPECT_TRUE(in.Empty());
+
+  std::string responses = out.ReadAllAsString();
+  const char* p = responses.data();
+  size_t left = responses.size();
+  struct {
+    uint32_t correlation_id;
+    std::string body;
+  } expected[] = {
+      {1, std::string("\0\0a", 3)},
+      {2, std::string("\0\0\0\0\0\x07", 6)},
+      {3, std::string("\0\0b", 3)},
+  };
+  Frame frame;
+  for (const auto& e : expected) {
+    ASSERT_EQ(DecodeFrame(p, left, 1024, &frame), DecodeStatus::Complete);
+    EXPECT_EQ(frame.header.correlation_id, e.correlation_id);
+    EXPECT_EQ(frame.body, e.body);
+    p += frame.Size();
+    left -= frame.Size();
+  }
+  EXPECT_EQ(left, 0u);
+}
+
+// read one response frame from fd, waiting at most timeout_ms
+static bool ReadResponse(int fd, int timeout_ms, Frame* frame, std::string* wire) {
+  timeval tv = {timeout_ms / 1000, (timeout_ms % 1000) * 1000};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  wire->clear();
+  while (true) {
+    DecodeStatus status = DecodeFrame(wire->data(), wire->size(), 1024, frame);
+    if (status == DecodeStatus::Complete) {
+      return true;
+    }
+    if (status == DecodeStatus::Invalid) {
+      return false;
+    }
+    char c;
+    if (read(fd, &c, 1) != 1) {
+      return false;
+    }
+    wire->push_back(c);
+  }
+}
+
+TEST(ProtocolTest, SuspendedServerTest) {
+  BrokerServerConfig config;
+  config.ip = "127.0.0.1";
+  config.port = 19632;
+  config.n_threads = 1;
+  BrokerServer server(config);
+  std::mutex mtx;
+  std::vector<Responder> pending;
+  server.HandleDeferred(Opcode::Fetch,
+                        [&](TCPConn* conn, const Frame& request, Responder r) {
+                          // parked like a long-poll fetch
+                          std::lock_guard<std::mutex> lck(mtx);
+                          pending.push_back(r);
+                        });
+  std::thread runner([&server] { server.Run(); });
+
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  ASSERT_GE(fd, 0);
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(config.port);
+  inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+  bool connected = false;
+  for (int i = 0; i < 50 && !connected; i++) {
+    connected = connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0;
+    if (!connected) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+  }
+  ASSERT_TRUE(connected);
+  std::string wire = Request(Opcode::Ping, 1, "a") + Request(Opcode::Fetch, 2, "") +
+                     Request(Opcode::Ping, 3, "b");
+  ASSERT_EQ(write(fd, wire.data(), wire.size()), ssize_t(wire.size()));
+
+  // the ping before the parked fetch is answered at once
+  Frame frame;
+  std::string response;
+  ASSERT_TRUE(ReadResponse(fd, 1000, &frame, &response));
+  EXPECT_EQ(frame.header.correlation_id, 1u);
+  EXPECT_EQ(frame.body, std::string("\0\0a", 3));
+  // the ping after it waits for its answer
+  EXPECT_FALSE(ReadResponse(fd, 100, &frame, &response));
+  {
+    std::lock_guard<std::mutex> lck(mtx);
+    ASSERT_EQ(pending.size(), 1u);
+    pending[0].Respond(ErrorCode::None, nullptr);
+  }
+  ASSERT_TRUE(ReadResponse(fd, 1000, &frame, &response));
+  EXPECT_EQ(frame.header.correlation_id, 2u);
+  ASSERT_TRUE(ReadResponse(fd, 1000, &frame, &response));
+  EXPECT_EQ(frame.header.correlation_id, 3u);
+  EXPECT_EQ(frame.body, std::string("\0\0b", 3));
+
+  close(fd);
+  server.Stop();
+  runner.join();
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -39,6 +39,13 @@ void Buffer::Append(const char *value, int len) {
   p_writer_ += len;
 }
 
+void Buffer::Swap(Buffer &other) {
+  std::swap(data_, other.data_);
+  std::swap(p_reader_, other.p_reader_);
+  std::swap(p_writer_, other.p_writer_);
+  std::swap(capacity_, other.capacity_);
+}
+
 void Buffer::Reset() {
   p_reader_ = 0;
   p_writer_ = 0;
@@ -210,6 +210,10 @@ class Buffer : public NoCopyable {
   /// @param n
   void EnsureBytesForWrite(size_t n);
 
+  /// @brief Exchange content and storage with other buffer.
+  /// @param other
+  void Swap(Buffer &other);
+
  private:
   /// @brief Move readable bytes to the head of buffer.
   void MoveReadableToHead();
@@ -178,6 +178,18 @@ TEST(BufferTest, AppendBufferTest) {
             "ok?kkkkkkkkkkkkkkkkkkkkkkkkkkkk");
 }
 
+TEST(BufferTest, SwapTest) {
+  ahrimq::Buffer buf(16);
+  buf.Append("hello");
+  ahrimq::Buffer buf2(4096);
+  buf2.Append("world!");
+  buf.Swap(buf2);
+  EXPECT_EQ(buf.ReadableAsString(), "world!");
+  EXPECT_EQ(buf.Capacity(), 4096);
+  EXPECT_EQ(buf2.ReadableAsString(), "hello");
+  EXPECT_EQ(buf2.Capacity(), 16);
+}
+
 int main(int argc, char **argv) {
   testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
@@ -0,0 +1,83 @@
+#include "net/coroutine.h"
+
+#ifdef AHRIMQ_COROUTINES
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <iostream>
+
+namespace ahrimq {
+namespace coro {
+
+static detail::Detached RunDetached(Task<void> task) {
+  try {
+    co_await task;
+  } catch (const std::exception& ex) {
+    std::cerr << "uncaught exception in coroutine: " << ex.what() << '\n';
+  } catch (...) {
+    std::cerr << "uncaught exception in coroutine\n";
+  }
+}
+
+void Spawn(Task<void> task) {
+  RunDetached(std::move(task));
+}
+
+FdAwaiter::~FdAwaiter() {
+  if (timer_ != 0) {
+    loop_->CancelTimer(timer_);
+  }
+  if (conn_ != nullptr) {
+    loop_->epoller->DetachConn(conn_.get());
+  }
+}
+
+bool FdAwaiter::await_suspend(std::coroutine_handle<> h) {
+  // the duplicate is closed with conn_, fd_ stays open
+  int dupfd = fcntl(fd_, F_DUPFD_CLOEXEC, 0);
+  if (dupfd == -1) {
+    return false;
+  }
+  auto ready = [this](ReactorConn*, bool& closed) {
+    // do not let the eventloop touch conn_ again, Finish() may destroy it
+    closed = true;
+    Finish(true);
+  };
+  conn_.reset(new ReactorConn(dupfd, events_ | EPOLLONESHOT, ready, ready, loop_,
+                              "coro-fd-wait"));
+  if (!loop_->epoller->AttachConn(conn_.get())) {
+    conn_.reset();
+    return false;
+  }
+  handle_ = h;
+  if (timeout_ms_ >= 0) {
+    timer_ = loop_->RunAfter(timeout_ms_, [this]() {
+      timer_ = 0;
+      Finish(false);
+    });
+  }
+  return true;
+}
+
+void FdAwaiter::Finish(bool ready) {
+  if (timer_ != 0) {
+    loop_->CancelTimer(timer_);
+    timer_ = 0;
+  }
+  loop_->epoller->DetachConn(conn_.get());
+  ready_ = ready;
+  // the coroutine may finish and destroy this awaiter, nothing is touched after
+  handle_.resume();
+}
+
+Task<void> WhenAll(std::vector<Task<void>> tasks) {
+  auto out = [](size_t) { return nullptr; };
+  detail::WhenAllAwaiter<void, decltype(out)> all{tasks, out, {}};
+  co_await all;
+}
+
+}  // namespace coro
+}  // namespace ahrimq
+
+#endif  // AHRIMQ_COROUTINES
@@ -0,0 +1,467 @@
+#ifndef _AHRIMQ_NET_COROUTINE_H_
+#define _AHRIMQ_NET_COROUTINE_H_
+
+#ifdef AHRIMQ_COROUTINES
+
+#include <cassert>
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "base/nocopyable.h"
+#include "net/eventloop.h"
+#include "net/reactor_conn.h"
+#include "pool/work_stealing_pool.hpp"
+
+namespace ahrimq {
+namespace coro {
+
+template <typename T = void>
+class Task;
+
+namespace detail {
+
+// resumes the awaiting coroutine, if any, once a task finishes
+struct FinalAwaiter {
+  bool await_ready() const noexcept {
+    return false;
+  }
+
+  template <typename Promise>
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> h) noexcept {
+    std::coroutine_handle<> next = h.promise().continuation;
+    return next ? next : std::noop_coroutine();
+  }
+
+  void await_resume() const noexcept {}
+};
+
+struct PromiseBase {
+  std::coroutine_handle<> continuation;
+  std::exception_ptr exception;
+
+  std::suspend_always initial_suspend() const noexcept {
+    return {};
+  }
+
+  FinalAwaiter final_suspend() const noexcept {
+    return {};
+  }
+
+  void unhandled_exception() noexcept {
+    exception = std::current_exception();
+  }
+};
+
+template <typename T>
+struct Promise : PromiseBase {
+  std::optional<T> value;
+
+  Task<T> get_return_object() noexcept;
+
+  template <typename U>
+  void return_value(U&& v) {
+    value.emplace(std::forward<U>(v));
+  }
+
+  T Result() {
+    if (exception) {
+      std::rethrow_exception(exception);
+    }
+    return std::move(*value);
+  }
+};
+
+template <>
+struct Promise<void> : PromiseBase {
+  Task<void> get_return_object() noexcept;
+
+  void return_void() const noexcept {}
+
+  void Result() {
+    if (exception) {
+      std::rethrow_exception(exception);
+    }
+  }
+};
+
+// fire and forget coroutine started by Spawn()
+struct Detached {
+  struct promise_type {
+    Detached get_return_object() const noexcept {
+      return {};
+    }
+
+    std::suspend_never initial_suspend() const noexcept {
+      return {};
+    }
+
+    std::suspend_never final_suspend() const noexcept {
+      return {};
+    }
+
+    void return_void() const noexcept {}
+
+    void unhandled_exception() const noexcept {
+      std::terminate();
+    }
+  };
+};
+
+}  // namespace detail
+
+/// @brief Task is a lazily started coroutine producing a T. It starts running when
+/// it is awaited, and the awaiting coroutine is resumed right after it finishes.
+/// Exceptions thrown inside the task are rethrown by co_await.
+///
+/// Coroutines of the network layer run in the eventloop thread of their
+/// connection. Everything they await resumes them in that same thread, so a
+/// handler never needs locks to touch its connection.
+template <typename T>
+class [[nodiscard]] Task {
+ public:
+  typedef detail::Promise<T> promise_type;
+  typedef std::coroutine_handle<promise_type> Handle;
+
+  Task() = default;
+
+  explicit Task(Handle h) : handle_(h) {}
+
+  Task(Task&& other) noexcept : handle_(std::exchange(other.handle_, nullptr)) {}
+
+  Task& operator=(Task&& other) noexcept {
+    if (this != &other) {
+      if (handle_) {
+        handle_.destroy();
+      }
+      handle_ = std::exchange(other.handle_, nullptr);
+    }
+    return *this;
+  }
+
+  Task(const Task&) = delete;
+  Task& operator=(const Task&) = delete;
+
+  ~Task() {
+    if (handle_) {
+      handle_.destroy();
+    }
+  }
+
+  bool Valid() const {
+    return static_cast<bool>(handle_);
+  }
+
+  bool Done() const {
+    return handle_ && handle_.done();
+  }
+
+  bool await_ready() const noexcept {
+    return !handle_ || handle_.done();
+  }
+
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+    handle_.promise().continuation = awaiting;
+    return handle_;
+  }
+
+  T await_resume() {
+    return handle_.promise().Result();
+  }
+
+ private:
+  Handle handle_;
+};
+
+namespace detail {
+
+template <typename T>
+inline Task<T> Promise<T>::get_return_object() noexcept {
+  return Task<T>(std::coroutine_handle<Promise<T>>::from_promise(*this));
+}
+
+inline Task<void> Promise<void>::get_return_object() noexcept {
+  return Task<void>(std::coroutine_handle<Promise<void>>::from_promise(*this));
+}
+
+}  // namespace detail
+
+/// @brief Start task without waiting for it. It runs in the calling thread until
+/// it first suspends. An exception escaping the task is reported on stderr.
+/// @param task
+void Spawn(Task<void> task);
+
+/// @brief Awaitable resuming the coroutine after a delay, see Sleep().
+class SleepAwaiter {
+ public:
+  SleepAwaiter(EventLoop* loop, uint64_t delay_ms)
+      : loop_(loop), delay_ms_(delay_ms) {
+    assert(loop_ != nullptr);
+  }
+
+  bool await_ready() const noexcept {
+    return false;
+  }
+
+  void await_suspend(std::coroutine_handle<> h) {
+    loop_->RunAfter(delay_ms_, [h]() { h.resume(); });
+  }
+
+  void await_resume() const noexcept {}
+
+ private:
+  EventLoop* loop_;
+  uint64_t delay_ms_;
+};
+
+/// @brief Suspend the calling coroutine for delay_ms milliseconds without blocking
+/// the eventloop. Must be awaited in an eventloop thread.
+/// @param delay_ms
+/// @return
+inline SleepAwaiter Sleep(uint64_t delay_ms) {
+  return SleepAwaiter(EventLoop::Current(), delay_ms);
+}
+
+/// @brief Awaitable moving the coroutine onto an eventloop, see ResumeOn().
+class LoopAwaiter {
+ public:
+  explicit LoopAwaiter(EventLoop* loop) : loop_(loop) {}
+
+  bool await_ready() const noexcept {
+    return false;
+  }
+
+  void await_suspend(std::coroutine_handle<> h) {
+    loop_->QueueInLoop([h]() { h.resume(); });
+  }
+
+  void await_resume() const noexcept {}
+
+ private:
+  EventLoop* loop_;
+};
+
+/// @brief Continue the calling coroutine in the thread of loop. Awaiting the
+/// current loop yields to the other events that are ready.
+/// @param loop
+/// @return
+inline LoopAwaiter ResumeOn(EventLoop* loop) {
+  return LoopAwaiter(loop);
+}
+
+/// @brief Awaitable waiting for a file descriptor to become readable or writable,
+/// see Readable() and Writable().
+class FdAwaiter : public NoCopyable {
+ public:
+  FdAwaiter(EventLoop* loop, int fd, uint32_t events, int timeout_ms)
+      : loop_(loop), fd_(fd), events_(events), timeout_ms_(timeout_ms) {
+    assert(loop_ != nullptr);
+  }
+
+  ~FdAwaiter();
+
+  bool await_ready() const noexcept {
+    return false;
+  }
+
+  bool await_suspend(std::coroutine_handle<> h);
+
+  /// @return true if the fd is ready, false on timeout or if it can not be watched
+  bool await_resume() const noexcept {
+    return ready_;
+  }
+
+ private:
+  void Finish(bool ready);
+
+ private:
+  EventLoop* loop_;
+  int fd_;
+  uint32_t events_;
+  int timeout_ms_;
+  // watches a duplicate of fd_ so that the caller keeps ownership of fd_
+  std::unique_ptr<ReactorConn> conn_;
+  TimerId timer_ = 0;
+  bool ready_ = false;
+  std::coroutine_handle<> handle_;
+};
+
+/// @brief Wait until fd is readable. Must be awaited in an eventloop thread.
+/// @param fd
+/// @param timeout_ms negative to wait forever
+/// @return awaitable resulting in false on timeout
+inline FdAwaiter Readable(int fd, int timeout_ms = -1) {
+  return FdAwaiter(EventLoop::Current(), fd, EPOLLIN, timeout_ms);
+}
+
+/// @brief Wait until fd is writable. Must be awaited in an eventloop thread.
+/// @param fd
+/// @param timeout_ms negative to wait forever
+/// @return awaitable resulting in false on timeout
+inline FdAwaiter Writable(int fd, int timeout_ms = -1) {
+  return FdAwaiter(EventLoop::Current(), fd, EPOLLOUT, timeout_ms);
+}
+
+/// @brief Awaitable running a function on a worker pool, see RunOn().
+template <typename F>
+class PoolAwaiter {
+ public:
+  typedef std::invoke_result_t<F&> Result;
+  static_assert(!std::is_void<Result>::value,
+                "functions run by RunOn() must return a value");
+
+  PoolAwaiter(WorkStealingPool& pool, EventLoop* loop, F fn)
+      : pool_(pool), loop_(loop), fn_(std::move(fn)) {
+    assert(loop_ != nullptr);
+  }
+
+  bool await_ready() const noexcept {
+    return false;
+  }
+
+  bool await_suspend(std::coroutine_handle<> h) {
+    // resumed right away if the pool does not take the function
+    return pool_.Submit([this, h]() {
+      try {
+        result_.emplace(fn_());
+      } catch (...) {
+        exception_ = std::current_exception();
+      }
+      loop_->QueueInLoop([h]() { h.resume(); });
+    });
+  }
+
+  /// @return std::nullopt if the pool is saturated or stopped
+  std::optional<Result> await_resume() {
+    if (exception_) {
+      std::rethrow_exception(exception_);
+    }
+    return std::move(result_);
+  }
+
+ private:
+  WorkStealingPool& pool_;
+  EventLoop* loop_;
+  F fn_;
+  std::optional<Result> result_;
+  std::exception_ptr exception_;
+};
+
+/// @brief Run fn on pool and resume the calling coroutine in its eventloop with
+/// the result, for blocking work a coroutine must not do on the eventloop. Must be
+/// awaited in an eventloop thread.
+/// @param pool
+/// @param fn
+/// @return awaitable resulting in std::optional of the result of fn
+template <typename F>
+PoolAwaiter<F> RunOn(WorkStealingPool& pool, F fn) {
+  return PoolAwaiter<F>(pool, EventLoop::Current(), std::move(fn));
+}
+
+namespace detail {
+
+struct WhenAllState {
+  // unfinished tasks, plus one held while the tasks are being started
+  size_t remaining = 0;
+  std::coroutine_handle<> awaiting;
+  std::exception_ptr exception;
+
+  void Fail() {
+    if (!exception) {
+      exception = std::current_exception();
+    }
+  }
+
+  void Finish() {
+    if (--remaining == 0) {
+      awaiting.resume();
+    }
+  }
+};
+
+// state lives in the awaiting frame, which may be gone after Finish()
+template <typename T>
+Detached RunChild(Task<T> task, WhenAllState* state, std::optional<T>* out) {
+  try {
+    out->emplace(co_await task);
+  } catch (...) {
+    state->Fail();
+  }
+  state->Finish();
+}
+
+inline Detached RunChild(Task<void> task, WhenAllState* state, std::nullptr_t) {
+  try {
+    co_await task;
+  } catch (...) {
+    state->Fail();
+  }
+  state->Finish();
+}
+
+// starts every task and suspends until the last one finishes
+template <typename T, typename Out>
+struct WhenAllAwaiter {
+  std::vector<Task<T>>& tasks;
+  Out out;
+  WhenAllState state;
+
+  bool await_ready() const noexcept {
+    return tasks.empty();
+  }
+
+  bool await_suspend(std::coroutine_handle<> h) {
+    state.awaiting = h;
+    state.remaining = tasks.size() + 1;
+    for (size_t i = 0; i < tasks.size(); i++) {
+      RunChild(std::move(tasks[i]), &state, out(i));
+    }
+    // stay running if every task finished synchronously
+    return --state.remaining != 0;
+  }
+
+  void await_resume() const {
+    if (state.exception) {
+      std::rethrow_exception(state.exception);
+    }
+  }
+};
+
+}  // namespace detail
+
+/// @brief Run tasks concurrently and wait for all of them, the building block of
+/// fan-out handlers. The tasks must resume in the calling thread, which is the case
+/// for all awaitables of this file. If any task throws, the first exception is
+/// rethrown once every task finished.
+/// @param tasks
+/// @return results in the order of tasks
+template <typename T>
+Task<std::vector<T>> WhenAll(std::vector<Task<T>> tasks) {
+  std::vector<std::optional<T>> results(tasks.size());
+  auto out = [&results](size_t i) { return &results[i]; };
+  detail::WhenAllAwaiter<T, decltype(out)> all{tasks, out, {}};
+  co_await all;
+  std::vector<T> values;
+  values.reserve(results.size());
+  for (auto& r : results) {
+    values.push_back(std::move(*r));
+  }
+  co_return values;
+}
+
+/// @brief Run tasks concurrently and wait for all of them.
+/// @param tasks
+/// @return
+Task<void> WhenAll(std::vector<Task<void>> tasks);
+
+}  // namespace coro
+}  // namespace ahrimq
+
+#endif  // AHRIMQ_COROUTINES
+
+#endif  // _AHRIMQ_NET_COROUTINE_H_
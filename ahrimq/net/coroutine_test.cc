@@ -0,0 +1,142 @@
+#include "net/coroutine.h"
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <future>
+#include <stdexcept>
+#include <thread>
+
+using namespace ahrimq;
+
+// runs an eventloop in its own thread
+class LoopThread {
+ public:
+  LoopThread() : thread_([this]() { loop_.Loop(); }) {}
+
+  ~LoopThread() {
+    loop_.QueueInLoop([this]() { loop_.Stop(); });
+    thread_.join();
+  }
+
+  // run task in the loop thread and wait for it to finish
+  template <typename T>
+  T Run(coro::Task<T> task) {
+    std::promise<T> result;
+    loop_.QueueInLoop([&]() {
+      coro::Spawn([](coro::Task<T> t, std::promise<T>& p) -> coro::Task<void> {
+        p.set_value(co_await t);
+      }(std::move(task), result));
+    });
+    return result.get_future().get();
+  }
+
+  EventLoop& Loop() {
+    return loop_;
+  }
+
+ private:
+  EventLoop loop_;
+  std::thread thread_;
+};
+
+static coro::Task<int> SleepThenReturn(int value, uint64_t delay_ms) {
+  co_await coro::Sleep(delay_ms);
+  co_return value;
+}
+
+TEST(CoroutineTest, SleepWhenAllTest) {
+  LoopThread lt;
+  auto start = std::chrono::steady_clock::now();
+  std::vector<int> values = lt.Run([]() -> coro::Task<std::vector<int>> {
+    std::vector<coro::Task<int>> tasks;
+    for (int i = 0; i < 3; i++) {
+      tasks.push_back(SleepThenReturn(i, 100));
+    }
+    co_return co_await coro::WhenAll(std::move(tasks));
+  }());
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  EXPECT_EQ(values, std::vector<int>({0, 1, 2}));
+  // the sleeps overlap
+  EXPECT_GE(elapsed, std::chrono::milliseconds(100));
+  EXPECT_LT(elapsed, std::chrono::milliseconds(250));
+
+  // tasks finishing synchronously
+  values = lt.Run([]() -> coro::Task<std::vector<int>> {
+    std::vector<coro::Task<int>> tasks;
+    tasks.push_back([]() -> coro::Task<int> { co_return 7; }());
+    co_return co_await coro::WhenAll(std::move(tasks));
+  }());
+  EXPECT_EQ(values, std::vector<int>({7}));
+}
+
+TEST(CoroutineTest, ExceptionTest) {
+  LoopThread lt;
+  bool caught = lt.Run([]() -> coro::Task<bool> {
+    auto fail = []() -> coro::Task<int> {
+      co_await coro::Sleep(1);
+      throw std::runtime_error("failed");
+    };
+    try {
+      co_await fail();
+    } catch (const std::runtime_error&) {
+      co_return true;
+    }
+    co_return false;
+  }());
+  EXPECT_TRUE(caught);
+}
+
+TEST(CoroutineTest, ReadableTest) {
+  LoopThread lt;
+  int fds[2];
+  ASSERT_EQ(pipe(fds), 0);
+  std::thread writer([&]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    ASSERT_EQ(write(fds[1], "x", 1), 1);
+  });
+  bool readable = lt.Run([](int fd) -> coro::Task<bool> {
+    co_return co_await coro::Readable(fd, 2000);
+  }(fds[0]));
+  writer.join();
+  EXPECT_TRUE(readable);
+
+  char c;
+  ASSERT_EQ(read(fds[0], &c, 1), 1);
+  // nothing to read, times out
+  readable = lt.Run([](int fd) -> coro::Task<bool> {
+    co_return co_await coro::Readable(fd, 20);
+  }(fds[0]));
+  EXPECT_FALSE(readable);
+  // the caller keeps its fd
+  EXPECT_EQ(write(fds[1], "y", 1), 1);
+  EXPECT_EQ(read(fds[0], &c, 1), 1);
+  close(fds[0]);
+  close(fds[1]);
+}
+
+TEST(CoroutineTest, RunOnPoolTest) {
+  LoopThread lt;
+  WorkStealingPool pool(2);
+  bool ok = lt.Run([](WorkStealingPool& pool) -> coro::Task<bool> {
+    std::thread::id loop_thread = std::this_thread::get_id();
+    std::optional<std::thread::id> worker =
+        co_await coro::RunOn(pool, []() { return std::this_thread::get_id(); });
+    co_return worker.has_value() && *worker != loop_thread &&
+        std::this_thread::get_id() == loop_thread;
+  }(pool));
+  EXPECT_TRUE(ok);
+
+  pool.Stop();
+  bool saturated = lt.Run([](WorkStealingPool& pool) -> coro::Task<bool> {
+    auto r = co_await coro::RunOn(pool, []() { return 1; });
+    co_return !r.has_value();
+  }(pool));
+  EXPECT_TRUE(saturated);
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -54,8 +54,11 @@ bool Epoller::AttachConn(ReactorConn *conn) {
   epev.events = conn->mask_;
   int ans = -1;
   if (!conn->watched_) {
-    if ((ans = epoll_ctl(epfd_, EPOLL_CTL_ADD, conn->fd_, &epev)) == 0) {
-      conn->watched_ = true;
+    // mark before adding, the owner loop may handle the first event and re-arm
+    // the connection before epoll_ctl returns here
+    conn->watched_ = true;
+    if ((ans = epoll_ctl(epfd_, EPOLL_CTL_ADD, conn->fd_, &epev)) != 0) {
+      conn->watched_ = false;
     }
   } else {
     ans = epoll_ctl(epfd_, EPOLL_CTL_MOD, conn->fd_, &epev);
@@ -1,15 +1,36 @@
 #include "net/eventloop.h"
 
+#include <sys/eventfd.h>
+
 namespace ahrimq {
 
+// the eventloop running in this thread, see EventLoop::Current()
+static thread_local EventLoop *t_current_loop = nullptr;
+
 EventLoop::EventLoop() : epoller(new (std::nothrow) Epoller(4096)), stopped(false) {
   if (epoller == nullptr) {
     std::cerr << "can not initialize epoller in event loop, program abort.\n";
     exit(EXIT_FAILURE);
   }
+  int efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (efd == -1) {
+    std::cerr << "can not create eventfd in event loop, program abort.\n";
+    exit(EXIT_FAILURE);
+  }
+  // level triggered, the read handler drains the counter
+  wakeup_conn_.reset(new ReactorConn(
+      efd, EPOLLIN, [this](ReactorConn*, bool&) { RunQueued(); }, nullptr, this,
+      "loop-wakeup"));
+  if (!epoller->AttachConn(wakeup_conn_.get())) {
+    std::cerr << "can not watch eventfd in event loop, program abort.\n";
+    exit(EXIT_FAILURE);
+  }
+  RefreshDate();
 }
 
 EventLoop::~EventLoop() {
+  // detached from the epoller before it goes away
+  wakeup_conn_.reset();
   if (epoller != nullptr) {
     delete epoller;
     epoller = nullptr;
@@ -22,8 +43,9 @@ void EventLoop::Loop() {
     return;
   }
   static int debug_n = 1;
+  t_current_loop = this;
   while (!stopped) {
-    int timeout_ms = -1;
+    int timeout_ms = NextTimeout();
     int ready = epoller->Wait(timeout_ms);
     // process events one by one
     debug_n += ready;
@@ -47,7 +69,13 @@ void EventLoop::Loop() {
         }
       }
     }
+    RunExpiredTimers();
   }
+  t_current_loop = nullptr;
+}
+
+EventLoop *EventLoop::Current() {
+  return t_current_loop;
 }
 
 void EventLoop::Stop() {
@@ -58,4 +86,103 @@ void EventLoop::Stop() {
   stopped.store(true, std::memory_order_relaxed);
 }
 
+TimerId EventLoop::RunAfter(uint64_t delay_ms, TimerCallback cb) {
+  // the clock drops the fraction of the current millisecond, which would let the
+  // timer fire up to one millisecond early
+  return AddTimer(time::GetCurrentMs() + delay_ms + 1, 0, std::move(cb));
+}
+
+TimerId EventLoop::RunEvery(uint64_t interval_ms, TimerCallback cb) {
+  if (interval_ms == 0) {
+    interval_ms = 1;
+  }
+  return AddTimer(time::GetCurrentMs() + interval_ms, interval_ms, std::move(cb));
+}
+
+void EventLoop::CancelTimer(TimerId id) {
+  auto it = timer_index_.find(id);
+  if (it == timer_index_.end()) {
+    return;
+  }
+  timers_.erase({it->second, id});
+  timer_index_.erase(it);
+}
+
+TimerId EventLoop::AddTimer(uint64_t when_ms, uint64_t interval_ms,
+                            TimerCallback cb) {
+  TimerId id = next_timer_id_++;
+  timers_.emplace(std::make_pair(when_ms, id), Timer{id, interval_ms, std::move(cb)});
+  timer_index_[id] = when_ms;
+  return id;
+}
+
+int EventLoop::NextTimeout() const {
+  if (timers_.empty()) {
+    return -1;
+  }
+  uint64_t now = time::GetCurrentMs();
+  uint64_t when = timers_.begin()->first.first;
+  return when <= now ? 0 : static_cast<int>(when - now);
+}
+
+void EventLoop::RunExpiredTimers() {
+  if (timers_.empty()) {
+    return;
+  }
+  uint64_t now = time::GetCurrentMs();
+  while (!timers_.empty() && timers_.begin()->first.first <= now) {
+    auto it = timers_.begin();
+    Timer timer = std::move(it->second);
+    timers_.erase(it);
+    if (timer.interval_ms != 0) {
+      // re-arm periodic timer before running it so that it can cancel itself
+      uint64_t next = now + timer.interval_ms;
+      timer_index_[timer.id] = next;
+      timers_.emplace(std::make_pair(next, timer.id), timer);
+    } else {
+      timer_index_.erase(timer.id);
+    }
+    if (timer.cb) {
+      timer.cb();
+    }
+  }
+}
+
+void EventLoop::QueueInLoop(std::function<void()> cb) {
+  {
+    std::lock_guard<std::mutex> lck(queue_mtx_);
+    queued_.push_back(std::move(cb));
+    if (queued_.size() > 1) {
+      // the loop has been woken up already
+      return;
+    }
+  }
+  uint64_t one = 1;
+  ssize_t n = write(wakeup_conn_->GetFd(), &one, sizeof(one));
+  (void)n;
+}
+
+void EventLoop::RunQueued() {
+  uint64_t count;
+  ssize_t n = read(wakeup_conn_->GetFd(), &count, sizeof(count));
+  (void)n;
+  std::vector<std::function<void()>> cbs;
+  {
+    std::lock_guard<std::mutex> lck(queue_mtx_);
+    cbs.swap(queued_);
+  }
+  for (auto& cb : cbs) {
+    cb();
+  }
+}
+
+// Date string only changes every second, so we re-render it at the beginning of
+// every second instead of doing it for every response.
+void EventLoop::RefreshDate() {
+  long sec, ms;
+  time::GetCurrentTime(&sec, &ms);
+  date_cache.Refresh(sec);
+  RunAfter(1000 - ms, [this]() { RefreshDate(); });
+}
+
 }  // namespace ahrimq
\ No newline at end of file
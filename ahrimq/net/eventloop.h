@@ -5,13 +5,16 @@
 #include <cstdint>
 #include <functional>
 #include <iostream>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <sstream>
 #include <unordered_map>
 #include <unordered_set>
 #include <utility>
 #include <vector>
 
+#include "base/time_utils.h"
 #include "net/epoller.h"
 #include "net/reactor_conn.h"
 
@@ -20,9 +23,14 @@ namespace ahrimq {
 class Epoller;
 class ReactorConn;
 
+typedef std::function<void()> TimerCallback;
+typedef uint64_t TimerId;
+
 struct EventLoop : public NoCopyable {
   Epoller *epoller = nullptr;
   std::atomic_bool stopped{false};
+  // pre-rendered Date string, refreshed every second by the loop timer
+  time::GMTDateCache date_cache;
 
   EventLoop();
 
@@ -31,6 +39,62 @@ struct EventLoop : public NoCopyable {
   void Loop();
 
   void Stop();
+
+  /// @brief Run callback once after at least delay_ms milliseconds. Timers must be
+  /// added in the loop thread or before the loop starts running.
+  /// @param delay_ms
+  /// @param cb
+  /// @return the id of the timer, which can be used to cancel it
+  TimerId RunAfter(uint64_t delay_ms, TimerCallback cb);
+
+  /// @brief Run callback every interval_ms milliseconds.
+  /// @param interval_ms
+  /// @param cb
+  /// @return the id of the timer, which can be used to cancel it
+  TimerId RunEvery(uint64_t interval_ms, TimerCallback cb);
+
+  /// @brief Cancel the timer with given id, it is fine to cancel a fired timer.
+  /// @param id
+  void CancelTimer(TimerId id);
+
+  /// @brief Run cb in the loop thread as soon as possible. Unlike the timer
+  /// functions, this may be called from any thread; it wakes the loop up through an
+  /// eventfd.
+  /// @param cb
+  void QueueInLoop(std::function<void()> cb);
+
+  /// @brief Return the eventloop running in the calling thread.
+  /// @return nullptr if the calling thread is not running an eventloop
+  static EventLoop *Current();
+
+ private:
+  struct Timer {
+    TimerId id;
+    uint64_t interval_ms;  // 0 for one-shot timer
+    TimerCallback cb;
+  };
+
+  TimerId AddTimer(uint64_t when_ms, uint64_t interval_ms, TimerCallback cb);
+
+  /// @brief Return the epoll timeout decided by the nearest timer.
+  int NextTimeout() const;
+
+  void RunExpiredTimers();
+
+  void RefreshDate();
+
+  void RunQueued();
+
+  // timers ordered by (expiration in ms, timer id)
+  std::map<std::pair<uint64_t, TimerId>, Timer> timers_;
+  // timer id -> expiration, used when cancelling
+  std::unordered_map<TimerId, uint64_t> timer_index_;
+  TimerId next_timer_id_ = 1;
+
+  // eventfd watched by the loop, written by QueueInLoop
+  std::unique_ptr<ReactorConn> wakeup_conn_;
+  std::mutex queue_mtx_;
+  std::vector<std::function<void()>> queued_;
 };
 
 typedef std::shared_ptr<EventLoop> EventLoopPtr;
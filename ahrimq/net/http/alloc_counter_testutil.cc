@@ -0,0 +1,124 @@
+#include "ahrimq/net/http/alloc_counter_testutil.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// Every form of the global operators is replaced, and they are kept out of line so
+// that the compiler pairs new with delete instead of seeing malloc and free.
+static std::atomic<size_t> g_allocs{0};
+
+static void* CountedAlloc(size_t n, size_t align) {
+  g_allocs.fetch_add(1, std::memory_order_relaxed);
+  n = n == 0 ? 1 : n;
+  if (align <= alignof(std::max_align_t)) {
+    return std::malloc(n);
+  }
+  return std::aligned_alloc(align, (n + align - 1) / align * align);
+}
+
+static void* CheckedAlloc(size_t n, size_t align) {
+  void* p = CountedAlloc(n, align);
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+#define AHRIMQ_NOINLINE __attribute__((noinline))
+
+AHRIMQ_NOINLINE void* operator new(size_t n) {
+  return CheckedAlloc(n, 0);
+}
+
+AHRIMQ_NOINLINE void* operator new[](size_t n) {
+  return CheckedAlloc(n, 0);
+}
+
+AHRIMQ_NOINLINE void* operator new(size_t n, std::align_val_t a) {
+  return CheckedAlloc(n, static_cast<size_t>(a));
+}
+
+AHRIMQ_NOINLINE void* operator new[](size_t n, std::align_val_t a) {
+  return CheckedAlloc(n, static_cast<size_t>(a));
+}
+
+AHRIMQ_NOINLINE void* operator new(size_t n, const std::nothrow_t&) noexcept {
+  return CountedAlloc(n, 0);
+}
+
+AHRIMQ_NOINLINE void* operator new[](size_t n, const std::nothrow_t&) noexcept {
+  return CountedAlloc(n, 0);
+}
+
+AHRIMQ_NOINLINE void* operator new(size_t n, std::align_val_t a,
+                                   const std::nothrow_t&) noexcept {
+  return CountedAlloc(n, static_cast<size_t>(a));
+}
+
+AHRIMQ_NOINLINE void* operator new[](size_t n, std::align_val_t a,
+                                     const std::nothrow_t&) noexcept {
+  return CountedAlloc(n, static_cast<size_t>(a));
+}
+
+AHRIMQ_NOINLINE void operator delete(void* p) noexcept {
+  std::free(p);
+}
+
+AHRIMQ_NOINLINE void operator delete[](void* p) noexcept {
+  std::free(p);
+}
+
+AHRIMQ_NOINLINE void operator delete(void* p, size_t) noexcept {
+  std::free(p);
+}
+
+AHRIMQ_NOINLINE void operator delete[](void* p, size_t) noexcept {
+  std::free(p);
+}
+
+AHRIMQ_NOINLINE void operator delete(void* p, std::align_val_t) noexcept {
+  std::free(p);
+}
+
+AHRIMQ_NOINLINE void operator delete[](void* p, std::align_val_t) noexcept {
+  std::free(p);
+}
+
+AHRIMQ_NOINLINE void operator delete(void* p, size_t, std::align_val_t) noexcept {
+  std::free(p);
+}
+
+AHRIMQ_NOINLINE void operator delete[](void* p, size_t, std::align_val_t) noexcept {
+  std::free(p);
+}
+
+AHRIMQ_NOINLINE void operator delete(void* p, const std::nothrow_t&) noexcept {
+  std::free(p);
+}
+
+AHRIMQ_NOINLINE void operator delete[](void* p, const std::nothrow_t&) noexcept {
+  std::free(p);
+}
+
+AHRIMQ_NOINLINE void operator delete(void* p, std::align_val_t,
+                                     const std::nothrow_t&) noexcept {
+  std::free(p);
+}
+
+AHRIMQ_NOINLINE void operator delete[](void* p, std::align_val_t,
+                                       const std::nothrow_t&) noexcept {
+  std::free(p);
+}
+
+#undef AHRIMQ_NOINLINE
+
+namespace ahrimq {
+namespace http {
+
+size_t HeapAllocations() {
+  return g_allocs.load(std::memory_order_relaxed);
+}
+
+}  // namespace http
+}  // namespace ahrimq
@@ -0,0 +1,17 @@
+#ifndef _AHRIMQ_NET_HTTP_ALLOC_COUNTER_TESTUTIL_H_
+#define _AHRIMQ_NET_HTTP_ALLOC_COUNTER_TESTUTIL_H_
+
+#include <cstddef>
+
+namespace ahrimq {
+namespace http {
+
+/// @brief Number of heap allocations made through the global operator new of a
+/// test binary linking alloc_counter_testutil.cc, which replaces every form of it.
+/// @return
+size_t HeapAllocations();
+
+}  // namespace http
+}  // namespace ahrimq
+
+#endif  // _AHRIMQ_NET_HTTP_ALLOC_COUNTER_TESTUTIL_H_
@@ -1,37 +1,58 @@
 #include "net/http/cookie.h"
 
+#include <charconv>
+#include <cstring>
+
 #include "base/str_utils.h"
 
 namespace ahrimq {
 namespace http {
 
-size_t ParseCookieString(const std::string& cookie, std::vector<Cookie>& out) {
-  if (cookie.empty()) {
-    return 0;
-  }
-  size_t sep_idx;
-  size_t start = 0;
-  size_t eq_idx = std::string::npos;
-  size_t nvalid = 0;
-  while ((eq_idx = cookie.find('=', start)) != std::string::npos) {
-    // [start, eq_idx - 1] -> name
-    std::string name = cookie.substr(start, eq_idx - start);
-    if (name.empty()) {
-      return nvalid;
+// Split a Cookie header value like "a=1; b=2" and call fn(name, value) for every
+// pair until fn returns false. Pairs without '=' or with an empty name are skipped
+// and the double quotes around a value are removed (RFC 6265 section 4.1.1).
+template <typename F>
+static size_t ForEachCookie(std::string_view s, F fn) {
+  size_t n = 0;
+  const char* p = s.data();
+  const char* end = p + s.size();
+  while (p < end) {
+    const char* semi = static_cast<const char*>(memchr(p, ';', end - p));
+    const char* stop = semi == nullptr ? end : semi;
+    while (p < stop && (*p == ' ' || *p == '\t')) {
+      p++;
     }
-    // find kCookieSeperator
-    start = eq_idx + 1;
-    if ((sep_idx = cookie.find(kCookieSeperator, start)) == std::string::npos) {
-      // the last cookie pair does not have kCookieSeperator at the end
-      sep_idx = cookie.size();
+    const char* eq = static_cast<const char*>(memchr(p, '=', stop - p));
+    if (eq != nullptr && eq != p) {
+      std::string_view name(p, eq - p);
+      std::string_view value(eq + 1, stop - eq - 1);
+      while (!name.empty() && (name.back() == ' ' || name.back() == '\t')) {
+        name.remove_suffix(1);
+      }
+      while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) {
+        value.remove_prefix(1);
+      }
+      while (!value.empty() && (value.back() == ' ' || value.back() == '\t')) {
+        value.remove_suffix(1);
+      }
+      if (value.size() >= 2 && value.front() == '"' && value.back() == '"') {
+        value = value.substr(1, value.size() - 2);
+      }
+      n++;
+      if (!fn(name, value)) {
+        break;
+      }
     }
-    // [start, sep_idx - 1] -> value
-    std::string value = cookie.substr(start, sep_idx - start);
-    out.emplace_back(std::move(name), std::move(value));
-    nvalid++;
-    start = sep_idx + 2;
+    p = stop + 1;
   }
-  return nvalid;
+  return n;
+}
+
+size_t ParseCookieString(const std::string& cookie, std::vector<Cookie>& out) {
+  return ForEachCookie(cookie, [&out](std::string_view name, std::string_view val) {
+    out.emplace_back(std::string(name), std::string(val));
+    return true;
+  });
 }
 
 size_t ParseCookieString(const std::string& cookie, std::vector<Cookie>& out,
@@ -40,122 +61,131 @@ size_t ParseCookieString(const std::string& cookie, std::vector<Cookie>& out,
   return ParseCookieString(cookie, out);
 }
 
-void Cookie::Serialize(std::string& out) const {
-  if (name_.empty()) {
-    return;
+size_t RequestCookies::Add(std::string_view header) {
+  size_t before = size_;
+  ForEachCookie(header, [this](std::string_view name, std::string_view value) {
+    if (size_ == kMaxCookies) {
+      return false;
+    }
+    pairs_[size_++] = CookieView{name, value};
+    return true;
+  });
+  return size_ - before;
+}
+
+std::string_view RequestCookies::Get(std::string_view name) const {
+  for (size_t i = 0; i < size_; i++) {
+    if (pairs_[i].name == name) {
+      return pairs_[i].value;
+    }
   }
-  out.append(name_);
-  out.push_back('=');
-  out.append(value_);
-  out.append(kCookieSeperator);
+  return {};
+}
+
+bool RequestCookies::Has(std::string_view name) const {
+  for (size_t i = 0; i < size_; i++) {
+    if (pairs_[i].name == name) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static char* CopyTo(char* p, std::string_view s) {
+  memcpy(p, s.data(), s.size());
+  return p + s.size();
+}
+
+// "; " + attribute name + "=", without the value
+constexpr static size_t kMaxAttributeLen = 2 + 9;
+// digits of an int64_t and its sign
+constexpr static size_t kMaxInt64Len = 20;
 
+size_t Cookie::MaxSerializedSize() const {
+  if (name_.empty()) {
+    return 0;
+  }
+  size_t size = name_.size() + 1 + value_.size();
   if (!path_.empty()) {
-    out.append("Path");
-    out.push_back('=');
-    out.append(path_);
-    out.append(kCookieSeperator);
+    size += kMaxAttributeLen + path_.size();
   }
   if (!domain_.empty()) {
-    out.append("Domain");
-    out.push_back('=');
-    out.append(domain_);
-    out.append(kCookieSeperator);
+    size += kMaxAttributeLen + domain_.size();
   }
   if (expireat_set_) {
-    out.append("Expires");
-    out.push_back('=');
-    out.append(expireat_.ToFormatString());
-    out.append(kCookieSeperator);
+    size += kMaxAttributeLen + time::kGMTTimeStringLen;
   }
   if (maxage_set_) {
-    out.append("Max-Age");
-    out.push_back('=');
-    out.append(std::to_string(maxage_));
-    out.append(kCookieSeperator);
+    size += kMaxAttributeLen + kMaxInt64Len;
   }
   if (httponly_) {
-    out.append("HttpOnly");
-    out.append(kCookieSeperator);
+    size += kMaxAttributeLen;
   }
   if (secure_) {
-    out.append("Secure");
-    out.append(kCookieSeperator);
+    size += kMaxAttributeLen;
   }
   if (samesite_set_) {
-    out.append("SameSite");
-    out.push_back('=');
-    if (samesite_ == SameSite::Lax) {
-      out.append("Lax");
-    } else if (samesite_ == SameSite::Strict) {
-      out.append("Strict");
-    } else {
-      out.append("None");
-    }
-    out.append(kCookieSeperator);
-  }
-  // remove trailing kCookieSeperator
-  if (out.back() == ' ' && out[out.size() - 2] == ';') {
-    out.erase(out.size() - 2, 2);
+    size += kMaxAttributeLen + 6;
   }
+  return size;
 }
 
-void Cookie::Serialize(Buffer& out) const {
+char* Cookie::SerializeTo(char* p) const {
   if (name_.empty()) {
-    return;
+    return p;
   }
-  out.Append(name_);
-  out.Append("=");
-  out.Append(value_);
-  out.Append(kCookieSeperator);
-
+  p = CopyTo(p, name_);
+  *p++ = '=';
+  p = CopyTo(p, value_);
   if (!path_.empty()) {
-    out.Append("Path");
-    out.Append("=");
-    out.Append(path_);
-    out.Append(kCookieSeperator);
+    p = CopyTo(p, "; Path=");
+    p = CopyTo(p, path_);
   }
   if (!domain_.empty()) {
-    out.Append("Domain");
-    out.Append("=");
-    out.Append(domain_);
-    out.Append(kCookieSeperator);
+    p = CopyTo(p, "; Domain=");
+    p = CopyTo(p, domain_);
   }
   if (expireat_set_) {
-    out.Append("Expires");
-    out.Append("=");
-    out.Append(expireat_.ToFormatString());
-    out.Append(kCookieSeperator);
+    // cookies of a response usually expire at the same second
+    thread_local time::GMTDateCache expires;
+    expires.Refresh(expireat_.ToTimeT());
+    p = CopyTo(p, "; Expires=");
+    p = CopyTo(p, std::string_view(expires.Data(), expires.Size()));
   }
   if (maxage_set_) {
-    out.Append("Max-Age");
-    out.Append("=");
-    out.Append(std::to_string(maxage_));
-    out.Append(kCookieSeperator);
+    p = CopyTo(p, "; Max-Age=");
+    p = std::to_chars(p, p + kMaxInt64Len, maxage_).ptr;
   }
   if (httponly_) {
-    out.Append("HttpOnly");
-    out.Append(kCookieSeperator);
+    p = CopyTo(p, "; HttpOnly");
   }
   if (secure_) {
-    out.Append("Secure");
-    out.Append(kCookieSeperator);
+    p = CopyTo(p, "; Secure");
   }
   if (samesite_set_) {
-    out.Append("SameSite");
-    out.Append("=");
+    p = CopyTo(p, "; SameSite=");
     if (samesite_ == SameSite::Lax) {
-      out.Append("Lax");
+      p = CopyTo(p, "Lax");
     } else if (samesite_ == SameSite::Strict) {
-      out.Append("Strict");
+      p = CopyTo(p, "Strict");
     } else {
-      out.Append("None");
+      p = CopyTo(p, "None");
     }
-    out.Append(kCookieSeperator);
-  }
-  // remove trailing kCookieSeperator
-  if (out.ReadableCharacterAt(out.Size() - 1) == ' ' && out.ReadableCharacterAt(out.Size() - 2) == ';') {
-    out.WriterIdxBackward(2);
   }
+  return p;
+}
+
+void Cookie::Serialize(std::string& out) const {
+  size_t old = out.size();
+  out.resize(old + MaxSerializedSize());
+  char* begin = out.data() + old;
+  out.resize(old + (SerializeTo(begin) - begin));
+}
+
+void Cookie::Serialize(Buffer& out) const {
+  out.EnsureBytesForWrite(MaxSerializedSize());
+  char* begin = out.BeginWritePointer();
+  out.WriterIdxForward(SerializeTo(begin) - begin);
 }
 
 std::ostream& operator<<(std::ostream& os, const Cookie& cookie) {
@@ -1,10 +1,12 @@
 #ifndef _AHRIMQ_NET_HTTP_COOKIE_H_
 #define _AHRIMQ_NET_HTTP_COOKIE_H_
 
-#include <unordered_map>
-#include <vector>
+#include <array>
 #include <ostream>
 #include <sstream>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
 
 #include "base/time_utils.h"
 #include "buffer/buffer.h"
@@ -29,6 +31,58 @@ size_t ParseCookieString(const std::string& cookie, std::vector<Cookie>& out);
 /// @return 
 size_t ParseCookieString(const std::string& cookie, std::vector<Cookie>& out, size_t estimate);
 
+/// @brief A name/value pair of a request Cookie header, viewing the header value.
+struct CookieView {
+  std::string_view name;
+  std::string_view value;
+};
+
+/// @brief RequestCookies holds the cookies sent with a request as views into its
+/// Cookie header. Pairs are kept in a fixed array, so splitting a header never
+/// allocates, and at most kMaxCookies pairs are taken from a request, the rest is
+/// ignored.
+class RequestCookies {
+ public:
+  constexpr static size_t kMaxCookies = 64;
+
+  /// @brief Split a Cookie header value into pairs and append them. Values keep
+  /// pointing into header, which must outlive the pairs.
+  /// @param header a Cookie header value like "a=1; b=2"
+  /// @return the number of pairs taken
+  size_t Add(std::string_view header);
+
+  /// @brief Get the value of the first cookie with given name.
+  /// @param name
+  /// @return an empty view if the cookie does not exist
+  std::string_view Get(std::string_view name) const;
+
+  bool Has(std::string_view name) const;
+
+  void Clear() {
+    size_ = 0;
+  }
+
+  size_t Size() const {
+    return size_;
+  }
+
+  bool Empty() const {
+    return size_ == 0;
+  }
+
+  const CookieView* begin() const {
+    return pairs_.data();
+  }
+
+  const CookieView* end() const {
+    return pairs_.data() + size_;
+  }
+
+ private:
+  std::array<CookieView, kMaxCookies> pairs_;
+  size_t size_ = 0;
+};
+
 /// @brief HTTP cookie
 class Cookie {
  public:
@@ -126,6 +180,18 @@ class Cookie {
   /// @param out 
   void Serialize(Buffer& out) const;
 
+  /// @brief An upper bound of the serialized size, for reserving space before
+  /// calling SerializeTo().
+  /// @return
+  size_t MaxSerializedSize() const;
+
+  /// @brief Serialize cookie instance into p, which must have room for
+  /// MaxSerializedSize() bytes. Expires dates are rendered through a per-thread
+  /// date cache, so cookies sharing an expiry second are formatted once.
+  /// @param p
+  /// @return the end of the written bytes
+  char* SerializeTo(char* p) const;
+
   friend std::ostream& operator<<(std::ostream& os, const Cookie& cookie);
 
  private:
@@ -25,6 +25,61 @@ TEST(CookieTest, ParseCookieStringTest) {
   for (auto& cookie : cookies) {
     std::cout << cookie << '\n';
   }
+  EXPECT_EQ(n, 28);
+  EXPECT_EQ(cookies[1].Name(), "buvid3");
+  EXPECT_EQ(cookies.back().Value(), "760205663980748800");
+}
+
+TEST(CookieTest, RequestCookiesTest) {
+  ahrimq::http::RequestCookies cookies;
+  EXPECT_EQ(cookies.Add("a=1; b=\"two\";c = 3 ;; noeq; =empty; d="), 4);
+  EXPECT_EQ(cookies.Get("a"), "1");
+  EXPECT_EQ(cookies.Get("b"), "two");
+  EXPECT_EQ(cookies.Get("c"), "3");
+  EXPECT_TRUE(cookies.Has("d"));
+  EXPECT_EQ(cookies.Get("d"), "");
+  EXPECT_FALSE(cookies.Has("noeq"));
+  EXPECT_FALSE(cookies.Has("e"));
+
+  // pairs beyond the limit are dropped
+  std::string many;
+  for (int i = 0; i < 100; i++) {
+    many += "k" + std::to_string(i) + "=v; ";
+  }
+  cookies.Clear();
+  EXPECT_EQ(cookies.Add(many), ahrimq::http::RequestCookies::kMaxCookies);
+  EXPECT_EQ(cookies.Size(), ahrimq::http::RequestCookies::kMaxCookies);
+  EXPECT_TRUE(cookies.Has("k63"));
+  EXPECT_FALSE(cookies.Has("k64"));
+}
+
+TEST(CookieTest, SerializeTest) {
+  ahrimq::http::Cookie cookie("name", "ryan");
+  cookie.SetPath("/");
+  cookie.SetDomain("example.com");
+  cookie.SetExpireAt(ahrimq::time::UTCTimePoint(1994, ahrimq::time::Month::Nov, 6, 8,
+                                                49, 37));
+  cookie.SetMaxAge(-1);
+  cookie.SetHttpOnly(true);
+  cookie.SetSecure(true);
+  cookie.SetSameSite(ahrimq::http::Cookie::SameSite::Strict);
+  const std::string expected =
+      "name=ryan; Path=/; Domain=example.com; "
+      "Expires=Sun, 06 Nov 1994 08:49:37 GMT; Max-Age=-1; HttpOnly; Secure; "
+      "SameSite=Strict";
+  std::string out = "Set-Cookie: ";
+  cookie.Serialize(out);
+  EXPECT_EQ(out, "Set-Cookie: " + expected);
+  EXPECT_LE(expected.size(), cookie.MaxSerializedSize());
+
+  ahrimq::Buffer buf;
+  cookie.Serialize(buf);
+  EXPECT_EQ(buf.ReadableAsString(), expected);
+
+  ahrimq::http::Cookie plain("a", "b");
+  out.clear();
+  plain.Serialize(out);
+  EXPECT_EQ(out, "a=b");
 }
 
 int main(int argc, char** argv) {
@@ -0,0 +1,470 @@
+#include "net/http/hpack.h"
+
+#include <algorithm>
+#include <array>
+#include <vector>
+
+namespace ahrimq {
+namespace http {
+
+// RFC 7541 Appendix B, the code of every byte value, EOS is left out
+static const uint32_t kHuffmanCodes[256] = {
+    0x1ff8, 0x7fffd8, 0xfffffe2, 0xfffffe3, 0xfffffe4, 0xfffffe5, 0xfffffe6,
+    0xfffffe7, 0xfffffe8, 0xffffea, 0x3ffffffc, 0xfffffe9, 0xfffffea, 0x3ffffffd,
+    0xfffffeb, 0xfffffec, 0xfffffed, 0xfffffee, 0xfffffef, 0xffffff0, 0xffffff1,
+    0xffffff2, 0x3ffffffe, 0xffffff3, 0xffffff4, 0xffffff5, 0xffffff6, 0xffffff7,
+    0xffffff8, 0xffffff9, 0xffffffa, 0xffffffb, 0x14, 0x3f8, 0x3f9,
+    0xffa, 0x1ff9, 0x15, 0xf8, 0x7fa, 0x3fa, 0x3fb,
+    0xf9, 0x7fb, 0xfa, 0x16, 0x17, 0x18, 0x0,
+    0x1, 0x2, 0x19, 0x1a, 0x1b, 0x1c, 0x1d,
+    0x1e, 0x1f, 0x5c, 0xfb, 0x7ffc, 0x20, 0xffb,
+    0x3fc, 0x1ffa, 0x21, 0x5d, 0x5e, 0x5f, 0x60,
+    0x61, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67,
+    0x68, 0x69, 0x6a, 0x6b, 0x6c, 0x6d, 0x6e,
+    0x6f, 0x70, 0x71, 0x72, 0xfc, 0x73, 0xfd,
+    0x1ffb, 0x7fff0, 0x1ffc, 0x3ffc, 0x22, 0x7ffd, 0x3,
+    0x23, 0x4, 0x24, 0x5, 0x25, 0x26, 0x27,
+    0x6, 0x74, 0x75, 0x28, 0x29, 0x2a, 0x7,
+    0x2b, 0x76, 0x2c, 0x8, 0x9, 0x2d, 0x77,
+    0x78, 0x79, 0x7a, 0x7b, 0x7ffe, 0x7fc, 0x3ffd,
+    0x1ffd, 0xffffffc, 0xfffe6, 0x3fffd2, 0xfffe7, 0xfffe8, 0x3fffd3,
+    0x3fffd4, 0x3fffd5, 0x7fffd9, 0x3fffd6, 0x7fffda, 0x7fffdb, 0x7fffdc,
+    0x7fffdd, 0x7fffde, 0xffffeb, 0x7fffdf, 0xffffec, 0xffffed, 0x3fffd7,
+    0x7fffe0, 0xffffee, 0x7fffe1, 0x7fffe2, 0x7fffe3, 0x7fffe4, 0x1fffdc,
+    0x3fffd8, 0x7fffe5, 0x3fffd9, 0x7fffe6, 0x7fffe7, 0xffffef, 0x3fffda,
+    0x1fffdd, 0xfffe9, 0x3fffdb, 0x3fffdc, 0x7fffe8, 0x7fffe9, 0x1fffde,
+    0x7fffea, 0x3fffdd, 0x3fffde, 0xfffff0, 0x1fffdf, 0x3fffdf, 0x7fffeb,
+    0x7fffec, 0x1fffe0, 0x1fffe1, 0x3fffe0, 0x1fffe2, 0x7fffed, 0x3fffe1,
+    0x7fffee, 0x7fffef, 0xfffea, 0x3fffe2, 0x3fffe3, 0x3fffe4, 0x7ffff0,
+    0x3fffe5, 0x3fffe6, 0x7ffff1, 0x3ffffe0, 0x3ffffe1, 0xfffeb, 0x7fff1,
+    0x3fffe7, 0x7ffff2, 0x3fffe8, 0x1ffffec, 0x3ffffe2, 0x3ffffe3, 0x3ffffe4,
+    0x7ffffde, 0x7ffffdf, 0x3ffffe5, 0xfffff1, 0x1ffffed, 0x7fff2, 0x1fffe3,
+    0x3ffffe6, 0x7ffffe0, 0x7ffffe1, 0x3ffffe7, 0x7ffffe2, 0xfffff2, 0x1fffe4,
+    0x1fffe5, 0x3ffffe8, 0x3ffffe9, 0xffffffd, 0x7ffffe3, 0x7ffffe4, 0x7ffffe5,
+    0xfffec, 0xfffff3, 0xfffed, 0x1fffe6, 0x3fffe9, 0x1fffe7, 0x1fffe8,
+    0x7ffff3, 0x3fffea, 0x3fffeb, 0x1ffffee, 0x1ffffef, 0xfffff4, 0xfffff5,
+    0x3ffffea, 0x7ffff4, 0x3ffffeb, 0x7ffffe6, 0x3ffffec, 0x3ffffed, 0x7ffffe7,
+    0x7ffffe8, 0x7ffffe9, 0x7ffffea, 0x7ffffeb, 0xffffffe, 0x7ffffec, 0x7ffffed,
+    0x7ffffee, 0x7ffffef, 0x7fffff0, 0x3ffffee,
+};
+
+static const uint8_t kHuffmanCodeLen[256] = {
+    13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28, 28, 28, 28, 28,
+    28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28, 6, 10, 10, 12, 13, 6, 8, 11,
+    10, 10, 8, 11, 8, 6, 6, 6, 5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8,
+    15, 6, 12, 10, 13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6, 15, 5, 6, 5,
+    6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5, 6, 7, 6, 5, 5, 6, 7, 7,
+    7, 7, 7, 15, 11, 14, 13, 28, 20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23,
+    23, 23, 24, 23, 24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+    22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23, 21, 21, 22, 21,
+    23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23, 26, 26, 20, 19, 22, 23, 22, 25,
+    26, 26, 26, 27, 27, 26, 24, 25, 19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26,
+    28, 27, 27, 27, 20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+    26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+};
+
+// RFC 7541 Appendix A
+static const std::pair<std::string_view, std::string_view>
+    kStaticTable[kHPACKStaticTableSize] = {
+        {":authority", ""},
+        {":method", "GET"},
+        {":method", "POST"},
+        {":path", "/"},
+        {":path", "/index.html"},
+        {":scheme", "http"},
+        {":scheme", "https"},
+        {":status", "200"},
+        {":status", "204"},
+        {":status", "206"},
+        {":status", "304"},
+        {":status", "400"},
+        {":status", "404"},
+        {":status", "500"},
+        {"accept-charset", ""},
+        {"accept-encoding", "gzip, deflate"},
+        {"accept-language", ""},
+        {"accept-ranges", ""},
+        {"accept", ""},
+        {"access-control-allow-origin", ""},
+        {"age", ""},
+        {"allow", ""},
+        {"authorization", ""},
+        {"cache-control", ""},
+        {"content-disposition", ""},
+        {"content-encoding", ""},
+        {"content-language", ""},
+        {"content-length", ""},
+        {"content-location", ""},
+        {"content-range", ""},
+        {"content-type", ""},
+        {"cookie", ""},
+        {"date", ""},
+        {"etag", ""},
+        {"expect", ""},
+        {"expires", ""},
+        {"from", ""},
+        {"host", ""},
+        {"if-match", ""},
+        {"if-modified-since", ""},
+        {"if-none-match", ""},
+        {"if-range", ""},
+        {"if-unmodified-since", ""},
+        {"last-modified", ""},
+        {"link", ""},
+        {"location", ""},
+        {"max-forwards", ""},
+        {"proxy-authenticate", ""},
+        {"proxy-authorization", ""},
+        {"range", ""},
+        {"referer", ""},
+        {"refresh", ""},
+        {"retry-after", ""},
+        {"server", ""},
+        {"set-cookie", ""},
+        {"strict-transport-security", ""},
+        {"transfer-encoding", ""},
+        {"user-agent", ""},
+        {"vary", ""},
+        {"via", ""},
+        {"www-authenticate", ""},
+};
+
+// The decoding tree consumes 8 bits per level. A slot either leads to the next
+// level or holds a symbol whose code ends within the slot, in which case every
+// slot sharing the code as prefix holds the same symbol.
+struct HuffmanSlot {
+  uint16_t next = 0;  // index of the next level, 0 if none
+  uint8_t sym = 0;
+  uint8_t len = 0;  // bits of the code within this level, 0 if not a symbol
+};
+
+typedef std::array<HuffmanSlot, 256> HuffmanLevel;
+
+static std::vector<HuffmanLevel> BuildHuffmanTree() {
+  std::vector<HuffmanLevel> tree(1);
+  for (int sym = 0; sym < 256; sym++) {
+    uint32_t code = kHuffmanCodes[sym];
+    int len = kHuffmanCodeLen[sym];
+    size_t cur = 0;
+    while (len > 8) {
+      len -= 8;
+      uint8_t i = static_cast<uint8_t>(code >> len);
+      if (tree[cur][i].next == 0) {
+        tree[cur][i].next = static_cast<uint16_t>(tree.size());
+        tree.emplace_back();
+      }
+      cur = tree[cur][i].next;
+    }
+    int shift = 8 - len;
+    size_t start = static_cast<uint8_t>(code << shift);
+    for (size_t i = start; i < start + (1u << shift); i++) {
+      tree[cur][i].sym = static_cast<uint8_t>(sym);
+      tree[cur][i].len = static_cast<uint8_t>(len);
+    }
+  }
+  return tree;
+}
+
+bool HuffmanDecode(std::string_view in, std::string& out) {
+  static const std::vector<HuffmanLevel> tree = BuildHuffmanTree();
+  size_t level = 0;
+  uint64_t cur = 0;
+  // bits in cur not consumed yet, and bits since the last complete symbol
+  unsigned cbits = 0;
+  unsigned sbits = 0;
+  for (unsigned char b : in) {
+    cur = cur << 8 | b;
+    cbits += 8;
+    sbits += 8;
+    while (cbits >= 8) {
+      uint8_t i = static_cast<uint8_t>(cur >> (cbits - 8));
+      const HuffmanSlot& slot = tree[level][i];
+      if (slot.len != 0) {
+        out.push_back(static_cast<char>(slot.sym));
+        cbits -= slot.len;
+        level = 0;
+        sbits = cbits;
+      } else if (slot.next != 0) {
+        level = slot.next;
+        cbits -= 8;
+      } else {
+        return false;
+      }
+    }
+  }
+  while (cbits > 0) {
+    const HuffmanSlot& slot = tree[level][static_cast<uint8_t>(cur << (8 - cbits))];
+    if (slot.len == 0 || slot.len > cbits) {
+      break;
+    }
+    out.push_back(static_cast<char>(slot.sym));
+    cbits -= slot.len;
+    level = 0;
+    sbits = cbits;
+  }
+  // the padding is shorter than a byte and a prefix of EOS, i.e. all ones
+  uint64_t mask = (uint64_t(1) << cbits) - 1;
+  return sbits <= 7 && (cur & mask) == mask;
+}
+
+size_t HuffmanEncodedLength(std::string_view in) {
+  size_t bits = 0;
+  for (unsigned char c : in) {
+    bits += kHuffmanCodeLen[c];
+  }
+  return (bits + 7) / 8;
+}
+
+void HuffmanEncode(std::string_view in, std::string& out) {
+  uint64_t cur = 0;
+  unsigned nbits = 0;
+  for (unsigned char c : in) {
+    cur = cur << kHuffmanCodeLen[c] | kHuffmanCodes[c];
+    nbits += kHuffmanCodeLen[c];
+    while (nbits >= 8) {
+      nbits -= 8;
+      out.push_back(static_cast<char>(cur >> nbits));
+    }
+  }
+  if (nbits > 0) {
+    // pad with the most significant bits of EOS
+    out.push_back(static_cast<char>(cur << (8 - nbits) | (0xff >> nbits)));
+  }
+}
+
+static void EncodeInteger(uint64_t v, int prefix, uint8_t flags, std::string& out) {
+  uint64_t max = (uint64_t(1) << prefix) - 1;
+  if (v < max) {
+    out.push_back(static_cast<char>(flags | v));
+    return;
+  }
+  out.push_back(static_cast<char>(flags | max));
+  v -= max;
+  while (v >= 128) {
+    out.push_back(static_cast<char>((v & 0x7f) | 0x80));
+    v >>= 7;
+  }
+  out.push_back(static_cast<char>(v));
+}
+
+static bool DecodeInteger(std::string_view& block, int prefix, uint64_t& out) {
+  if (block.empty()) {
+    return false;
+  }
+  uint64_t max = (uint64_t(1) << prefix) - 1;
+  uint64_t v = static_cast<uint8_t>(block[0]) & max;
+  block.remove_prefix(1);
+  if (v < max) {
+    out = v;
+    return true;
+  }
+  // up to 4 continuation bytes, far more than any sane length or index
+  for (int shift = 0; shift <= 21; shift += 7) {
+    if (block.empty()) {
+      return false;
+    }
+    uint8_t b = static_cast<uint8_t>(block[0]);
+    block.remove_prefix(1);
+    v += uint64_t(b & 0x7f) << shift;
+    if ((b & 0x80) == 0) {
+      out = v;
+      return true;
+    }
+  }
+  return false;
+}
+
+void HPACKTable::Add(std::string_view name, std::string_view value) {
+  size_t need = name.size() + value.size() + 32;
+  if (need > max_size_) {
+    entries_.clear();
+    size_ = 0;
+    return;
+  }
+  // copied before evicting, name may refer to an entry about to be evicted
+  Entry entry(name, value);
+  Evict(need);
+  entries_.push_front(std::move(entry));
+  size_ += need;
+}
+
+void HPACKTable::SetMaxSize(size_t max_size) {
+  max_size_ = max_size;
+  Evict(0);
+}
+
+void HPACKTable::Evict(size_t need) {
+  while (!entries_.empty() && size_ + need > max_size_) {
+    const Entry& oldest = entries_.back();
+    size_ -= oldest.first.size() + oldest.second.size() + 32;
+    entries_.pop_back();
+  }
+}
+
+bool HPACKDecoder::Lookup(uint64_t index, std::string_view& name,
+                          std::string_view& value) const {
+  if (index == 0) {
+    return false;
+  }
+  if (index <= kHPACKStaticTableSize) {
+    name = kStaticTable[index - 1].first;
+    value = kStaticTable[index - 1].second;
+    return true;
+  }
+  index -= kHPACKStaticTableSize + 1;
+  if (index >= table_.Count()) {
+    return false;
+  }
+  name = table_.At(index).first;
+  value = table_.At(index).second;
+  return true;
+}
+
+bool HPACKDecoder::String(std::string_view& block, std::string& out,
+                          std::string_view& view) {
+  if (block.empty()) {
+    return false;
+  }
+  bool huffman = (block[0] & 0x80) != 0;
+  uint64_t len;
+  if (!DecodeInteger(block, 7, len) || len > block.size()) {
+    return false;
+  }
+  std::string_view raw = block.substr(0, len);
+  block.remove_prefix(len);
+  if (!huffman) {
+    view = raw;
+    return true;
+  }
+  out.clear();
+  if (!HuffmanDecode(raw, out)) {
+    return false;
+  }
+  view = out;
+  return true;
+}
+
+HPACKDecoder::Result HPACKDecoder::Next(std::string_view& block, bool first,
+                                        std::string_view& name,
+                                        std::string_view& value) {
+  uint8_t b = static_cast<uint8_t>(block[0]);
+  uint64_t index;
+  if (b & 0x80) {
+    // indexed header field
+    if (!DecodeInteger(block, 7, index) || !Lookup(index, name, value)) {
+      return Result::Error;
+    }
+    return Result::Field;
+  }
+  if ((b & 0xe0) == 0x20) {
+    // dynamic table size update, only allowed before the first field
+    uint64_t size;
+    if (!first || !DecodeInteger(block, 5, size) || size > max_table_size_) {
+      return Result::Error;
+    }
+    table_.SetMaxSize(size);
+    return Result::SizeUpdate;
+  }
+  bool indexing = (b & 0xc0) == 0x40;
+  if (!DecodeInteger(block, indexing ? 6 : 4, index)) {
+    return Result::Error;
+  }
+  std::string_view unused;
+  if (index == 0 ? !String(block, name_buf_, name) : !Lookup(index, name, unused)) {
+    return Result::Error;
+  }
+  if (!String(block, value_buf_, value)) {
+    return Result::Error;
+  }
+  if (indexing) {
+    table_.Add(name, value);
+    if (table_.Count() > 0) {
+      // the views may have pointed into an evicted entry
+      name = table_.At(0).first;
+      value = table_.At(0).second;
+    }
+  }
+  return Result::Field;
+}
+
+void HPACKEncoder::SetMaxTableSize(size_t max_size) {
+  max_size = std::min(max_size, kHPACKDefaultTableSize);
+  if (max_size == table_.MaxSize()) {
+    return;
+  }
+  table_.SetMaxSize(max_size);
+  min_pending_size_ = std::min(min_pending_size_, max_size);
+  size_changed_ = true;
+}
+
+void HPACKEncoder::BeginBlock(std::string& out) {
+  if (!size_changed_) {
+    return;
+  }
+  if (min_pending_size_ < table_.MaxSize()) {
+    EncodeInteger(min_pending_size_, 5, 0x20, out);
+  }
+  EncodeInteger(table_.MaxSize(), 5, 0x20, out);
+  min_pending_size_ = SIZE_MAX;
+  size_changed_ = false;
+}
+
+void HPACKEncoder::String(std::string_view s, std::string& out) {
+  size_t huffman_len = HuffmanEncodedLength(s);
+  if (huffman_len < s.size()) {
+    EncodeInteger(huffman_len, 7, 0x80, out);
+    HuffmanEncode(s, out);
+  } else {
+    EncodeInteger(s.size(), 7, 0x00, out);
+    out.append(s.data(), s.size());
+  }
+}
+
+void HPACKEncoder::Encode(std::string_view name, std::string_view value,
+                          HPACKIndexing indexing, std::string& out) {
+  uint64_t name_index = 0;
+  for (size_t i = 0; i < kHPACKStaticTableSize; i++) {
+    if (kStaticTable[i].first != name) {
+      continue;
+    }
+    if (kStaticTable[i].second == value) {
+      EncodeInteger(i + 1, 7, 0x80, out);
+      return;
+    }
+    if (name_index == 0) {
+      name_index = i + 1;
+    }
+  }
+  if (indexing != HPACKIndexing::Never) {
+    for (size_t i = 0; i < table_.Count(); i++) {
+      const HPACKTable::Entry& entry = table_.At(i);
+      if (entry.first != name) {
+        continue;
+      }
+      if (entry.second == value) {
+        EncodeInteger(kHPACKStaticTableSize + 1 + i, 7, 0x80, out);
+        return;
+      }
+      if (name_index == 0) {
+        name_index = kHPACKStaticTableSize + 1 + i;
+      }
+    }
+  }
+  if (indexing == HPACKIndexing::Incremental) {
+    EncodeInteger(name_index, 6, 0x40, out);
+  } else {
+    uint8_t flags = indexing == HPACKIndexing::Never ? 0x10 : 0x00;
+    EncodeInteger(name_index, 4, flags, out);
+  }
+  if (name_index == 0) {
+    String(name, out);
+  }
+  String(value, out);
+  if (indexing == HPACKIndexing::Incremental) {
+    table_.Add(name, value);
+  }
+}
+
+}  // namespace http
+}  // namespace ahrimq
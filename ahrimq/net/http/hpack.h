@@ -0,0 +1,197 @@
+#ifndef _AHRIMQ_NET_HTTP_HPACK_H_
+#define _AHRIMQ_NET_HTTP_HPACK_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <utility>
+
+namespace ahrimq {
+namespace http {
+
+/// @brief Dynamic table size both ends start with (RFC 7541 section 4.2).
+constexpr static size_t kHPACKDefaultTableSize = 4096;
+
+/// @brief Number of entries of the static table, the dynamic table is addressed
+/// from kHPACKStaticTableSize + 1 on.
+constexpr static size_t kHPACKStaticTableSize = 61;
+
+/// @brief Decode a Huffman coded string (RFC 7541 section 5.2) and append it to out.
+/// @param in
+/// @param out
+/// @return false if in is not a valid code, e.g. it ends with more than 7 bits of
+/// padding or contains the EOS symbol
+bool HuffmanDecode(std::string_view in, std::string& out);
+
+/// @brief Return the number of bytes the Huffman code of in takes.
+/// @param in
+/// @return
+size_t HuffmanEncodedLength(std::string_view in);
+
+/// @brief Append the Huffman code of in to out.
+/// @param in
+/// @param out
+void HuffmanEncode(std::string_view in, std::string& out);
+
+/// @brief HPACKTable is the dynamic table of one direction of a connection (RFC
+/// 7541 section 2.3.2). Entries are kept newest first, each one counts its name and
+/// value plus 32 bytes against the maximum size, and the oldest are evicted when a
+/// new entry does not fit.
+class HPACKTable {
+ public:
+  typedef std::pair<std::string, std::string> Entry;
+
+  explicit HPACKTable(size_t max_size = kHPACKDefaultTableSize)
+      : max_size_(max_size) {}
+
+  /// @brief Insert a field as the newest entry. A field larger than the maximum
+  /// size empties the table and is not inserted.
+  /// @param name
+  /// @param value
+  void Add(std::string_view name, std::string_view value);
+
+  /// @brief Change the maximum size, evicting entries which do not fit any more.
+  /// @param max_size
+  void SetMaxSize(size_t max_size);
+
+  /// @brief Return the entry at index, 0 is the newest one.
+  /// @param index
+  /// @return
+  const Entry& At(size_t index) const {
+    return entries_[index];
+  }
+
+  size_t Count() const {
+    return entries_.size();
+  }
+
+  size_t Size() const {
+    return size_;
+  }
+
+  size_t MaxSize() const {
+    return max_size_;
+  }
+
+ private:
+  // evict the oldest entries until size_ + need fits
+  void Evict(size_t need);
+
+ private:
+  std::deque<Entry> entries_;
+  size_t size_ = 0;
+  size_t max_size_;
+};
+
+/// @brief HPACKDecoder decodes the header blocks received on a connection. Its
+/// dynamic table is shared by every block, so every block has to be decoded in the
+/// order it was received, even the blocks of refused streams.
+class HPACKDecoder {
+ public:
+  /// @brief Construct a decoder.
+  /// @param max_table_size the SETTINGS_HEADER_TABLE_SIZE sent to the peer
+  explicit HPACKDecoder(size_t max_table_size = kHPACKDefaultTableSize)
+      : table_(max_table_size), max_table_size_(max_table_size) {}
+
+  /// @brief Decode a complete header block. emit(name, value) is called for every
+  /// field, the views are only valid during the call.
+  /// @param block
+  /// @param emit
+  /// @return false on a decoding error, which is a connection error of type
+  /// COMPRESSION_ERROR
+  template <typename F>
+  bool Decode(std::string_view block, F&& emit) {
+    bool first = true;
+    while (!block.empty()) {
+      std::string_view name, value;
+      Result res = Next(block, first, name, value);
+      if (res == Result::Error) {
+        return false;
+      }
+      if (res == Result::Field) {
+        emit(name, value);
+        first = false;
+      }
+    }
+    return true;
+  }
+
+  const HPACKTable& Table() const {
+    return table_;
+  }
+
+ private:
+  enum class Result { Field, SizeUpdate, Error };
+
+  // decode one representation at the front of block and advance block past it
+  Result Next(std::string_view& block, bool first, std::string_view& name,
+              std::string_view& value);
+
+  // decode a string literal into out, or view it in place if it is not Huffman
+  // coded
+  bool String(std::string_view& block, std::string& out, std::string_view& view);
+
+  // resolve an index of the static or the dynamic table
+  bool Lookup(uint64_t index, std::string_view& name, std::string_view& value) const;
+
+ private:
+  HPACKTable table_;
+  size_t max_table_size_;
+  // storage of decoded Huffman strings, reused for every field
+  std::string name_buf_;
+  std::string value_buf_;
+};
+
+/// @brief How an encoded field may be kept by the peer (RFC 7541 section 6.2).
+enum class HPACKIndexing {
+  // inserted into the dynamic table, for fields repeated across messages
+  Incremental,
+  // not inserted, for values that change from message to message
+  None,
+  // not inserted by any intermediary either, for sensitive values
+  Never,
+};
+
+/// @brief HPACKEncoder encodes the header blocks sent on a connection.
+class HPACKEncoder {
+ public:
+  /// @brief Apply the SETTINGS_HEADER_TABLE_SIZE of the peer. The encoder uses at
+  /// most kHPACKDefaultTableSize bytes and signals a change of its table size at the
+  /// start of the next block.
+  /// @param max_size
+  void SetMaxTableSize(size_t max_size);
+
+  /// @brief Start a new header block in out.
+  /// @param out
+  void BeginBlock(std::string& out);
+
+  /// @brief Append the representation of a field to out. name must be lowercase.
+  /// @param name
+  /// @param value
+  /// @param indexing
+  /// @param out
+  void Encode(std::string_view name, std::string_view value, HPACKIndexing indexing,
+              std::string& out);
+
+  const HPACKTable& Table() const {
+    return table_;
+  }
+
+ private:
+  // append a string literal, Huffman coded if that is shorter
+  static void String(std::string_view s, std::string& out);
+
+ private:
+  HPACKTable table_;
+  // the smallest and the last size set since the previous block, both have to be
+  // signalled (RFC 7541 section 4.2)
+  size_t min_pending_size_ = SIZE_MAX;
+  bool size_changed_ = false;
+};
+
+}  // namespace http
+}  // namespace ahrimq
+
+#endif  // _AHRIMQ_NET_HTTP_HPACK_H_
@@ -0,0 +1,152 @@
+#include "ahrimq/net/http/hpack.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace ahrimq::http;
+
+typedef std::vector<std::pair<std::string, std::string>> Fields;
+
+static std::string FromHex(const std::string& hex) {
+  std::string out;
+  for (size_t i = 0; i + 1 < hex.size(); i += 2) {
+    out.push_back(static_cast<char>(std::stoi(hex.substr(i, 2), nullptr, 16)));
+  }
+  return out;
+}
+
+static bool Decode(HPACKDecoder& decoder, const std::string& block, Fields& fields) {
+  fields.clear();
+  return decoder.Decode(block, [&](std::string_view name, std::string_view value) {
+    fields.emplace_back(std::string(name), std::string(value));
+  });
+}
+
+// RFC 7541 Appendix C.3 and C.4, the same requests without and with Huffman
+// coding
+static const Fields kRequest1 = {{":method", "GET"},
+                                 {":scheme", "http"},
+                                 {":path", "/"},
+                                 {":authority", "www.example.com"}};
+static const Fields kRequest2 = {{":method", "GET"},
+                                 {":scheme", "http"},
+                                 {":path", "/"},
+                                 {":authority", "www.example.com"},
+                                 {"cache-control", "no-cache"}};
+static const Fields kRequest3 = {{":method", "GET"},
+                                 {":scheme", "https"},
+                                 {":path", "/index.html"},
+                                 {":authority", "www.example.com"},
+                                 {"custom-key", "custom-value"}};
+
+TEST(HPACKTest, DecodeRequestsTest) {
+  HPACKDecoder decoder;
+  Fields fields;
+  ASSERT_TRUE(
+      Decode(decoder, FromHex("828684410f7777772e6578616d706c652e636f6d"), fields));
+  EXPECT_EQ(fields, kRequest1);
+  EXPECT_EQ(decoder.Table().Size(), 57u);
+  ASSERT_TRUE(Decode(decoder, FromHex("828684be58086e6f2d6361636865"), fields));
+  EXPECT_EQ(fields, kRequest2);
+  EXPECT_EQ(decoder.Table().Size(), 110u);
+  ASSERT_TRUE(Decode(decoder,
+                     FromHex("828785bf400a637573746f6d2d6b65790c637573746f6d2d76"
+                             "616c7565"),
+                     fields));
+  EXPECT_EQ(fields, kRequest3);
+  EXPECT_EQ(decoder.Table().Size(), 164u);
+  EXPECT_EQ(decoder.Table().At(0).first, "custom-key");
+
+  HPACKDecoder huffman;
+  ASSERT_TRUE(
+      Decode(huffman, FromHex("828684418cf1e3c2e5f23a6ba0ab90f4ff"), fields));
+  EXPECT_EQ(fields, kRequest1);
+  ASSERT_TRUE(Decode(huffman, FromHex("828684be5886a8eb10649cbf"), fields));
+  EXPECT_EQ(fields, kRequest2);
+  ASSERT_TRUE(Decode(huffman,
+                     FromHex("828785bf408825a849e95ba97d7f8925a849e95bb8e8b4bf"),
+                     fields));
+  EXPECT_EQ(fields, kRequest3);
+  EXPECT_EQ(huffman.Table().Size(), 164u);
+}
+
+TEST(HPACKTest, DecodeErrorTest) {
+  HPACKDecoder decoder;
+  Fields fields;
+  // index 0, an index past both tables, a truncated literal
+  EXPECT_FALSE(Decode(decoder, FromHex("80"), fields));
+  EXPECT_FALSE(Decode(decoder, FromHex("c0"), fields));
+  EXPECT_FALSE(Decode(decoder, FromHex("410f7777"), fields));
+  // a size update larger than the SETTINGS_HEADER_TABLE_SIZE sent
+  EXPECT_FALSE(Decode(decoder, FromHex("3fe21f"), fields));
+  // a size update after the first field
+  EXPECT_FALSE(Decode(decoder, FromHex("8220"), fields));
+  EXPECT_TRUE(Decode(decoder, FromHex("2082"), fields));
+}
+
+TEST(HPACKTest, EncodeTest) {
+  HPACKEncoder encoder;
+  HPACKDecoder decoder;
+  std::string block;
+  Fields fields;
+  const Fields* requests[] = {&kRequest1, &kRequest2, &kRequest3};
+  const char* expected[] = {"828684418cf1e3c2e5f23a6ba0ab90f4ff",
+                            "828684be5886a8eb10649cbf",
+                            "828785bf408825a849e95ba97d7f8925a849e95bb8e8b4bf"};
+  for (int i = 0; i < 3; i++) {
+    block.clear();
+    encoder.BeginBlock(block);
+    for (const auto& field : *requests[i]) {
+      encoder.Encode(field.first, field.second, HPACKIndexing::Incremental, block);
+    }
+    // the same choices as the examples of the RFC
+    EXPECT_EQ(block, FromHex(expected[i]));
+    ASSERT_TRUE(Decode(decoder, block, fields));
+    EXPECT_EQ(fields, *requests[i]);
+  }
+
+  // fields which are never indexed stay out of both tables
+  block.clear();
+  encoder.Encode("set-cookie", "id=1", HPACKIndexing::Never, block);
+  EXPECT_EQ(static_cast<uint8_t>(block[0]) & 0xf0, 0x10);
+  ASSERT_TRUE(Decode(decoder, block, fields));
+  EXPECT_EQ(fields, Fields({{"set-cookie", "id=1"}}));
+  EXPECT_EQ(encoder.Table().Size(), decoder.Table().Size());
+
+  // a smaller table of the peer is announced at the start of the next block
+  encoder.SetMaxTableSize(0);
+  block.clear();
+  encoder.BeginBlock(block);
+  encoder.Encode("custom-key", "custom-value", HPACKIndexing::Incremental, block);
+  ASSERT_TRUE(Decode(decoder, block, fields));
+  EXPECT_EQ(fields, Fields({{"custom-key", "custom-value"}}));
+  EXPECT_EQ(decoder.Table().Count(), 0u);
+}
+
+TEST(HPACKTest, HuffmanTest) {
+  std::string all;
+  for (int i = 0; i < 256; i++) {
+    all.push_back(static_cast<char>(i));
+  }
+  for (const std::string& s :
+       {std::string(), std::string("www.example.com"), std::string("no-cache"),
+        std::string("Mon, 21 Oct 2013 20:13:21 GMT"), all}) {
+    std::string encoded, decoded;
+    HuffmanEncode(s, encoded);
+    EXPECT_EQ(encoded.size(), HuffmanEncodedLength(s));
+    ASSERT_TRUE(HuffmanDecode(encoded, decoded));
+    EXPECT_EQ(decoded, s);
+  }
+  std::string out;
+  // padding which is not a prefix of EOS, and more than 7 bits of padding
+  EXPECT_FALSE(HuffmanDecode(FromHex("00"), out));
+  EXPECT_FALSE(HuffmanDecode(FromHex("ffff"), out));
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,1029 @@
+#include "net/http/http2.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+
+#include "base/str_utils.h"
+
+namespace ahrimq {
+namespace http {
+
+// frame flags
+constexpr static uint8_t kFlagEndStream = 0x1;
+constexpr static uint8_t kFlagAck = 0x1;
+constexpr static uint8_t kFlagEndHeaders = 0x4;
+constexpr static uint8_t kFlagPadded = 0x8;
+constexpr static uint8_t kFlagPriority = 0x20;
+
+// settings identifiers
+constexpr static uint16_t kSettingsHeaderTableSize = 0x1;
+constexpr static uint16_t kSettingsEnablePush = 0x2;
+constexpr static uint16_t kSettingsMaxConcurrentStreams = 0x3;
+constexpr static uint16_t kSettingsInitialWindowSize = 0x4;
+constexpr static uint16_t kSettingsMaxFrameSize = 0x5;
+constexpr static uint16_t kSettingsMaxHeaderListSize = 0x6;
+
+constexpr static size_t kFrameHeaderSize = 9;
+// the largest frame accepted, SETTINGS_MAX_FRAME_SIZE is left at its default
+constexpr static uint32_t kMaxFrameSize = 16384;
+constexpr static int64_t kMaxWindowSize = 0x7fffffff;
+// response bytes buffered in the write buffer before FlushData stops, the rest
+// is framed after the write buffer is flushed
+constexpr static size_t kMaxBufferedBytes = 256 << 10;
+// exchanges of closed streams kept for later streams
+constexpr static size_t kMaxIdleExchanges = 16;
+
+static const char kDefaultServer[] = "AhriMQ/1.0";
+
+static inline uint32_t ReadUInt32(const char* p) {
+  const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+  return (uint32_t(u[0]) << 24) | (uint32_t(u[1]) << 16) | (uint32_t(u[2]) << 8) |
+         uint32_t(u[3]);
+}
+
+static inline void WriteUInt32(char* p, uint32_t v) {
+  p[0] = static_cast<char>(v >> 24);
+  p[1] = static_cast<char>(v >> 16);
+  p[2] = static_cast<char>(v >> 8);
+  p[3] = static_cast<char>(v);
+}
+
+int MatchHTTP2Preface(const char* data, size_t len) {
+  size_t n = std::min(len, kHTTP2PrefaceLen);
+  if (memcmp(data, kHTTP2Preface, n) != 0) {
+    return -1;
+  }
+  return n == kHTTP2PrefaceLen ? 1 : 0;
+}
+
+bool DecodeHTTP2Settings(std::string_view value, std::string& payload) {
+  payload.clear();
+  uint32_t acc = 0;
+  int bits = 0;
+  for (char c : value) {
+    int v;
+    if (c >= 'A' && c <= 'Z') {
+      v = c - 'A';
+    } else if (c >= 'a' && c <= 'z') {
+      v = c - 'a' + 26;
+    } else if (c >= '0' && c <= '9') {
+      v = c - '0' + 52;
+    } else if (c == '-') {
+      v = 62;
+    } else if (c == '_') {
+      v = 63;
+    } else if (c == '=') {
+      // padding is not part of base64url but tolerated at the end
+      break;
+    } else {
+      return false;
+    }
+    acc = (acc << 6) | v;
+    bits += 6;
+    if (bits >= 8) {
+      bits -= 8;
+      payload.push_back(static_cast<char>((acc >> bits) & 0xff));
+    }
+  }
+  return payload.size() % 6 == 0;
+}
+
+// fields a HTTP/2 message must not carry (RFC 9113 section 8.2.2)
+static bool ConnectionSpecific(std::string_view name) {
+  return name == "connection" || name == "keep-alive" ||
+         name == "proxy-connection" || name == "transfer-encoding" ||
+         name == "upgrade";
+}
+
+// fields not worth a place in the dynamic table of the peer, or which must not
+// take one
+static HPACKIndexing IndexingOf(std::string_view name) {
+  if (name == "set-cookie" || name == "authorization") {
+    return HPACKIndexing::Never;
+  }
+  if (name == "content-length" || name == "date" || name == "etag" ||
+      name == "last-modified" || name == "content-range" || name == "location" ||
+      name == "expires" || name == "age") {
+    return HPACKIndexing::None;
+  }
+  return HPACKIndexing::Incremental;
+}
+
+static void ToLower(std::string_view in, std::string& out) {
+  out.resize(in.size());
+  for (size_t i = 0; i < in.size(); i++) {
+    char c = in[i];
+    out[i] = (c >= 'A' && c <= 'Z') ? static_cast<char>(c + 32) : c;
+  }
+}
+
+HTTP2Session::HTTP2Session(ReactorConn* conn, Buffer& wbuf,
+                           const HTTP2Limits& limits, RequestCallback on_request)
+    : conn_(conn), wbuf_(wbuf), limits_(limits), on_request_(std::move(on_request)) {
+  limits_.initial_window_size = static_cast<uint32_t>(std::clamp<int64_t>(
+      limits_.initial_window_size, 65535, kMaxWindowSize));
+}
+
+void HTTP2Session::Start() {
+  WriteSettings();
+  if (limits_.initial_window_size > conn_recv_window_) {
+    // the connection window is not covered by SETTINGS_INITIAL_WINDOW_SIZE
+    WriteWindowUpdate(0, limits_.initial_window_size - conn_recv_window_);
+    conn_recv_window_ = limits_.initial_window_size;
+  }
+}
+
+bool HTTP2Session::Upgrade(const HTTPRequest& req, std::string_view settings) {
+  if (!ApplySettings(settings)) {
+    return false;
+  }
+  last_stream_id_ = 1;
+  Stream& stream = OpenStream(1);
+  HTTPRequestPtr& dst = stream.exchange->CurrentRequestRef();
+  dst->SetMethod(req.Method());
+  dst->SetURL(req.URLRef().StringWithQuery());
+  dst->SetHTTPVersion(Version2_0);
+  HTTPHeaderPtr& header = dst->HeaderRef();
+  for (const auto& item : req.GetHeader()->Members()) {
+    std::string_view key = item.first;
+    std::string lower;
+    ToLower(key, lower);
+    if (ConnectionSpecific(lower) || lower == "http2-settings") {
+      continue;
+    }
+    for (const auto& value : item.second) {
+      header->Add(key, value);
+    }
+  }
+  // the request was sent in full before the switch (RFC 7540 section 3.2)
+  stream.remote_closed = true;
+  EndOfRequest(1, stream);
+  return true;
+}
+
+void HTTP2Session::Feed(Buffer& rbuf) {
+  if (goaway_sent_) {
+    rbuf.Reset();
+    return;
+  }
+  if (!preface_received_) {
+    int m = MatchHTTP2Preface(rbuf.BeginReadPointer(), rbuf.Size());
+    if (m == 0) {
+      return;
+    }
+    if (m < 0) {
+      ConnectionError(HTTP2Error::ProtocolError);
+      rbuf.Reset();
+      return;
+    }
+    rbuf.ReaderIdxForward(kHTTP2PrefaceLen);
+    preface_received_ = true;
+  }
+  while (rbuf.Size() >= kFrameHeaderSize) {
+    const char* p = rbuf.BeginReadPointer();
+    uint32_t len = ReadUInt32(p) >> 8;
+    if (len > kMaxFrameSize) {
+      ConnectionError(HTTP2Error::FrameSizeError);
+      break;
+    }
+    if (rbuf.Size() < kFrameHeaderSize + len) {
+      break;
+    }
+    HTTP2FrameType type = static_cast<HTTP2FrameType>(p[3]);
+    uint8_t flags = static_cast<uint8_t>(p[4]);
+    uint32_t stream_id = ReadUInt32(p + 5) & 0x7fffffff;
+    bool ok = OnFrame(type, flags, stream_id,
+                      std::string_view(p + kFrameHeaderSize, len));
+    rbuf.ReaderIdxForward(kFrameHeaderSize + len);
+    if (!ok) {
+      break;
+    }
+  }
+  if (goaway_sent_) {
+    rbuf.Reset();
+    return;
+  }
+  FlushData();
+}
+
+void HTTP2Session::SubmitResponse(HTTPConn* exchange,
+                                  const time::GMTDateCache& date) {
+  uint32_t stream_id = exchange->StreamId();
+  Stream* stream = FindStream(stream_id);
+  if (goaway_sent_ || stream == nullptr || stream->exchange.get() != exchange ||
+      stream->responding) {
+    // reset by the peer while the handler ran
+    return;
+  }
+  EncodeResponseHead(exchange, date);
+  HTTPResponse& res = *exchange->CurrentResponseRef();
+  int status = res.Status();
+  stream->responding = true;
+  if (exchange->CurrentRequestRef()->Method() != HTTPMethod::Head &&
+      status != StatusNoContent && status != StatusNotModified) {
+    stream->body = res.BodyView();
+    if (exchange->sending_file_ != nullptr) {
+      stream->file_offset = exchange->file_offset_;
+      stream->file_length = exchange->file_length_;
+    }
+  }
+  bool end_stream = stream->body.empty() && stream->file_length == 0;
+  WriteHeaders(stream_id, block_, end_stream);
+  if (end_stream) {
+    FinishStream(stream_id, *stream);
+    return;
+  }
+  Schedule(stream_id, *stream);
+  FlushData();
+}
+
+void HTTP2Session::OnWritten() {
+  FlushData();
+}
+
+void HTTP2Session::WriteFrameHeader(size_t len, HTTP2FrameType type, uint8_t flags,
+                                    uint32_t stream_id) {
+  char header[kFrameHeaderSize];
+  WriteUInt32(header, static_cast<uint32_t>(len) << 8);
+  header[3] = static_cast<char>(type);
+  header[4] = static_cast<char>(flags);
+  WriteUInt32(header + 5, stream_id);
+  wbuf_.Append(header, kFrameHeaderSize);
+}
+
+void HTTP2Session::WriteSettings() {
+  const std::pair<uint16_t, uint32_t> settings[] = {
+      {kSettingsEnablePush, 0},
+      {kSettingsMaxConcurrentStreams, limits_.max_concurrent_streams},
+      {kSettingsInitialWindowSize, limits_.initial_window_size},
+      {kSettingsMaxHeaderListSize, limits_.max_header_list_size},
+  };
+  WriteFrameHeader(sizeof(settings) / sizeof(settings[0]) * 6,
+                   HTTP2FrameType::Settings, 0, 0);
+  for (const auto& setting : settings) {
+    char p[6];
+    p[0] = static_cast<char>(setting.first >> 8);
+    p[1] = static_cast<char>(setting.first);
+    WriteUInt32(p + 2, setting.second);
+    wbuf_.Append(p, sizeof(p));
+  }
+}
+
+void HTTP2Session::WriteWindowUpdate(uint32_t stream_id, uint32_t increment) {
+  char p[4];
+  WriteUInt32(p, increment);
+  WriteFrameHeader(sizeof(p), HTTP2FrameType::WindowUpdate, 0, stream_id);
+  wbuf_.Append(p, sizeof(p));
+}
+
+void HTTP2Session::WriteRstStream(uint32_t stream_id, HTTP2Error code) {
+  char p[4];
+  WriteUInt32(p, static_cast<uint32_t>(code));
+  WriteFrameHeader(sizeof(p), HTTP2FrameType::RstStream, 0, stream_id);
+  wbuf_.Append(p, sizeof(p));
+}
+
+void HTTP2Session::WriteHeaders(uint32_t stream_id, std::string_view block,
+                                bool end_stream) {
+  HTTP2FrameType type = HTTP2FrameType::Headers;
+  uint8_t flags = end_stream ? kFlagEndStream : 0;
+  do {
+    size_t n = std::min<size_t>(block.size(), peer_max_frame_size_);
+    if (n == block.size()) {
+      flags |= kFlagEndHeaders;
+    }
+    WriteFrameHeader(n, type, flags, stream_id);
+    wbuf_.Append(block.data(), static_cast<int>(n));
+    block.remove_prefix(n);
+    type = HTTP2FrameType::Continuation;
+    flags = 0;
+  } while (!block.empty());
+}
+
+void HTTP2Session::ConnectionError(HTTP2Error code) {
+  if (goaway_sent_) {
+    return;
+  }
+  char p[8];
+  WriteUInt32(p, last_stream_id_);
+  WriteUInt32(p + 4, static_cast<uint32_t>(code));
+  WriteFrameHeader(sizeof(p), HTTP2FrameType::GoAway, 0, 0);
+  wbuf_.Append(p, sizeof(p));
+  goaway_sent_ = true;
+  ready_.clear();
+}
+
+void HTTP2Session::StreamError(uint32_t stream_id, HTTP2Error code) {
+  WriteRstStream(stream_id, code);
+  CloseStream(stream_id);
+}
+
+bool HTTP2Session::OnFrame(HTTP2FrameType type, uint8_t flags, uint32_t stream_id,
+                           std::string_view payload) {
+  if (!settings_received_ && type != HTTP2FrameType::Settings) {
+    // the client preface ends with a SETTINGS frame
+    ConnectionError(HTTP2Error::ProtocolError);
+    return false;
+  }
+  if (continuation_stream_ != 0 && (type != HTTP2FrameType::Continuation ||
+                                    stream_id != continuation_stream_)) {
+    // a header block is not interleaved with other frames
+    ConnectionError(HTTP2Error::ProtocolError);
+    return false;
+  }
+  switch (type) {
+    case HTTP2FrameType::Data:
+      return OnData(flags, stream_id, payload);
+    case HTTP2FrameType::Headers:
+      return OnHeaders(flags, stream_id, payload);
+    case HTTP2FrameType::Continuation:
+      return OnContinuation(flags, stream_id, payload);
+    case HTTP2FrameType::Settings:
+      return OnSettings(flags, stream_id, payload);
+    case HTTP2FrameType::WindowUpdate:
+      return OnWindowUpdate(stream_id, payload);
+    case HTTP2FrameType::Priority: {
+      // priorities are not honoured, streams take turns
+      if (stream_id == 0) {
+        ConnectionError(HTTP2Error::ProtocolError);
+        return false;
+      }
+      if (payload.size() != 5) {
+        StreamError(stream_id, HTTP2Error::FrameSizeError);
+      }
+      return true;
+    }
+    case HTTP2FrameType::RstStream: {
+      if (stream_id == 0 || stream_id > last_stream_id_) {
+        ConnectionError(HTTP2Error::ProtocolError);
+        return false;
+      }
+      if (payload.size() != 4) {
+        ConnectionError(HTTP2Error::FrameSizeError);
+        return false;
+      }
+      CloseStream(stream_id);
+      return true;
+    }
+    case HTTP2FrameType::Ping: {
+      if (stream_id != 0) {
+        ConnectionError(HTTP2Error::ProtocolError);
+        return false;
+      }
+      if (payload.size() != 8) {
+        ConnectionError(HTTP2Error::FrameSizeError);
+        return false;
+      }
+      if ((flags & kFlagAck) == 0) {
+        WriteFrameHeader(8, HTTP2FrameType::Ping, kFlagAck, 0);
+        wbuf_.Append(payload.data(), 8);
+      }
+      return true;
+    }
+    case HTTP2FrameType::GoAway: {
+      if (stream_id != 0) {
+        ConnectionError(HTTP2Error::ProtocolError);
+        return false;
+      }
+      // streams already received are still answered
+      peer_goaway_ = true;
+      return true;
+    }
+    case HTTP2FrameType::PushPromise: {
+      // clients never push
+      ConnectionError(HTTP2Error::ProtocolError);
+      return false;
+    }
+    default:
+      // unknown frame types are ignored (RFC 9113 section 5.5)
+      return true;
+  }
+}
+
+bool HTTP2Session::OnData(uint8_t flags, uint32_t stream_id,
+                          std::string_view payload) {
+  if (stream_id == 0 || stream_id > last_stream_id_) {
+    ConnectionError(HTTP2Error::ProtocolError);
+    return false;
+  }
+  // the whole payload counts against the windows, padding included
+  uint32_t size = static_cast<uint32_t>(payload.size());
+  conn_recv_window_ -= size;
+  if (conn_recv_window_ < 0) {
+    ConnectionError(HTTP2Error::FlowControlError);
+    return false;
+  }
+  conn_recv_unacked_ += size;
+  if (conn_recv_unacked_ >= limits_.initial_window_size / 2) {
+    WriteWindowUpdate(0, conn_recv_unacked_);
+    conn_recv_window_ += conn_recv_unacked_;
+    conn_recv_unacked_ = 0;
+  }
+  std::string_view data = payload;
+  if (flags & kFlagPadded) {
+    size_t pad = data.empty() ? 0 : static_cast<uint8_t>(data[0]);
+    if (data.empty() || pad >= data.size()) {
+      ConnectionError(HTTP2Error::ProtocolError);
+      return false;
+    }
+    data = data.substr(1, data.size() - 1 - pad);
+  }
+  Stream* stream = FindStream(stream_id);
+  if (stream == nullptr) {
+    // the stream was reset, frames sent before the peer saw it are dropped
+    return true;
+  }
+  if (stream->remote_closed) {
+    StreamError(stream_id, HTTP2Error::StreamClosed);
+    return true;
+  }
+  stream->recv_window -= size;
+  if (stream->recv_window < 0) {
+    StreamError(stream_id, HTTP2Error::FlowControlError);
+    return true;
+  }
+  stream->received += data.size();
+  if (stream->content_length >= 0 &&
+      stream->received > uint64_t(stream->content_length)) {
+    StreamError(stream_id, HTTP2Error::ProtocolError);
+    return true;
+  }
+  if (!stream->dispatched) {
+    HTTPConn* exchange = stream->exchange.get();
+    Buffer& body = exchange->GetReadBuffer();
+    body.Append(data.data(), static_cast<int>(data.size()));
+    HTTPRequestPtr& req = exchange->CurrentRequestRef();
+    if (req->MultipartForm()) {
+      // parts are streamed out of the body as they arrive, the length is known
+      // at the end of the stream
+      int retcode = req->FeedMultipart(body, UINT64_MAX);
+      if (retcode != StatusPrivatePending) {
+        stream->dispatched = true;
+        HTTPConnPtr holder = stream->exchange;
+        on_request_(holder, retcode);
+        return true;
+      }
+    }
+  }
+  if (flags & kFlagEndStream) {
+    stream->remote_closed = true;
+    if (stream->content_length >= 0 &&
+        stream->received != uint64_t(stream->content_length)) {
+      StreamError(stream_id, HTTP2Error::ProtocolError);
+      return true;
+    }
+    EndOfRequest(stream_id, *stream);
+    return true;
+  }
+  stream->recv_unacked += size;
+  if (stream->recv_unacked >= limits_.initial_window_size / 2) {
+    WriteWindowUpdate(stream_id, stream->recv_unacked);
+    stream->recv_window += stream->recv_unacked;
+    stream->recv_unacked = 0;
+  }
+  return true;
+}
+
+bool HTTP2Session::OnHeaders(uint8_t flags, uint32_t stream_id,
+                             std::string_view payload) {
+  if (stream_id == 0 || (stream_id & 1) == 0) {
+    ConnectionError(HTTP2Error::ProtocolError);
+    return false;
+  }
+  std::string_view fragment = payload;
+  size_t pad = 0;
+  if (flags & kFlagPadded) {
+    if (fragment.empty()) {
+      ConnectionError(HTTP2Error::ProtocolError);
+      return false;
+    }
+    pad = static_cast<uint8_t>(fragment[0]);
+    fragment.remove_prefix(1);
+  }
+  if (flags & kFlagPriority) {
+    // stream dependency and weight
+    if (fragment.size() < 5) {
+      ConnectionError(HTTP2Error::ProtocolError);
+      return false;
+    }
+    fragment.remove_prefix(5);
+  }
+  if (pad > fragment.size()) {
+    ConnectionError(HTTP2Error::ProtocolError);
+    return false;
+  }
+  fragment.remove_suffix(pad);
+  header_block_.assign(fragment.data(), fragment.size());
+  continuation_stream_ = stream_id;
+  continuation_end_stream_ = (flags & kFlagEndStream) != 0;
+  if (flags & kFlagEndHeaders) {
+    return OnHeaderBlock(stream_id, continuation_end_stream_);
+  }
+  return true;
+}
+
+bool HTTP2Session::OnContinuation(uint8_t flags, uint32_t stream_id,
+                                  std::string_view payload) {
+  if (continuation_stream_ == 0 || stream_id != continuation_stream_) {
+    ConnectionError(HTTP2Error::ProtocolError);
+    return false;
+  }
+  if (header_block_.size() + payload.size() > 2 * limits_.max_header_list_size) {
+    // a compressed block is never that much larger than the fields it carries
+    ConnectionError(HTTP2Error::EnhanceYourCalm);
+    return false;
+  }
+  header_block_.append(payload.data(), payload.size());
+  if (flags & kFlagEndHeaders) {
+    return OnHeaderBlock(stream_id, continuation_end_stream_);
+  }
+  return true;
+}
+
+bool HTTP2Session::OnSettings(uint8_t flags, uint32_t stream_id,
+                              std::string_view payload) {
+  if (stream_id != 0) {
+    ConnectionError(HTTP2Error::ProtocolError);
+    return false;
+  }
+  if (flags & kFlagAck) {
+    if (!payload.empty() || !settings_received_) {
+      ConnectionError(HTTP2Error::FrameSizeError);
+      return false;
+    }
+    return true;
+  }
+  if (payload.size() % 6 != 0) {
+    ConnectionError(HTTP2Error::FrameSizeError);
+    return false;
+  }
+  if (!ApplySettings(payload)) {
+    return false;
+  }
+  settings_received_ = true;
+  WriteFrameHeader(0, HTTP2FrameType::Settings, kFlagAck, 0);
+  return true;
+}
+
+bool HTTP2Session::OnWindowUpdate(uint32_t stream_id, std::string_view payload) {
+  if (payload.size() != 4) {
+    ConnectionError(HTTP2Error::FrameSizeError);
+    return false;
+  }
+  uint32_t increment = ReadUInt32(payload.data()) & 0x7fffffff;
+  if (stream_id == 0) {
+    if (increment == 0) {
+      ConnectionError(HTTP2Error::ProtocolError);
+      return false;
+    }
+    conn_send_window_ += increment;
+    if (conn_send_window_ > kMaxWindowSize) {
+      ConnectionError(HTTP2Error::FlowControlError);
+      return false;
+    }
+    return true;
+  }
+  if (stream_id > last_stream_id_) {
+    ConnectionError(HTTP2Error::ProtocolError);
+    return false;
+  }
+  Stream* stream = FindStream(stream_id);
+  if (stream == nullptr) {
+    return true;
+  }
+  if (increment == 0) {
+    StreamError(stream_id, HTTP2Error::ProtocolError);
+    return true;
+  }
+  stream->send_window += increment;
+  if (stream->send_window > kMaxWindowSize) {
+    StreamError(stream_id, HTTP2Error::FlowControlError);
+    return true;
+  }
+  Schedule(stream_id, *stream);
+  return true;
+}
+
+bool HTTP2Session::ApplySettings(std::string_view payload) {
+  if (payload.size() % 6 != 0) {
+    ConnectionError(HTTP2Error::FrameSizeError);
+    return false;
+  }
+  for (size_t i = 0; i < payload.size(); i += 6) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(&payload[i]);
+    uint16_t id = static_cast<uint16_t>((p[0] << 8) | p[1]);
+    uint32_t value = ReadUInt32(&payload[i + 2]);
+    switch (id) {
+      case kSettingsHeaderTableSize:
+        encoder_.SetMaxTableSize(value);
+        break;
+      case kSettingsEnablePush:
+        if (value > 1) {
+          ConnectionError(HTTP2Error::ProtocolError);
+          return false;
+        }
+        break;
+      case kSettingsInitialWindowSize: {
+        if (value > kMaxWindowSize) {
+          ConnectionError(HTTP2Error::FlowControlError);
+          return false;
+        }
+        // applies to the windows of every open stream (RFC 9113 section 6.9.2)
+        int64_t delta = int64_t(value) - peer_initial_window_;
+        peer_initial_window_ = value;
+        for (auto& item : streams_) {
+          item.second.send_window += delta;
+          if (item.second.send_window > kMaxWindowSize) {
+            ConnectionError(HTTP2Error::FlowControlError);
+            return false;
+          }
+          Schedule(item.first, item.second);
+        }
+        break;
+      }
+      case kSettingsMaxFrameSize:
+        if (value < 16384 || value > 16777215) {
+          ConnectionError(HTTP2Error::ProtocolError);
+          return false;
+        }
+        peer_max_frame_size_ = value;
+        break;
+      default:
+        // SETTINGS_MAX_CONCURRENT_STREAMS limits pushes, which are never sent,
+        // SETTINGS_MAX_HEADER_LIST_SIZE is advisory, unknown ones are ignored
+        break;
+    }
+  }
+  return true;
+}
+
+bool HTTP2Session::OnHeaderBlock(uint32_t stream_id, bool end_stream) {
+  continuation_stream_ = 0;
+  Stream* stream = FindStream(stream_id);
+  if (stream != nullptr || stream_id <= last_stream_id_) {
+    // trailers, which end the stream and are dropped, or a closed stream
+    bool ok = decoder_.Decode(header_block_,
+                              [](std::string_view, std::string_view) {});
+    if (!ok) {
+      ConnectionError(HTTP2Error::CompressionError);
+      return false;
+    }
+    if (stream == nullptr) {
+      if (!end_stream) {
+        ConnectionError(HTTP2Error::StreamClosed);
+        return false;
+      }
+      // trailers of a stream reset by us, still decoded to keep the table
+      return true;
+    }
+    if (stream->remote_closed) {
+      StreamError(stream_id, HTTP2Error::StreamClosed);
+      return true;
+    }
+    if (!end_stream) {
+      StreamError(stream_id, HTTP2Error::ProtocolError);
+      return true;
+    }
+    stream->remote_closed = true;
+    if (stream->content_length >= 0 &&
+        stream->received != uint64_t(stream->content_length)) {
+      StreamError(stream_id, HTTP2Error::ProtocolError);
+      return true;
+    }
+    EndOfRequest(stream_id, *stream);
+    return true;
+  }
+
+  last_stream_id_ = stream_id;
+  if (streams_.size() >= limits_.max_concurrent_streams || peer_goaway_) {
+    if (!decoder_.Decode(header_block_, [](std::string_view, std::string_view) {})) {
+      ConnectionError(HTTP2Error::CompressionError);
+      return false;
+    }
+    WriteRstStream(stream_id, HTTP2Error::RefusedStream);
+    return true;
+  }
+
+  Stream& opened = OpenStream(stream_id);
+  HTTPRequestPtr& req = opened.exchange->CurrentRequestRef();
+  HTTPHeaderPtr& header = req->HeaderRef();
+  bool has_method = false, has_scheme = false, has_path = false;
+  bool has_authority = false, has_host = false;
+  bool malformed = false;
+  bool regular_seen = false;
+  size_t list_size = 0;
+  int64_t content_length = -1;
+  bool ok = decoder_.Decode(header_block_, [&](std::string_view name,
+                                               std::string_view value) {
+    list_size += name.size() + value.size() + 32;
+    if (malformed || list_size > limits_.max_header_list_size) {
+      return;
+    }
+    for (char c : name) {
+      if (c >= 'A' && c <= 'Z') {
+        malformed = true;
+        return;
+      }
+    }
+    if (!name.empty() && name[0] == ':') {
+      // pseudo-header fields come first and only once
+      bool* seen = nullptr;
+      if (name == ":method") {
+        seen = &has_method;
+      } else if (name == ":scheme") {
+        seen = &has_scheme;
+      } else if (name == ":path") {
+        seen = &has_path;
+      } else if (name == ":authority") {
+        seen = &has_authority;
+      }
+      if (seen == nullptr || *seen || regular_seen) {
+        malformed = true;
+        return;
+      }
+      *seen = true;
+      if (name == ":method") {
+        std::string m(value);
+        if (!HTTPMethodSupported(m)) {
+          malformed = true;
+          return;
+        }
+        req->SetMethod(m);
+      } else if (name == ":path") {
+        if (value.empty()) {
+          malformed = true;
+          return;
+        }
+        req->SetURL(value);
+      } else if (name == ":authority" && !has_host) {
+        // handlers look for the authority in Host, as sent by HTTP/1.1 clients
+        header->Add("Host", value);
+        has_host = true;
+      }
+      return;
+    }
+    regular_seen = true;
+    if (ConnectionSpecific(name) || (name == "te" && value != "trailers")) {
+      malformed = true;
+      return;
+    }
+    if (name == "host") {
+      if (has_host) {
+        return;
+      }
+      has_host = true;
+      header->Add("Host", value);
+      return;
+    }
+    if (name == "content-length") {
+      uint64_t n;
+      if (!CanConvertToUInt64(std::string(value), n) ||
+          (content_length >= 0 && uint64_t(content_length) != n)) {
+        malformed = true;
+        return;
+      }
+      content_length = static_cast<int64_t>(n);
+    }
+    header->Add(name, value);
+  });
+  if (!ok) {
+    ConnectionError(HTTP2Error::CompressionError);
+    return false;
+  }
+  if (malformed || !has_method || !has_scheme || !has_path) {
+    StreamError(stream_id, HTTP2Error::ProtocolError);
+    return true;
+  }
+  req->SetHTTPVersion(Version2_0);
+  opened.content_length = content_length;
+  opened.remote_closed = end_stream;
+  if (list_size > limits_.max_header_list_size) {
+    opened.dispatched = true;
+    on_request_(opened.exchange, StatusBadRequest);
+    return true;
+  }
+  if (end_stream) {
+    if (content_length > 0) {
+      StreamError(stream_id, HTTP2Error::ProtocolError);
+      return true;
+    }
+    EndOfRequest(stream_id, opened);
+  }
+  return true;
+}
+
+HTTP2Session::Stream* HTTP2Session::FindStream(uint32_t stream_id) {
+  auto it = streams_.find(stream_id);
+  return it == streams_.end() ? nullptr : &it->second;
+}
+
+HTTP2Session::Stream& HTTP2Session::OpenStream(uint32_t stream_id) {
+  HTTPConnPtr exchange;
+  for (size_t i = 0; i < idle_.size(); i++) {
+    if (idle_[i].use_count() == 1) {
+      exchange = std::move(idle_[i]);
+      idle_[i] = std::move(idle_.back());
+      idle_.pop_back();
+      exchange->ResetExchange();
+      exchange->stream_id_ = stream_id;
+      break;
+    }
+  }
+  if (exchange == nullptr) {
+    exchange = std::make_shared<HTTPConn>(conn_, weak_from_this(), stream_id);
+  }
+  exchange->CurrentRequestRef()->SetFormLimits(form_limits_);
+  Stream& stream = streams_[stream_id];
+  stream.exchange = std::move(exchange);
+  stream.recv_window = limits_.initial_window_size;
+  stream.send_window = peer_initial_window_;
+  return stream;
+}
+
+void HTTP2Session::EndOfRequest(uint32_t stream_id, Stream& stream) {
+  if (stream.dispatched) {
+    // answered early with an error
+    return;
+  }
+  stream.dispatched = true;
+  int status = StatusPrivateDone;
+  HTTPConnPtr exchange = stream.exchange;
+  HTTPRequestPtr& req = exchange->CurrentRequestRef();
+  if (req->MultipartForm()) {
+    int retcode = req->FeedMultipart(exchange->GetReadBuffer(), stream.received);
+    if (retcode != StatusPrivateComplete) {
+      status = retcode == StatusPrivatePending ? StatusBadRequest : retcode;
+    }
+  }
+  // the handler may respond right away, which can close the stream
+  on_request_(exchange, status);
+}
+
+void HTTP2Session::CloseStream(uint32_t stream_id) {
+  auto it = streams_.find(stream_id);
+  if (it == streams_.end()) {
+    return;
+  }
+  HTTPConnPtr exchange = std::move(it->second.exchange);
+  if (it->second.responding) {
+    // the handler is done with the exchange, the file is not needed any more
+    exchange->sending_file_.reset();
+    exchange->file_offset_ = 0;
+    exchange->file_length_ = 0;
+  }
+  streams_.erase(it);
+  if (idle_.size() < kMaxIdleExchanges) {
+    idle_.push_back(std::move(exchange));
+  }
+}
+
+void HTTP2Session::FlushData() {
+  while (!ready_.empty() && conn_send_window_ > 0 && !goaway_sent_ &&
+         wbuf_.Size() < kMaxBufferedBytes) {
+    uint32_t stream_id = ready_.front();
+    ready_.pop_front();
+    Stream* stream = FindStream(stream_id);
+    if (stream == nullptr) {
+      continue;
+    }
+    stream->queued = false;
+    if (stream->send_window <= 0) {
+      // queued again by its WINDOW_UPDATE
+      continue;
+    }
+    if (WriteData(stream_id, *stream)) {
+      ready_.push_back(stream_id);
+      stream->queued = true;
+    }
+  }
+}
+
+bool HTTP2Session::WriteData(uint32_t stream_id, Stream& stream) {
+  size_t n = std::min<int64_t>({stream.send_window, conn_send_window_,
+                                int64_t(peer_max_frame_size_)});
+  bool from_file = stream.body.empty();
+  n = std::min(n, from_file ? stream.file_length : stream.body.size());
+  bool last = from_file ? n == stream.file_length
+                        : n == stream.body.size() && stream.file_length == 0;
+  if (!from_file) {
+    WriteFrameHeader(n, HTTP2FrameType::Data, last ? kFlagEndStream : 0, stream_id);
+    wbuf_.Append(stream.body.data(), static_cast<int>(n));
+    stream.body.remove_prefix(n);
+  } else {
+    // the file is read straight behind the frame header
+    wbuf_.EnsureBytesForWrite(kFrameHeaderSize + n);
+    WriteFrameHeader(n, HTTP2FrameType::Data, last ? kFlagEndStream : 0, stream_id);
+    int fd = stream.exchange->sending_file_->fd;
+    size_t total = 0;
+    while (total < n) {
+      ssize_t r = pread(fd, wbuf_.BeginWritePointer() + total, n - total,
+                        stream.file_offset + total);
+      if (r == -1 && errno == EINTR) {
+        continue;
+      }
+      if (r <= 0) {
+        // the file shrunk, the frame header is taken back
+        wbuf_.WriterIdxBackward(kFrameHeaderSize);
+        StreamError(stream_id, HTTP2Error::InternalError);
+        return false;
+      }
+      total += r;
+    }
+    wbuf_.WriterIdxForward(n);
+    stream.file_offset += n;
+    stream.file_length -= n;
+  }
+  stream.send_window -= n;
+  conn_send_window_ -= n;
+  if (last) {
+    FinishStream(stream_id, stream);
+    return false;
+  }
+  return true;
+}
+
+void HTTP2Session::FinishStream(uint32_t stream_id, Stream& stream) {
+  if (!stream.remote_closed) {
+    // answered before the request was complete, the rest is not needed
+    // (RFC 9113 section 8.1)
+    WriteRstStream(stream_id, HTTP2Error::NoError);
+  }
+  CloseStream(stream_id);
+}
+
+void HTTP2Session::Schedule(uint32_t stream_id, Stream& stream) {
+  if (stream.responding && !stream.queued && stream.send_window > 0 &&
+      (!stream.body.empty() || stream.file_length > 0)) {
+    ready_.push_back(stream_id);
+    stream.queued = true;
+  }
+}
+
+void HTTP2Session::EncodeResponseHead(HTTPConn* exchange,
+                                      const time::GMTDateCache& date) {
+  const HTTPResponse& res = *exchange->CurrentResponseRef();
+  const HTTPHeader::MemberMapType& members = res.GetHeader()->Members();
+  block_.clear();
+  encoder_.BeginBlock(block_);
+  char status[4];
+  auto r = std::to_chars(status, status + sizeof(status), res.Status());
+  encoder_.Encode(":status", std::string_view(status, r.ptr - status),
+                  HPACKIndexing::Incremental, block_);
+  bool has_date = false;
+  bool has_server = false;
+  std::string name;
+  for (const auto& item : members) {
+    if (item.second.empty()) {
+      continue;
+    }
+    ToLower(item.first, name);
+    if (ConnectionSpecific(name)) {
+      continue;
+    }
+    has_date = has_date || name == "date";
+    has_server = has_server || name == "server";
+    HPACKIndexing indexing = IndexingOf(name);
+    for (const auto& value : item.second) {
+      encoder_.Encode(name, value, indexing, block_);
+    }
+  }
+  if (!has_date) {
+    encoder_.Encode("date", std::string_view(date.Data(), date.Size()),
+                    HPACKIndexing::None, block_);
+  }
+  if (!has_server) {
+    encoder_.Encode("server", kDefaultServer, HPACKIndexing::Incremental, block_);
+  }
+  // pre-rendered "Name: value" lines
+  std::string_view head = res.PrebuiltHead();
+  while (!head.empty()) {
+    size_t eol = head.find("\r\n");
+    std::string_view line = head.substr(0, eol);
+    head.remove_prefix(eol == std::string_view::npos ? head.size() : eol + 2);
+    size_t colon = line.find(':');
+    if (colon == std::string_view::npos) {
+      continue;
+    }
+    std::string_view value = line.substr(colon + 1);
+    while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) {
+      value.remove_prefix(1);
+    }
+    ToLower(line.substr(0, colon), name);
+    if (!ConnectionSpecific(name)) {
+      encoder_.Encode(name, value, IndexingOf(name), block_);
+    }
+  }
+  std::string cookie;
+  for (const auto& item : res.Cookies()) {
+    cookie.resize(item.MaxSerializedSize());
+    char* end = item.SerializeTo(&cookie[0]);
+    cookie.resize(end - cookie.data());
+    encoder_.Encode("set-cookie", cookie, HPACKIndexing::Never, block_);
+  }
+}
+
+}  // namespace http
+}  // namespace ahrimq
@@ -0,0 +1,288 @@
+#ifndef _AHRIMQ_NET_HTTP_HTTP2_H_
+#define _AHRIMQ_NET_HTTP_HTTP2_H_
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "base/nocopyable.h"
+#include "base/time_utils.h"
+#include "buffer/buffer.h"
+#include "net/http/hpack.h"
+#include "net/http/http_conn.h"
+
+namespace ahrimq {
+namespace http {
+
+/// @brief The connection preface a HTTP/2 client starts with (RFC 9113 section
+/// 3.4).
+constexpr static char kHTTP2Preface[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+constexpr static size_t kHTTP2PrefaceLen = sizeof(kHTTP2Preface) - 1;
+
+/// @brief HTTP/2 frame types (RFC 9113 section 6).
+enum class HTTP2FrameType : uint8_t {
+  Data = 0x0,
+  Headers = 0x1,
+  Priority = 0x2,
+  RstStream = 0x3,
+  Settings = 0x4,
+  PushPromise = 0x5,
+  Ping = 0x6,
+  GoAway = 0x7,
+  WindowUpdate = 0x8,
+  Continuation = 0x9,
+};
+
+/// @brief HTTP/2 error codes (RFC 9113 section 7).
+enum class HTTP2Error : uint32_t {
+  NoError = 0x0,
+  ProtocolError = 0x1,
+  InternalError = 0x2,
+  FlowControlError = 0x3,
+  SettingsTimeout = 0x4,
+  StreamClosed = 0x5,
+  FrameSizeError = 0x6,
+  RefusedStream = 0x7,
+  Cancel = 0x8,
+  CompressionError = 0x9,
+  ConnectError = 0xa,
+  EnhanceYourCalm = 0xb,
+  InadequateSecurity = 0xc,
+  HTTP11Required = 0xd,
+};
+
+/// @brief Limits a HTTP/2 server announces to its clients.
+struct HTTP2Limits {
+  // streams a client may have open at once
+  uint32_t max_concurrent_streams = 100;
+  // receive window of every stream and of the connection, at least 65535
+  uint32_t initial_window_size = 1 << 20;
+  // size of the header fields of one request, after decoding
+  uint32_t max_header_list_size = 64 << 10;
+};
+
+/// @brief Check whether the bytes received so far may be the HTTP/2 connection
+/// preface.
+/// @param data
+/// @param len
+/// @return 1 if data starts with the whole preface, 0 if data is a proper prefix of
+/// it and -1 otherwise
+int MatchHTTP2Preface(const char* data, size_t len);
+
+/// @brief Decode the base64url coded SETTINGS payload of a HTTP2-Settings header
+/// (RFC 7540 section 3.2.1).
+/// @param value
+/// @param payload
+/// @return false if value is not valid base64url
+bool DecodeHTTP2Settings(std::string_view value, std::string& payload);
+
+/// @brief HTTP2Session runs the HTTP/2 protocol over one connection. Frames are
+/// read from the read buffer of the connection, every request becomes a stream
+/// whose exchange is a HTTPConn, and what the session sends goes into the write
+/// buffer of the connection, so that all frames produced while handling one event
+/// leave in a single write.
+///
+/// Response bodies stay where the handler left them, in the response or in a file,
+/// and are framed as the flow control windows of the peer allow. Streams with data
+/// to send take turns, one frame each. The session runs in the eventloop of its
+/// connection and is not thread safe.
+class HTTP2Session : public std::enable_shared_from_this<HTTP2Session>,
+                     public NoCopyable {
+ public:
+  /// @brief Called when the request of a stream is complete, with StatusPrivateDone
+  /// or the status to respond with if the request is malformed.
+  typedef std::function<void(const HTTPConnPtr& stream, int status)> RequestCallback;
+
+  /// @brief Construct a session.
+  /// @param conn the connection, may be nullptr in tests
+  /// @param wbuf the write buffer of the connection
+  /// @param limits
+  /// @param on_request
+  HTTP2Session(ReactorConn* conn, Buffer& wbuf, const HTTP2Limits& limits,
+               RequestCallback on_request);
+
+  /// @brief Set the limits of multipart/form-data bodies of requests.
+  /// @param limits
+  void SetFormLimits(const FormLimits& limits) {
+    form_limits_ = limits;
+  }
+
+  /// @brief Send the server connection preface, which is a SETTINGS frame.
+  void Start();
+
+  /// @brief Take the HTTP/1.1 request the connection was upgraded with as stream
+  /// 1, whose response is sent over HTTP/2. Call after Start().
+  /// @param req
+  /// @param settings the decoded HTTP2-Settings header of the request
+  /// @return false if settings are invalid
+  bool Upgrade(const HTTPRequest& req, std::string_view settings);
+
+  /// @brief Process the frames received so far, complete frames are consumed.
+  /// @param rbuf
+  void Feed(Buffer& rbuf);
+
+  /// @brief Send the response of a stream whose handler is done. Responses of
+  /// streams reset in the meantime are dropped.
+  /// @param stream
+  /// @param date the date cache of the eventloop
+  void SubmitResponse(HTTPConn* stream, const time::GMTDateCache& date);
+
+  /// @brief Continue sending response bodies after the write buffer was flushed.
+  void OnWritten();
+
+  /// @brief Check if the connection can be closed once the write buffer is
+  /// flushed, after a connection error or a GOAWAY of the peer with no stream left.
+  /// @return
+  bool Finished() const {
+    return goaway_sent_ || (peer_goaway_ && streams_.empty());
+  }
+
+  /// @brief Number of streams which are open or still sending their response.
+  /// @return
+  size_t ActiveStreams() const {
+    return streams_.size();
+  }
+
+ private:
+  struct Stream {
+    HTTPConnPtr exchange;
+    // the peer may send this many more bytes on the stream
+    int64_t recv_window = 0;
+    // bytes received since the last WINDOW_UPDATE of the stream
+    uint32_t recv_unacked = 0;
+    // we may send this many more bytes on the stream
+    int64_t send_window = 0;
+    // Content-Length of the request, -1 if absent
+    int64_t content_length = -1;
+    uint64_t received = 0;
+    // the peer ended the stream
+    bool remote_closed = false;
+    // the request was handed to the handler
+    bool dispatched = false;
+    // the response head was sent
+    bool responding = false;
+    // in ready_, waiting for its turn to send a DATA frame
+    bool queued = false;
+    // the body left to send, from memory and then from the file of the exchange
+    std::string_view body;
+    size_t file_offset = 0;
+    size_t file_length = 0;
+  };
+
+  // frames
+
+  void WriteFrameHeader(size_t len, HTTP2FrameType type, uint8_t flags,
+                        uint32_t stream_id);
+
+  void WriteSettings();
+
+  void WriteWindowUpdate(uint32_t stream_id, uint32_t increment);
+
+  void WriteRstStream(uint32_t stream_id, HTTP2Error code);
+
+  // write a header block as HEADERS and CONTINUATION frames
+  void WriteHeaders(uint32_t stream_id, std::string_view block, bool end_stream);
+
+  // send GOAWAY and stop processing frames
+  void ConnectionError(HTTP2Error code);
+
+  // send RST_STREAM and forget the stream
+  void StreamError(uint32_t stream_id, HTTP2Error code);
+
+  // handle one frame, false once a connection error occurred
+  bool OnFrame(HTTP2FrameType type, uint8_t flags, uint32_t stream_id,
+               std::string_view payload);
+
+  bool OnData(uint8_t flags, uint32_t stream_id, std::string_view payload);
+
+  bool OnHeaders(uint8_t flags, uint32_t stream_id, std::string_view payload);
+
+  bool OnContinuation(uint8_t flags, uint32_t stream_id, std::string_view payload);
+
+  bool OnSettings(uint8_t flags, uint32_t stream_id, std::string_view payload);
+
+  bool OnWindowUpdate(uint32_t stream_id, std::string_view payload);
+
+  // apply a SETTINGS payload of the peer
+  bool ApplySettings(std::string_view payload);
+
+  // decode the header block of a stream once END_HEADERS is reached
+  bool OnHeaderBlock(uint32_t stream_id, bool end_stream);
+
+  // streams
+
+  Stream* FindStream(uint32_t stream_id);
+
+  Stream& OpenStream(uint32_t stream_id);
+
+  // the stream was ended by the peer, hand the request to the handler
+  void EndOfRequest(uint32_t stream_id, Stream& stream);
+
+  // forget the stream, its exchange is kept for a later stream
+  void CloseStream(uint32_t stream_id);
+
+  // write DATA frames while the windows and the write buffer allow
+  void FlushData();
+
+  // write one DATA frame of the stream, false once its body is sent or the
+  // stream failed
+  bool WriteData(uint32_t stream_id, Stream& stream);
+
+  // the response of the stream is sent completely
+  void FinishStream(uint32_t stream_id, Stream& stream);
+
+  // queue the stream for FlushData if it has body bytes and window to send them
+  void Schedule(uint32_t stream_id, Stream& stream);
+
+  // encode the response of the exchange as a header block into block_
+  void EncodeResponseHead(HTTPConn* exchange, const time::GMTDateCache& date);
+
+ private:
+  ReactorConn* conn_;
+  Buffer& wbuf_;
+  HTTP2Limits limits_;
+  FormLimits form_limits_;
+  RequestCallback on_request_;
+
+  HPACKDecoder decoder_;
+  HPACKEncoder encoder_;
+
+  std::unordered_map<uint32_t, Stream> streams_;
+  // streams with body bytes to send, in the order they take turns
+  std::deque<uint32_t> ready_;
+  // exchanges of closed streams, reused once no handler holds them any more
+  std::vector<HTTPConnPtr> idle_;
+  // the highest stream id the peer opened
+  uint32_t last_stream_id_ = 0;
+
+  bool preface_received_ = false;
+  bool settings_received_ = false;
+  bool goaway_sent_ = false;
+  bool peer_goaway_ = false;
+
+  // header block of the stream waiting for CONTINUATION frames
+  std::string header_block_;
+  uint32_t continuation_stream_ = 0;
+  bool continuation_end_stream_ = false;
+  // header block being sent, reused for every response
+  std::string block_;
+
+  // settings of the peer
+  uint32_t peer_initial_window_ = 65535;
+  uint32_t peer_max_frame_size_ = 16384;
+
+  // the connection flow control windows
+  int64_t conn_send_window_ = 65535;
+  int64_t conn_recv_window_ = 65535;
+  uint32_t conn_recv_unacked_ = 0;
+};
+
+}  // namespace http
+}  // namespace ahrimq
+
+#endif  // _AHRIMQ_NET_HTTP_HTTP2_H_
@@ -0,0 +1,302 @@
+#include "ahrimq/net/http/http2.h"
+
+#include <gtest/gtest.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace ahrimq;
+using namespace ahrimq::http;
+
+struct Frame {
+  HTTP2FrameType type;
+  uint8_t flags;
+  uint32_t stream_id;
+  std::string payload;
+};
+
+static std::string FrameBytes(HTTP2FrameType type, uint8_t flags, uint32_t stream_id,
+                              const std::string& payload) {
+  std::string out;
+  size_t len = payload.size();
+  out.push_back(static_cast<char>(len >> 16));
+  out.push_back(static_cast<char>(len >> 8));
+  out.push_back(static_cast<char>(len));
+  out.push_back(static_cast<char>(type));
+  out.push_back(static_cast<char>(flags));
+  for (int shift = 24; shift >= 0; shift -= 8) {
+    out.push_back(static_cast<char>(stream_id >> shift));
+  }
+  return out + payload;
+}
+
+static std::string Setting(uint16_t id, uint32_t value) {
+  std::string out;
+  out.push_back(static_cast<char>(id >> 8));
+  out.push_back(static_cast<char>(id));
+  for (int shift = 24; shift >= 0; shift -= 8) {
+    out.push_back(static_cast<char>(value >> shift));
+  }
+  return out;
+}
+
+static std::string UInt32(uint32_t v) {
+  return Setting(0, v).substr(2);
+}
+
+static uint32_t ReadUInt32(const std::string& s, size_t at = 0) {
+  const unsigned char* p = reinterpret_cast<const unsigned char*>(s.data() + at);
+  return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) |
+         uint32_t(p[3]);
+}
+
+// A client driving a session: what it sends is fed straight to the session and
+// the frames the session wrote are taken out of the write buffer.
+class HTTP2SessionTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    session_ = std::make_shared<HTTP2Session>(
+        nullptr, wbuf_, HTTP2Limits(),
+        [this](const HTTPConnPtr& stream, int status) {
+          requests_.push_back(stream);
+          statuses_.push_back(status);
+          if (respond_ != nullptr) {
+            respond_(*stream);
+            session_->SubmitResponse(stream.get(), date_);
+          }
+        });
+    session_->Start();
+  }
+
+  void Send(const std::string& bytes) {
+    rbuf_.Append(bytes);
+    session_->Feed(rbuf_);
+  }
+
+  void Handshake(const std::string& settings = "") {
+    Send(std::string(kHTTP2Preface, kHTTP2PrefaceLen) +
+         FrameBytes(HTTP2FrameType::Settings, 0, 0, settings));
+    std::vector<Frame> frames = Received();
+    ASSERT_EQ(frames.size(), 3u);
+    EXPECT_EQ(frames[0].type, HTTP2FrameType::Settings);
+    EXPECT_EQ(frames[1].type, HTTP2FrameType::WindowUpdate);
+    EXPECT_EQ(frames[2].type, HTTP2FrameType::Settings);
+    EXPECT_EQ(frames[2].flags, 0x1);
+  }
+
+  typedef std::vector<std::pair<std::string, std::string>> Fields;
+
+  std::string Headers(const Fields& fields) {
+    std::string block;
+    encoder_.BeginBlock(block);
+    for (const auto& field : fields) {
+      encoder_.Encode(field.first, field.second, HPACKIndexing::Incremental, block);
+    }
+    return block;
+  }
+
+  std::string Get(const std::string& path) {
+    return Headers({{":method", "GET"},
+                    {":scheme", "http"},
+                    {":path", path},
+                    {":authority", "localhost"}});
+  }
+
+  std::vector<Frame> Received() {
+    std::vector<Frame> frames;
+    while (wbuf_.Size() >= 9) {
+      std::string head = wbuf_.ReadString(9);
+      uint32_t len = ReadUInt32(head) >> 8;
+      if (wbuf_.Size() < 9 + len) {
+        break;
+      }
+      wbuf_.ReaderIdxForward(9);
+      frames.push_back({static_cast<HTTP2FrameType>(head[3]),
+                        static_cast<uint8_t>(head[4]),
+                        ReadUInt32(head, 5) & 0x7fffffff,
+                        wbuf_.ReadStringAndForward(len)});
+    }
+    return frames;
+  }
+
+  std::map<std::string, std::string> DecodeHeaders(const Frame& frame) {
+    std::map<std::string, std::string> fields;
+    decoder_.Decode(frame.payload,
+                    [&](std::string_view name, std::string_view value) {
+                      fields[std::string(name)] = std::string(value);
+                    });
+    return fields;
+  }
+
+ protected:
+  Buffer rbuf_;
+  Buffer wbuf_;
+  time::GMTDateCache date_;
+  std::shared_ptr<HTTP2Session> session_;
+  HPACKEncoder encoder_;
+  HPACKDecoder decoder_;
+  std::function<void(HTTPConn&)> respond_;
+  std::vector<HTTPConnPtr> requests_;
+  std::vector<int> statuses_;
+};
+
+TEST_F(HTTP2SessionTest, RequestResponseTest) {
+  Handshake();
+  respond_ = [](HTTPConn& stream) {
+    HTTPRequest& req = *stream.CurrentRequestRef();
+    HTTPResponse& res = *stream.CurrentResponseRef();
+    res.SetStatus(StatusOK);
+    res.SetHeader("Connection", "keep-alive");
+    res.AddCookie(Cookie("session", "abc"));
+    res.MakeContentPlainText(req.GetHeader()->Get("Host") +
+                             std::string(req.URLRef().Path()) + "?" +
+                             req.Query().Get("q"));
+  };
+  // two requests in one read, answered in one write, the blocks are encoded in
+  // the order they are sent
+  std::string first = Get("/a?q=1");
+  std::string second = Get("/b?q=2");
+  Send(FrameBytes(HTTP2FrameType::Headers, 0x5, 1, first) +
+       FrameBytes(HTTP2FrameType::Headers, 0x5, 3, second));
+  ASSERT_EQ(statuses_, std::vector<int>({StatusPrivateDone, StatusPrivateDone}));
+  EXPECT_EQ(requests_[0]->CurrentRequestRef()->GetHTTPVersion(), Version2_0);
+  std::vector<Frame> frames = Received();
+  ASSERT_EQ(frames.size(), 4u);
+  std::string bodies[2] = {"localhost/a?1", "localhost/b?2"};
+  for (int i = 0; i < 2; i++) {
+    const Frame& headers = frames[2 * i];
+    const Frame& data = frames[2 * i + 1];
+    EXPECT_EQ(headers.type, HTTP2FrameType::Headers);
+    EXPECT_EQ(headers.flags, 0x4);
+    EXPECT_EQ(headers.stream_id, 2u * i + 1);
+    auto fields = DecodeHeaders(headers);
+    EXPECT_EQ(fields[":status"], "200");
+    EXPECT_EQ(fields["content-type"], "text/plain; charset=utf-8");
+    EXPECT_EQ(fields["set-cookie"], "session=abc");
+    EXPECT_EQ(fields["server"], "AhriMQ/1.0");
+    EXPECT_EQ(fields.count("connection"), 0u);
+    EXPECT_EQ(fields.count("date"), 1u);
+    EXPECT_EQ(data.type, HTTP2FrameType::Data);
+    EXPECT_EQ(data.flags, 0x1);
+    EXPECT_EQ(data.payload, bodies[i]);
+  }
+  EXPECT_EQ(session_->ActiveStreams(), 0u);
+}
+
+TEST_F(HTTP2SessionTest, RequestBodyTest) {
+  Handshake();
+  std::string block = Headers({{":method", "POST"},
+                               {":scheme", "http"},
+                               {":path", "/upload"},
+                               {"content-length", "11"}});
+  // the header block split over HEADERS and CONTINUATION
+  Send(FrameBytes(HTTP2FrameType::Headers, 0, 1, block.substr(0, 3)) +
+       FrameBytes(HTTP2FrameType::Continuation, 0x4, 1, block.substr(3)));
+  EXPECT_TRUE(requests_.empty());
+  // padded DATA frame
+  Send(FrameBytes(HTTP2FrameType::Data, 0x8, 1,
+                  std::string("\x02hello ", 7) + "xx"));
+  Send(FrameBytes(HTTP2FrameType::Data, 0x1, 1, "world"));
+  ASSERT_EQ(requests_.size(), 1u);
+  HTTPRequest& req = *requests_[0]->CurrentRequestRef();
+  EXPECT_EQ(req.Method(), HTTPMethod::Post);
+  EXPECT_EQ(req.Body()->ReadableAsString(), "hello world");
+
+  // a body longer than its content-length resets the stream
+  Send(FrameBytes(HTTP2FrameType::Headers, 0x4, 3, block));
+  Received();
+  Send(FrameBytes(HTTP2FrameType::Data, 0x1, 3, "hello world!"));
+  std::vector<Frame> frames = Received();
+  ASSERT_EQ(frames.size(), 1u);
+  EXPECT_EQ(frames[0].type, HTTP2FrameType::RstStream);
+  EXPECT_EQ(frames[0].stream_id, 3u);
+  EXPECT_EQ(ReadUInt32(frames[0].payload), uint32_t(HTTP2Error::ProtocolError));
+  EXPECT_EQ(requests_.size(), 1u);
+}
+
+TEST_F(HTTP2SessionTest, FlowControlTest) {
+  // the client starts with a 10 bytes window for every stream
+  Handshake(Setting(0x4, 10));
+  std::string body(40000, 'x');
+  respond_ = [&body](HTTPConn& stream) {
+    HTTPResponse& res = *stream.CurrentResponseRef();
+    res.SetStatus(StatusOK);
+    res.MakeContentPlainText(body);
+  };
+  std::string first = Get("/");
+  std::string second = Get("/");
+  Send(FrameBytes(HTTP2FrameType::Headers, 0x5, 1, first) +
+       FrameBytes(HTTP2FrameType::Headers, 0x5, 3, second));
+  std::vector<Frame> frames = Received();
+  ASSERT_EQ(frames.size(), 4u);
+  EXPECT_EQ(frames[1].payload.size(), 10u);
+  EXPECT_EQ(frames[3].payload.size(), 10u);
+  EXPECT_EQ(session_->ActiveStreams(), 2u);
+
+  // once the windows open, the streams take turns, one frame each
+  Send(FrameBytes(HTTP2FrameType::WindowUpdate, 0, 1, UInt32(100000)) +
+       FrameBytes(HTTP2FrameType::WindowUpdate, 0, 3, UInt32(100000)) +
+       FrameBytes(HTTP2FrameType::WindowUpdate, 0, 0, UInt32(100000)));
+  frames = Received();
+  std::vector<uint32_t> order;
+  size_t sent[4] = {0, 10, 0, 10};
+  for (const Frame& frame : frames) {
+    ASSERT_EQ(frame.type, HTTP2FrameType::Data);
+    EXPECT_LE(frame.payload.size(), 16384u);
+    order.push_back(frame.stream_id);
+    sent[frame.stream_id] += frame.payload.size();
+  }
+  EXPECT_EQ(order, std::vector<uint32_t>({1, 3, 1, 3, 1, 3}));
+  EXPECT_EQ(sent[1], body.size());
+  EXPECT_EQ(sent[3], body.size());
+  EXPECT_EQ(frames.back().flags, 0x1);
+  EXPECT_EQ(session_->ActiveStreams(), 0u);
+}
+
+TEST_F(HTTP2SessionTest, ErrorTest) {
+  Handshake();
+  // uppercase field names make a request malformed
+  Send(FrameBytes(HTTP2FrameType::Headers, 0x5, 1,
+                  Headers({{":method", "GET"},
+                           {":scheme", "http"},
+                           {":path", "/"},
+                           {"User-Agent", "test"}})));
+  std::vector<Frame> frames = Received();
+  ASSERT_EQ(frames.size(), 1u);
+  EXPECT_EQ(frames[0].type, HTTP2FrameType::RstStream);
+  EXPECT_TRUE(requests_.empty());
+
+  Send(FrameBytes(HTTP2FrameType::Ping, 0, 0, "12345678"));
+  frames = Received();
+  ASSERT_EQ(frames.size(), 1u);
+  EXPECT_EQ(frames[0].type, HTTP2FrameType::Ping);
+  EXPECT_EQ(frames[0].flags, 0x1);
+  EXPECT_EQ(frames[0].payload, "12345678");
+  EXPECT_FALSE(session_->Finished());
+
+  // DATA on stream 0 is a connection error
+  Send(FrameBytes(HTTP2FrameType::Data, 0, 0, "x"));
+  frames = Received();
+  ASSERT_EQ(frames.size(), 1u);
+  EXPECT_EQ(frames[0].type, HTTP2FrameType::GoAway);
+  EXPECT_EQ(ReadUInt32(frames[0].payload), 1u);
+  EXPECT_EQ(ReadUInt32(frames[0].payload, 4), uint32_t(HTTP2Error::ProtocolError));
+  EXPECT_TRUE(session_->Finished());
+}
+
+TEST(HTTP2Test, SettingsHeaderTest) {
+  std::string payload;
+  ASSERT_TRUE(DecodeHTTP2Settings("AAMAAABkAARAAAAAAAIAAAAA", payload));
+  EXPECT_EQ(payload.size(), 18u);
+  EXPECT_EQ(payload.substr(0, 6), Setting(0x3, 100));
+  EXPECT_FALSE(DecodeHTTP2Settings("AAMAAABk+", payload));
+  EXPECT_EQ(MatchHTTP2Preface("PRI * HTTP/2.0\r\n", 16), 0);
+  EXPECT_EQ(MatchHTTP2Preface("GET / HTTP/1.1\r\n", 16), -1);
+  EXPECT_EQ(MatchHTTP2Preface(kHTTP2Preface, kHTTP2PrefaceLen), 1);
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
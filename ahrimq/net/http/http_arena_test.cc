@@ -0,0 +1,71 @@
+#include <gtest/gtest.h>
+
+#include <iostream>
+
+#include "ahrimq/net/http/alloc_counter_testutil.h"
+#include "ahrimq/net/http/http_conn.h"
+
+using namespace ahrimq;
+using namespace ahrimq::http;
+
+static const std::string kRequest =
+    "GET /search/items?q=arena+allocator&page=2&sort=relevance HTTP/1.1\r\n"
+    "Host: www.example.com:9527\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:109.0) Gecko/20100101\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9\r\n"
+    "Accept-Language: en-US,en;q=0.5\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Connection: keep-alive\r\n"
+    "Upgrade-Insecure-Requests: 1\r\n"
+    "Cookie: theme=light; session=8ee196c823bf6184b9c06638e80ffd0b; lang=en\r\n"
+    "\r\n";
+
+// parse a request and build its response the way the server does
+static void Exchange(HTTPConn& conn, const time::GMTDateCache& date) {
+  HTTPRequest& req = *conn.CurrentRequestRef();
+  HTTPResponse& res = *conn.CurrentResponseRef();
+  conn.GetReadBuffer().Append(kRequest);
+  ASSERT_EQ(ParseRequestDatagram(&conn), StatusPrivateDone);
+  ASSERT_EQ(req.Query().GetView("q"), "arena allocator");
+  ASSERT_TRUE(req.GetHeader()->Equals("Connection", "keep-alive"));
+  ASSERT_EQ(req.GetHeader()->GetView("Accept-Encoding"), "gzip, deflate, br");
+  ASSERT_EQ(req.Cookies().Get("session"), "8ee196c823bf6184b9c06638e80ffd0b");
+  res.SetStatus(StatusOK);
+  res.SetHeader("Content-Type", "application/json; charset=utf-8");
+  res.SetHeader("Connection", "keep-alive");
+  res.SetHeader("Cache-Control", "private, max-age=0, must-revalidate");
+  res.Organize(conn.GetWriteBuffer(), date);
+  conn.ResetExchange();
+}
+
+// operator new calls per request once the connection reached its steady state
+static double AllocationsPerRequest(HTTPConn& conn) {
+  constexpr int kRequests = 1000;
+  time::GMTDateCache date;
+  for (int i = 0; i < 3; i++) {
+    Exchange(conn, date);
+  }
+  size_t before = HeapAllocations();
+  for (int i = 0; i < kRequests; i++) {
+    Exchange(conn, date);
+  }
+  return double(HeapAllocations() - before) / kRequests;
+}
+
+TEST(HTTPArenaTest, AllocationsPerRequestTest) {
+  HTTPConn conn(nullptr);
+  double arena = AllocationsPerRequest(conn);
+  // the same connection with header fields taken from the heap
+  conn.CurrentRequestRef() = std::make_shared<HTTPRequest>(&conn.GetReadBuffer());
+  conn.CurrentResponseRef() = std::make_shared<HTTPResponse>(&conn.GetWriteBuffer());
+  double heap = AllocationsPerRequest(conn);
+  std::cout << "allocations per request: " << arena << " with the connection arena, "
+            << heap << " without\n";
+  EXPECT_EQ(arena, 0);
+  EXPECT_GT(heap, arena);
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
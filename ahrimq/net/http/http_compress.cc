@@ -0,0 +1,233 @@
+#include "net/http/http_compress.h"
+
+#include <cctype>
+#include <cstring>
+
+namespace ahrimq {
+namespace http {
+
+const char* ContentCodingName(ContentCoding coding) {
+  switch (coding) {
+    case ContentCoding::Gzip:
+      return "gzip";
+    case ContentCoding::Deflate:
+      return "deflate";
+    default:
+      return "identity";
+  }
+}
+
+static std::string_view Trim(std::string_view s) {
+  while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) {
+    s.remove_prefix(1);
+  }
+  while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) {
+    s.remove_suffix(1);
+  }
+  return s;
+}
+
+static bool CaseEqual(std::string_view s, const char* lower) {
+  size_t n = strlen(lower);
+  if (s.size() != n) {
+    return false;
+  }
+  for (size_t i = 0; i < n; i++) {
+    if (tolower(static_cast<unsigned char>(s[i])) != lower[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Parse a qvalue ("0", "0.5", "1.000") into thousandths, -1 if malformed.
+static int ParseQValue(std::string_view s) {
+  if (s.empty() || (s[0] != '0' && s[0] != '1')) {
+    return -1;
+  }
+  int q = (s[0] - '0') * 1000;
+  if (s.size() == 1) {
+    return q;
+  }
+  if (s[1] != '.' || s.size() > 5) {
+    return -1;
+  }
+  int scale = 100;
+  for (size_t i = 2; i < s.size(); i++, scale /= 10) {
+    if (!isdigit(static_cast<unsigned char>(s[i]))) {
+      return -1;
+    }
+    q += (s[i] - '0') * scale;
+  }
+  return q > 1000 ? -1 : q;
+}
+
+ContentCoding NegotiateEncoding(std::string_view accept_encoding) {
+  // q-values in thousandths, -1 if not mentioned
+  int gzip = -1;
+  int deflate = -1;
+  int any = -1;
+  while (!accept_encoding.empty()) {
+    size_t comma = accept_encoding.find(',');
+    std::string_view item = accept_encoding.substr(0, comma);
+    accept_encoding.remove_prefix(comma == std::string_view::npos
+                                      ? accept_encoding.size()
+                                      : comma + 1);
+    size_t semi = item.find(';');
+    std::string_view name = Trim(item.substr(0, semi));
+    int q = 1000;
+    while (semi != std::string_view::npos) {
+      item.remove_prefix(semi + 1);
+      semi = item.find(';');
+      std::string_view param = Trim(item.substr(0, semi));
+      if (param.size() >= 2 && (param[0] == 'q' || param[0] == 'Q') &&
+          param[1] == '=') {
+        q = ParseQValue(param.substr(2));
+      }
+    }
+    if (q < 0) {
+      continue;
+    }
+    if (CaseEqual(name, "gzip") || CaseEqual(name, "x-gzip")) {
+      gzip = q;
+    } else if (CaseEqual(name, "deflate")) {
+      deflate = q;
+    } else if (name == "*") {
+      any = q;
+    }
+  }
+  if (gzip < 0) {
+    gzip = any;
+  }
+  if (deflate < 0) {
+    deflate = any;
+  }
+  if (gzip <= 0 && deflate <= 0) {
+    return ContentCoding::Identity;
+  }
+  return gzip >= deflate ? ContentCoding::Gzip : ContentCoding::Deflate;
+}
+
+CompressionPolicy::CompressionPolicy() {
+  const char* types[] = {"text/*",
+                         "application/json",
+                         "application/javascript",
+                         "application/xml",
+                         "application/wasm",
+                         "image/svg+xml"};
+  for (const char* type : types) {
+    levels_[type] = kDefaultLevel;
+  }
+}
+
+void CompressionPolicy::SetLevel(const std::string& type, int level) {
+  std::string key(type);
+  for (auto& c : key) {
+    c = tolower(static_cast<unsigned char>(c));
+  }
+  levels_[key] = level;
+}
+
+int CompressionPolicy::Level(std::string_view content_type) const {
+  content_type = Trim(content_type.substr(0, content_type.find(';')));
+  if (content_type.empty()) {
+    return kNoCompression;
+  }
+  std::string key(content_type);
+  for (auto& c : key) {
+    c = tolower(static_cast<unsigned char>(c));
+  }
+  auto it = levels_.find(key);
+  if (it != levels_.end()) {
+    return it->second;
+  }
+  size_t slash = key.find('/');
+  if (slash != std::string::npos) {
+    key.resize(slash + 1);
+    key += '*';
+    it = levels_.find(key);
+    if (it != levels_.end()) {
+      return it->second;
+    }
+  }
+  return default_level_;
+}
+
+Compressor::Compressor() {
+  memset(&zs_, 0, sizeof(zs_));
+}
+
+Compressor::~Compressor() {
+  if (inited_) {
+    deflateEnd(&zs_);
+  }
+}
+
+bool Compressor::Begin(ContentCoding coding, int level) {
+  if (inited_ && coding == coding_ && level == level_) {
+    return deflateReset(&zs_) == Z_OK;
+  }
+  if (inited_) {
+    deflateEnd(&zs_);
+    inited_ = false;
+  }
+  if (coding == ContentCoding::Identity) {
+    return false;
+  }
+  memset(&zs_, 0, sizeof(zs_));
+  // 16 + window bits selects the gzip wrapper, HTTP deflate is the zlib format
+  int window_bits = coding == ContentCoding::Gzip ? 16 + MAX_WBITS : MAX_WBITS;
+  if (deflateInit2(&zs_, level, Z_DEFLATED, window_bits, 8, Z_DEFAULT_STRATEGY) !=
+      Z_OK) {
+    return false;
+  }
+  inited_ = true;
+  coding_ = coding;
+  level_ = level;
+  return true;
+}
+
+bool Compressor::Update(const char* data, size_t len, Buffer& out, bool finish) {
+  if (!inited_) {
+    return false;
+  }
+  zs_.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+  zs_.avail_in = len;
+  int flush = finish ? Z_FINISH : Z_NO_FLUSH;
+  while (true) {
+    size_t want = deflateBound(&zs_, zs_.avail_in);
+    out.EnsureBytesForWrite(want < 4096 ? 4096 : want);
+    size_t room = out.WritableBytes();
+    zs_.next_out = reinterpret_cast<Bytef*>(out.BeginWritePointer());
+    zs_.avail_out = room;
+    int ret = deflate(&zs_, flush);
+    if (ret == Z_STREAM_ERROR) {
+      return false;
+    }
+    out.WriterIdxForward(room - zs_.avail_out);
+    if (finish ? ret == Z_STREAM_END : zs_.avail_in == 0 && zs_.avail_out != 0) {
+      return true;
+    }
+  }
+}
+
+bool Compressor::Compress(const char* data, size_t len, std::string& out) {
+  if (!inited_) {
+    return false;
+  }
+  out.resize(deflateBound(&zs_, len));
+  zs_.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+  zs_.avail_in = len;
+  zs_.next_out = reinterpret_cast<Bytef*>(&out[0]);
+  zs_.avail_out = out.size();
+  // the bound guarantees a single call finishes the stream
+  if (deflate(&zs_, Z_FINISH) != Z_STREAM_END) {
+    out.clear();
+    return false;
+  }
+  out.resize(out.size() - zs_.avail_out);
+  return true;
+}
+
+}  // namespace http
+}  // namespace ahrimq
@@ -0,0 +1,108 @@
+#ifndef _AHRIMQ_NET_HTTP_HTTP_COMPRESS_H_
+#define _AHRIMQ_NET_HTTP_HTTP_COMPRESS_H_
+
+#include <zlib.h>
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "base/nocopyable.h"
+#include "buffer/buffer.h"
+
+namespace ahrimq {
+namespace http {
+
+/// @brief Content codings the server can produce.
+enum class ContentCoding { Identity = 0, Gzip, Deflate };
+
+constexpr static size_t kContentCodingCount =
+    static_cast<size_t>(ContentCoding::Deflate) + 1;
+
+/// @brief Return the Content-Encoding token of coding, "identity" for Identity.
+/// @param coding
+/// @return
+const char* ContentCodingName(ContentCoding coding);
+
+/// @brief Pick the coding for a response from an Accept-Encoding value. The coding
+/// with the highest q-value wins, gzip is preferred over deflate on a tie, and "*"
+/// applies to codings not listed explicitly.
+/// @param accept_encoding Accept-Encoding header value
+/// @return ContentCoding::Identity if neither gzip nor deflate is acceptable
+ContentCoding NegotiateEncoding(std::string_view accept_encoding);
+
+/// @brief CompressionPolicy decides per media type whether a response is worth
+/// compressing, and with which zlib level. Already compressed formats (images,
+/// video, archives) are left alone by default.
+class CompressionPolicy {
+ public:
+  constexpr static int kNoCompression = -1;
+  constexpr static int kDefaultLevel = 6;
+
+  /// @brief Construct a policy compressing text, JSON, JavaScript, XML, SVG and
+  /// WebAssembly at kDefaultLevel.
+  CompressionPolicy();
+
+  /// @brief Set the level for a media type. type is either a full media type like
+  /// "application/json" or a wildcard like "text/*".
+  /// @param type
+  /// @param level zlib level from 0 to 9, or kNoCompression
+  void SetLevel(const std::string& type, int level);
+
+  /// @brief Set the level for media types without any matching rule.
+  /// @param level
+  void SetDefaultLevel(int level) {
+    default_level_ = level;
+  }
+
+  /// @brief Return the level for a Content-Type value, parameters are ignored.
+  /// @param content_type
+  /// @return kNoCompression if the type should not be compressed
+  int Level(std::string_view content_type) const;
+
+ private:
+  std::unordered_map<std::string, int> levels_;
+  int default_level_ = kNoCompression;
+};
+
+/// @brief Compressor is a reusable zlib deflate stream. The zlib state is kept
+/// between streams and only reset, so one compressor per thread avoids allocating
+/// the deflate window for every response.
+class Compressor : public NoCopyable {
+ public:
+  Compressor();
+
+  ~Compressor();
+
+  /// @brief Start a new stream.
+  /// @param coding ContentCoding::Gzip or ContentCoding::Deflate
+  /// @param level zlib level
+  /// @return false if zlib can not be initialized
+  bool Begin(ContentCoding coding, int level);
+
+  /// @brief Feed data into the stream, appending compressed bytes to out.
+  /// @param data
+  /// @param len
+  /// @param out
+  /// @param finish true for the last chunk of the stream
+  /// @return false on zlib errors
+  bool Update(const char* data, size_t len, Buffer& out, bool finish);
+
+  /// @brief Compress data as a whole stream into out, replacing its content.
+  /// @param data
+  /// @param len
+  /// @param out
+  /// @return false on zlib errors
+  bool Compress(const char* data, size_t len, std::string& out);
+
+ private:
+  z_stream zs_;
+  bool inited_ = false;
+  ContentCoding coding_ = ContentCoding::Identity;
+  int level_ = 0;
+};
+
+}  // namespace http
+}  // namespace ahrimq
+
+#endif  // _AHRIMQ_NET_HTTP_HTTP_COMPRESS_H_
@@ -0,0 +1,92 @@
+#include "ahrimq/net/http/http_compress.h"
+
+#include <gtest/gtest.h>
+
+using namespace ahrimq;
+using http::ContentCoding;
+
+static std::string Inflate(const char* data, size_t len) {
+  z_stream zs;
+  memset(&zs, 0, sizeof(zs));
+  // 32 + window bits detects both the gzip and the zlib wrapper
+  if (inflateInit2(&zs, 32 + MAX_WBITS) != Z_OK) {
+    return "";
+  }
+  std::string out;
+  char chunk[4096];
+  zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+  zs.avail_in = len;
+  int ret;
+  do {
+    zs.next_out = reinterpret_cast<Bytef*>(chunk);
+    zs.avail_out = sizeof(chunk);
+    ret = inflate(&zs, Z_NO_FLUSH);
+    out.append(chunk, sizeof(chunk) - zs.avail_out);
+  } while (ret == Z_OK);
+  inflateEnd(&zs);
+  return ret == Z_STREAM_END ? out : "";
+}
+
+TEST(HTTPCompressTest, NegotiateEncodingTest) {
+  EXPECT_EQ(http::NegotiateEncoding(""), ContentCoding::Identity);
+  EXPECT_EQ(http::NegotiateEncoding("gzip, deflate, br"), ContentCoding::Gzip);
+  EXPECT_EQ(http::NegotiateEncoding("deflate"), ContentCoding::Deflate);
+  EXPECT_EQ(http::NegotiateEncoding("GZIP;q=0.5, deflate;q=0.8"),
+            ContentCoding::Deflate);
+  EXPECT_EQ(http::NegotiateEncoding("gzip;q=0, deflate;q=0"),
+            ContentCoding::Identity);
+  EXPECT_EQ(http::NegotiateEncoding("*"), ContentCoding::Gzip);
+  EXPECT_EQ(http::NegotiateEncoding("*;q=0.1, gzip;q=0"), ContentCoding::Deflate);
+  EXPECT_EQ(http::NegotiateEncoding("x-gzip"), ContentCoding::Gzip);
+  EXPECT_EQ(http::NegotiateEncoding("br, identity"), ContentCoding::Identity);
+  // malformed q-values drop the item
+  EXPECT_EQ(http::NegotiateEncoding("gzip;q=2, deflate"), ContentCoding::Deflate);
+}
+
+TEST(HTTPCompressTest, PolicyTest) {
+  http::CompressionPolicy policy;
+  EXPECT_EQ(policy.Level("application/json; charset=utf-8"),
+            http::CompressionPolicy::kDefaultLevel);
+  EXPECT_EQ(policy.Level("Text/HTML"), http::CompressionPolicy::kDefaultLevel);
+  EXPECT_EQ(policy.Level("image/png"), http::CompressionPolicy::kNoCompression);
+  EXPECT_EQ(policy.Level(""), http::CompressionPolicy::kNoCompression);
+  policy.SetLevel("application/json", 9);
+  policy.SetLevel("text/*", 1);
+  policy.SetLevel("text/csv", http::CompressionPolicy::kNoCompression);
+  EXPECT_EQ(policy.Level("application/json"), 9);
+  EXPECT_EQ(policy.Level("text/plain"), 1);
+  EXPECT_EQ(policy.Level("text/csv"), http::CompressionPolicy::kNoCompression);
+  policy.SetDefaultLevel(3);
+  EXPECT_EQ(policy.Level("image/png"), 3);
+}
+
+TEST(HTTPCompressTest, CompressorTest) {
+  std::string text;
+  for (int i = 0; i < 1000; i++) {
+    text += "{\"id\":" + std::to_string(i) + ",\"name\":\"ahrimq\"},";
+  }
+  http::Compressor compressor;
+  for (auto coding : {ContentCoding::Gzip, ContentCoding::Deflate}) {
+    // streaming in chunks, the same compressor is reused for every stream
+    for (int round = 0; round < 2; round++) {
+      ASSERT_TRUE(compressor.Begin(coding, 6));
+      Buffer out(16);
+      size_t half = text.size() / 2;
+      ASSERT_TRUE(compressor.Update(text.data(), half, out, false));
+      ASSERT_TRUE(
+          compressor.Update(text.data() + half, text.size() - half, out, true));
+      EXPECT_LT(out.Size(), text.size() / 4);
+      EXPECT_EQ(Inflate(out.BeginReadPointer(), out.Size()), text);
+    }
+    std::string whole;
+    ASSERT_TRUE(compressor.Begin(coding, 9));
+    ASSERT_TRUE(compressor.Compress(text.data(), text.size(), whole));
+    EXPECT_EQ(Inflate(whole.data(), whole.size()), text);
+  }
+  EXPECT_FALSE(compressor.Begin(ContentCoding::Identity, 6));
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -7,8 +7,19 @@ HTTPConn::HTTPConn(ReactorConn* conn)
     : TCPConn(conn),
       current_parsing_state_(RequestParsingState::RequestLine),
       current_line_state_(LineParsingState::LineComplete) {
-  current_request_ = std::make_shared<HTTPRequest>(&read_buf_);
-  current_response_ = std::make_shared<HTTPResponse>(&write_buf_);
+  current_request_ = std::make_shared<HTTPRequest>(&read_buf_, &arena_);
+  current_response_ = std::make_shared<HTTPResponse>(&write_buf_, &arena_);
+}
+
+HTTPConn::HTTPConn(ReactorConn* conn, std::weak_ptr<HTTP2Session> session,
+                   uint32_t stream_id)
+    : TCPConn(conn, 4096, 64),
+      current_parsing_state_(RequestParsingState::Done),
+      current_line_state_(LineParsingState::LineComplete),
+      session_(std::move(session)),
+      stream_id_(stream_id) {
+  current_request_ = std::make_shared<HTTPRequest>(&read_buf_, &arena_);
+  current_response_ = std::make_shared<HTTPResponse>(&write_buf_, &arena_);
 }
 
 HTTPConn::~HTTPConn() {
@@ -16,5 +27,50 @@ HTTPConn::~HTTPConn() {
   current_response_.reset();
 }
 
+void HTTPConn::ResetExchange() {
+  current_request_->Reset();
+  current_response_->Reset();
+  // nothing refers to the arena any more
+  arena_.Reset();
+}
+
+bool HTTPConn::PutFile(const OpenFileCache::FilePtr& file) {
+  if (IsStream()) {
+    return PutFile(file, 0, file->size);
+  }
+  if (!conn_->PutFile(file->fd, false)) {
+    return false;
+  }
+  sending_file_ = file;
+  return true;
+}
+
+bool HTTPConn::PutFile(const OpenFileCache::FilePtr& file, size_t offset,
+                       size_t length) {
+  if (!IsStream()) {
+    if (!conn_->PutFile(file->fd, offset, length, false)) {
+      return false;
+    }
+  } else if (offset + length > file->size) {
+    return false;
+  }
+  sending_file_ = file;
+  file_offset_ = offset;
+  file_length_ = length;
+  return true;
+}
+
+void HTTPConn::Suspend() {
+  if (!IsStream()) {
+    conn_->Suspend();
+  }
+}
+
+void HTTPConn::Resume() {
+  if (!Detached()) {
+    conn_->Resume();
+  }
+}
+
 }  // namespace http
 }  // namespace ahrimq
\ No newline at end of file
@@ -1,7 +1,9 @@
 #ifndef _AHRIMQ_NET_HTTP_HTTP_CONN_H_
 #define _AHRIMQ_NET_HTTP_HTTP_CONN_H_
 
+#include "base/arena.h"
 #include "net/http/http_parser.h"
+#include "net/http/open_file_cache.h"
 #include "net/http/http_request.h"
 #include "net/http/http_response.h"
 #include "net/tcp/tcp_conn.h"
@@ -13,6 +15,8 @@ enum class RequestParsingState;
 enum class LineParsingState;
 class HTTPServer;
 class HTTPConn;
+class HTTP2Session;
+class WebSocketConn;
 
 /// @brief RequestParsingState Indicates the current state when parsing http request datagram, current
 /// state means expected data to see next
@@ -46,15 +50,26 @@ enum class LineParsingState {
   LineCompleteEmptyLine
 };
 
-/// @brief HTTPConn represents a http connection over tcp connection.
+/// @brief HTTPConn represents a http connection over tcp connection. The streams of
+/// a HTTP/2 connection are HTTPConn instances as well, sharing the connection of
+/// their session, so that every request goes through the same handling.
 class HTTPConn : public TCPConn {
   friend class HTTPServer;
+  friend class HTTP2Session;
 
  public:
   /// @brief Construct a http connection instance.
   /// @param conn
   explicit HTTPConn(ReactorConn* conn);
 
+  /// @brief Construct the exchange of a HTTP/2 stream. Its read buffer only holds
+  /// the request body, its write buffer is not used.
+  /// @param conn the connection of the session
+  /// @param session
+  /// @param stream_id
+  HTTPConn(ReactorConn* conn, std::weak_ptr<HTTP2Session> session,
+           uint32_t stream_id);
+
   ~HTTPConn();
 
   /// @brief Set current http request parsing state to target state.
@@ -123,7 +138,53 @@ class HTTPConn : public TCPConn {
     return current_response_ == nullptr;
   }
 
+  /// @brief Reset the request and the response for the next request on this
+  /// connection, and release everything they took from the arena at once.
+  void ResetExchange();
+
+  /// @brief Check if this is a stream of a HTTP/2 connection.
+  /// @return
+  bool IsStream() const {
+    return stream_id_ != 0;
+  }
+
+  uint32_t StreamId() const {
+    return stream_id_;
+  }
+
+  /// @brief Check if the connection of a stream is gone, which happens when a
+  /// handler outlives the connection it was called for.
+  /// @return
+  bool Detached() const {
+    return IsStream() && session_.expired();
+  }
+
+  /// @brief Send the whole file after the response head. A HTTP/1 connection hands
+  /// it to the reactor, which uses sendfile, a stream frames it into DATA frames.
+  /// The file is kept open until it is sent.
+  /// @param file
+  /// @return false if the file can not be sent
+  bool PutFile(const OpenFileCache::FilePtr& file);
+
+  /// @brief Send bytes [offset, offset + length) of file after the response head.
+  /// @param file
+  /// @param offset
+  /// @param length
+  /// @return false if the range is not inside the file
+  bool PutFile(const OpenFileCache::FilePtr& file, size_t offset, size_t length);
+
+  /// @brief Stop watching the connection while the response is prepared outside
+  /// of the event handlers. A stream leaves its connection watched, so that the
+  /// other streams go on.
+  void Suspend();
+
+  /// @brief Watch the connection again, for writing if the response is ready.
+  void Resume();
+
  private:
+  // per-request memory of the request and response headers, declared first so
+  // that it outlives them
+  Arena arena_;
   // the state this HTTP connection is at when parsing request datagram
   RequestParsingState current_parsing_state_;
   // the state this HTTP connection is at when parsing line
@@ -132,6 +193,18 @@ class HTTPConn : public TCPConn {
   HTTPRequestPtr current_request_;
   // current HTTP response
   HTTPResponsePtr current_response_;
+  // file being sent by the reactor, held until the response is written
+  OpenFileCache::FilePtr sending_file_;
+  // the file range a stream sends after its head
+  size_t file_offset_ = 0;
+  size_t file_length_ = 0;
+  // set on the streams of a HTTP/2 connection
+  std::weak_ptr<HTTP2Session> session_;
+  uint32_t stream_id_ = 0;
+  // the session of a connection which switched to HTTP/2
+  std::shared_ptr<HTTP2Session> h2_;
+  // the connection which took over after a WebSocket handshake
+  std::shared_ptr<WebSocketConn> ws_;
 };
 
 typedef std::shared_ptr<HTTPConn> HTTPConnPtr;
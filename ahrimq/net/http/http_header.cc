@@ -1,5 +1,7 @@
 #include "net/http/http_header.h"
 
+#include <strings.h>
+
 #include <cstring>
 
 #include "base/str_utils.h"
@@ -7,43 +9,64 @@
 namespace ahrimq {
 namespace http {
 
-HTTPHeader::HTTPHeader(HTTPHeader&& other) {
-  other.members_.swap(members_);
+static bool KeyEquals(std::string_view a, std::string_view b) {
+  return a.size() == b.size() && strncasecmp(a.data(), b.data(), a.size()) == 0;
 }
 
-void HTTPHeader::Add(const std::string& key, const std::string& value) {
-  members_[key].emplace_back(value);
+const HTTPHeader::MemberType* HTTPHeader::Find(std::string_view key) const {
+  for (const auto& item : members_) {
+    if (KeyEquals(item.first, key)) {
+      return &item;
+    }
+  }
+  return nullptr;
 }
 
-void HTTPHeader::Del(const std::string& key) {
-  members_.erase(key);
+HTTPHeader::MemberType* HTTPHeader::Find(std::string_view key) {
+  return const_cast<MemberType*>(
+      static_cast<const HTTPHeader*>(this)->Find(key));
 }
 
-std::string HTTPHeader::Get(const std::string& key) const {
-  if (!Has(key)) {
-    return "";
+void HTTPHeader::Add(std::string_view key, std::string_view value) {
+  MemberType* item = Find(key);
+  if (item == nullptr) {
+    // the pair, its key and its values all use the allocator of members_
+    item = &members_.emplace_back(std::piecewise_construct, std::tuple(key),
+                                  std::tuple());
   }
-  try {
-    return members_.at(key)[0];
-  } catch (std::exception& ex) {
-    return "";
+  item->second.emplace_back(value);
+}
+
+void HTTPHeader::Del(std::string_view key) {
+  const MemberType* item = Find(key);
+  if (item != nullptr) {
+    members_.erase(members_.begin() + (item - members_.data()));
   }
 }
 
-std::vector<std::string> HTTPHeader::Values(const std::string& key) const {
-  try {
-    return members_.at(key);
-  } catch (std::exception& ex) {
+std::string_view HTTPHeader::GetView(std::string_view key) const {
+  const MemberType* item = Find(key);
+  if (item == nullptr || item->second.empty()) {
     return {};
   }
+  return item->second[0];
 }
 
-void HTTPHeader::Set(const std::string& key, const std::string& value) {
-  if (members_.count(key) == 0) {
-    members_.emplace(key, std::vector<std::string>{value});
+std::vector<std::string> HTTPHeader::Values(std::string_view key) const {
+  const MemberType* item = Find(key);
+  if (item == nullptr) {
+    return {};
+  }
+  return std::vector<std::string>(item->second.begin(), item->second.end());
+}
+
+void HTTPHeader::Set(std::string_view key, std::string_view value) {
+  MemberType* item = Find(key);
+  if (item == nullptr) {
+    Add(key, value);
   } else {
-    members_[key].clear();
-    members_[key].emplace_back(value);
+    item->second.clear();
+    item->second.emplace_back(value);
   }
 }
 
@@ -60,59 +83,36 @@ std::vector<std::vector<std::string>> HTTPHeader::AllFieldValues() const {
   std::vector<std::vector<std::string>> values;
   values.reserve(members_.size());
   for (auto&& item : members_) {
-    values.emplace_back(item.second);
+    values.emplace_back(item.second.begin(), item.second.end());
   }
   return values;
 }
 
 void HTTPHeader::Clear() {
-  members_.clear();
+  // clear() would keep the capacity, which an arena reset takes away
+  members_ = MemberMapType(members_.get_allocator());
 }
 
-bool HTTPHeader::Has(const std::string& key) const {
-  return members_.count(key) != 0;
+bool HTTPHeader::Has(std::string_view key) const {
+  return Find(key) != nullptr;
 }
 
-bool HTTPHeader::Equals(const std::string& key, const std::string& target) const {
-  try {
-    return members_.at(key)[0] == target;
-  } catch (std::exception& ex) {
-    return false;
-  }
+bool HTTPHeader::Equals(std::string_view key, std::string_view target) const {
+  const MemberType* item = Find(key);
+  return item != nullptr && !item->second.empty() && item->second[0] == target;
 }
 
-bool HTTPHeader::Equals(const std::string& key, const char* target) const {
-  try {
-    return std::strcmp(members_.at(key)[0].c_str(), target) == 0;
-  } catch (std::exception& ex) {
-    return false;
-  }
-}
-
-bool HTTPHeader::CaseEquals(const std::string& key,
-                            const std::string& target) const {
-  try {
-    return strcasecmp(members_.at(key)[0].c_str(), target.c_str()) == 0;
-  } catch (std::exception& ex) {
-    return false;
-  }
+bool HTTPHeader::CaseEquals(std::string_view key, std::string_view target) const {
+  const MemberType* item = Find(key);
+  return item != nullptr && !item->second.empty() &&
+         KeyEquals(item->second[0], target);
 }
 
-bool HTTPHeader::CaseEquals(const std::string& key, const char* target) const {
-  try {
-    return strcasecmp(members_.at(key)[0].c_str(), target) == 0;
-  } catch (std::exception& ex) {
-    return false;
-  }
-}
-
-bool HTTPHeader::Contains(const std::string& key, const std::string& target) const {
-  try {
-    return members_.at(key)[0].find(target) != std::string::npos;
-  } catch (std::exception& ex) {
-    return false;
-  }
+bool HTTPHeader::Contains(std::string_view key, std::string_view target) const {
+  const MemberType* item = Find(key);
+  return item != nullptr && !item->second.empty() &&
+         item->second[0].find(target) != std::string::npos;
 }
 
 }  // namespace http
-}  // namespace ahrimq
\ No newline at end of file
+}  // namespace ahrimq
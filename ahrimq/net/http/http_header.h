@@ -3,8 +3,9 @@
 
 #include <cstring>
 #include <memory>
+#include <memory_resource>
 #include <string>
-#include <unordered_map>
+#include <string_view>
 #include <vector>
 
 #include "base/str_utils.h"
@@ -12,62 +13,62 @@
 namespace ahrimq {
 namespace http {
 
-/// @brief HTTPHeader represents a http header
+/// @brief HTTPHeader represents a http header. Fields are kept in insertion order
+/// and looked up case-insensitively by a linear scan, which is cheaper than hashing
+/// for the handful of fields a message usually carries, and gives a stable order
+/// when the header is serialized.
+///
+/// The fields are pmr containers drawing from the memory resource given at
+/// construction, the connection arena for the headers of a request or a response.
 class HTTPHeader {
-  struct CaseInsensitiveHasher {
-    size_t operator()(const std::string& s) const {
-      std::string n(s);
-      StrInplaceToLower(n);
-      return std::hash<std::string>()(n);
-    }
-  };
-
-  struct CaseInsensitiveComparator {
-    bool operator()(const std::string& s1, const std::string& s2) const {
-      return strcasecmp(s1.c_str(), s2.c_str()) == 0;
-    }
-  };
-
  public:
-  // clang-format off
-  using MemberMapType = std::unordered_map<std::string, 
-                      std::vector<std::string>, 
-                      CaseInsensitiveHasher,
-                      CaseInsensitiveComparator>;
-  // clang-format on
+  using MemberType = std::pair<std::pmr::string, std::pmr::vector<std::pmr::string>>;
+  using MemberMapType = std::pmr::vector<MemberType>;
 
-  HTTPHeader() = default;
+  /// @brief Construct an empty header.
+  /// @param mr memory resource of the fields, it must outlive the header
+  explicit HTTPHeader(
+      std::pmr::memory_resource* mr = std::pmr::get_default_resource())
+      : members_(mr) {}
 
   HTTPHeader(const HTTPHeader&) = default;
 
   HTTPHeader& operator=(const HTTPHeader&) = default;
 
-  HTTPHeader(HTTPHeader&& other);
+  HTTPHeader(HTTPHeader&& other) = default;
 
   /// @brief Add field into http header.
   /// @param key
   /// @param value
-  void Add(const std::string& key, const std::string& value);
+  void Add(std::string_view key, std::string_view value);
 
   /// @brief Delete field from http header.
   /// @param key
-  void Del(const std::string& key);
+  void Del(std::string_view key);
 
   /// @brief Gets the first value associated with the given key.
   /// @param key
   /// @return
-  std::string Get(const std::string& key) const;
+  std::string Get(std::string_view key) const {
+    return std::string(GetView(key));
+  }
+
+  /// @brief Gets the first value associated with the given key without copying.
+  /// The view is valid until the field is modified or the header is cleared.
+  /// @param key
+  /// @return an empty view if key does not exist
+  std::string_view GetView(std::string_view key) const;
 
   /// @brief Gets all values associated with the given key.
   /// @param key
   /// @return
-  std::vector<std::string> Values(const std::string& key) const;
+  std::vector<std::string> Values(std::string_view key) const;
 
   /// @brief Set value with given key. If key already exists, the original value will
   /// be overwritten.
   /// @param key
   /// @param value
-  void Set(const std::string& key, const std::string& value);
+  void Set(std::string_view key, std::string_view value);
 
   /// @brief Get all field keys.
   /// @return
@@ -77,33 +78,26 @@ class HTTPHeader {
   /// @return
   std::vector<std::vector<std::string>> AllFieldValues() const;
 
-  /// @brief Clear all header fields.
+  /// @brief Clear all header fields and give their storage back to the memory
+  /// resource.
   void Clear();
 
   /// @brief Check given field exists.
   /// @param key
   /// @return
-  bool Has(const std::string& key) const;
-
-  /// @brief Compares the first value with the given key is equal to target.
-  /// @param key given key
-  /// @param target target value
-  /// @return
-  bool Equals(const std::string& key, const std::string& target) const;
+  bool Has(std::string_view key) const;
 
   /// @brief Compares the first value with the given key is equal to target.
   /// @param key given key
   /// @param target target value
   /// @return
-  bool Equals(const std::string& key, const char* target) const;
+  bool Equals(std::string_view key, std::string_view target) const;
 
-  bool CaseEquals(const std::string& key, const std::string& target) const;
+  bool CaseEquals(std::string_view key, std::string_view target) const;
 
-  bool CaseEquals(const std::string& key, const char* target) const;
+  bool Contains(std::string_view key, std::string_view target) const;
 
-  bool Contains(const std::string& key, const std::string& target) const;
-
-  /// @brief Return the underneath std::unordered_map.
+  /// @brief Return all fields in insertion order.
   /// @return
   const MemberMapType& Members() const {
     return members_;
@@ -113,6 +107,18 @@ class HTTPHeader {
     return members_.size();
   }
 
+  bool Empty() const {
+    return members_.empty();
+  }
+
+ private:
+  /// @brief Find field with given key, return nullptr if not found.
+  /// @param key
+  /// @return
+  const MemberType* Find(std::string_view key) const;
+
+  MemberType* Find(std::string_view key);
+
  private:
   MemberMapType members_;
 };
@@ -35,6 +35,10 @@ enum class HTTPMethod {
   Trace
 };
 
+/// @brief Number of HTTPMethod values, usable to index per-method arrays.
+constexpr static size_t kHTTPMethodCount =
+    static_cast<size_t>(HTTPMethod::Trace) + 1;
+
 static std::unordered_map<HTTPMethod, std::string> httpMethodStringMapping{
     {HTTPMethod::Get, MethodGet},         {HTTPMethod::Head, MethodHead},
     {HTTPMethod::Post, MethodPost},       {HTTPMethod::Put, MethodPut},
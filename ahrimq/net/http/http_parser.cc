@@ -9,18 +9,18 @@ namespace http {
 
 // line store the parsed single line as result
 // CRLF is line seperator
-LineParsingState ParseSingleLine(HTTPConn* conn, std::string& line) {
+LineParsingState ParseSingleLine(HTTPConn* conn, std::string_view& line) {
   Buffer& rbuf = conn->GetReadBuffer();
   if (rbuf.Size() == 0) {
     return LineParsingState::LinePending;
   }
-  // line.replace(line.begin(), line.end(), rbuf.ReadStringAndForwardTill(kCRLF));
-  bool crlf_found;
-  std::string tmp = rbuf.ReadStringAndForwardTill(kCRLF, crlf_found);
-  if (!crlf_found) {
+  int pos = rbuf.FindCRLFInReadable();
+  if (pos == -1) {
     return LineParsingState::LinePending;
   }
-  line.replace(line.begin(), line.end(), std::move(tmp));
+  // the bytes stay in place until the buffer is written again
+  line = std::string_view(rbuf.BeginReadPointer(), pos);
+  rbuf.ReaderIdxForward(pos + 2);
   // found
   if (line.empty()) {
     // CRLF is at the begining of the buffer
@@ -35,24 +35,31 @@ int ParseRequestLine(HTTPConn* conn) {
   Buffer& rbuf = conn->GetReadBuffer();
   // we should always ignore any leading CRLF when parsing request line
   rbuf.TrimLeft();
-  std::string request_line;
+  std::string_view request_line;
   LineParsingState line_state = ParseSingleLine(conn, request_line);
   if (line_state == LineParsingState::LinePending ||
       line_state == LineParsingState::LineCompleteEmptyLine) {
     return StatusPrivatePending;
   }
   // check request line
-  std::vector<std::string> v = StrSplit(request_line, ' ');
   // HTTPMethod Request-URL HTTPVersion
-  if (v.size() != 3) {  // syntax error
+  std::string_view v[3];
+  size_t n = 0;
+  while (n < 3 && !request_line.empty()) {
+    size_t sp = request_line.find(' ');
+    v[n++] = request_line.substr(0, sp);
+    request_line.remove_prefix(sp == std::string_view::npos ? request_line.size()
+                                                            : sp + 1);
+  }
+  if (n != 3 || !request_line.empty()) {  // syntax error
     conn->SetCurrentParsingStateInvalid();
     std::cerr << "ParseRequestLine " << StatusBadRequest << '\n';
     return StatusBadRequest;  // 400
   }
 
   HTTPRequestPtr& req_ref = conn->CurrentRequestRef();
-  // method
-  const std::string& request_method = v[0];
+  // method, short enough to not allocate
+  const std::string request_method(v[0]);
   if (!HTTPMethodSupported(request_method)) {
     conn->SetCurrentParsingStateInvalid();  // invalidate
     std::cerr << "ParseRequestLine " << StatusNotImplemented << '\n';
@@ -61,11 +68,10 @@ int ParseRequestLine(HTTPConn* conn) {
   req_ref->SetMethod(request_method);
 
   // url
-  const std::string& request_url = v[1];
-  req_ref->SetURL(request_url);
+  req_ref->SetURL(v[1]);
 
   // version
-  const std::string& request_http_version = v[2];
+  const std::string request_http_version(v[2]);
   int httpver = ParseHTTPVersion(request_http_version);
   if (!HTTPVersionSupported(httpver)) {
     conn->SetCurrentParsingStateInvalid();  // invalidate
@@ -79,33 +85,31 @@ int ParseRequestLine(HTTPConn* conn) {
 }
 
 int ParseRequestHeader(HTTPConn* conn) {
-  Buffer& rbuf = conn->GetReadBuffer();
   HTTPRequestPtr& req_ref = conn->CurrentRequestRef();
   HTTPHeaderPtr& header_ref = req_ref->HeaderRef();
   LineParsingState line_state = LineParsingState::LineComplete;
-  std::string field;
+  std::string_view field;
 
   while ((line_state = ParseSingleLine(conn, field)) ==
          LineParsingState::LineComplete) {
     // parse field-key and field-value
-    auto where_is_colon = std::find(field.begin(), field.end(), ':');
-    if (where_is_colon != field.end()) {
+    size_t where_is_colon = field.find(':');
+    if (where_is_colon != std::string_view::npos) {
       // found colon-seperator(':'), we assume this field is value;
-      std::string field_key = std::string(field.begin(), where_is_colon);
-      std::string field_value = std::string(where_is_colon + 1, field.end());
-      field_value = StrTrimLeft(field_value);
-      if (strcasecmp(field_key.c_str(), "cookie") == 0) {
-        // special handling for cookie header
-        ParseCookieString(field_value, req_ref->Cookies(), 16);
-      } else {
-        // field-value may be a list whose elements are seperate by comma(,)
-        header_ref->Add(field_key, field_value);
+      std::string_view field_key = field.substr(0, where_is_colon);
+      std::string_view field_value = field.substr(where_is_colon + 1);
+      while (!field_value.empty() &&
+             (field_value.front() == ' ' || field_value.front() == '\t')) {
+        field_value.remove_prefix(1);
       }
+      // field-value may be a list whose elements are seperate by comma(,), cookies
+      // are split from the header when the handler asks for them
+      header_ref->Add(field_key, field_value);
       // continue to parse next field
       continue;
     } else {
       // we could not found colon-seperator, assume this is a bad request
-      line_state == LineParsingState::LineInvalid;
+      line_state = LineParsingState::LineInvalid;
       break;
     }
   }
@@ -172,6 +176,17 @@ int ParseRequestBody(HTTPConn* conn) {
     return StatusBadRequest;  // 400
   }
   Buffer& rbuf = conn->GetReadBuffer();
+  HTTPRequestPtr& req = conn->CurrentRequestRef();
+  if (req->MultipartForm()) {
+    // parts are streamed out of the read buffer as they arrive
+    int retcode = req->FeedMultipart(rbuf, clen);
+    if (retcode == StatusPrivateComplete) {
+      conn->SetCurrentParsingStateDone();
+    } else if (retcode != StatusPrivatePending) {
+      conn->SetCurrentParsingStateInvalid();
+    }
+    return retcode;
+  }
   if (rbuf.Size() >= clen) {
     // already receive content whose length is clen
     conn->SetCurrentParsingStateDone();
@@ -216,7 +231,10 @@ int ParseRequestDatagram(HTTPConn* conn) {
         conn->ResetWriteBuffer();
         // TODO 2. close client connection if needed (408)
         printf("case RequestParsingState::Invalid\n");
-        retcode = StatusPrivateInvalid;
+        // keep the status reported by the failed step, e.g. 413
+        if (retcode == StatusPrivateComplete) {
+          retcode = StatusPrivateInvalid;
+        }
         break;
       }
       case RequestParsingState::Done: {
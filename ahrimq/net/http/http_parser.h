@@ -23,7 +23,12 @@ const static char* kCRLF = "\r\n";
 /// @brief This enum class represents the operation result after parsing.
 enum class ParsingResCode { Complete, Pending, Invalid };
 
-LineParsingState ParseSingleLine(HTTPConn* conn, std::string& line);
+/// @brief Take the next CRLF terminated line out of the read buffer.
+/// @param conn
+/// @param line receives a view of the line without CRLF, which stays valid until
+/// more data is appended to the read buffer
+/// @return
+LineParsingState ParseSingleLine(HTTPConn* conn, std::string_view& line);
 
 int ParseRequestLine(HTTPConn* conn);
 
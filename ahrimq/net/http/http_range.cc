@@ -0,0 +1,149 @@
+#include "net/http/http_range.h"
+
+#include <strings.h>
+
+#include "base/time_utils.h"
+
+namespace ahrimq {
+namespace http {
+
+static inline std::string_view Trim(std::string_view s) {
+  while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) {
+    s.remove_prefix(1);
+  }
+  while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) {
+    s.remove_suffix(1);
+  }
+  return s;
+}
+
+// parse a non-empty decimal number without overflow
+static bool ParseSize(std::string_view s, size_t& out) {
+  if (s.empty()) {
+    return false;
+  }
+  size_t v = 0;
+  for (char c : s) {
+    if (c < '0' || c > '9') {
+      return false;
+    }
+    size_t d = c - '0';
+    if (v > (SIZE_MAX - d) / 10) {
+      return false;
+    }
+    v = v * 10 + d;
+  }
+  out = v;
+  return true;
+}
+
+RangeResult ParseRange(const std::string& value, size_t size,
+                       std::vector<ByteRange>& out) {
+  out.clear();
+  std::string_view v = Trim(value);
+  if (v.size() < 6 || strncasecmp(v.data(), "bytes=", 6) != 0) {
+    return RangeResult::None;
+  }
+  v.remove_prefix(6);
+  size_t specs = 0;
+  while (!v.empty()) {
+    size_t comma = v.find(',');
+    std::string_view spec = Trim(v.substr(0, comma));
+    v = comma == std::string_view::npos ? std::string_view() : v.substr(comma + 1);
+    if (spec.empty()) {
+      continue;  // empty list elements are allowed
+    }
+    if (++specs > kMaxByteRanges) {
+      out.clear();
+      return RangeResult::None;
+    }
+    size_t dash = spec.find('-');
+    if (dash == std::string_view::npos) {
+      out.clear();
+      return RangeResult::None;
+    }
+    std::string_view first = spec.substr(0, dash);
+    std::string_view last = spec.substr(dash + 1);
+    size_t a = 0;
+    size_t b = 0;
+    if (first.empty()) {
+      // suffix range "-n": the last n bytes
+      if (!ParseSize(last, b)) {
+        out.clear();
+        return RangeResult::None;
+      }
+      if (b == 0 || size == 0) {
+        continue;
+      }
+      if (b > size) {
+        b = size;
+      }
+      out.push_back(ByteRange{size - b, b});
+      continue;
+    }
+    if (!ParseSize(first, a)) {
+      out.clear();
+      return RangeResult::None;
+    }
+    if (last.empty()) {
+      b = size == 0 ? 0 : size - 1;
+    } else if (!ParseSize(last, b) || b < a) {
+      out.clear();
+      return RangeResult::None;
+    }
+    if (a >= size) {
+      continue;
+    }
+    if (b >= size) {
+      b = size - 1;
+    }
+    out.push_back(ByteRange{a, b - a + 1});
+  }
+  if (specs == 0) {
+    return RangeResult::None;
+  }
+  return out.empty() ? RangeResult::NotSatisfiable : RangeResult::Satisfiable;
+}
+
+static inline std::string_view StripWeak(std::string_view tag) {
+  if (tag.size() >= 2 && tag[0] == 'W' && tag[1] == '/') {
+    tag.remove_prefix(2);
+  }
+  return tag;
+}
+
+bool ETagListMatch(const std::string& value, std::string_view etag) {
+  std::string_view v = Trim(value);
+  if (v == "*") {
+    return true;
+  }
+  etag = StripWeak(etag);
+  while (!v.empty()) {
+    size_t comma = v.find(',');
+    std::string_view tag = Trim(v.substr(0, comma));
+    v = comma == std::string_view::npos ? std::string_view() : v.substr(comma + 1);
+    if (StripWeak(tag) == etag) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool IfRangeMatch(const std::string& value, std::string_view etag, time_t mtime) {
+  std::string_view v = Trim(value);
+  if (v.empty()) {
+    return false;
+  }
+  if (v.front() == '"') {
+    return v == etag;
+  }
+  if (v.front() == 'W' && v.size() > 1 && v[1] == '/') {
+    // weak entity tags never match strongly
+    return false;
+  }
+  time_t t;
+  return time::ParseGMTTime(v.data(), v.size(), t) && t == mtime;
+}
+
+}  // namespace http
+}  // namespace ahrimq
@@ -0,0 +1,66 @@
+#ifndef _AHRIMQ_NET_HTTP_HTTP_RANGE_H_
+#define _AHRIMQ_NET_HTTP_HTTP_RANGE_H_
+
+#include <ctime>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace ahrimq {
+namespace http {
+
+/// @brief ByteRange represents bytes [offset, offset + length) of a file.
+struct ByteRange {
+  size_t offset;
+  size_t length;
+};
+
+/// @brief Outcome of parsing a Range header.
+enum class RangeResult {
+  // no usable range, the whole representation should be sent
+  None,
+  // at least one satisfiable range
+  Satisfiable,
+  // syntactically valid but no range overlaps the representation (416)
+  NotSatisfiable
+};
+
+/// @brief Requests with more ranges than this are answered with the full
+/// representation.
+constexpr static size_t kMaxByteRanges = 16;
+
+/// @brief multipart/byteranges bodies are assembled in memory, requests asking for
+/// more bytes than this in several ranges are answered with the full
+/// representation.
+constexpr static size_t kMaxMultiRangeBytes = 1024 * 1024;
+
+/// @brief Parse a Range header value like "bytes=0-99,200-,-50" against a
+/// representation of size bytes. Ranges are clipped to size; unsatisfiable ones are
+/// dropped. An invalid header yields RangeResult::None, as the header must then be
+/// ignored.
+/// @param value Range header value
+/// @param size representation size
+/// @param out satisfiable ranges in request order
+/// @return
+RangeResult ParseRange(const std::string& value, size_t size,
+                       std::vector<ByteRange>& out);
+
+/// @brief Check an If-None-Match value ("*" or a list of entity tags) against etag
+/// using the weak comparison.
+/// @param value If-None-Match header value
+/// @param etag quoted entity tag of the representation
+/// @return
+bool ETagListMatch(const std::string& value, std::string_view etag);
+
+/// @brief Check whether an If-Range value still matches the representation. An
+/// entity tag is compared strongly, a date must equal the modification time.
+/// @param value If-Range header value
+/// @param etag quoted entity tag of the representation
+/// @param mtime modification time of the representation
+/// @return
+bool IfRangeMatch(const std::string& value, std::string_view etag, time_t mtime);
+
+}  // namespace http
+}  // namespace ahrimq
+
+#endif  // _AHRIMQ_NET_HTTP_HTTP_RANGE_H_
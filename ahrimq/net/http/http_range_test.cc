@@ -0,0 +1,68 @@
+#include "ahrimq/net/http/http_range.h"
+
+#include <gtest/gtest.h>
+
+using namespace ahrimq;
+
+TEST(HTTPRangeTest, ParseRangeTest) {
+  struct rangeCase {
+    std::string value;
+    size_t size;
+    http::RangeResult expect;
+    std::vector<std::pair<size_t, size_t>> ranges;
+  };
+  using http::RangeResult;
+  auto cases = std::vector<rangeCase>{
+      {"bytes=0-99", 1000, RangeResult::Satisfiable, {{0, 100}}},
+      {"bytes=500-", 1000, RangeResult::Satisfiable, {{500, 500}}},
+      {"bytes=-200", 1000, RangeResult::Satisfiable, {{800, 200}}},
+      {"bytes=-2000", 1000, RangeResult::Satisfiable, {{0, 1000}}},
+      {"bytes=900-1999", 1000, RangeResult::Satisfiable, {{900, 100}}},
+      {"Bytes= 0-0 , 10-19,", 1000, RangeResult::Satisfiable, {{0, 1}, {10, 10}}},
+      {"bytes=1000-", 1000, RangeResult::NotSatisfiable, {}},
+      {"bytes=-0", 1000, RangeResult::NotSatisfiable, {}},
+      {"bytes=0-", 0, RangeResult::NotSatisfiable, {}},
+      {"bytes=1000-1100,0-9", 1000, RangeResult::Satisfiable, {{0, 10}}},
+      {"bytes=10-5", 1000, RangeResult::None, {}},
+      {"bytes=a-5", 1000, RangeResult::None, {}},
+      {"bytes=5", 1000, RangeResult::None, {}},
+      {"items=0-5", 1000, RangeResult::None, {}},
+      {"bytes=", 1000, RangeResult::None, {}},
+      {"bytes=0-99999999999999999999999", 1000, RangeResult::None, {}},
+  };
+  for (const auto& c : cases) {
+    std::vector<http::ByteRange> out;
+    EXPECT_EQ(http::ParseRange(c.value, c.size, out), c.expect) << c.value;
+    ASSERT_EQ(out.size(), c.ranges.size()) << c.value;
+    for (size_t i = 0; i < out.size(); i++) {
+      EXPECT_EQ(out[i].offset, c.ranges[i].first) << c.value;
+      EXPECT_EQ(out[i].length, c.ranges[i].second) << c.value;
+    }
+  }
+
+  std::string many = "bytes=0-0";
+  for (size_t i = 1; i <= http::kMaxByteRanges; i++) {
+    many += "," + std::to_string(i) + "-" + std::to_string(i);
+  }
+  std::vector<http::ByteRange> out;
+  EXPECT_EQ(http::ParseRange(many, 1000, out), http::RangeResult::None);
+}
+
+TEST(HTTPRangeTest, ValidatorTest) {
+  std::string etag = "\"1a-2b-3c\"";
+  EXPECT_TRUE(http::ETagListMatch("*", etag));
+  EXPECT_TRUE(http::ETagListMatch("\"1a-2b-3c\"", etag));
+  EXPECT_TRUE(http::ETagListMatch("\"x\", W/\"1a-2b-3c\"", etag));
+  EXPECT_FALSE(http::ETagListMatch("\"x\", \"y\"", etag));
+  EXPECT_FALSE(http::ETagListMatch("", etag));
+
+  EXPECT_TRUE(http::IfRangeMatch("\"1a-2b-3c\"", etag, 784111777));
+  EXPECT_FALSE(http::IfRangeMatch("W/\"1a-2b-3c\"", etag, 784111777));
+  EXPECT_TRUE(http::IfRangeMatch("Sun, 06 Nov 1994 08:49:37 GMT", etag, 784111777));
+  EXPECT_FALSE(http::IfRangeMatch("Sun, 06 Nov 1994 08:49:38 GMT", etag, 784111777));
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
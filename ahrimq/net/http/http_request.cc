@@ -1,12 +1,21 @@
 #include "net/http/http_request.h"
 
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+
 namespace ahrimq {
 namespace http {
 
 size_t MAX_BODY_BYTES = (1ul << 31) - 1;
 
-HTTPRequest::HTTPRequest(Buffer* rbuf)
-    : header_(std::make_shared<HTTPHeader>()), url_("/"), body_(rbuf) {}
+HTTPRequest::HTTPRequest(Buffer* rbuf, std::pmr::memory_resource* mr)
+    : header_(std::make_shared<HTTPHeader>(mr)), url_("/"), body_(rbuf) {}
 
 void HTTPRequest::Reset() {
   header_->Clear();
@@ -15,29 +24,178 @@ void HTTPRequest::Reset() {
   url_.Reset();
   body_->Reset();
   form_.Clear();
-  cookies_.clear();
+  cookies_.Clear();
+  cookies_parsed_ = false;
+  ResetMultipart();
 }
 
 HTTPRequest::~HTTPRequest() {
+  ResetMultipart();
   body_ = nullptr;
 }
 
+const RequestCookies& HTTPRequest::Cookies() const {
+  if (!cookies_parsed_) {
+    for (const auto& item : header_->Members()) {
+      std::string_view key = item.first;
+      if (key.size() == 6 && strncasecmp(key.data(), "cookie", 6) == 0) {
+        for (const auto& value : item.second) {
+          cookies_.Add(value);
+        }
+      }
+    }
+    cookies_parsed_ = true;
+  }
+  return cookies_;
+}
+
+void HTTPRequest::ResetMultipart() {
+  if (upload_fd_ != -1) {
+    close(upload_fd_);
+    upload_fd_ = -1;
+  }
+  for (const FormFile& file : files_) {
+    // fails harmlessly if the handler moved the file away
+    unlink(file.path.c_str());
+  }
+  files_.clear();
+  multipart_.reset();
+  multipart_consumed_ = 0;
+  multipart_error_ = 0;
+  field_name_.clear();
+  field_value_.clear();
+}
+
+// the media type of a Content-Type value without its parameters
+static bool MediaTypeIs(const std::string& content_type, const char* type) {
+  size_t end = content_type.find(';');
+  if (end == std::string::npos) {
+    end = content_type.size();
+  }
+  while (end > 0 && isspace(static_cast<unsigned char>(content_type[end - 1]))) {
+    end--;
+  }
+  return end == strlen(type) && strncasecmp(content_type.data(), type, end) == 0;
+}
+
+bool HTTPRequest::MultipartForm() const {
+  return multipart_ != nullptr ||
+         MediaTypeIs(header_->Get("Content-Type"), "multipart/form-data");
+}
+
+bool HTTPRequest::StartMultipart() {
+  std::string boundary;
+  if (!MultipartBoundary(header_->Get("Content-Type"), boundary)) {
+    return false;
+  }
+  multipart_ = std::make_unique<MultipartParser>(boundary);
+  multipart_->SetOnPartBegin([this](const MultipartPart& part) {
+    if (multipart_->Parts() > form_limits_.max_parts) {
+      multipart_error_ = StatusContentTooLarge;
+      return false;
+    }
+    if (!part.IsFile()) {
+      field_name_ = part.name;
+      field_value_.clear();
+      return true;
+    }
+    std::string path = form_limits_.upload_dir + "/ahrimq-upload-XXXXXX";
+    upload_fd_ = mkstemp(&path[0]);
+    if (upload_fd_ == -1) {
+      multipart_error_ = StatusInternalServerError;
+      return false;
+    }
+    files_.push_back({part.name, part.filename, part.content_type, path, 0});
+    return true;
+  });
+  multipart_->SetOnPartData([this](const char* data, size_t len) {
+    if (upload_fd_ == -1) {
+      if (field_value_.size() + len > form_limits_.max_field_size) {
+        multipart_error_ = StatusContentTooLarge;
+        return false;
+      }
+      field_value_.append(data, len);
+      return true;
+    }
+    FormFile& file = files_.back();
+    if (file.size + len > form_limits_.max_file_size) {
+      multipart_error_ = StatusContentTooLarge;
+      return false;
+    }
+    file.size += len;
+    while (len > 0) {
+      ssize_t n = write(upload_fd_, data, len);
+      if (n == -1 && errno == EINTR) {
+        continue;
+      }
+      if (n <= 0) {
+        multipart_error_ = StatusInternalServerError;
+        return false;
+      }
+      data += n;
+      len -= n;
+    }
+    return true;
+  });
+  multipart_->SetOnPartEnd([this]() {
+    if (upload_fd_ != -1) {
+      close(upload_fd_);
+      upload_fd_ = -1;
+    } else {
+      form_.Add(field_name_, field_value_);
+    }
+    return true;
+  });
+  return true;
+}
+
+int HTTPRequest::FeedMultipart(Buffer& rbuf, uint64_t content_length) {
+  if (multipart_ == nullptr && !StartMultipart()) {
+    return StatusBadRequest;  // 400
+  }
+  uint64_t remaining = content_length - multipart_consumed_;
+  size_t avail = static_cast<size_t>(std::min<uint64_t>(rbuf.Size(), remaining));
+  size_t consumed = 0;
+  MultipartParser::Result res =
+      multipart_->Parse(rbuf.BeginReadPointer(), avail, consumed);
+  rbuf.ReaderIdxForward(consumed);
+  multipart_consumed_ += consumed;
+  if (res == MultipartParser::Result::Invalid) {
+    return multipart_error_ != 0 ? multipart_error_ : StatusBadRequest;
+  }
+  if (multipart_consumed_ == content_length) {
+    // a body ending before its closing boundary is malformed
+    return res == MultipartParser::Result::Complete ? StatusPrivateComplete
+                                                    : StatusBadRequest;
+  }
+  if (avail == remaining) {
+    // the body is complete but ends inside a boundary
+    return StatusBadRequest;  // 400
+  }
+  return StatusPrivatePending;
+}
+
 int HTTPRequest::ParseForm() {
   std::string ct = header_->Get("Content-Type");
   if (ct.empty()) {
     // FIXME: we should decide which type from the content
   }
-  if (ct == "application/x-www-form-urlencoded") {
+  if (MediaTypeIs(ct, "application/x-www-form-urlencoded")) {
     if (body_->Size() > MAX_BODY_BYTES) {
       // body too large
       return StatusContentTooLarge;  // 413
     }
-    std::string content = body_->ReadAllAsString();
-    form_.ParseString(content, true);
+    // copied into the arena of the form, decoded when the form is read
+    form_.ParseString(
+        std::string_view(body_->BeginReadPointer(), body_->ReadableBytes()), true);
+    body_->ReaderIdxForward(body_->ReadableBytes());
+    return StatusPrivateDone;
+  } else if (MediaTypeIs(ct, "multipart/form-data")) {
+    // parsed while the body was received
+    if (multipart_ == nullptr || !multipart_->Done()) {
+      return StatusBadRequest;  // 400
+    }
     return StatusPrivateDone;
-  } else if (ct == "multipart/form-data") {
-    // TODO this is a little bit complicated
-    return StatusNotImplemented;  // 501
   }
   return StatusInternalServerError;  // 500
 }
@@ -11,6 +11,7 @@
 #include "net/http/http_method.h"
 #include "net/http/http_status.h"
 #include "net/http/http_version.h"
+#include "net/http/multipart.h"
 #include "net/http/url.h"
 #include "net/http/cookie.h"
 
@@ -19,10 +20,38 @@ namespace http {
 
 typedef URL::Query BodyForm;
 
+/// @brief Limits applied while a multipart/form-data body is received.
+struct FormLimits {
+  // file parts are spooled into temporary files of this directory
+  std::string upload_dir = "/tmp";
+  // bytes of a plain field, kept in memory
+  size_t max_field_size = 1ul << 20;
+  // bytes of a single uploaded file
+  size_t max_file_size = 1ul << 30;
+  // parts of a single body
+  size_t max_parts = 256;
+};
+
+/// @brief FormFile is a file part of a multipart/form-data body spooled to disk.
+struct FormFile {
+  // the form field name
+  std::string field;
+  // the file name sent by the client, never use it as a path as it is
+  std::string filename;
+  std::string content_type;
+  // the temporary file, removed after the response unless the handler renames it
+  std::string path;
+  size_t size = 0;
+};
+
 /// @brief HTTPRequest represents a http request instance.
 class HTTPRequest {
  public:
-  explicit HTTPRequest(Buffer* rbuf);
+  /// @brief Construct a http request.
+  /// @param rbuf read buffer of the connection, which holds the body
+  /// @param mr memory resource of the header fields
+  explicit HTTPRequest(Buffer* rbuf, std::pmr::memory_resource* mr =
+                                         std::pmr::get_default_resource());
 
   ~HTTPRequest();
 
@@ -60,7 +89,7 @@ class HTTPRequest {
     return url_;
   }
 
-  void SetURL(const std::string& url) {
+  void SetURL(std::string_view url) {
     url_.Set(url);
   }
 
@@ -108,18 +137,47 @@ class HTTPRequest {
     return form_.Empty();
   }
 
-  const std::vector<Cookie>& Cookies() const {
-    return cookies_;
+  /// @brief Files uploaded with a multipart/form-data body.
+  /// @return
+  const std::vector<FormFile>& Files() const {
+    return files_;
   }
 
-  std::vector<Cookie>& Cookies() {
-    return cookies_;
+  void SetFormLimits(const FormLimits& limits) {
+    form_limits_ = limits;
   }
 
+  /// @brief Check if the request carries a multipart/form-data body.
+  /// @return
+  bool MultipartForm() const;
+
+  /// @brief Feed the body bytes of rbuf received so far to the multipart parser.
+  /// Parsed bytes are consumed from rbuf, plain fields are added to the form and
+  /// file parts are written to temporary files as they arrive, so the body is
+  /// never held in memory as a whole.
+  /// @param rbuf the read buffer of the connection
+  /// @param content_length the Content-Length of the request
+  /// @return StatusPrivateComplete once the whole body is parsed,
+  /// StatusPrivatePending if more bytes are needed, or an error status
+  int FeedMultipart(Buffer& rbuf, uint64_t content_length);
+
+  /// @brief Cookies of the request, split from the Cookie header on first access.
+  /// The pairs view the header and are valid until the header is modified or the
+  /// request is reset.
+  /// @return
+  const RequestCookies& Cookies() const;
+
   bool CookiesEmpty() const {
-    return cookies_.empty();
+    return Cookies().Empty();
   }
 
+ private:
+  // create the multipart parser and hook it to form_ and files_
+  bool StartMultipart();
+
+  // close and remove the files of the current multipart body
+  void ResetMultipart();
+
  private:
   HTTPHeaderPtr header_;
   HTTPMethod method_;
@@ -127,7 +185,20 @@ class HTTPRequest {
   URL url_;
   Buffer* body_;
   BodyForm form_;
-  std::vector<Cookie> cookies_;
+  mutable RequestCookies cookies_;
+  mutable bool cookies_parsed_ = false;
+
+  FormLimits form_limits_;
+  std::unique_ptr<MultipartParser> multipart_;
+  // body bytes consumed by multipart_
+  uint64_t multipart_consumed_ = 0;
+  // status set by a multipart callback which aborted parsing
+  int multipart_error_ = 0;
+  std::string field_name_;
+  std::string field_value_;
+  // the file the current file part is written to
+  int upload_fd_ = -1;
+  std::vector<FormFile> files_;
 };
 
 typedef std::shared_ptr<HTTPRequest> HTTPRequestPtr;
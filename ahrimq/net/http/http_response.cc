@@ -1,36 +1,53 @@
 #include "net/http/http_response.h"
 
+#include <strings.h>
+
 #include "base/str_utils.h"
 #include "base/time_utils.h"
 
 namespace ahrimq {
 namespace http {
 
-HTTPResponse::HTTPResponse(Buffer* wbuf)
-    : header_(std::make_shared<HTTPHeader>()), write_buf_(wbuf) {
-  // add some default header fields into response header
-  header_->Add("Server", "AhriMQ/1.0");
+// Default header lines which are written by Organize unless the user overrides
+// them in response header.
+static const char kDefaultServerLine[] = "Server: AhriMQ/1.0\r\n";
+static const size_t kDefaultServerLineLen = sizeof(kDefaultServerLine) - 1;
+static const char kDatePrefix[] = "Date: ";
+static const size_t kDatePrefixLen = sizeof(kDatePrefix) - 1;
+static const char kSetCookiePrefix[] = "Set-Cookie: ";
+static const size_t kSetCookiePrefixLen = sizeof(kSetCookiePrefix) - 1;
+
+static inline char* CopyTo(char* dst, const char* src, size_t len) {
+  memcpy(dst, src, len);
+  return dst + len;
+}
+
+static inline char* CopyTo(char* dst, std::string_view src) {
+  return CopyTo(dst, src.data(), src.size());
 }
 
+HTTPResponse::HTTPResponse(Buffer* wbuf, std::pmr::memory_resource* mr)
+    : header_(std::make_shared<HTTPHeader>(mr)), write_buf_(wbuf) {}
+
 HTTPResponse::~HTTPResponse() {
   user_buf_.Reset();
   write_buf_ = nullptr;
 }
 
-void HTTPResponse::AddHeader(const std::string& key, const std::string& value) {
+void HTTPResponse::AddHeader(std::string_view key, std::string_view value) {
   header_->Add(key, value);
 }
 
-void HTTPResponse::SetHeader(const std::string& key, const std::string& value) {
+void HTTPResponse::SetHeader(std::string_view key, std::string_view value) {
   header_->Set(key, value);
 }
 
-bool HTTPResponse::HeaderContains(const std::string& key) {
+bool HTTPResponse::HeaderContains(std::string_view key) {
   return header_->Has(key);
 }
 
 void HTTPResponse::SetStatus(int status) {
-  if (StatusCodeStringMapping.count(status) != 0) {
+  if (StatusCodeSupported(status)) {
     // status supported
     status_ = status;
   }
@@ -39,57 +56,116 @@ void HTTPResponse::SetStatus(int status) {
 void HTTPResponse::Reset() {
   header_->Clear();
   status_ = StatusBadRequest;
-  header_->Add("Server", "AhriMQ/1.0");
+  cookies_.clear();
+  user_buf_.Reset();
+  ClearPrebuilt();
   write_buf_->Reset();
 }
 
 void HTTPResponse::Organize(Buffer& wbuf) const {
-  const static char* colon_seperator = ": ";
-  header_->Add("Date", time::GMTTimeNowString());  // response GMT time
-  // response line
-  char buf[64] = {0};
-  std::sprintf(buf, "%s %d %s\r\n", "HTTP/1.1", status_,
-               StatusCodeStringMapping[status_].c_str());
-  wbuf.Append(buf, std::strlen(buf));
-
-  // organize response header
-  for (const auto& item : header_->Members()) {
-    const std::string& key = item.first;
-    const std::vector<std::string>& values = item.second;
+  time::GMTDateCache date;
+  Organize(wbuf, date);
+}
+
+// The response head is written in two passes over the header fields: the first one
+// computes the serialized size (an upper bound for cookies) so that the write
+// buffer grows at most once, the second one copies bytes straight into the write
+// buffer.
+void HTTPResponse::Organize(Buffer& wbuf, const time::GMTDateCache& date) const {
+  const HTTPHeader::MemberMapType& members = header_->Members();
+  StatusLine line = HTTP11StatusLine(status_);
+  bool has_date = false;
+  bool has_server = false;
+  bool multi_values = false;
+  size_t size = line.len;
+  for (const auto& item : members) {
+    std::string_view key = item.first;
+    const auto& values = item.second;
     if (values.empty()) {
       continue;
     }
-    wbuf.Append(key);
-    wbuf.Append(colon_seperator, 2);
-    for (size_t i = 0; i < values.size(); i++) {
-      const std::string& value = values[i];
-      if (!StrCaseEqual(key, "date") && value.find(',') != std::string::npos) {
-        wbuf.Append("\"");
-        wbuf.Append(value);
-        wbuf.Append("\"");
-      } else {
-        wbuf.Append(value);
+    size += key.size() + 4;  // ": " and CRLF
+    for (const auto& value : values) {
+      size += value.size();
+    }
+    if (values.size() > 1) {
+      size += values.size() - 1;  // every elements are seperated by comma
+      multi_values = true;
+    }
+    if (key.size() == 4 && strncasecmp(key.data(), "date", 4) == 0) {
+      has_date = true;
+    } else if (key.size() == 6 && strncasecmp(key.data(), "server", 6) == 0) {
+      has_server = true;
+    }
+  }
+  if (!has_date) {
+    size += kDatePrefixLen + date.Size() + 2;
+  }
+  if (!has_server) {
+    size += kDefaultServerLineLen;
+  }
+  std::string_view body = BodyView();
+  size += prebuilt_head_.size();
+  for (const auto& cookie : cookies_) {
+    size += kSetCookiePrefixLen + cookie.MaxSerializedSize() + 2;
+  }
+  size += 2 + body.size();  // empty line and body
+
+  wbuf.EnsureBytesForWrite(size);
+  char* begin = wbuf.BeginWritePointer();
+  char* p = CopyTo(begin, line.data, line.len);
+  if (!has_date) {
+    p = CopyTo(p, kDatePrefix, kDatePrefixLen);
+    p = CopyTo(p, date.Data(), date.Size());
+    p = CopyTo(p, CRLF, 2);
+  }
+  if (!has_server) {
+    p = CopyTo(p, kDefaultServerLine, kDefaultServerLineLen);
+  }
+  if (!multi_values) {
+    // fast path: every field carries exactly one value
+    for (const auto& item : members) {
+      if (item.second.empty()) {
+        continue;
+      }
+      p = CopyTo(p, item.first);
+      p = CopyTo(p, ": ", 2);
+      p = CopyTo(p, item.second[0]);
+      p = CopyTo(p, CRLF, 2);
+    }
+  } else {
+    for (const auto& item : members) {
+      const auto& values = item.second;
+      if (values.empty()) {
+        continue;
       }
-      // every elements are seperated by comma
-      if (i != values.size() - 1) {
-        wbuf.Append(",");
+      p = CopyTo(p, item.first);
+      p = CopyTo(p, ": ", 2);
+      for (size_t i = 0; i < values.size(); i++) {
+        if (i != 0) {
+          *p++ = ',';
+        }
+        p = CopyTo(p, values[i]);
       }
+      p = CopyTo(p, CRLF, 2);
     }
-    wbuf.Append("\r\n");
   }
-  // cookies
+  p = CopyTo(p, prebuilt_head_.data(), prebuilt_head_.size());
   for (const auto& cookie : cookies_) {
-    wbuf.Append("Set-Cookie");
-    wbuf.Append(colon_seperator, 2);
-    cookie.Serialize(wbuf);
-    wbuf.Append("\r\n");
+    p = CopyTo(p, kSetCookiePrefix, kSetCookiePrefixLen);
+    p = cookie.SerializeTo(p);
+    p = CopyTo(p, CRLF, 2);
   }
-  wbuf.Append("\r\n");
+  p = CopyTo(p, CRLF, 2);
+  p = CopyTo(p, body.data(), body.size());
+  wbuf.WriterIdxForward(p - begin);
+}
 
-  if (!user_buf_.Empty()) {
-    // organize response body content from user_buf_
-    wbuf.Append(user_buf_);
+std::string_view HTTPResponse::BodyView() const {
+  if (prebuilt_holder_ != nullptr) {
+    return prebuilt_body_;
   }
+  return std::string_view(user_buf_.BeginReadPointer(), user_buf_.Size());
 }
 
 void HTTPResponse::AppendConnBuffer(const std::string& content) {
@@ -112,7 +188,21 @@ void HTTPResponse::SetContentEncoding(const std::string& encoding) {
   header_->Set("Content-Encoding", encoding);
 }
 
+void HTTPResponse::SetPrebuilt(std::string_view head, std::string_view body,
+                               std::shared_ptr<const void> holder) {
+  prebuilt_head_ = head;
+  prebuilt_body_ = body;
+  prebuilt_holder_ = std::move(holder);
+}
+
+void HTTPResponse::ClearPrebuilt() {
+  prebuilt_holder_.reset();
+  prebuilt_head_ = std::string_view();
+  prebuilt_body_ = std::string_view();
+}
+
 void HTTPResponse::MakeContentPlainText(const std::string& text) {
+  ClearPrebuilt();
   user_buf_.Reset();
   user_buf_.Append(text);
   header_->Set("Content-Type", "text/plain; charset=utf-8");
@@ -120,6 +210,7 @@ void HTTPResponse::MakeContentPlainText(const std::string& text) {
 }
 
 void HTTPResponse::MakeContentJson(const std::string& json) {
+  ClearPrebuilt();
   user_buf_.Reset();
   user_buf_.Append(json);
   header_->Set("Content-Type", "application/json; charset=utf-8");
@@ -127,6 +218,7 @@ void HTTPResponse::MakeContentJson(const std::string& json) {
 }
 
 void HTTPResponse::MakeContentJson(const nlohmann::json& json) {
+  ClearPrebuilt();
   user_buf_.Reset();
   // dump json instance to string
   user_buf_.Append(json.dump());
@@ -135,6 +227,7 @@ void HTTPResponse::MakeContentJson(const nlohmann::json& json) {
 }
 
 void HTTPResponse::MakeContentSimpleHTML(const std::string& html) {
+  ClearPrebuilt();
   user_buf_.Reset();
   user_buf_.Append(html);
   header_->Set("Content-Type", "text/html; charset=utf-8");
@@ -151,7 +244,7 @@ void HTTPResponse::AddCookie(const Cookie& cookie) {
 }
 
 void HTTPResponse::AddCookie(Cookie&& cookie) {
-  cookies_.push_back(cookie);
+  cookies_.push_back(std::move(cookie));
 }
 
 }  //  namespace http
@@ -3,8 +3,10 @@
 
 #include <list>
 #include <memory>
+#include <string_view>
 #include "thirdparty/nlohmann/json.hpp"
 
+#include "base/time_utils.h"
 #include "buffer/buffer.h"
 #include "net/http/http_header.h"
 #include "net/http/http_status.h"
@@ -16,7 +18,11 @@ namespace http {
 /// @brief HTTPResponse represents a http response.
 class HTTPResponse {
  public:
-  explicit HTTPResponse(Buffer* wbuf);
+  /// @brief Construct a http response.
+  /// @param wbuf write buffer of the connection
+  /// @param mr memory resource of the header fields
+  explicit HTTPResponse(Buffer* wbuf, std::pmr::memory_resource* mr =
+                                          std::pmr::get_default_resource());
 
   ~HTTPResponse();
 
@@ -31,17 +37,17 @@ class HTTPResponse {
   /// @brief Add key-value into response header.
   /// @param key
   /// @param value
-  void AddHeader(const std::string& key, const std::string& value);
+  void AddHeader(std::string_view key, std::string_view value);
 
   /// @brief Set key-value into response header.
   /// @param key
   /// @param value
-  void SetHeader(const std::string& key, const std::string& value);
+  void SetHeader(std::string_view key, std::string_view value);
 
   /// @brief Check if header contains given key.
   /// @param key
   /// @return
-  bool HeaderContains(const std::string& key);
+  bool HeaderContains(std::string_view key);
 
   /// @brief Return response status code.
   /// @return
@@ -62,6 +68,12 @@ class HTTPResponse {
   /// @param wbuf
   void Organize(Buffer& wbuf) const;
 
+  /// @brief Organize response content into write buffer, the Date header is taken
+  /// from the pre-rendered date cache of the eventloop.
+  /// @param wbuf
+  /// @param date
+  void Organize(Buffer& wbuf, const time::GMTDateCache& date) const;
+
   /// @brief Append char content to response write buffer. Constructing manually http
   /// format is needed when using this function.
   /// @param content
@@ -85,6 +97,33 @@ class HTTPResponse {
     return user_buf_;
   }
 
+  /// @brief Respond with bytes owned by holder instead of the user buffer. head is a
+  /// block of complete CRLF terminated header lines written after the response
+  /// header, body replaces the user buffer content. Nothing is copied until
+  /// Organize, holder keeps both alive until then.
+  /// @param head
+  /// @param body
+  /// @param holder
+  void SetPrebuilt(std::string_view head, std::string_view body,
+                   std::shared_ptr<const void> holder);
+
+  /// @brief Check if response content is taken from SetPrebuilt.
+  /// @return
+  bool HasPrebuilt() const {
+    return prebuilt_holder_ != nullptr;
+  }
+
+  /// @brief Return the header lines given to SetPrebuilt.
+  /// @return
+  std::string_view PrebuiltHead() const {
+    return prebuilt_head_;
+  }
+
+  /// @brief Return the response body, the prebuilt one if set, the user buffer
+  /// content otherwise.
+  /// @return
+  std::string_view BodyView() const;
+
   /// @brief Convenient function to add plain text response body. Using this function
   /// to add response body is recommended. Note that this function will clear
   /// existing data in user buffer.
@@ -114,8 +153,15 @@ class HTTPResponse {
 
   void AddCookie(Cookie&& cookie);
 
+  const std::list<Cookie>& Cookies() const {
+    return cookies_;
+  }
+
   // TODO implement and multipart response body
 
+ private:
+  void ClearPrebuilt();
+
  private:
   // response status code
   int status_ = StatusBadRequest;
@@ -127,6 +173,10 @@ class HTTPResponse {
   Buffer user_buf_;
   // cookies
   std::list<Cookie> cookies_;
+  // pre-rendered header lines and body, kept alive by prebuilt_holder_
+  std::shared_ptr<const void> prebuilt_holder_;
+  std::string_view prebuilt_head_;
+  std::string_view prebuilt_body_;
 };
 
 typedef std::shared_ptr<HTTPResponse> HTTPResponsePtr;
@@ -0,0 +1,82 @@
+#include "ahrimq/net/http/http_response.h"
+
+#include <gtest/gtest.h>
+
+using namespace ahrimq;
+
+TEST(HTTPResponseTest, StatusLineTest) {
+  for (const auto& item : http::StatusCodeStringMapping) {
+    http::StatusLine line = http::HTTP11StatusLine(item.first);
+    std::string expect =
+        "HTTP/1.1 " + std::to_string(item.first) + " " + item.second + "\r\n";
+    EXPECT_EQ(std::string(line.data, line.len), expect);
+  }
+  EXPECT_EQ(http::HTTP11StatusLine(299).len, 0);
+  EXPECT_FALSE(http::StatusCodeSupported(600));
+  EXPECT_TRUE(http::StatusCodeSupported(http::StatusNotFound));
+}
+
+TEST(HTTPResponseTest, OrganizeWithDateCacheTest) {
+  Buffer wbuf;
+  http::HTTPResponse res(&wbuf);
+  res.SetStatus(http::StatusOK);
+  res.MakeContentPlainText("hello");
+
+  time::GMTDateCache date;
+  date.Refresh(784111777);
+  Buffer out;
+  res.Organize(out, date);
+  std::string s = out.ReadableAsString();
+  EXPECT_EQ(s.find("HTTP/1.1 200 OK\r\n"), 0);
+  EXPECT_NE(s.find("\r\nDate: Sun, 06 Nov 1994 08:49:37 GMT\r\n"), std::string::npos);
+  EXPECT_NE(s.find("\r\nContent-Length: 5\r\n"), std::string::npos);
+  EXPECT_EQ(s.substr(s.size() - 9), "\r\n\r\nhello");
+}
+
+TEST(HTTPResponseTest, OrganizeStableOrderTest) {
+  Buffer wbuf;
+  http::HTTPResponse res(&wbuf);
+  res.SetStatus(http::StatusNotFound);
+  res.AddHeader("X-B", "2");
+  res.AddHeader("X-A", "1");
+  res.AddHeader("Vary", "Accept-Encoding");
+  res.AddHeader("vary", "Cookie");
+  res.AddHeader("Location", "/a,b");
+  res.SetHeader("Server", "custom");
+
+  time::GMTDateCache date;
+  date.Refresh(0);
+  Buffer out;
+  res.Organize(out, date);
+  EXPECT_EQ(out.ReadableAsString(),
+            "HTTP/1.1 404 Not Found\r\n"
+            "Date: Thu, 01 Jan 1970 00:00:00 GMT\r\n"
+            "X-B: 2\r\n"
+            "X-A: 1\r\n"
+            "Vary: Accept-Encoding,Cookie\r\n"
+            "Location: /a,b\r\n"
+            "Server: custom\r\n"
+            "\r\n");
+}
+
+TEST(HTTPResponseTest, OrganizeDefaultHeadersTest) {
+  Buffer wbuf;
+  http::HTTPResponse res(&wbuf);
+  res.SetStatus(http::StatusNoContent);
+  time::GMTDateCache date;
+  date.Refresh(0);
+  Buffer out;
+  // organizing into a non-empty buffer should keep existing content
+  out.Append("prev");
+  res.Organize(out, date);
+  EXPECT_EQ(out.ReadableAsString(),
+            "prevHTTP/1.1 204 No Content\r\n"
+            "Date: Thu, 01 Jan 1970 00:00:00 GMT\r\n"
+            "Server: AhriMQ/1.0\r\n"
+            "\r\n");
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -1,5 +1,6 @@
 #include "net/http/http_router.h"
 
+#include <algorithm>
 #include <iostream>
 
 #include "base/str_utils.h"
@@ -94,50 +95,128 @@ int CheckWildcard(const std::string& s, std::string& outname) {
 RouteNode::Params::Params(
     const std::vector<std::pair<std::string, std::string>>& params) {
   for (auto& p : params) {
-    params_.insert(p);
+    Set(p.first, p.second);
   }
 }
 
+RouteNode::Params::Params(const Params& other) {
+  *this = other;
+}
+
+RouteNode::Params& RouteNode::Params::operator=(const Params& other) {
+  if (this == &other) {
+    return *this;
+  }
+  // views of other may point into its own storage, so everything is copied
+  Reset();
+  for (size_t i = 0; i < other.size_; i++) {
+    const Entry& e = other.At(i);
+    Add(Own(e.key), Own(e.value));
+  }
+  return *this;
+}
+
 std::vector<std::string> RouteNode::Params::Keys() const {
   std::vector<std::string> keys;
-  keys.reserve(params_.size());
-  for (const auto& item : params_) {
-    keys.emplace_back(item.first);
+  keys.reserve(size_);
+  for (size_t i = 0; i < size_; i++) {
+    keys.emplace_back(At(i).key);
   }
   return keys;
 }
 
 std::vector<std::string> RouteNode::Params::Values() const {
   std::vector<std::string> values;
-  values.reserve(params_.size());
-  for (const auto& item : params_) {
-    values.emplace_back(item.second);
+  values.reserve(size_);
+  for (size_t i = 0; i < size_; i++) {
+    values.emplace_back(At(i).value);
   }
   return values;
 }
 
 void RouteNode::Params::Set(const std::string& key, const std::string& value) {
-  params_[key] = value;
+  Entry* e = Find(key);
+  if (e != nullptr) {
+    e->value = Own(value);
+    return;
+  }
+  Add(Own(key), Own(value));
+}
+
+void RouteNode::Params::Add(std::string_view key, std::string_view value) {
+  Entry* e = Find(key);
+  if (e != nullptr) {
+    e->value = value;
+    return;
+  }
+  if (size_ < kInlineParams) {
+    inline_[size_] = Entry{key, value};
+  } else {
+    overflow_.push_back(Entry{key, value});
+  }
+  size_++;
 }
 
 std::string RouteNode::Params::Get(const std::string& key) const {
-  try {
-    return params_.at(key);
-  } catch (std::exception& ex) {
+  const Entry* e = Find(key);
+  if (e == nullptr) {
     return "";
   }
+  return std::string(e->value);
+}
+
+std::string_view RouteNode::Params::GetView(std::string_view key) const {
+  const Entry* e = Find(key);
+  if (e == nullptr) {
+    return std::string_view();
+  }
+  return e->value;
 }
 
 void RouteNode::Params::Reset() {
-  params_.clear();
+  size_ = 0;
+  overflow_.clear();
+  owned_.clear();
 }
 
 bool RouteNode::Params::operator==(const Params& other) const {
-  return params_ == other.params_;
+  if (size_ != other.size_) {
+    return false;
+  }
+  for (size_t i = 0; i < size_; i++) {
+    const Entry* e = other.Find(At(i).key);
+    if (e == nullptr || e->value != At(i).value) {
+      return false;
+    }
+  }
+  return true;
 }
 
 bool RouteNode::Params::operator!=(const Params& other) const {
-  return params_ != other.params_;
+  return !(*this == other);
+}
+
+RouteNode::Params::Entry* RouteNode::Params::Find(std::string_view key) {
+  for (size_t i = 0; i < size_; i++) {
+    if (At(i).key == key) {
+      return &At(i);
+    }
+  }
+  return nullptr;
+}
+
+const RouteNode::Params::Entry* RouteNode::Params::Find(std::string_view key) const {
+  for (size_t i = 0; i < size_; i++) {
+    if (At(i).key == key) {
+      return &At(i);
+    }
+  }
+  return nullptr;
+}
+
+std::string_view RouteNode::Params::Own(std::string_view s) {
+  owned_.emplace_front(s);
+  return owned_.front();
 }
 
 RouteNode::RouteNode() {}
@@ -152,7 +231,8 @@ RouteNode::~RouteNode() {
   children_.clear();
 }
 
-bool RouteNode::InsertRoute(const std::string& url, const HTTPCallback& callback) {
+bool RouteNode::InsertRoute(const std::string& url, const HTTPCallback& callback,
+                            ExecPolicy policy) {
   if (url == "/") {
     if (!pattern_.empty()) {
       return false;
@@ -160,6 +240,7 @@ bool RouteNode::InsertRoute(const std::string& url, const HTTPCallback& callback
     pattern_ = "/";
     segment_ = "/";
     handler_ = callback;
+    policy_ = policy;
     return true;
   }
   std::vector<std::string> segments;
@@ -167,7 +248,7 @@ bool RouteNode::InsertRoute(const std::string& url, const HTTPCallback& callback
   if (segments.empty()) {
     return false;
   }
-  return Insert(url, segments, 0, callback);
+  return Insert(url, segments, 0, callback, policy);
 }
 
 const RouteNode* RouteNode::SearchRoute(const std::string& url,
@@ -194,12 +275,13 @@ const RouteNode::HTTPHandler RouteNode::SearchHandler(const std::string& url,
 
 bool RouteNode::Insert(const std::string& url,
                        const std::vector<std::string>& segments, size_t index,
-                       const HTTPCallback& callback) {
+                       const HTTPCallback& callback, ExecPolicy policy) {
   if (index == segments.size()) {
     // reach destination node
     if (pattern_.empty()) {
       pattern_ = url;
       handler_ = callback;
+      policy_ = policy;
       return true;
     }
     // url already exists, insertion failed
@@ -284,7 +366,7 @@ bool RouteNode::Insert(const std::string& url,
         std::make_shared<RouteNode>(segments[index], child_wildname));
     next = children_.back();
   }
-  return next->Insert(url, segments, index + 1, callback);
+  return next->Insert(url, segments, index + 1, callback, policy);
 }
 
 const RouteNode* RouteNode::Search(const std::string& url,
@@ -349,103 +431,302 @@ const RouteNode* RouteNode::Search(const std::string& url,
   return nullptr;
 }
 
+void RouteTable::Build(const RouteNode& root) {
+  nodes_.clear();
+  edges_.clear();
+  labels_.clear();
+  handlers_.clear();
+  policies_.clear();
+  root_handler_ = -1;
+  Compile(root);
+  // the root handler is only reachable through the exact "/" pattern, not through
+  // an url made of empty segments like "//"
+  if (root.pattern_ == "/") {
+    root_handler_ = nodes_[0].handler;
+  }
+  nodes_[0].handler = -1;
+}
+
+const RouteNode::HTTPHandler* RouteTable::Match(std::string_view path,
+                                                RouteNode::Params& params,
+                                                ExecPolicy* policy) const {
+  if (nodes_.empty()) {
+    return nullptr;
+  }
+  if (path == "/") {
+    if (root_handler_ < 0) {
+      return nullptr;
+    }
+    if (policy != nullptr) {
+      *policy = policies_[root_handler_];
+    }
+    return &handlers_[root_handler_];
+  }
+  uint32_t cur = 0;
+  bool walked = false;
+  size_t pos = 0;
+  size_t n = path.size();
+  while (pos < n) {
+    if (path[pos] == '/') {
+      pos++;  // empty segments are skipped
+      continue;
+    }
+    size_t end = path.find('/', pos);
+    if (end == std::string_view::npos) {
+      end = n;
+    }
+    std::string_view seg = path.substr(pos, end - pos);
+    pos = end;
+    walked = true;
+
+    const Node& node = nodes_[cur];
+    const Edge* first = edges_.data() + node.static_begin;
+    const Edge* last = first + node.static_count;
+    auto less = [this](const Edge& e, std::string_view s) {
+      return Label(e.label_off, e.label_len) < s;
+    };
+    const Edge* it = std::lower_bound(first, last, seg, less);
+    if (it != last && Label(it->label_off, it->label_len) == seg) {
+      cur = it->child;
+      continue;
+    }
+
+    // static and wildcard children never match the same segment, see
+    // RouteNode::Insert, so wildcards are only tried when no static child matches
+    bool matched = false;
+    const Edge* wild = edges_.data() + node.wild_begin;
+    for (uint32_t i = 0; i < node.wild_count; i++, wild++) {
+      std::string_view prefix = Label(wild->label_off, wild->label_len);
+      if (prefix.empty()) {
+        // "{xxx}" matches any segment
+        params.Add(Label(wild->name_off, wild->name_len), seg);
+      } else if (seg.size() > prefix.size() &&
+                 seg.compare(0, prefix.size(), prefix) == 0 &&
+                 seg[prefix.size()] != '{') {
+        // "abc{xxx}" needs the prefix and a non-empty remainder
+        params.Add(Label(wild->name_off, wild->name_len), seg.substr(prefix.size()));
+      } else {
+        continue;
+      }
+      cur = wild->child;
+      matched = true;
+      break;
+    }
+    if (!matched) {
+      return nullptr;
+    }
+  }
+  if (!walked || nodes_[cur].handler < 0) {
+    return nullptr;
+  }
+  if (policy != nullptr) {
+    *policy = policies_[nodes_[cur].handler];
+  }
+  return &handlers_[nodes_[cur].handler];
+}
+
+int32_t RouteTable::AddHandler(const RouteNode::HTTPHandler& handler,
+                               ExecPolicy policy) {
+  handlers_.push_back(handler);
+  policies_.push_back(policy);
+  return static_cast<int32_t>(handlers_.size() - 1);
+}
+
+uint32_t RouteTable::AddLabel(const std::string& s) {
+  uint32_t off = static_cast<uint32_t>(labels_.size());
+  labels_.append(s);
+  return off;
+}
+
+uint32_t RouteTable::Compile(const RouteNode& node) {
+  uint32_t idx = static_cast<uint32_t>(nodes_.size());
+  nodes_.emplace_back();
+  if (node.handler_ != nullptr) {
+    nodes_[idx].handler = AddHandler(node.handler_, node.policy_);
+  }
+
+  std::vector<const RouteNode*> statics;
+  std::vector<const RouteNode*> wilds;
+  for (const auto& child : node.children_) {
+    if (child->IsWildNode()) {
+      wilds.push_back(child.get());
+    } else {
+      statics.push_back(child.get());
+    }
+  }
+  std::sort(statics.begin(), statics.end(),
+            [](const RouteNode* a, const RouteNode* b) {
+              return a->segment_ < b->segment_;
+            });
+
+  // edges of one node are laid out contiguously before descending into children
+  uint32_t static_begin = static_cast<uint32_t>(edges_.size());
+  for (const RouteNode* child : statics) {
+    uint32_t off = AddLabel(child->segment_);
+    uint32_t len = static_cast<uint32_t>(child->segment_.size());
+    edges_.push_back(Edge{off, len, 0, 0, 0});
+  }
+  uint32_t wild_begin = static_cast<uint32_t>(edges_.size());
+  for (const RouteNode* child : wilds) {
+    std::string prefix = child->segment_.substr(0, child->segment_.find('{'));
+    uint32_t off = AddLabel(prefix);
+    uint32_t name_off = AddLabel(child->wildcard_name_);
+    edges_.push_back(Edge{off, static_cast<uint32_t>(prefix.size()), name_off,
+                          static_cast<uint32_t>(child->wildcard_name_.size()), 0});
+  }
+  nodes_[idx].static_begin = static_begin;
+  nodes_[idx].static_count = static_cast<uint32_t>(statics.size());
+  nodes_[idx].wild_begin = wild_begin;
+  nodes_[idx].wild_count = static_cast<uint32_t>(wilds.size());
+
+  for (size_t i = 0; i < statics.size(); i++) {
+    uint32_t child = Compile(*statics[i]);
+    edges_[static_begin + i].child = child;
+  }
+  for (size_t i = 0; i < wilds.size(); i++) {
+    uint32_t child = Compile(*wilds[i]);
+    edges_[wild_begin + i].child = child;
+  }
+  return idx;
+}
+
 }  // namespace detail
 
 HTTPRouter::HTTPRouter() {
   // construct tree
-  trees_.emplace(HTTPMethod::Get, std::make_shared<detail::RouteNode>());
-  trees_.emplace(HTTPMethod::Head, std::make_shared<detail::RouteNode>());
-  trees_.emplace(HTTPMethod::Post, std::make_shared<detail::RouteNode>());
-  trees_.emplace(HTTPMethod::Put, std::make_shared<detail::RouteNode>());
-  trees_.emplace(HTTPMethod::Patch, std::make_shared<detail::RouteNode>());
-  trees_.emplace(HTTPMethod::Delete, std::make_shared<detail::RouteNode>());
-  trees_.emplace(HTTPMethod::Connect, std::make_shared<detail::RouteNode>());
-  trees_.emplace(HTTPMethod::Options, std::make_shared<detail::RouteNode>());
-  trees_.emplace(HTTPMethod::Trace, std::make_shared<detail::RouteNode>());
+  for (size_t i = 0; i < kHTTPMethodCount; i++) {
+    trees_[i] = std::make_shared<detail::RouteNode>();
+  }
 }
 
-HTTPRouter::~HTTPRouter() {
-  trees_.clear();
-}
+HTTPRouter::~HTTPRouter() {}
 
 std::string HTTPRouter::Route(HTTPMethod method, const std::string& url,
                               const HTTPRequest& req, HTTPResponse& res) {
-  // find handler function for given method and given url
+  return Route(method, std::string_view(url), req, res);
+}
+
+std::string HTTPRouter::Route(HTTPMethod method, std::string_view path,
+                              const HTTPRequest& req, HTTPResponse& res) {
   URLParams params;
+  ExecPolicy policy;
+  const HTTPCallback* handler = Match(method, path, params, policy);
+  return Dispatch(method, path, handler, params, req, res);
+}
+
+const HTTPCallback* HTTPRouter::Match(HTTPMethod method, std::string_view path,
+                                      URLParams& params, ExecPolicy& policy) const {
+  // find handler function for given method and given url
+  size_t m = static_cast<size_t>(method);
+  if (m >= kHTTPMethodCount) {
+    return nullptr;
+  }
+  if (frozen_) {
+    return tables_[m].Match(path, params, &policy);
+  }
+  const detail::RouteNode* node = trees_[m]->SearchRoute(std::string(path), params);
+  if (node == nullptr || node->Handler() == nullptr) {
+    return nullptr;
+  }
+  policy = node->Policy();
+  return &node->Handler();
+}
+
+std::string HTTPRouter::Dispatch(HTTPMethod method, std::string_view path,
+                                 const HTTPCallback* handler,
+                                 const URLParams& params, const HTTPRequest& req,
+                                 HTTPResponse& res) {
   std::string response_page = "";
-  if (trees_.count(method) == 0) {
+  if (static_cast<size_t>(method) >= kHTTPMethodCount) {
     // method not supported (405)
     res.SetStatus(StatusMethodNotAllowed);
     return response_page;
-  } else {
-    const HTTPCallback& handler = trees_[method]->SearchHandler(url, params);
-    if (handler == nullptr) {
-      if (method == HTTPMethod::Get) {
-        // try to find in config root
-        if (url.front() == '/') {
-          return url.substr(1);
-        }
-        return url;
+  }
+  if (handler == nullptr) {
+    if (method == HTTPMethod::Get) {
+      // try to find in config root
+      if (!path.empty() && path.front() == '/') {
+        return std::string(path.substr(1));
       }
-      // given url is not registered on this method (404)
-      res.SetStatus(StatusNotFound);
-      return response_page;
-    }
-    // custom handler found
-    try {
-      response_page = handler(req, res, params);
-    } catch (std::exception& ex) {
-      // internal error
-      res.SetStatus(StatusInternalServerError);
+      return std::string(path);
     }
+    // given url is not registered on this method (404)
+    res.SetStatus(StatusNotFound);
+    return response_page;
+  }
+  // custom handler found
+  try {
+    response_page = (*handler)(req, res, params);
+  } catch (std::exception& ex) {
+    // internal error
+    res.SetStatus(StatusInternalServerError);
   }
   return response_page;
 }
 
-bool HTTPRouter::RegisterGet(const std::string& url, const HTTPCallback& callback) {
-  return Register(HTTPMethod::Get, url, callback);
+void HTTPRouter::Freeze() {
+  for (size_t i = 0; i < kHTTPMethodCount; i++) {
+    tables_[i].Build(*trees_[i]);
+  }
+  frozen_ = true;
 }
 
-bool HTTPRouter::RegisterHead(const std::string& url, const HTTPCallback& callback) {
-  return Register(HTTPMethod::Head, url, callback);
+bool HTTPRouter::RegisterGet(const std::string& url, const HTTPCallback& callback,
+                             ExecPolicy policy) {
+  return Register(HTTPMethod::Get, url, callback, policy);
 }
 
-bool HTTPRouter::RegisterPost(const std::string& url, const HTTPCallback& callback) {
-  return Register(HTTPMethod::Post, url, callback);
+bool HTTPRouter::RegisterHead(const std::string& url, const HTTPCallback& callback,
+                              ExecPolicy policy) {
+  return Register(HTTPMethod::Head, url, callback, policy);
 }
 
-bool HTTPRouter::RegisterPut(const std::string& url, const HTTPCallback& callback) {
-  return Register(HTTPMethod::Put, url, callback);
+bool HTTPRouter::RegisterPost(const std::string& url, const HTTPCallback& callback,
+                              ExecPolicy policy) {
+  return Register(HTTPMethod::Post, url, callback, policy);
 }
 
-bool HTTPRouter::RegisterPatch(const std::string& url,
-                               const HTTPCallback& callback) {
-  return Register(HTTPMethod::Patch, url, callback);
+bool HTTPRouter::RegisterPut(const std::string& url, const HTTPCallback& callback,
+                             ExecPolicy policy) {
+  return Register(HTTPMethod::Put, url, callback, policy);
 }
 
-bool HTTPRouter::RegisterDelete(const std::string& url,
-                                const HTTPCallback& callback) {
-  return Register(HTTPMethod::Delete, url, callback);
+bool HTTPRouter::RegisterPatch(const std::string& url, const HTTPCallback& callback,
+                               ExecPolicy policy) {
+  return Register(HTTPMethod::Patch, url, callback, policy);
+}
+
+bool HTTPRouter::RegisterDelete(const std::string& url, const HTTPCallback& callback,
+                                ExecPolicy policy) {
+  return Register(HTTPMethod::Delete, url, callback, policy);
 }
 
 bool HTTPRouter::RegisterConnect(const std::string& url,
-                                 const HTTPCallback& callback) {
-  return Register(HTTPMethod::Connect, url, callback);
+                                 const HTTPCallback& callback, ExecPolicy policy) {
+  return Register(HTTPMethod::Connect, url, callback, policy);
 }
 
 bool HTTPRouter::RegisterOptions(const std::string& url,
-                                 const HTTPCallback& callback) {
-  return Register(HTTPMethod::Options, url, callback);
+                                 const HTTPCallback& callback, ExecPolicy policy) {
+  return Register(HTTPMethod::Options, url, callback, policy);
 }
 
-bool HTTPRouter::RegisterTrace(const std::string& url,
-                               const HTTPCallback& callback) {
-  return Register(HTTPMethod::Trace, url, callback);
+bool HTTPRouter::RegisterTrace(const std::string& url, const HTTPCallback& callback,
+                               ExecPolicy policy) {
+  return Register(HTTPMethod::Trace, url, callback, policy);
 }
 
 bool HTTPRouter::Register(HTTPMethod method, const std::string& url,
-                          const HTTPCallback& callback) {
-  return trees_[method]->InsertRoute(url, callback);
+                          const HTTPCallback& callback, ExecPolicy policy) {
+  if (static_cast<size_t>(method) >= kHTTPMethodCount) {
+    return false;
+  }
+  if (!trees_[static_cast<size_t>(method)]->InsertRoute(url, callback, policy)) {
+    return false;
+  }
+  // compiled tables are stale until the next Freeze()
+  frozen_ = false;
+  return true;
 }
 
 }  // namespace http
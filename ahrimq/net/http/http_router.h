@@ -1,10 +1,12 @@
 #ifndef _AHRIMQ_NET_HTTP_HTTP_ROUTER_H_
 #define _AHRIMQ_NET_HTTP_HTTP_ROUTER_H_
 
+#include <cstdint>
+#include <forward_list>
 #include <functional>
 #include <memory>
 #include <string>
-#include <unordered_map>
+#include <string_view>
 #include <vector>
 
 #include "net/http/http_request.h"
@@ -17,6 +19,16 @@ namespace http {
 // typedef std::function<std::string(const HTTPRequest &, HTTPResponse &)>
 // HTTPCallback;
 
+/// @brief ExecPolicy decides which thread runs the handler of a route.
+///   Inline: the handler runs on the eventloop thread which read the request.
+///   Pool: the handler runs on the server worker pool, for handlers which block or
+///   take long; the response is written back by the eventloop once it finishes.
+///   Coroutine: the handler only creates a coroutine, which the server then runs on
+///   the eventloop thread and responds with once it finishes.
+///   WebSocket: the handler decides on a WebSocket handshake, the server then
+///   switches the connection to the WebSocket protocol.
+enum class ExecPolicy { Inline, Pool, Coroutine, WebSocket };
+
 /// Helper functionality
 namespace detail {
 
@@ -54,21 +66,43 @@ typedef std::shared_ptr<RouteNode> RouteNodePtr;
 /// @brief Approximate radix tree node implementation to support http router
 class RouteNode {
  public:
-  /// @brief Params represents the parameters in url string
+  /// @brief Params represents the parameters in url string. Matched parameters are
+  /// stored as views (key into the compiled route table, value into the request
+  /// url) in a small inline array, so capturing them does not allocate. Values set
+  /// through Set() are copied and owned by the Params instance.
   class Params {
    public:
     Params() = default;
 
     Params(const std::vector<std::pair<std::string, std::string>> &params);
 
+    Params(const Params &other);
+
+    Params &operator=(const Params &other);
+
+    Params(Params &&other) = default;
+
+    Params &operator=(Params &&other) = default;
+
     std::vector<std::string> Keys() const;
 
     std::vector<std::string> Values() const;
 
     void Set(const std::string &key, const std::string &value);
 
+    /// @brief Record a parameter without copying. Both views must outlive this
+    /// instance (or the next Reset()).
+    void Add(std::string_view key, std::string_view value);
+
     std::string Get(const std::string &key) const;
 
+    /// @brief Same as Get() but returns a view, empty if key is not present.
+    std::string_view GetView(std::string_view key) const;
+
+    size_t Size() const {
+      return size_;
+    }
+
     void Reset();
 
     bool operator==(const Params &other) const;
@@ -76,7 +110,33 @@ class RouteNode {
     bool operator!=(const Params &other) const;
 
    private:
-    std::unordered_map<std::string, std::string> params_;
+    struct Entry {
+      std::string_view key;
+      std::string_view value;
+    };
+
+    constexpr static size_t kInlineParams = 8;
+
+    Entry &At(size_t i) {
+      return i < kInlineParams ? inline_[i] : overflow_[i - kInlineParams];
+    }
+
+    const Entry &At(size_t i) const {
+      return i < kInlineParams ? inline_[i] : overflow_[i - kInlineParams];
+    }
+
+    Entry *Find(std::string_view key);
+
+    const Entry *Find(std::string_view key) const;
+
+    std::string_view Own(std::string_view s);
+
+   private:
+    Entry inline_[kInlineParams];
+    std::vector<Entry> overflow_;
+    size_t size_ = 0;
+    // backing storage for keys and values passed to Set(), nodes never move
+    std::forward_list<std::string> owned_;
   };
 
   // clang-format off
@@ -104,7 +164,12 @@ class RouteNode {
     return handler_;
   }
 
-  bool InsertRoute(const std::string &url, const HTTPHandler &callback);
+  ExecPolicy Policy() const {
+    return policy_;
+  }
+
+  bool InsertRoute(const std::string &url, const HTTPHandler &callback,
+                   ExecPolicy policy = ExecPolicy::Inline);
 
   const RouteNode *SearchRoute(const std::string &url, Params &params) const;
 
@@ -118,7 +183,7 @@ class RouteNode {
 
  private:
   bool Insert(const std::string &url, const std::vector<std::string> &segments,
-              size_t index, const HTTPHandler &callback);
+              size_t index, const HTTPHandler &callback, ExecPolicy policy);
 
   const RouteNode *Search(const std::string &url,
                           const std::vector<std::string> &segments, size_t index,
@@ -133,8 +198,75 @@ class RouteNode {
   std::vector<RouteNodePtr> children_;
   // handler
   HTTPHandler handler_;
+  // which thread runs handler_
+  ExecPolicy policy_ = ExecPolicy::Inline;
   // wildcard parameter name, if no wildcard parameter, it is ""
   std::string wildcard_name_;
+
+  friend class RouteTable;
+};
+
+/// @brief RouteTable is the frozen form of a RouteNode tree. All nodes, edges and
+/// segment labels live in contiguous arrays and children are addressed by index, so
+/// a lookup walks the url in place without splitting it and without allocating.
+/// Static children of a node are sorted for binary search; wildcard children keep
+/// their insertion order, which preserves the matching semantics of
+/// RouteNode::SearchRoute.
+class RouteTable {
+ public:
+  /// @brief Compile the tree rooted at root. Any previous content is discarded.
+  void Build(const RouteNode &root);
+
+  /// @brief Find the handler registered for path. Wildcard values are recorded in
+  /// params as views into path.
+  /// @param path
+  /// @param params
+  /// @param policy if not nullptr, receives the policy of the matched route
+  /// @return nullptr if not found
+  const RouteNode::HTTPHandler *Match(std::string_view path,
+                                      RouteNode::Params &params,
+                                      ExecPolicy *policy = nullptr) const;
+
+  bool Empty() const {
+    return nodes_.empty();
+  }
+
+ private:
+  struct Node {
+    uint32_t static_begin = 0;  // first static edge
+    uint32_t static_count = 0;
+    uint32_t wild_begin = 0;  // first wildcard edge
+    uint32_t wild_count = 0;
+    int32_t handler = -1;  // index into handlers_
+  };
+
+  struct Edge {
+    uint32_t label_off;  // static segment, or prefix before '{' for wildcards
+    uint32_t label_len;
+    uint32_t name_off;  // wildcard parameter name
+    uint32_t name_len;
+    uint32_t child;
+  };
+
+  std::string_view Label(uint32_t off, uint32_t len) const {
+    return std::string_view(labels_.data() + off, len);
+  }
+
+  int32_t AddHandler(const RouteNode::HTTPHandler &handler, ExecPolicy policy);
+
+  uint32_t AddLabel(const std::string &s);
+
+  uint32_t Compile(const RouteNode &node);
+
+ private:
+  std::vector<Node> nodes_;
+  std::vector<Edge> edges_;
+  std::string labels_;
+  std::vector<RouteNode::HTTPHandler> handlers_;
+  // policies_[i] is the policy of handlers_[i]
+  std::vector<ExecPolicy> policies_;
+  // handler registered on "/"
+  int32_t root_handler_ = -1;
 };
 
 }  // namespace detail
@@ -155,31 +287,85 @@ class HTTPRouter {
   std::string Route(HTTPMethod method, const std::string &url,
                     const HTTPRequest &req, HTTPResponse &res);
 
-  bool RegisterGet(const std::string &url, const HTTPCallback &callback);
+  std::string Route(HTTPMethod method, std::string_view path,
+                    const HTTPRequest &req, HTTPResponse &res);
 
-  bool RegisterHead(const std::string &url, const HTTPCallback &callback);
+  /// @brief Find the route of a request without running it. Route() is Match()
+  /// followed by Dispatch(); splitting them lets the caller decide where the
+  /// handler runs.
+  /// @param method
+  /// @param path
+  /// @param params receives the url parameters as views into path
+  /// @param policy receives the policy of the matched route
+  /// @return nullptr if no route matches
+  const HTTPCallback *Match(HTTPMethod method, std::string_view path,
+                            URLParams &params, ExecPolicy &policy) const;
+
+  /// @brief Run a handler returned by Match(). Without handler, a GET request
+  /// resolves to the static page at path and anything else is answered with 404,
+  /// or 405 for methods the router does not know.
+  /// @param method
+  /// @param path
+  /// @param handler
+  /// @param params
+  /// @param req
+  /// @param res
+  /// @return the page to respond with, empty if the response is already built
+  static std::string Dispatch(HTTPMethod method, std::string_view path,
+                              const HTTPCallback *handler, const URLParams &params,
+                              const HTTPRequest &req, HTTPResponse &res);
+
+  /// @brief Compile every route tree into its RouteTable. Routing uses the
+  /// compiled tables until another route is registered. Call this once all routes
+  /// are registered, before serving requests.
+  void Freeze();
+
+  bool Frozen() const {
+    return frozen_;
+  }
 
-  bool RegisterPost(const std::string &url, const HTTPCallback &callback);
+  bool RegisterGet(const std::string &url, const HTTPCallback &callback,
+                    ExecPolicy policy = ExecPolicy::Inline);
 
-  bool RegisterPut(const std::string &url, const HTTPCallback &callback);
+  bool RegisterHead(const std::string &url, const HTTPCallback &callback,
+                     ExecPolicy policy = ExecPolicy::Inline);
 
-  bool RegisterPatch(const std::string &url, const HTTPCallback &callback);
+  bool RegisterPost(const std::string &url, const HTTPCallback &callback,
+                     ExecPolicy policy = ExecPolicy::Inline);
 
-  bool RegisterDelete(const std::string &url, const HTTPCallback &callback);
+  bool RegisterPut(const std::string &url, const HTTPCallback &callback,
+                    ExecPolicy policy = ExecPolicy::Inline);
 
-  bool RegisterConnect(const std::string &url, const HTTPCallback &callback);
+  bool RegisterPatch(const std::string &url, const HTTPCallback &callback,
+                      ExecPolicy policy = ExecPolicy::Inline);
 
-  bool RegisterOptions(const std::string &url, const HTTPCallback &callback);
+  bool RegisterDelete(const std::string &url, const HTTPCallback &callback,
+                       ExecPolicy policy = ExecPolicy::Inline);
 
-  bool RegisterTrace(const std::string &url, const HTTPCallback &callback);
+  bool RegisterConnect(const std::string &url, const HTTPCallback &callback,
+                        ExecPolicy policy = ExecPolicy::Inline);
 
- private:
+  bool RegisterOptions(const std::string &url, const HTTPCallback &callback,
+                        ExecPolicy policy = ExecPolicy::Inline);
+
+  bool RegisterTrace(const std::string &url, const HTTPCallback &callback,
+                      ExecPolicy policy = ExecPolicy::Inline);
+
+  /// @brief Register callback for method on url.
+  /// @param method
+  /// @param url
+  /// @param callback
+  /// @param policy
+  /// @return false if method is unknown or url is already registered
   bool Register(HTTPMethod method, const std::string &url,
-                const HTTPCallback &callback);
+                const HTTPCallback &callback, ExecPolicy policy);
 
  private:
-  // every method maps to a route tree
-  std::unordered_map<HTTPMethod, detail::RouteNodePtr> trees_;
+  // every method maps to a route tree, indexed by HTTPMethod
+  detail::RouteNodePtr trees_[kHTTPMethodCount];
+  // compiled form of trees_
+  detail::RouteTable tables_[kHTTPMethodCount];
+  bool frozen_ = false;
 };
 
 typedef std::shared_ptr<HTTPRouter> HTTPRouterPtr;
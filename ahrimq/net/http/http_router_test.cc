@@ -2,6 +2,11 @@
 
 #include <gtest/gtest.h>
 
+#include <chrono>
+#include <cstddef>
+
+#include "ahrimq/net/http/alloc_counter_testutil.h"
+
 ahrimq::http::detail::RouteNode::Params fake_params;
 
 template <typename T>
@@ -419,6 +424,203 @@ TEST(HTTPRouterTest, RouteNodeMultipleWildcardTest) {
   }
 }
 
+TEST(HTTPRouterTest, RouteTableMatchTest) {
+  using namespace ahrimq::http;
+  detail::RouteNode root;
+  auto gen_fn = [](std::string arg) -> HTTPCallback {
+    return [arg](const HTTPRequest&, HTTPResponse&,
+                 const URLParams&) -> std::string { return arg; };
+  };
+  auto routes = std::vector<std::string>{
+      "/",
+      "/home/{name}",
+      "/home/{name}/{id}/about",
+      "/r/image/{id}",
+      "/r/music/user_{uid}",
+      "/r/music/vip_{vid}/page",
+      "/r/music",
+      "/user_{name}",
+      "/user_{name}/about",
+      "/data/lib{id}",
+      "/data/list",
+      "/你好/世界",
+  };
+  for (const auto& r : routes) {
+    ASSERT_TRUE(root.InsertRoute(r, gen_fn(r))) << r;
+  }
+  detail::RouteTable table;
+  table.Build(root);
+
+  auto urls = std::vector<std::string>{
+      "/",
+      "//",
+      "",
+      "/home/rita",
+      "/home/",
+      "/home",
+      "/home/a/1/about",
+      "/home/a/1",
+      "/r/image/123",
+      "/r/image",
+      "/r/music",
+      "/r/musicsd",
+      "/r/music/user_100",
+      "/r/music/user_",
+      "/r/music/user_{x}",
+      "/r/music/vip_7/page",
+      "/r/music/vip_7",
+      "/user_ryan/about",
+      "/user_ryan",
+      "/data/liba.so",
+      "/data/list",
+      "/data/lic.so",
+      "//data//list/",
+      "/你好/世界",
+      "/a/b/c",
+  };
+  HTTPRequest req(nullptr);
+  HTTPResponse res(nullptr);
+  for (const auto& url : urls) {
+    URLParams tree_params;
+    URLParams table_params;
+    auto node = root.SearchRoute(url, tree_params);
+    bool tree_found = node != nullptr && node->Handler() != nullptr;
+    auto handler = table.Match(url, table_params);
+    ASSERT_EQ(tree_found, handler != nullptr) << url;
+    if (handler == nullptr) {
+      continue;
+    }
+    EXPECT_EQ(node->Handler()(req, res, tree_params),
+              (*handler)(req, res, table_params))
+        << url;
+    EXPECT_EQ(tree_params, table_params) << url;
+  }
+}
+
+TEST(HTTPRouterTest, HTTPRouterFreezeTest) {
+  using namespace ahrimq::http;
+  HTTPRouter router;
+  auto cb = [](const HTTPRequest&, HTTPResponse&,
+               const URLParams& p) -> std::string { return p.Get("id"); };
+  ASSERT_TRUE(router.RegisterGet("/item/{id}", cb));
+  HTTPRequest req(nullptr);
+  HTTPResponse res(nullptr);
+  EXPECT_EQ(router.Route(HTTPMethod::Get, std::string("/item/12"), req, res), "12");
+  router.Freeze();
+  EXPECT_TRUE(router.Frozen());
+  EXPECT_EQ(router.Route(HTTPMethod::Get, std::string("/item/34"), req, res), "34");
+  // not registered on GET, falls back to static file lookup
+  EXPECT_EQ(router.Route(HTTPMethod::Get, std::string("/index.html"), req, res),
+            "index.html");
+  // registering after Freeze() falls back to the tree until frozen again
+  ASSERT_TRUE(router.RegisterPost("/item/{id}", cb));
+  EXPECT_FALSE(router.Frozen());
+  EXPECT_EQ(router.Route(HTTPMethod::Post, std::string("/item/56"), req, res), "56");
+}
+
+TEST(HTTPRouterTest, HTTPRouterExecPolicyTest) {
+  using namespace ahrimq::http;
+  HTTPRouter router;
+  auto cb = [](const HTTPRequest&, HTTPResponse&,
+               const URLParams& p) -> std::string { return p.Get("id"); };
+  ASSERT_TRUE(router.RegisterGet("/fast/{id}", cb));
+  ASSERT_TRUE(router.RegisterGet("/slow/{id}", cb, ExecPolicy::Pool));
+  for (int frozen = 0; frozen < 2; frozen++) {
+    if (frozen) {
+      router.Freeze();
+    }
+    URLParams params;
+    ExecPolicy policy = ExecPolicy::Pool;
+    EXPECT_NE(router.Match(HTTPMethod::Get, "/fast/1", params, policy), nullptr);
+    EXPECT_EQ(policy, ExecPolicy::Inline);
+    params.Reset();
+    const HTTPCallback* handler =
+        router.Match(HTTPMethod::Get, "/slow/2", params, policy);
+    ASSERT_NE(handler, nullptr);
+    EXPECT_EQ(policy, ExecPolicy::Pool);
+    HTTPRequest req(nullptr);
+    HTTPResponse res(nullptr);
+    EXPECT_EQ(HTTPRouter::Dispatch(HTTPMethod::Get, "/slow/2", handler, params, req,
+                                   res),
+              "2");
+    params.Reset();
+    EXPECT_EQ(router.Match(HTTPMethod::Post, "/slow/2", params, policy), nullptr);
+  }
+}
+
+TEST(HTTPRouterTest, RouteTableBenchmark) {
+  using namespace ahrimq::http;
+  constexpr int kRoutes = 1000;
+  detail::RouteNode root;
+  HTTPCallback cb = [](const HTTPRequest&, HTTPResponse&, const URLParams&) {
+    return std::string();
+  };
+  // a mix of static routes, full wildcards and prefix wildcards spread over a few
+  // top level groups
+  std::vector<std::string> urls;
+  for (int i = 0; i < kRoutes; i++) {
+    std::string g = "/g" + std::to_string(i % 16);
+    std::string r;
+    switch (i % 4) {
+      case 0:
+        r = g + "/static" + std::to_string(i) + "/list";
+        urls.push_back(r);
+        break;
+      case 1:
+        r = g + "/res" + std::to_string(i) + "/{id}";
+        urls.push_back(g + "/res" + std::to_string(i) + "/42");
+        break;
+      case 2:
+        r = g + "/res" + std::to_string(i) + "/{id}/items/{item}";
+        urls.push_back(g + "/res" + std::to_string(i) + "/7/items/abc");
+        break;
+      default:
+        r = g + "/user" + std::to_string(i) + "/u_{uid}";
+        urls.push_back(g + "/user" + std::to_string(i) + "/u_1001");
+        break;
+    }
+    ASSERT_TRUE(root.InsertRoute(r, cb)) << r;
+  }
+  detail::RouteTable table;
+  table.Build(root);
+
+  constexpr int kRounds = 200;
+  URLParams params;
+  std::vector<std::string_view> views(urls.begin(), urls.end());
+
+  size_t found = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int round = 0; round < kRounds; round++) {
+    for (const auto& url : urls) {
+      params.Reset();
+      found += root.SearchHandler(url, params) != nullptr;
+    }
+  }
+  auto tree_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                     std::chrono::steady_clock::now() - start)
+                     .count();
+  EXPECT_EQ(found, size_t(kRoutes) * kRounds);
+
+  found = 0;
+  size_t allocs = ahrimq::http::HeapAllocations();
+  start = std::chrono::steady_clock::now();
+  for (int round = 0; round < kRounds; round++) {
+    for (const auto& url : views) {
+      params.Reset();
+      found += table.Match(url, params) != nullptr;
+    }
+  }
+  auto table_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+  EXPECT_EQ(ahrimq::http::HeapAllocations() - allocs, 0u);
+  EXPECT_EQ(found, size_t(kRoutes) * kRounds);
+
+  double lookups = double(kRoutes) * kRounds;
+  std::cout << "[ bench    ] " << kRoutes << " routes, tree: " << tree_ns / lookups
+            << " ns/op, compiled: " << table_ns / lookups << " ns/op" << std::endl;
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
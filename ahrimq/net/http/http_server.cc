@@ -1,9 +1,12 @@
 #include "net/http/http_server.h"
 
+#include <strings.h>
+
 #include <atomic>
 #include <chrono>
 
 #include "mime/mime.h"
+#include "net/http/http_range.h"
 
 using std::placeholders::_1;  // _1, _2, ...
 using std::placeholders::_2;
@@ -28,19 +31,30 @@ HTTPServer::HTTPServer(const HTTPServer::Config& config)
 
 HTTPServer::~HTTPServer() {
   stopped_.store(true, std::memory_order_relaxed);
+  if (pool_ != nullptr) {
+    pool_->Stop();
+  }
   reactor_.reset();
 }
 
 // TODO improve Run and Stop protocol
 void HTTPServer::Run() {
   assert(reactor_ != nullptr);
+  router_.Freeze();
   reactor_->React();
   reactor_->Wait();
 }
 
 void HTTPServer::Stop() {
   stopped_.store(true, std::memory_order_relaxed);
+  if (pool_ != nullptr) {
+    // handlers still running post their responses before the loops stop
+    pool_->Stop();
+  }
   reactor_->Stop();
+  if (static_cache_ != nullptr) {
+    static_cache_->Stop();
+  }
 }
 
 void HTTPServer::InitReactorHandlers() {
@@ -62,46 +76,83 @@ void HTTPServer::InitReactorHandlers() {
   });
 }
 
-bool HTTPServer::Get(const std::string& pattern, const HTTPCallback& callback) {
-  return router_.RegisterGet(pattern, callback);
+bool HTTPServer::Get(const std::string& pattern, const HTTPCallback& callback,
+                     ExecPolicy policy) {
+  return router_.RegisterGet(pattern, callback, policy);
 }
 
-bool HTTPServer::Head(const std::string& pattern, const HTTPCallback& callback) {
-  return router_.RegisterHead(pattern, callback);
+bool HTTPServer::Head(const std::string& pattern, const HTTPCallback& callback,
+                      ExecPolicy policy) {
+  return router_.RegisterHead(pattern, callback, policy);
 }
 
-bool HTTPServer::Post(const std::string& pattern, const HTTPCallback& callback) {
-  return router_.RegisterPost(pattern, callback);
+bool HTTPServer::Post(const std::string& pattern, const HTTPCallback& callback,
+                      ExecPolicy policy) {
+  return router_.RegisterPost(pattern, callback, policy);
 }
 
-bool HTTPServer::Put(const std::string& pattern, const HTTPCallback& callback) {
-  return router_.RegisterPut(pattern, callback);
+bool HTTPServer::Put(const std::string& pattern, const HTTPCallback& callback,
+                     ExecPolicy policy) {
+  return router_.RegisterPut(pattern, callback, policy);
 }
 
-bool HTTPServer::Patch(const std::string& pattern, const HTTPCallback& callback) {
-  return router_.RegisterPatch(pattern, callback);
+bool HTTPServer::Patch(const std::string& pattern, const HTTPCallback& callback,
+                       ExecPolicy policy) {
+  return router_.RegisterPatch(pattern, callback, policy);
 }
 
-bool HTTPServer::Delete(const std::string& pattern, const HTTPCallback& callback) {
-  return router_.RegisterDelete(pattern, callback);
+bool HTTPServer::Delete(const std::string& pattern, const HTTPCallback& callback,
+                        ExecPolicy policy) {
+  return router_.RegisterDelete(pattern, callback, policy);
 }
 
-bool HTTPServer::Connect(const std::string& pattern, const HTTPCallback& callback) {
-  return router_.RegisterConnect(pattern, callback);
+bool HTTPServer::Connect(const std::string& pattern, const HTTPCallback& callback,
+                         ExecPolicy policy) {
+  return router_.RegisterConnect(pattern, callback, policy);
 }
 
-bool HTTPServer::Options(const std::string& pattern, const HTTPCallback& callback) {
-  return router_.RegisterOptions(pattern, callback);
+bool HTTPServer::Options(const std::string& pattern, const HTTPCallback& callback,
+                         ExecPolicy policy) {
+  return router_.RegisterOptions(pattern, callback, policy);
 }
 
-bool HTTPServer::Trace(const std::string& pattern, const HTTPCallback& callback) {
-  return router_.RegisterTrace(pattern, callback);
+bool HTTPServer::Trace(const std::string& pattern, const HTTPCallback& callback,
+                       ExecPolicy policy) {
+  return router_.RegisterTrace(pattern, callback, policy);
 }
 
+#ifdef AHRIMQ_COROUTINES
+// Callback of a route registered with Handle(). The route keeps the coroutine
+// handler, StartCoroutine() takes it from the matched route to create the task;
+// run as a plain callback it does nothing.
+struct CoroutineRoute {
+  HTTPCoroutine coroutine;
+
+  std::string operator()(const HTTPRequest& req, HTTPResponse& res,
+                         const URLParams& params) const {
+    return "";
+  }
+};
+
+bool HTTPServer::Handle(HTTPMethod method, const std::string& pattern,
+                        HTTPCoroutine coroutine) {
+  if (coroutine == nullptr) {
+    return false;
+  }
+  return router_.Register(method, pattern, CoroutineRoute{std::move(coroutine)},
+                          ExecPolicy::Coroutine);
+}
+#endif
+
 void HTTPServer::InitHTTPServer() {
   assert(reactor_ != nullptr);
   InitReactorHandlers();
   InitErrHandler();
+  InitFileCaches();
+  if (config_.worker_threads > 0) {
+    pool_ = std::make_unique<WorkStealingPool>(config_.worker_threads,
+                                               config_.worker_queue_limit);
+  }
   InitCleanup();
   stopped_.store(false);
 }
@@ -111,6 +162,7 @@ void HTTPServer::InitErrHandler() {
   err_handlers_[StatusNotFound] = Default404Handler;
   err_handlers_[StatusMethodNotAllowed] = Default405Handler;
   err_handlers_[StatusInternalServerError] = Default500Handler;
+  err_handlers_[StatusServiceUnavailable] = Default503Handler;
 }
 
 void HTTPServer::InitCleanup() {
@@ -119,8 +171,32 @@ void HTTPServer::InitCleanup() {
   cleanup_wrk_.detach();
 }
 
+void HTTPServer::InitFileCaches() {
+  open_files_ = std::make_unique<OpenFileCache>(config_.open_file_cache_max_files);
+  if (!config_.static_cache) {
+    return;
+  }
+  static_cache_ = std::make_unique<StaticFileCache>(
+      config_.static_cache_max_file_size, config_.static_cache_capacity,
+      config_.static_cache_variant_capacity, config_.static_cache_max_compress_size,
+      config_.static_cache_max_entries);
+  // descriptors of changed files must not be served any more
+  static_cache_->SetOnChange([this](const std::string& path) {
+    if (path.empty()) {
+      open_files_->Clear();
+    } else {
+      open_files_->Invalidate(path);
+    }
+  });
+  if (!static_cache_->Watch()) {
+    std::cerr << "static file cache disabled, can not watch files. ["
+              << std::strerror(errno) << "]\n";
+    static_cache_.reset();
+  }
+}
+
 void HTTPServer::OnStreamOpen(ReactorConn* conn, bool& close_after) {
-  std::string conn_name = conn->GetName();
+  const std::string& conn_name = conn->GetName();
   // create a new http connection instance
   HTTPConnPtr httpconn = std::make_shared<HTTPConn>(conn);
   if (httpconn == nullptr) {
@@ -133,6 +209,7 @@ void HTTPServer::OnStreamOpen(ReactorConn* conn, bool& close_after) {
   httpconn->SetTCPKeepAlivePeriod(config_.tcp_keepalive_period);
   httpconn->SetTCPKeepAliveCount(config_.tcp_keepalive_count);
   httpconn->SetTCPNoDelay(config_.tcp_nodelay);
+  httpconn->CurrentRequestRef()->SetFormLimits(config_.form_limits);
   mtx_.lock();
   httpconns_.insert({conn_name, httpconn});
   mtx_.unlock();
@@ -146,7 +223,7 @@ void HTTPServer::OnStreamOpen(ReactorConn* conn, bool& close_after) {
 // ATTENTION!! this method may be invoked in multiple threads
 void HTTPServer::OnStreamReached(ReactorConn* conn, bool allread,
                                  bool& close_after) {
-  std::string conn_name = conn->GetName();
+  const std::string& conn_name = conn->GetName();
   // get http connection
   mtx_.lock();
   HTTPConnPtr httpconn = httpconns_[conn_name];
@@ -159,14 +236,47 @@ void HTTPServer::OnStreamReached(ReactorConn* conn, bool allread,
   }
   mtx_.unlock();
 
+  if (httpconn->h2_ != nullptr) {
+    httpconn->h2_->Feed(httpconn->read_buf_);
+    close_after = httpconn->h2_->Finished() && httpconn->write_buf_.Empty();
+    return;
+  }
+  if (httpconn->ws_ != nullptr) {
+    WebSocketConn* ws = httpconn->ws_.get();
+    ws->Feed();
+    close_after = ws->Finished() && ws->GetWriteBuffer().Empty();
+    return;
+  }
+  if (config_.http2 &&
+      httpconn->GetCurrentParsingState() == RequestParsingState::RequestLine) {
+    // HTTP/2 with prior knowledge starts with the connection preface
+    Buffer& rbuf = httpconn->read_buf_;
+    int preface = MatchHTTP2Preface(rbuf.BeginReadPointer(), rbuf.Size());
+    if (preface == 0) {
+      return;
+    }
+    if (preface == 1) {
+      StartHTTP2(httpconn);
+      httpconn->h2_->Feed(rbuf);
+      return;
+    }
+  }
+
 StartParsingRequestDatagramTag:
   int retcode = ParseRequestDatagram(httpconn.get());
   if (retcode == StatusPrivatePending) {
     // In pending state, we do not need to send response
     return;
   } else if (retcode == StatusPrivateDone) {
+    if (config_.http2 && UpgradeToHTTP2(httpconn)) {
+      // stream 1 carries the response
+      return;
+    }
     // do request
-    DoRequest(httpconn.get());
+    if (!DoRequest(httpconn)) {
+      // the worker pool completes the response
+      return;
+    }
   } else {
     // request datagram is abnormal, we need to do error handling
     if (retcode == StatusPrivateInvalid) {
@@ -174,23 +284,228 @@ StartParsingRequestDatagramTag:
     }
     DoRequestError(httpconn.get(), retcode);
   }
+  FinishResponse(httpconn.get());
+}
+
+void HTTPServer::FinishResponse(HTTPConn* conn) {
   // centralized error handler processing
-  CentrailzedStatusCodeHandling(httpconn.get());
+  CentrailzedStatusCodeHandling(conn);
+  CompressResponse(conn);
+
+  if (conn->IsStream()) {
+    // framed by the session, the body is sent from where the response keeps it
+    std::shared_ptr<HTTP2Session> session = conn->session_.lock();
+    if (session != nullptr) {
+      session->SubmitResponse(conn, conn->conn_->GetLoop()->date_cache);
+    }
+    conn->CurrentRequestRef()->Reset();
+    return;
+  }
 
   // send all response data out to client
   // TODO consider the situation where http request pipelining is needed
-  httpconn->CurrentResponseRef()->Organize(httpconn->GetWriteBuffer());
-  httpconn->CurrentRequestRef()->Reset();
-  httpconn->Send();
+  conn->CurrentResponseRef()->Organize(conn->GetWriteBuffer(),
+                                       conn->conn_->GetLoop()->date_cache);
+  conn->CurrentRequestRef()->Reset();
+  conn->Send();
+}
+
+// ATTENTION!! this method is invoked in the eventloop of the connection, after a
+// handler finished elsewhere
+void HTTPServer::CompleteResponse(HTTPConn* conn, const std::string& page) {
+  if (conn->Detached()) {
+    // the connection of the stream was closed in the meantime
+    return;
+  }
+  DoResponsePage(conn, page);
+  FinishResponse(conn);
+  conn->Resume();
+}
+
+void HTTPServer::StartHTTP2(const HTTPConnPtr& httpconn) {
+  auto session = std::make_shared<HTTP2Session>(
+      httpconn->conn_, httpconn->write_buf_, config_.http2_limits,
+      [this](const HTTPConnPtr& stream, int status) {
+        DoStreamRequest(stream, status);
+      });
+  session->SetFormLimits(config_.form_limits);
+  session->Start();
+  httpconn->h2_ = std::move(session);
+}
+
+// Check if a comma separated header value contains token, case-insensitively.
+static bool HasToken(std::string_view list, std::string_view token) {
+  while (!list.empty()) {
+    size_t comma = list.find(',');
+    std::string_view item = list.substr(0, comma);
+    list.remove_prefix(comma == std::string_view::npos ? list.size() : comma + 1);
+    while (!item.empty() && (item.front() == ' ' || item.front() == '\t')) {
+      item.remove_prefix(1);
+    }
+    while (!item.empty() && (item.back() == ' ' || item.back() == '\t')) {
+      item.remove_suffix(1);
+    }
+    if (item.size() == token.size() &&
+        strncasecmp(item.data(), token.data(), token.size()) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Switch to HTTP/2 if the request asks for it (RFC 7540 section 3.2). Requests
+// with a body are answered over HTTP/1.1, as the upgrade would have to wait for
+// the whole body.
+bool HTTPServer::UpgradeToHTTP2(const HTTPConnPtr& httpconn) {
+  const HTTPRequest& req = *httpconn->CurrentRequestRef();
+  const HTTPHeader& header = *req.GetHeader();
+  if (req.GetHTTPVersion() != Version1_1 || !header.Has("HTTP2-Settings") ||
+      !HasToken(header.GetView("Upgrade"), "h2c") ||
+      !HasToken(header.GetView("Connection"), "upgrade") ||
+      !HasToken(header.GetView("Connection"), "http2-settings") ||
+      (header.Has("Content-Length") && header.GetView("Content-Length") != "0")) {
+    return false;
+  }
+  std::string settings;
+  if (!DecodeHTTP2Settings(header.GetView("HTTP2-Settings"), settings)) {
+    return false;
+  }
+  httpconn->write_buf_.Append(
+      "HTTP/1.1 101 Switching Protocols\r\nConnection: Upgrade\r\n"
+      "Upgrade: h2c\r\n\r\n");
+  StartHTTP2(httpconn);
+  bool upgraded = httpconn->h2_->Upgrade(req, settings);
+  // what follows the request, the client preface at least, and what was written
+  // so far belong to HTTP/2, they are kept apart from the reset of the HTTP/1.1
+  // exchange
+  Buffer rest, out;
+  rest.Swap(httpconn->read_buf_);
+  out.Swap(httpconn->write_buf_);
+  httpconn->ResetExchange();
+  httpconn->read_buf_.Swap(rest);
+  httpconn->write_buf_.Swap(out);
+  if (upgraded) {
+    httpconn->h2_->Feed(httpconn->read_buf_);
+  }
+  return true;
+}
+
+// Check the WebSocket handshake of req (RFC 6455 section 4.2.1) and set up the
+// response refusing it if it is not valid.
+static bool CheckWebSocketHandshake(const HTTPRequest& req, HTTPResponse& res) {
+  const HTTPHeader& header = *req.GetHeader();
+  HTTPHeaderPtr& res_header = res.HeaderRef();
+  if (req.GetHTTPVersion() != Version1_1 ||
+      !HasToken(header.GetView("Upgrade"), "websocket") ||
+      !HasToken(header.GetView("Connection"), "upgrade") ||
+      header.GetView("Sec-WebSocket-Version") != "13") {
+    // also the answer to HTTP/2 requests, which can not be upgraded
+    res.SetStatus(StatusUpgradeRequired);
+    res_header->Set("Upgrade", "websocket");
+    res_header->Set("Sec-WebSocket-Version", "13");
+    return false;
+  }
+  if (!ValidWebSocketKey(header.GetView("Sec-WebSocket-Key"))) {
+    res.SetStatus(StatusBadRequest);
+    return false;
+  }
+  return true;
+}
+
+// Callback of a route registered with WebSocket(). The route keeps the handlers,
+// UpgradeToWebSocket() takes them from the matched route once Accept() agrees to
+// the handshake.
+struct WebSocketRoute {
+  std::shared_ptr<const WebSocketHandlers> handlers;
+
+  bool Accept(const HTTPRequest& req, HTTPResponse& res,
+              const URLParams& params) const {
+    if (!CheckWebSocketHandshake(req, res)) {
+      return false;
+    }
+    // the status of a refused request unless on_upgrade sets another one
+    res.SetStatus(StatusForbidden);
+    return handlers->on_upgrade == nullptr || handlers->on_upgrade(req, res, params);
+  }
+
+  std::string operator()(const HTTPRequest& req, HTTPResponse& res,
+                         const URLParams& params) const {
+    Accept(req, res, params);
+    return "";
+  }
+};
+
+bool HTTPServer::WebSocket(const std::string& pattern, WebSocketHandlers handlers) {
+  WebSocketRoute route{
+      std::make_shared<const WebSocketHandlers>(std::move(handlers))};
+  return router_.Register(HTTPMethod::Get, pattern, route, ExecPolicy::WebSocket);
+}
+
+bool HTTPServer::UpgradeToWebSocket(const HTTPConnPtr& httpconn,
+                                    const HTTPCallback* handler,
+                                    const URLParams& params) {
+  const WebSocketRoute* route =
+      handler != nullptr ? handler->target<WebSocketRoute>() : nullptr;
+  if (route == nullptr ||
+      !route->Accept(*httpconn->CurrentRequestRef(), *httpconn->CurrentResponseRef(),
+                     params) ||
+      httpconn->IsStream()) {
+    // refused, the response is set up by the route
+    return false;
+  }
+  std::shared_ptr<const WebSocketHandlers> handlers = route->handlers;
+  const HTTPRequest& req = *httpconn->CurrentRequestRef();
+  const HTTPHeader& res_header = *httpconn->CurrentResponseRef()->GetHeader();
+  auto ws = std::make_shared<WebSocketConn>(
+      httpconn->conn_, config_.websocket_limits, std::move(handlers));
+  Buffer& wbuf = ws->GetWriteBuffer();
+  wbuf.Append(
+      "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\n"
+      "Connection: Upgrade\r\nSec-WebSocket-Accept: ");
+  wbuf.Append(WebSocketAccept(req.GetHeader()->GetView("Sec-WebSocket-Key")));
+  if (res_header.Has("Sec-WebSocket-Protocol")) {
+    // the subprotocol picked by on_upgrade
+    wbuf.Append("\r\nSec-WebSocket-Protocol: ");
+    wbuf.Append(res_header.Get("Sec-WebSocket-Protocol"));
+  }
+  wbuf.Append("\r\n\r\n");
+  // the frames which came with the handshake belong to the new connection
+  ws->GetReadBuffer().Swap(httpconn->read_buf_);
+  httpconn->ResetExchange();
+  httpconn->conn_->SetReadBuffer(&ws->GetReadBuffer());
+  httpconn->conn_->SetWriteBuffer(&wbuf);
+  httpconn->ws_ = ws;
+  ws->Open();
+  return true;
+}
+
+void HTTPServer::DoStreamRequest(const HTTPConnPtr& stream, int status) {
+  if (status == StatusPrivateDone) {
+    if (!DoRequest(stream)) {
+      // the worker pool completes the response
+      return;
+    }
+  } else {
+    DoRequestError(stream.get(), status);
+  }
+  FinishResponse(stream.get());
 }
 
 // ATTENTION!! this method may be invoked in multiple threads
 void HTTPServer::OnStreamClosed(ReactorConn* conn, bool& close_after) {
   // TODO handle connection close by reusing connections
-  std::string conn_name = conn->GetName();
+  const std::string& conn_name = conn->GetName();
+  HTTPConnPtr httpconn;
   mtx_.lock();
-  httpconns_.erase(conn_name);
+  auto it = httpconns_.find(conn_name);
+  if (it != httpconns_.end()) {
+    httpconn = std::move(it->second);
+    httpconns_.erase(it);
+  }
   mtx_.unlock();
+  if (httpconn != nullptr && httpconn->ws_ != nullptr) {
+    httpconn->ws_->OnClosed();
+  }
 #ifdef AHRIMQ_DEBUG
   // printf("HTTP connection %s closed!\n", conn_name.c_str());
 #endif
@@ -198,10 +513,31 @@ void HTTPServer::OnStreamClosed(ReactorConn* conn, bool& close_after) {
 
 // ATTENTION!! this method may be invoked in multiple threads
 void HTTPServer::OnStreamWritten(ReactorConn* conn, bool& close_after) {
-  std::string conn_name = conn->GetName();
+  const std::string& conn_name = conn->GetName();
   mtx_.lock();
   HTTPConnPtr httpconn = httpconns_[conn_name];
   mtx_.unlock();
+  if (httpconn == nullptr) {
+    close_after = true;
+    return;
+  }
+  if (httpconn->h2_ != nullptr) {
+    // frame what the flushed write buffer left room for
+    httpconn->h2_->OnWritten();
+    if (!httpconn->write_buf_.Empty()) {
+      conn->Resume();
+    } else if (httpconn->h2_->Finished()) {
+      close_after = true;
+    }
+    return;
+  }
+  if (httpconn->ws_ != nullptr) {
+    // the write buffer is empty, what was sent last may be our close frame
+    close_after = httpconn->ws_->Finished();
+    return;
+  }
+  // the reactor is done with the file
+  httpconn->sending_file_.reset();
   // keepalive handling
   HTTPHeaderPtr& res_header = httpconn->CurrentResponseRef()->HeaderRef();
   if (!res_header->Has("Connection") ||
@@ -213,15 +549,15 @@ void HTTPServer::OnStreamWritten(ReactorConn* conn, bool& close_after) {
     mtx_.unlock();
   } else {
     // the http connection is kept
-    httpconn->CurrentRequestRef()->Reset();
-    httpconn->CurrentResponseRef()->Reset();
+    httpconn->ResetExchange();
   }
 #ifdef AHRIMQ_DEBUG
   // printf("HTTPServer::OnStreamWritten, Request and Response reset\n");
 #endif
 }
 
-void HTTPServer::DoRequest(HTTPConn* conn) {
+bool HTTPServer::DoRequest(const HTTPConnPtr& httpconn) {
+  HTTPConn* conn = httpconn.get();
   HTTPRequestPtr& req = conn->CurrentRequestRef();
   HTTPHeaderPtr& req_header = req->HeaderRef();
 
@@ -240,49 +576,364 @@ void HTTPServer::DoRequest(HTTPConn* conn) {
     // we should parse request body here
     status_code = req->ParseForm();
   }
-  if (status_code == StatusPrivateDone) {
-    // ROUTING !!!!
-    std::string response_page = DoRouting(conn);
-    if (!response_page.empty()) {
-      // if response_page is not empty, we do file sending operation
-      // and any existing write buffer content should be clear to avoid confilce
-      res->UserBuffer().Reset();
-      std::string response_page_fullpath;
-      PathJoin(config_.root, response_page, response_page_fullpath);
-      // then open response page file
-      int ofd = OpenFile(response_page_fullpath);
-      if (ofd == -1) {
-        std::cerr << "can not open file " << response_page_fullpath << ". ["
-                  << std::strerror(errno) << "]\n";
-        if (errno == ENOENT) {
-          status_code = StatusNotFound;
-        } else {
-          status_code = StatusInternalServerError;
-        }
-        goto do_request_error;
-      } else {
-        // found
-        ReactorConn* rc = conn->conn_;
-        if (rc->PutFile(ofd, false) == false) {
-          // treat it as 404
-          status_code = StatusNotFound;
-          goto do_request_error;
-        }
-        // put file ok
-        // set some corresponding response header
-        res_header->Set("Content-Length", std::to_string(rc->FileSize()));
-        // content-type
-        res->SetContentType(
-            mime::DecideMimeTypeFromExtension(response_page_fullpath));
-        // TODO: content-encoding
-        res->SetStatus(StatusOK);
+  if (status_code != StatusPrivateDone) {
+    // still has error
+    DoRequestError(conn, status_code);
+    return true;
+  }
+  // ROUTING !!!!
+  URLParams params;
+  ExecPolicy policy = ExecPolicy::Inline;
+  const HTTPCallback* handler =
+      router_.Match(m, req->URLRef().Path(), params, policy);
+  if (handler != nullptr && policy == ExecPolicy::Pool && pool_ != nullptr) {
+    if (DoRequestOnPool(httpconn, handler, std::move(params))) {
+      return false;
+    }
+    // too many requests are waiting for a worker
+    res_header->Set("Retry-After", "1");
+    DoRequestError(conn, StatusServiceUnavailable);
+    return true;
+  }
+  if (policy == ExecPolicy::WebSocket) {
+    // the connection speaks WebSocket from now on unless the route refuses
+    return !UpgradeToWebSocket(httpconn, handler, params);
+  }
+#ifdef AHRIMQ_COROUTINES
+  if (policy == ExecPolicy::Coroutine && StartCoroutine(httpconn, handler, params)) {
+    // the coroutine completes the response
+    return false;
+  }
+#endif
+  std::string page = DoRouting(conn, handler, params);
+  DoResponsePage(conn, page);
+  return true;
+}
+
+bool HTTPServer::DoRequestOnPool(const HTTPConnPtr& httpconn,
+                                 const HTTPCallback* handler, URLParams params) {
+  // eventloops outlive the connections, which may close while a stream's
+  // handler runs
+  EventLoop* loop = httpconn->conn_->GetLoop();
+  bool submitted = pool_->Submit(
+      [this, httpconn, handler, loop, params = std::move(params)]() {
+        std::string page = DoRouting(httpconn.get(), handler, params);
+        loop->QueueInLoop([this, httpconn, page = std::move(page)]() {
+          // back in the eventloop, which owns the connection again
+          CompleteResponse(httpconn.get(), page);
+        });
+      });
+  if (submitted) {
+    // the completion runs in this thread after the current event, so the
+    // connection is suspended before it can be resumed
+    httpconn->Suspend();
+  }
+  return submitted;
+}
+
+#ifdef AHRIMQ_COROUTINES
+bool HTTPServer::StartCoroutine(const HTTPConnPtr& httpconn,
+                                const HTTPCallback* handler,
+                                const URLParams& params) {
+  const CoroutineRoute* route =
+      handler != nullptr ? handler->target<CoroutineRoute>() : nullptr;
+  if (route == nullptr) {
+    return false;
+  }
+  coro::Task<std::string> task;
+  try {
+    // tasks are lazy, nothing of the handler runs here
+    task = route->coroutine(*httpconn->CurrentRequestRef(),
+                            *httpconn->CurrentResponseRef(), params);
+  } catch (std::exception& ex) {
+    // the route failed before creating its coroutine
+    httpconn->CurrentResponseRef()->SetStatus(StatusInternalServerError);
+    return false;
+  }
+  if (!task.Valid()) {
+    return false;
+  }
+  // suspend first, the coroutine may finish before Spawn returns
+  httpconn->Suspend();
+  coro::Spawn(RunCoroutine(httpconn, std::move(task)));
+  return true;
+}
+
+coro::Task<void> HTTPServer::RunCoroutine(HTTPConnPtr httpconn,
+                                          coro::Task<std::string> task) {
+  HTTPConn* conn = httpconn.get();
+  std::string page;
+  try {
+    page = co_await task;
+  } catch (...) {
+    // internal error
+    conn->CurrentResponseRef()->SetStatus(StatusInternalServerError);
+  }
+  // every awaitable resumes in the eventloop of the connection
+  CompleteResponse(conn, page);
+}
+#endif
+
+void HTTPServer::DoResponsePage(HTTPConn* conn, const std::string& page) {
+  if (page.empty()) {
+    return;
+  }
+  // if response_page is not empty, we do file sending operation
+  // and any existing write buffer content should be clear to avoid confilce
+  conn->CurrentResponseRef()->UserBuffer().Reset();
+  std::string response_page_fullpath;
+  PathJoin(config_.root, page, response_page_fullpath);
+  int status_code = ServeFile(conn, response_page_fullpath);
+  if (status_code != StatusPrivateDone) {
+    DoRequestError(conn, status_code);
+  }
+}
+
+// Conditional GET: If-None-Match takes precedence over If-Modified-Since.
+static bool NotModified(const HTTPHeader& req_header, std::string_view etag,
+                        time_t mtime) {
+  if (req_header.Has("If-None-Match")) {
+    return ETagListMatch(req_header.Get("If-None-Match"), etag);
+  }
+  if (req_header.Has("If-Modified-Since")) {
+    std::string since = req_header.Get("If-Modified-Since");
+    time_t t;
+    return time::ParseGMTTime(since.data(), since.size(), t) && mtime <= t;
+  }
+  return false;
+}
+
+// ATTENTION!! this method may be invoked in multiple threads
+int HTTPServer::ServeFile(HTTPConn* conn, const std::string& path) {
+  HTTPHeaderPtr& req_header = conn->CurrentRequestRef()->HeaderRef();
+  HTTPResponsePtr& res = conn->CurrentResponseRef();
+  HTTPHeaderPtr& res_header = res->HeaderRef();
+
+  // describe the file, from memory if possible
+  StaticFileCache::EntryPtr entry = nullptr;
+  if (static_cache_ != nullptr) {
+    entry = static_cache_->Get(path);
+    if (entry == nullptr && errno == ENOENT) {
+      return StatusNotFound;
+    }
+  }
+  OpenFileCache::FilePtr file = nullptr;
+  int ofd = -1;
+  if (entry == nullptr || !entry->has_body) {
+    // then open response page file
+    file = open_files_->Open(path);
+    if (file == nullptr) {
+      std::cerr << "can not open file " << path << ". [" << std::strerror(errno)
+                << "]\n";
+      return errno == ENOENT ? StatusNotFound : StatusInternalServerError;
+    }
+    ofd = file->fd;
+  }
+  if (entry == nullptr) {
+    struct stat st;
+    if (fstat(ofd, &st) == -1) {
+      return StatusInternalServerError;
+    }
+    if (!S_ISREG(st.st_mode)) {
+      return StatusNotFound;
+    }
+    entry = StaticFileCache::Describe(path, st);
+  }
+
+  // content negotiation, ranges always apply to the identity representation
+  StaticFileCache::VariantPtr variant = nullptr;
+  int level = CompressionPolicy::kNoCompression;
+  if (config_.compression) {
+    level = config_.compression_policy.Level(entry->content_type);
+  }
+  if (level != CompressionPolicy::kNoCompression) {
+    res_header->Add("Vary", "Accept-Encoding");
+    if (static_cache_ != nullptr && !req_header->Has("Range") &&
+        req_header->Has("Accept-Encoding")) {
+      ContentCoding coding =
+          NegotiateEncoding(req_header->GetView("Accept-Encoding"));
+      variant = static_cache_->GetVariant(entry, coding, level);
+    }
+  }
+  if (variant != nullptr) {
+    if (NotModified(*req_header, variant->etag, entry->mtime)) {
+      res->SetPrebuilt(variant->validators, std::string_view(), variant);
+      res->SetStatus(StatusNotModified);
+      return StatusPrivateDone;
+    }
+    if (variant->file.empty()) {
+      res->SetPrebuilt(variant->head, variant->body, variant);
+      res->SetStatus(StatusOK);
+      return StatusPrivateDone;
+    }
+    // large precompressed sibling goes through sendfile
+    OpenFileCache::FilePtr encoded = open_files_->Open(variant->file);
+    if (encoded != nullptr && encoded->size == variant->size &&
+        conn->PutFile(encoded)) {
+      res->SetPrebuilt(variant->head, std::string_view(), variant);
+      res->SetStatus(StatusOK);
+      return StatusPrivateDone;
+    }
+    // the sibling changed under us, fall back to the identity representation
+  }
+
+  if (NotModified(*req_header, entry->etag, entry->mtime)) {
+    res->SetPrebuilt(entry->validators, std::string_view(), entry);
+    res->SetStatus(StatusNotModified);
+    return StatusPrivateDone;
+  }
+
+  std::vector<ByteRange> ranges;
+  RangeResult rr = RangeResult::None;
+  if (req_header->Has("Range") &&
+      (!req_header->Has("If-Range") ||
+       IfRangeMatch(req_header->Get("If-Range"), entry->etag, entry->mtime))) {
+    rr = ParseRange(req_header->Get("Range"), entry->size, ranges);
+  }
+  if (rr == RangeResult::NotSatisfiable) {
+    res_header->Set("Content-Range", "bytes */" + std::to_string(entry->size));
+    res_header->Set("Content-Length", "0");
+    res->SetStatus(StatusRangeNotSatisfiable);
+    return StatusPrivateDone;
+  }
+  if (rr == RangeResult::Satisfiable && ranges.size() > 1) {
+    size_t total = 0;
+    for (const auto& r : ranges) {
+      total += r.length;
+    }
+    if (total > kMaxMultiRangeBytes) {
+      rr = RangeResult::None;
+    }
+  }
+
+  if (rr == RangeResult::None) {
+    // whole file
+    if (entry->has_body) {
+      // served from memory
+      res->SetPrebuilt(entry->head, entry->body, entry);
+    } else {
+      // the descriptor is kept open until the file is sent
+      if (!conn->PutFile(file)) {
+        // treat it as 404
+        return StatusNotFound;
       }
+      res->SetPrebuilt(entry->head, std::string_view(), entry);
     }
+    res->SetStatus(StatusOK);
+    return StatusPrivateDone;
+  }
+
+  char content_range[80];
+  if (ranges.size() == 1) {
+    const ByteRange& r = ranges[0];
+    snprintf(content_range, sizeof(content_range), "bytes %zu-%zu/%zu", r.offset,
+             r.offset + r.length - 1, entry->size);
+    res_header->Set("Content-Type", entry->content_type);
+    res_header->Set("Content-Range", content_range);
+    res_header->Set("Content-Length", std::to_string(r.length));
+    if (entry->has_body) {
+      res->SetPrebuilt(entry->validators,
+                       std::string_view(entry->body).substr(r.offset, r.length),
+                       entry);
+    } else {
+      // the range goes straight into sendfile, or DATA frames
+      if (!conn->PutFile(file, r.offset, r.length)) {
+        return StatusRangeNotSatisfiable;
+      }
+      res->SetPrebuilt(entry->validators, std::string_view(), entry);
+    }
+    res->SetStatus(StatusPartialContent);
+    return StatusPrivateDone;
+  }
+
+  // several ranges: multipart/byteranges assembled in the user buffer
+  static std::atomic<uint64_t> boundary_seq{0};
+  char boundary[40];
+  snprintf(boundary, sizeof(boundary), "ahrimq%016lx",
+           static_cast<unsigned long>(time::GetCurrentMs() * 0x9E3779B97F4A7C15ULL ^
+                                      boundary_seq.fetch_add(1)));
+  Buffer& body = res->UserBuffer();
+  for (const auto& r : ranges) {
+    snprintf(content_range, sizeof(content_range), "bytes %zu-%zu/%zu", r.offset,
+             r.offset + r.length - 1, entry->size);
+    body.Append("\r\n--");
+    body.Append(boundary);
+    body.Append("\r\nContent-Type: ");
+    body.Append(entry->content_type);
+    body.Append("\r\nContent-Range: ");
+    body.Append(content_range);
+    body.Append("\r\n\r\n");
+    if (entry->has_body) {
+      body.Append(entry->body.data() + r.offset, r.length);
+      continue;
+    }
+    body.EnsureBytesForWrite(r.length);
+    size_t total = 0;
+    while (total < r.length) {
+      ssize_t n = pread(ofd, body.BeginWritePointer() + total, r.length - total,
+                        r.offset + total);
+      if (n == -1 && errno == EINTR) {
+        continue;
+      }
+      if (n <= 0) {
+        body.Reset();
+        return StatusInternalServerError;
+      }
+      total += n;
+    }
+    body.WriterIdxForward(r.length);
+  }
+  body.Append("\r\n--");
+  body.Append(boundary);
+  body.Append("--\r\n");
+  res_header->Set("Content-Type",
+                  std::string("multipart/byteranges; boundary=") + boundary);
+  res_header->Set("Content-Length", std::to_string(body.Size()));
+  res_header->Set("ETag", entry->etag);
+  res_header->Set("Last-Modified", entry->last_modified);
+  res->SetStatus(StatusPartialContent);
+  return StatusPrivateDone;
+}
+
+void HTTPServer::CompressResponse(HTTPConn* conn) {
+  if (!config_.compression) {
+    return;
+  }
+  HTTPResponsePtr& res = conn->CurrentResponseRef();
+  Buffer& body = res->UserBuffer();
+  if (res->HasPrebuilt() || body.Size() < config_.compress_min_size ||
+      res->Status() == StatusPartialContent) {
     return;
   }
-do_request_error:
-  // still has error
-  DoRequestError(conn, status_code);
+  HTTPHeaderPtr& res_header = res->HeaderRef();
+  if (res_header->Has("Content-Encoding")) {
+    return;
+  }
+  int level = config_.compression_policy.Level(res_header->GetView("Content-Type"));
+  if (level == CompressionPolicy::kNoCompression) {
+    return;
+  }
+  res_header->Add("Vary", "Accept-Encoding");
+  HTTPHeaderPtr& req_header = conn->CurrentRequestRef()->HeaderRef();
+  if (!req_header->Has("Accept-Encoding")) {
+    return;
+  }
+  ContentCoding coding = NegotiateEncoding(req_header->GetView("Accept-Encoding"));
+  if (coding == ContentCoding::Identity) {
+    return;
+  }
+  // both are reused by every response handled on this thread
+  thread_local Compressor compressor;
+  thread_local Buffer encoded;
+  encoded.Reset();
+  if (!compressor.Begin(coding, level) ||
+      !compressor.Update(body.BeginReadPointer(), body.Size(), encoded, true) ||
+      encoded.Size() >= body.Size()) {
+    return;
+  }
+  body.Swap(encoded);
+  res_header->Set("Content-Encoding", ContentCodingName(coding));
+  res_header->Set("Content-Length", std::to_string(body.Size()));
 }
 
 // handle http request error state and create response
@@ -308,12 +959,15 @@ void HTTPServer::DoRequestError(HTTPConn* conn, int errcode) {
   }
 }
 
-std::string HTTPServer::DoRouting(HTTPConn* conn) {
+// ATTENTION!! this method may be invoked in worker threads
+std::string HTTPServer::DoRouting(HTTPConn* conn, const HTTPCallback* handler,
+                                  const URLParams& params) {
   HTTPRequestPtr& req_ref = conn->CurrentRequestRef();
   HTTPResponsePtr& res_ref = conn->CurrentResponseRef();
-  std::string path = conn->CurrentRequestRef()->URLRef().StringWithQuery();
-  // use http router to decide which handler callback function should be invoked.
-  return router_.Route(req_ref->Method(), path, *req_ref, *res_ref);
+  std::string_view path = req_ref->URLRef().Path();
+  // run the matched handler, or fall back to static files
+  return HTTPRouter::Dispatch(req_ref->Method(), path, handler, params, *req_ref,
+                              *res_ref);
 }
 
 void HTTPServer::CentrailzedStatusCodeHandling(HTTPConn* conn) {
@@ -345,42 +999,23 @@ void HTTPServer::Default500Handler(const HTTPRequest& req, HTTPResponse& res) {
   res.MakeContentSimpleHTML(DEFAULT_500_PAGE);
 }
 
-// ATTENTION!! this method may be invoked in multiple threads
-int HTTPServer::OpenFile(const std::string& filename) {
-  std::lock_guard<std::mutex> lck(mtx_);
-  int fd = -1;
-  if (file_mappings_.count(filename) == 0) {
-    // can not find in cache
-    // we need to open file
-    fd = open(filename.c_str(), O_RDONLY);
-    if (fd != -1) {
-      file_mappings_.insert({filename, std::make_shared<_OpenedFileStatus>(fd)});
-    }
-  } else {
-    // in cache
-    fd = file_mappings_[filename]->fd;
-    file_mappings_[filename]->count++;
-    file_mappings_[filename]->last = time::GetCurrentSec();
-  }
-  return fd;
+void HTTPServer::Default503Handler(const HTTPRequest& req, HTTPResponse& res) {
+  res.SetStatus(StatusServiceUnavailable);
+  res.MakeContentSimpleHTML(DEFAULT_503_PAGE);
 }
 
 void HTTPServer::Cleanup() {
   // this function works in background executing clean-up operation periodically
   while (!stopped_) {
-    std::unique_lock<std::mutex> lck(mtx_);
-    // wait up every 10 seconds
-    cond_.wait_for(lck, std::chrono::seconds(10),
-                   [this] { return stopped_.load(); });
-    // we have lock here
-    // 1. randomly close some opened files
-    for (auto it = file_mappings_.begin(); it != file_mappings_.end();) {
-      if (it->second->NeedClose()) {
-        it = file_mappings_.erase(it);
-      } else {
-        it++;
-      }
+    {
+      std::unique_lock<std::mutex> lck(mtx_);
+      // wait up every 10 seconds
+      cond_.wait_for(lck, std::chrono::seconds(10),
+                     [this] { return stopped_.load(); });
     }
+    // 1. close files which are not used since the previous round, files still
+    // being sent are kept open by their connections
+    open_files_->Sweep();
 
     // TODO 2. close idle http connections
   }
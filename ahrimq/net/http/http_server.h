@@ -6,13 +6,20 @@
 
 #include "base/nocopyable.h"
 #include "base/time_utils.h"
+#include "net/coroutine.h"
+#include "net/http/http2.h"
+#include "net/http/http_compress.h"
 #include "net/http/http_conn.h"
 #include "net/http/http_request.h"
 #include "net/http/http_response.h"
 #include "net/http/http_router.h"
+#include "net/http/open_file_cache.h"
+#include "net/http/static_file_cache.h"
+#include "net/http/websocket.h"
 #include "net/iserver.h"
 #include "net/reactor_conn.h"
 #include "net/tcp/tcp_server.h"
+#include "pool/work_stealing_pool.hpp"
 
 namespace ahrimq {
 namespace http {
@@ -20,6 +27,14 @@ namespace http {
 #define DEFAULT_HTTP_SERVER_IP "127.0.0.1"
 #define DEFAULT_HTTP_PORT 80
 
+#ifdef AHRIMQ_COROUTINES
+/// @brief Coroutine handler of a route. The url parameters are taken by value as
+/// the coroutine outlives the routing of the request.
+typedef std::function<coro::Task<std::string>(const HTTPRequest&, HTTPResponse&,
+                                              URLParams)>
+    HTTPCoroutine;
+#endif
+
 /// @brief HTTPServer implements a minimum HTTP/1.1 server
 class HTTPServer : public NoCopyable, public IServer {
  public:
@@ -28,6 +43,41 @@ class HTTPServer : public NoCopyable, public IServer {
    public:
     // http server root path
     std::string root;
+    // serve static files from an in-memory cache invalidated by inotify
+    bool static_cache = true;
+    // files larger than this are not kept in memory, they are sent by sendfile
+    size_t static_cache_max_file_size = StaticFileCache::kDefaultMaxFileSize;
+    // total bytes of file content the static cache may hold
+    size_t static_cache_capacity = StaticFileCache::kDefaultCapacity;
+    // gzip or deflate encoded static file bytes the static cache may hold
+    size_t static_cache_variant_capacity = StaticFileCache::kDefaultVariantCapacity;
+    // static files larger than this are only sent encoded from a ".gz" sibling
+    size_t static_cache_max_compress_size = StaticFileCache::kDefaultMaxCompressSize;
+    // files the static cache may describe, large ones keep their header lines only
+    size_t static_cache_max_entries = StaticFileCache::kDefaultMaxEntries;
+    // how many file descriptors of served files may be kept open
+    size_t open_file_cache_max_files = OpenFileCache::kDefaultMaxFiles;
+    // negotiate gzip and deflate response encoding by Accept-Encoding, static
+    // files are only encoded when the static cache is running
+    bool compression = true;
+    // dynamic response bodies smaller than this are sent unencoded
+    size_t compress_min_size = 1024;
+    // media types worth compressing and their zlib levels
+    CompressionPolicy compression_policy;
+    // threads running handlers registered with ExecPolicy::Pool, 0 runs them
+    // inline on the eventloops
+    size_t worker_threads = 4;
+    // requests waiting for a worker beyond this are answered with 503
+    size_t worker_queue_limit = 1024;
+    // limits of multipart/form-data bodies and where their files are spooled
+    FormLimits form_limits;
+    // speak HTTP/2 over cleartext to clients starting with the connection preface
+    // or asking for "Upgrade: h2c"
+    bool http2 = true;
+    // settings announced to HTTP/2 clients
+    HTTP2Limits http2_limits;
+    // message size, ping interval and send buffer of WebSocket connections
+    WebSocketLimits websocket_limits;
     // indicate HTTPS
     bool _http_secure;  // (reserved)
   };
@@ -51,34 +101,68 @@ class HTTPServer : public NoCopyable, public IServer {
   /// @brief Add callback function for http GET method on given url pattern.
   /// @param pattern url pattern
   /// @param callback the callback function to handle url pattern
+  /// @param policy ExecPolicy::Pool runs callback on the worker pool
   /// @return true on success, false on failure(already exists callback fucntion on
   /// pattern or other error)
-  bool Get(const std::string& pattern, const HTTPCallback& callback);
+  bool Get(const std::string& pattern, const HTTPCallback& callback,
+           ExecPolicy policy = ExecPolicy::Inline);
 
   /// @brief Add callback function for http HEAD method on given url pattern.
   /// @param pattern
   /// @param callback
+  /// @param policy
   /// @return
-  bool Head(const std::string& pattern, const HTTPCallback& callback);
+  bool Head(const std::string& pattern, const HTTPCallback& callback,
+            ExecPolicy policy = ExecPolicy::Inline);
 
   /// @brief Add callback function for http POST method on given url pattern.
   /// @param pattern url pattern
   /// @param callback the callback function to handle url pattern
+  /// @param policy ExecPolicy::Pool runs callback on the worker pool
   /// @return true on success, false on failure(already exists callback fucntion on
   /// pattern or other error)
-  bool Post(const std::string& pattern, const HTTPCallback& callback);
+  bool Post(const std::string& pattern, const HTTPCallback& callback,
+            ExecPolicy policy = ExecPolicy::Inline);
+
+  bool Put(const std::string& pattern, const HTTPCallback& callback,
+          ExecPolicy policy = ExecPolicy::Inline);
 
-  bool Put(const std::string& pattern, const HTTPCallback& callback);
+  bool Patch(const std::string& pattern, const HTTPCallback& callback,
+            ExecPolicy policy = ExecPolicy::Inline);
 
-  bool Patch(const std::string& pattern, const HTTPCallback& callback);
+  bool Delete(const std::string& pattern, const HTTPCallback& callback,
+             ExecPolicy policy = ExecPolicy::Inline);
 
-  bool Delete(const std::string& pattern, const HTTPCallback& callback);
+  bool Connect(const std::string& pattern, const HTTPCallback& callback,
+              ExecPolicy policy = ExecPolicy::Inline);
 
-  bool Connect(const std::string& pattern, const HTTPCallback& callback);
+  bool Options(const std::string& pattern, const HTTPCallback& callback,
+              ExecPolicy policy = ExecPolicy::Inline);
 
-  bool Options(const std::string& pattern, const HTTPCallback& callback);
+  bool Trace(const std::string& pattern, const HTTPCallback& callback,
+            ExecPolicy policy = ExecPolicy::Inline);
 
-  bool Trace(const std::string& pattern, const HTTPCallback& callback);
+  /// @brief Accept WebSocket connections on given url pattern. A GET request with
+  /// a valid handshake switches its connection to the WebSocket protocol, other
+  /// requests are answered with 426.
+  /// @param pattern url pattern
+  /// @param handlers
+  /// @return true on success, false on failure
+  bool WebSocket(const std::string& pattern, WebSocketHandlers handlers);
+
+#ifdef AHRIMQ_COROUTINES
+  /// @brief Add a coroutine handler for method on given url pattern. The coroutine
+  /// runs on the eventloop of the connection and may co_await timers, socket
+  /// readiness, worker pool results or other tasks while the eventloop keeps
+  /// serving other connections. Its result is used like the one of a
+  /// HTTPCallback.
+  /// @param method
+  /// @param pattern url pattern
+  /// @param coroutine
+  /// @return true on success, false on failure
+  bool Handle(HTTPMethod method, const std::string& pattern,
+              HTTPCoroutine coroutine);
+#endif
 
  protected:
   void InitReactorHandlers() override;
@@ -89,6 +173,8 @@ class HTTPServer : public NoCopyable, public IServer {
 
   void InitCleanup();
 
+  void InitFileCaches();
+
   void OnStreamOpen(ReactorConn* conn, bool& close_after) override;
 
   void OnStreamReached(ReactorConn* conn, bool allread, bool& close_after) override;
@@ -98,15 +184,80 @@ class HTTPServer : public NoCopyable, public IServer {
   void OnStreamWritten(ReactorConn* conn, bool& close_after) override;
 
   /// @brief Handle one single http request, and organize http response.
+  /// @param httpconn
+  /// @return false if the handler was handed over to the worker pool, which then
+  /// completes the response
+  bool DoRequest(const HTTPConnPtr& httpconn);
+
+  /// @brief Run handler on the worker pool and complete the response in the
+  /// eventloop of the connection afterwards. The connection is not watched in the
+  /// meantime.
+  /// @param httpconn
+  /// @param handler
+  /// @param params
+  /// @return false if the pool is saturated or stopped
+  bool DoRequestOnPool(const HTTPConnPtr& httpconn, const HTTPCallback* handler,
+                       URLParams params);
+
+  /// @brief Respond with the page returned by a handler, if any.
   /// @param conn
-  void DoRequest(HTTPConn* conn);
+  /// @param page
+  void DoResponsePage(HTTPConn* conn, const std::string& page);
+
+  /// @brief Run error handlers and encoding, then put the response into the write
+  /// buffer.
+  /// @param conn
+  void FinishResponse(HTTPConn* conn);
+
+  void CompleteResponse(HTTPConn* conn, const std::string& page);
+
+  void StartHTTP2(const HTTPConnPtr& httpconn);
+
+  bool UpgradeToHTTP2(const HTTPConnPtr& httpconn);
+
+  void DoStreamRequest(const HTTPConnPtr& stream, int status);
+
+  /// @brief Complete the WebSocket handshake of a request routed to a WebSocket
+  /// route and hand the connection over to a WebSocketConn.
+  /// @param httpconn
+  /// @param handler the matched route
+  /// @param params
+  /// @return false if the request was refused, its response is set up then
+  bool UpgradeToWebSocket(const HTTPConnPtr& httpconn, const HTTPCallback* handler,
+                          const URLParams& params);
 
   /// @brief Handle one single http invalid request and organize http response.
   /// @param conn
   /// @param errcode
   void DoRequestError(HTTPConn* conn, int errcode);
 
-  std::string DoRouting(HTTPConn* conn);
+  std::string DoRouting(HTTPConn* conn, const HTTPCallback* handler,
+                        const URLParams& params);
+
+#ifdef AHRIMQ_COROUTINES
+  /// @brief Create the coroutine of a route registered with Handle(), start it and
+  /// complete the response once it finishes. The connection is not watched in the
+  /// meantime.
+  /// @param httpconn
+  /// @param handler the matched route
+  /// @param params
+  /// @return false if the route did not create a coroutine
+  bool StartCoroutine(const HTTPConnPtr& httpconn, const HTTPCallback* handler,
+                      const URLParams& params);
+
+  coro::Task<void> RunCoroutine(HTTPConnPtr httpconn, coro::Task<std::string> task);
+#endif
+
+  /// @brief Respond with a static file, answering conditional and range requests.
+  /// @param conn
+  /// @param path full file path
+  /// @return StatusPrivateDone on success, or the error status code
+  int ServeFile(HTTPConn* conn, const std::string& path);
+
+  /// @brief Encode the dynamic response body of conn if the client accepts it and
+  /// its media type is worth compressing.
+  /// @param conn
+  void CompressResponse(HTTPConn* conn);
 
   void CentrailzedStatusCodeHandling(HTTPConn* conn);
 
@@ -118,9 +269,9 @@ class HTTPServer : public NoCopyable, public IServer {
 
   static void Default500Handler(const HTTPRequest& req, HTTPResponse& res);
 
-  static void DefaultErrHandler(const HTTPRequest& req, HTTPResponse& res);
+  static void Default503Handler(const HTTPRequest& req, HTTPResponse& res);
 
-  int OpenFile(const std::string& filename);
+  static void DefaultErrHandler(const HTTPRequest& req, HTTPResponse& res);
 
   void Cleanup();
 
@@ -136,30 +287,12 @@ class HTTPServer : public NoCopyable, public IServer {
   // default error status code handlers
   std::unordered_map<int, InternHTTPErrHandler> err_handlers_;
   
-  // file name and its status fd
-  struct _OpenedFileStatus {
-    size_t count;
-    uint64_t last;
-    int fd;
-    explicit _OpenedFileStatus(int f) : count(1), last(time::GetCurrentSec()), fd(f) {}
-
-    ~_OpenedFileStatus() {
-      if (close(fd) != -1) {
-        printf("file-%d closed\n", fd);
-      }
-    }
-
-    /// @brief Define a simple rule to close opened file. If opened file is not used
-    /// within 60 seconds, then we close it.
-    /// @return
-    bool NeedClose() {
-      return time::GetCurrentSec() - last >= 60;
-      ;
-    }
-  };
-  typedef std::shared_ptr<_OpenedFileStatus> _OpenedFileStatusPtr;
-
-  std::unordered_map<std::string, _OpenedFileStatusPtr> file_mappings_;
+  // opened files shared by all connections
+  std::unique_ptr<OpenFileCache> open_files_;
+  // in-memory static files, nullptr if disabled or inotify is unavailable
+  std::unique_ptr<StaticFileCache> static_cache_;
+  // runs ExecPolicy::Pool handlers, nullptr if disabled
+  std::unique_ptr<WorkStealingPool> pool_;
   // cleaner worker
   std::thread cleanup_wrk_;
 };
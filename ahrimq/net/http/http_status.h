@@ -57,6 +57,7 @@ constexpr static int StatusRequestURITooLong = 414;
 constexpr static int StatusUnsupportedMediaType = 415;
 constexpr static int StatusRangeNotSatisfiable = 416;
 constexpr static int StatusExpectationFailed = 417;
+constexpr static int StatusUpgradeRequired = 426;
 
 constexpr static int StatusInternalServerError = 500;
 constexpr static int StatusNotImplemented = 501;
@@ -65,53 +66,88 @@ constexpr static int StatusServiceUnavailable = 503;
 constexpr static int StatusGatewayTimeout = 504;
 constexpr static int StatusHTTPVersionNotSupported = 505;
 
+// X-macro list of all supported status codes and their reason phrases, every
+// supported code should be listed here exactly once.
+#define AHRIMQ_HTTP_STATUS_MAP(XX)                   \
+  XX(100, "Continue")                                \
+  XX(101, "Switching Protocols")                     \
+  XX(200, "OK")                                      \
+  XX(201, "Created")                                 \
+  XX(202, "Accepted")                                \
+  XX(203, "Non-Authoritative Information")           \
+  XX(204, "No Content")                              \
+  XX(205, "Reset Content")                           \
+  XX(206, "Partial Content")                         \
+  XX(300, "Multiple Choices")                        \
+  XX(301, "Moved Permanently")                       \
+  XX(302, "Found")                                   \
+  XX(303, "See Other")                               \
+  XX(304, "Not Modified")                            \
+  XX(305, "Use Proxy")                               \
+  XX(307, "Temporary Redirect")                      \
+  XX(308, "Permanent Redirect")                      \
+  XX(400, "Bad Request")                             \
+  XX(401, "Unauthorized")                            \
+  XX(402, "Payment Required")                        \
+  XX(403, "Forbidden")                               \
+  XX(404, "Not Found")                               \
+  XX(405, "Method Not Allowed")                      \
+  XX(406, "Not Acceptable")                          \
+  XX(407, "Proxy Authentication Required")           \
+  XX(408, "Request Timeout")                         \
+  XX(409, "Conflict")                                \
+  XX(410, "Gone")                                    \
+  XX(411, "Length Required")                         \
+  XX(412, "Precondition Failed")                     \
+  XX(413, "Content Too Large")                       \
+  XX(414, "URI Too Long")                            \
+  XX(415, "Unsupported Media Type")                  \
+  XX(416, "Range Not Satisfiable")                   \
+  XX(417, "Expectation Failed")                      \
+  XX(426, "Upgrade Required")                        \
+  XX(500, "Internal Server Error")                   \
+  XX(501, "Not Implemented")                         \
+  XX(502, "Bad Gateway")                             \
+  XX(503, "Service Unavailable")                     \
+  XX(504, "Gateway Timeout")                         \
+  XX(505, "HTTP Version Not Supported")
+
 static std::unordered_map<int, std::string> StatusCodeStringMapping = {
-    // 1xx
-    {StatusContinue, "Continue"},
-    {StatusSwitchingProtocols, "Switching Protocols"},
-    // 2xx
-    {StatusOK, "OK"},
-    {StatusCreated, "Created"},
-    {StatusAccepted, "Accepted"},
-    {StatusNonAuthoritativeInfo, "Non-Authoritative Information"},
-    {StatusNoContent, "No Content"},
-    {StatusResetContent, "Reset Content"},
-    {StatusPartialContent, "Partial Content"},
-    // 3xx
-    {StatusMultipleChoices, "Multiple Choices"},
-    {StatusMovedPermanently, "Moved Permanently"},
-    {StatusFound, "Found"},
-    {StatusSeeOther, "See Other"},
-    {StatusNotModified, "Not Modified"},
-    {StatusUseProxy, "Use Proxy"},
-    {StatusTemporaryRedirect, "Temporary Redirect"},
-    {StatusPermanentRedirect, "Permanent Redirect"},
-    // 4xx
-    {StatusBadRequest, "Bad Request"},
-    {StatusUnauthorized, "Unauthorized"},
-    {StatusPaymentRequired, "Payment Required"},
-    {StatusForbidden, "Forbidden"},
-    {StatusNotFound, "Not Found"},
-    {StatusMethodNotAllowed, "Method Not Allowed"},
-    {StatusNotAcceptable, "Not Acceptable"},
-    {StatusProxyAuthenticationRequired, "Proxy Authentication Required"},
-    {StatusRequestTimeout, "Request Timeout"},
-    {StatusConflict, "Conflict"},
-    {StatusGone, "Gone"},
-    {StatusLengthRequired, "Length Required"},
-    {StatusPreconditionFailed, "Precondition Failed"},
-    {StatusContentTooLarge, "Content Too Large"},
-    {StatusRequestURITooLong, "URI Too Long"},
-    {StatusUnsupportedMediaType, "Unsupported Media Type"},
-    {StatusRangeNotSatisfiable, "Range Not Satisfiable"},
-    {StatusExpectationFailed, "Expectation Failed"},
-    // 5xx
-    {StatusInternalServerError, "Internal Server Error"},
-    {StatusNotImplemented, "Not Implemented"},
-    {StatusBadGateway, "Bad Gateway"},
-    {StatusServiceUnavailable, "Service Unavailable"},
-    {StatusGatewayTimeout, "Gateway Timeout"},
-    {StatusHTTPVersionNotSupported, "HTTP Version Not Supported"}};
+#define XX(code, reason) {code, reason},
+    AHRIMQ_HTTP_STATUS_MAP(XX)
+#undef XX
+};
+
+/// @brief Pre-rendered status line of http response, like "HTTP/1.1 200 OK\r\n".
+struct StatusLine {
+  const char* data;
+  size_t len;
+};
+
+/// @brief Return the pre-rendered HTTP/1.1 status line of given status code. All
+/// lines are string literals concatenated at compile time, so no formatting is
+/// needed when organizing the response.
+/// @param code status code
+/// @return status line with len 0 if code is not supported
+static inline StatusLine HTTP11StatusLine(int code) {
+  switch (code) {
+#define XX(code, reason)                                     \
+  case code:                                                 \
+    return {"HTTP/1.1 " #code " " reason "\r\n",             \
+            sizeof("HTTP/1.1 " #code " " reason "\r\n") - 1};
+    AHRIMQ_HTTP_STATUS_MAP(XX)
+#undef XX
+    default:
+      return {nullptr, 0};
+  }
+}
+
+/// @brief Check if given status code is supported.
+/// @param code
+/// @return
+static inline bool StatusCodeSupported(int code) {
+  return HTTP11StatusLine(code).len != 0;
+}
 
 /// @brief Identify the kind of status code.
 /// @param code the status code
@@ -19,7 +19,7 @@ bool HTTPVersionSupported(const std::string& version) {
 }
 
 bool HTTPVersionSupported(int v) {
-  return v == Version1_0 || v == Version1_1;
+  return v == Version1_0 || v == Version1_1 || v == Version2_0;
 }
 
 }  // namespace http
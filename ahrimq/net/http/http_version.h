@@ -12,6 +12,8 @@ namespace http {
 constexpr static int VersionNotSupported = 0x00;
 constexpr static int Version1_0 = 0x10;
 constexpr static int Version1_1 = 0x11;
+// requests received on HTTP/2 streams, never parsed from a request line
+constexpr static int Version2_0 = 0x20;
 
 const static char* Version1_0_Str = "HTTP/1.0";
 const static char* Version1_1_Str = "HTTP/1.1";
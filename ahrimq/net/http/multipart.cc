@@ -0,0 +1,312 @@
+#include "net/http/multipart.h"
+
+#include <strings.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+namespace ahrimq {
+namespace http {
+
+static std::string_view TrimSpaces(std::string_view s) {
+  while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) {
+    s.remove_prefix(1);
+  }
+  while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) {
+    s.remove_suffix(1);
+  }
+  return s;
+}
+
+static bool CaseEqual(std::string_view a, std::string_view b) {
+  return a.size() == b.size() && strncasecmp(a.data(), b.data(), a.size()) == 0;
+}
+
+static int HexValue(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  c = tolower(static_cast<unsigned char>(c));
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  return -1;
+}
+
+// Split a header value into ';' separated parameters, calling fn(key, value) for
+// every "key=value" pair with quotes and escapes of the value removed.
+template <typename F>
+static void ForEachParam(std::string_view s, F fn) {
+  size_t i = 0;
+  while (i < s.size()) {
+    size_t end = i;
+    bool quoted = false;
+    std::string value;
+    size_t eq = std::string_view::npos;
+    // find the end of the parameter, ';' inside quotes does not count
+    for (; end < s.size(); end++) {
+      char c = s[end];
+      if (quoted) {
+        if (c == '\\' && end + 1 < s.size()) {
+          value.push_back(s[++end]);
+        } else if (c == '"') {
+          quoted = false;
+        } else {
+          value.push_back(c);
+        }
+      } else if (c == ';') {
+        break;
+      } else if (c == '"' && eq != std::string_view::npos) {
+        quoted = true;
+      } else if (c == '=' && eq == std::string_view::npos) {
+        eq = end;
+      } else if (eq != std::string_view::npos && c != ' ' && c != '\t') {
+        value.push_back(c);
+      }
+    }
+    if (eq != std::string_view::npos) {
+      fn(TrimSpaces(s.substr(i, eq - i)), value);
+    }
+    i = end + 1;
+  }
+}
+
+bool MultipartBoundary(std::string_view content_type, std::string& boundary) {
+  size_t semi = content_type.find(';');
+  if (semi == std::string_view::npos ||
+      !CaseEqual(TrimSpaces(content_type.substr(0, semi)), "multipart/form-data")) {
+    return false;
+  }
+  boundary.clear();
+  ForEachParam(content_type.substr(semi + 1),
+               [&](std::string_view key, const std::string& value) {
+                 if (CaseEqual(key, "boundary")) {
+                   boundary = value;
+                 }
+               });
+  // RFC 2046: 1 to 70 characters
+  return !boundary.empty() && boundary.size() <= 70;
+}
+
+BoundaryMatcher::BoundaryMatcher(std::string pattern)
+    : pattern_(std::move(pattern)) {
+  size_t m = pattern_.size();
+  std::fill(std::begin(skip_), std::end(skip_), m);
+  for (size_t i = 0; i + 1 < m; i++) {
+    skip_[static_cast<unsigned char>(pattern_[i])] = m - 1 - i;
+  }
+}
+
+size_t BoundaryMatcher::Find(const char* data, size_t len) const {
+  size_t m = pattern_.size();
+  if (m == 0 || len < m) {
+    return std::string_view::npos;
+  }
+  const char* p = pattern_.data();
+  size_t last = m - 1;
+  for (size_t i = 0; i + m <= len;) {
+    unsigned char c = data[i + last];
+    if (c == static_cast<unsigned char>(p[last]) && memcmp(data + i, p, last) == 0) {
+      return i;
+    }
+    i += skip_[c];
+  }
+  return std::string_view::npos;
+}
+
+size_t BoundaryMatcher::PartialMatch(const char* data, size_t len) const {
+  size_t m = pattern_.size();
+  if (m == 0) {
+    return 0;
+  }
+  size_t window = std::min(m - 1, len);
+  const char* p = data + len - window;
+  const char* end = data + len;
+  // candidates start with the first pattern byte, the earliest gives the longest
+  while ((p = static_cast<const char*>(memchr(p, pattern_[0], end - p)))) {
+    if (memcmp(p, pattern_.data(), end - p) == 0) {
+      return end - p;
+    }
+    p++;
+  }
+  return 0;
+}
+
+MultipartParser::MultipartParser(const std::string& boundary, size_t max_header_size)
+    : delimiter_("\r\n--" + boundary), max_header_size_(max_header_size) {}
+
+bool MultipartParser::ParseHeaderLine(std::string_view line) {
+  size_t colon = line.find(':');
+  if (colon == std::string_view::npos || colon == 0) {
+    return false;
+  }
+  std::string_view key = TrimSpaces(line.substr(0, colon));
+  std::string_view value = TrimSpaces(line.substr(colon + 1));
+  part_.headers.emplace_back(std::string(key), std::string(value));
+  if (CaseEqual(key, "Content-Disposition")) {
+    bool extended_filename = false;
+    ForEachParam(value, [&](std::string_view k, const std::string& v) {
+      if (CaseEqual(k, "name")) {
+        part_.name = v;
+      } else if (CaseEqual(k, "filename") && !extended_filename) {
+        part_.filename = v;
+      } else if (CaseEqual(k, "filename*")) {
+        // RFC 5987 charset'language'percent-encoded, wins over filename
+        size_t quote = v.find('\'');
+        quote = quote == std::string::npos ? quote : v.find('\'', quote + 1);
+        if (quote == std::string::npos) {
+          return;
+        }
+        std::string decoded;
+        for (size_t i = quote + 1; i < v.size(); i++) {
+          int hi, lo;
+          if (v[i] == '%' && i + 2 < v.size() && (hi = HexValue(v[i + 1])) >= 0 &&
+              (lo = HexValue(v[i + 2])) >= 0) {
+            decoded.push_back(static_cast<char>(hi * 16 + lo));
+            i += 2;
+          } else {
+            decoded.push_back(v[i]);
+          }
+        }
+        part_.filename = std::move(decoded);
+        extended_filename = true;
+      }
+    });
+  } else if (CaseEqual(key, "Content-Type")) {
+    part_.content_type = std::string(value);
+  }
+  return true;
+}
+
+MultipartParser::Result MultipartParser::Parse(const char* data, size_t len,
+                                               size_t& consumed) {
+  const std::string& delim = delimiter_.Pattern();
+  size_t pos = 0;
+  while (true) {
+    switch (state_) {
+      case State::Preamble: {
+        if (at_start_) {
+          // the body may start with the boundary itself, without CRLF
+          size_t n = std::min(delim.size() - 2, len - pos);
+          if (memcmp(data + pos, delim.data() + 2, n) == 0) {
+            if (n < delim.size() - 2) {
+              consumed = pos;
+              return Result::Pending;
+            }
+            pos += n;
+            at_start_ = false;
+            state_ = State::Delimiter;
+            break;
+          }
+          at_start_ = false;
+        }
+        size_t at = delimiter_.Find(data + pos, len - pos);
+        if (at == std::string_view::npos) {
+          // the preamble is ignored
+          consumed = len - delimiter_.PartialMatch(data + pos, len - pos);
+          return Result::Pending;
+        }
+        pos += at + delim.size();
+        state_ = State::Delimiter;
+        break;
+      }
+      case State::Delimiter: {
+        if (len - pos < 2) {
+          consumed = pos;
+          return Result::Pending;
+        }
+        if (data[pos] == '-' && data[pos + 1] == '-') {
+          // closing boundary
+          pos += 2;
+          state_ = State::Epilogue;
+          break;
+        }
+        // transport padding may precede the CRLF
+        size_t i = pos;
+        while (i < len && (data[i] == ' ' || data[i] == '\t')) {
+          i++;
+        }
+        if (len - i < 2) {
+          consumed = pos;
+          return Result::Pending;
+        }
+        if (data[i] != '\r' || data[i + 1] != '\n') {
+          return Fail();
+        }
+        pos = i + 2;
+        part_ = MultipartPart();
+        header_bytes_ = 0;
+        state_ = State::Headers;
+        break;
+      }
+      case State::Headers: {
+        std::string_view rest(data + pos, len - pos);
+        size_t eol = rest.find("\r\n");
+        if (eol == std::string_view::npos) {
+          if (header_bytes_ + rest.size() > max_header_size_) {
+            return Fail();
+          }
+          consumed = pos;
+          return Result::Pending;
+        }
+        header_bytes_ += eol + 2;
+        if (header_bytes_ > max_header_size_) {
+          return Fail();
+        }
+        pos += eol + 2;
+        if (eol == 0) {
+          // empty line, the content follows
+          parts_++;
+          if (on_part_begin_ && !on_part_begin_(part_)) {
+            return Fail();
+          }
+          state_ = State::Body;
+        } else if (!ParseHeaderLine(rest.substr(0, eol))) {
+          return Fail();
+        }
+        break;
+      }
+      case State::Body: {
+        size_t at = delimiter_.Find(data + pos, len - pos);
+        if (at == std::string_view::npos) {
+          // hand out everything that can not be the start of the delimiter
+          size_t n = len - pos - delimiter_.PartialMatch(data + pos, len - pos);
+          if (n > 0 && on_part_data_ && !on_part_data_(data + pos, n)) {
+            return Fail();
+          }
+          consumed = pos + n;
+          return Result::Pending;
+        }
+        if (at > 0 && on_part_data_ && !on_part_data_(data + pos, at)) {
+          return Fail();
+        }
+        if (on_part_end_ && !on_part_end_()) {
+          return Fail();
+        }
+        pos += at + delim.size();
+        state_ = State::Delimiter;
+        break;
+      }
+      case State::Epilogue: {
+        // the epilogue is ignored
+        consumed = len;
+        return Result::Complete;
+      }
+      default: {
+        consumed = pos;
+        return Result::Invalid;
+      }
+    }
+  }
+}
+
+MultipartParser::Result MultipartParser::Parse(Buffer& buf) {
+  size_t consumed = 0;
+  Result res = Parse(buf.BeginReadPointer(), buf.ReadableBytes(), consumed);
+  buf.ReaderIdxForward(consumed);
+  return res;
+}
+
+}  // namespace http
+}  // namespace ahrimq
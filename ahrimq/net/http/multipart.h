@@ -0,0 +1,155 @@
+#ifndef _AHRIMQ_NET_HTTP_MULTIPART_H_
+#define _AHRIMQ_NET_HTTP_MULTIPART_H_
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "buffer/buffer.h"
+
+namespace ahrimq {
+namespace http {
+
+/// @brief Extract the boundary parameter of a multipart Content-Type value.
+/// @param content_type e.g. "multipart/form-data; boundary=----x"
+/// @param boundary receives the unquoted boundary
+/// @return false if content_type is not multipart/form-data or has no valid
+/// boundary
+bool MultipartBoundary(std::string_view content_type, std::string& boundary);
+
+/// @brief BoundaryMatcher finds a fixed pattern with the Boyer-Moore-Horspool
+/// algorithm. A mismatch on the last byte of the window skips up to the whole
+/// pattern length, so body bytes are mostly not looked at one by one.
+class BoundaryMatcher {
+ public:
+  explicit BoundaryMatcher(std::string pattern);
+
+  /// @brief Find the first occurrence of the pattern.
+  /// @param data
+  /// @param len
+  /// @return offset of the match, std::string_view::npos if not found
+  size_t Find(const char* data, size_t len) const;
+
+  /// @brief Return the length of the longest proper prefix of the pattern which
+  /// data ends with, the bytes that have to be kept until more data arrives.
+  /// @param data
+  /// @param len
+  /// @return
+  size_t PartialMatch(const char* data, size_t len) const;
+
+  const std::string& Pattern() const {
+    return pattern_;
+  }
+
+ private:
+  std::string pattern_;
+  size_t skip_[256];
+};
+
+/// @brief Headers of one part of a multipart/form-data body.
+struct MultipartPart {
+  // the name parameter of Content-Disposition
+  std::string name;
+  // the filename parameter of Content-Disposition, empty for plain fields
+  std::string filename;
+  std::string content_type;
+  // every header line of the part
+  std::vector<std::pair<std::string, std::string>> headers;
+
+  bool IsFile() const {
+    return !filename.empty();
+  }
+};
+
+/// @brief MultipartParser is an incremental multipart/form-data parser. It is fed
+/// with body bytes as they arrive and hands out the content of every part as a
+/// stream of chunks, so large parts never need to be held in memory.
+///
+/// The callbacks return false to abort parsing, Parse() then reports Invalid.
+class MultipartParser {
+ public:
+  /// @brief Parsing result, see Parse().
+  enum class Result { Complete, Pending, Invalid };
+
+  typedef std::function<bool(const MultipartPart&)> PartBeginCallback;
+  typedef std::function<bool(const char*, size_t)> PartDataCallback;
+  typedef std::function<bool()> PartEndCallback;
+
+  constexpr static size_t kDefaultMaxHeaderSize = 8 * 1024;
+
+  /// @brief Construct a parser.
+  /// @param boundary the boundary parameter of the Content-Type
+  /// @param max_header_size maximum bytes of the headers of a single part
+  explicit MultipartParser(const std::string& boundary,
+                           size_t max_header_size = kDefaultMaxHeaderSize);
+
+  void SetOnPartBegin(PartBeginCallback cb) {
+    on_part_begin_ = std::move(cb);
+  }
+
+  void SetOnPartData(PartDataCallback cb) {
+    on_part_data_ = std::move(cb);
+  }
+
+  void SetOnPartEnd(PartEndCallback cb) {
+    on_part_end_ = std::move(cb);
+  }
+
+  /// @brief Parse as many bytes of data as possible. Bytes which may belong to a
+  /// boundary are not consumed, they have to be passed again together with the
+  /// bytes following them.
+  /// @param data
+  /// @param len
+  /// @param consumed receives the number of bytes consumed
+  /// @return Complete once the closing boundary is parsed, the epilogue after it
+  /// is consumed and ignored
+  Result Parse(const char* data, size_t len, size_t& consumed);
+
+  /// @brief Parse the readable bytes of buf, consuming them from buf.
+  /// @param buf
+  /// @return
+  Result Parse(Buffer& buf);
+
+  bool Done() const {
+    return state_ == State::Epilogue;
+  }
+
+  /// @brief Number of parts begun so far.
+  size_t Parts() const {
+    return parts_;
+  }
+
+ private:
+  enum class State { Preamble, Delimiter, Headers, Body, Epilogue, Invalid };
+
+  // parse one header line of the current part
+  bool ParseHeaderLine(std::string_view line);
+
+  Result Fail() {
+    state_ = State::Invalid;
+    return Result::Invalid;
+  }
+
+ private:
+  // "\r\n--" followed by the boundary
+  BoundaryMatcher delimiter_;
+  size_t max_header_size_;
+  State state_ = State::Preamble;
+  // the first boundary may come without the leading CRLF
+  bool at_start_ = true;
+  size_t header_bytes_ = 0;
+  MultipartPart part_;
+  size_t parts_ = 0;
+
+  PartBeginCallback on_part_begin_;
+  PartDataCallback on_part_data_;
+  PartEndCallback on_part_end_;
+};
+
+}  // namespace http
+}  // namespace ahrimq
+
+#endif  // _AHRIMQ_NET_HTTP_MULTIPART_H_
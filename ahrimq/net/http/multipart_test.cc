@@ -0,0 +1,210 @@
+#include "ahrimq/net/http/multipart.h"
+
+#include <gtest/gtest.h>
+#include <sys/stat.h>
+
+#include <fstream>
+#include <random>
+#include <sstream>
+
+#include "ahrimq/net/http/http_request.h"
+
+using namespace ahrimq;
+using namespace ahrimq::http;
+
+static const std::string kBody =
+    "preamble\r\n"
+    "--XyZ\r\n"
+    "Content-Disposition: form-data; name=\"title\"\r\n"
+    "\r\n"
+    "hello world\r\n"
+    "--XyZ  \r\n"
+    "Content-Disposition: form-data; name=\"file\"; filename=\"a;b.txt\"\r\n"
+    "Content-Type: text/plain\r\n"
+    "\r\n"
+    "line one\r\n--Xy-not-a-boundary\r\n--Xy\r\n"
+    "--XyZ\r\n"
+    "Content-Disposition: form-data; name=\"empty\"\r\n"
+    "\r\n"
+    "\r\n"
+    "--XyZ--\r\n"
+    "epilogue";
+
+struct Collected {
+  std::vector<MultipartPart> parts;
+  std::vector<std::string> contents;
+  int ended = 0;
+};
+
+static void Collect(MultipartParser& parser, Collected& c) {
+  parser.SetOnPartBegin([&c](const MultipartPart& part) {
+    c.parts.push_back(part);
+    c.contents.emplace_back();
+    return true;
+  });
+  parser.SetOnPartData([&c](const char* data, size_t len) {
+    c.contents.back().append(data, len);
+    return true;
+  });
+  parser.SetOnPartEnd([&c]() {
+    c.ended++;
+    return true;
+  });
+}
+
+// feed body in chunks of random sizes, keeping the unconsumed bytes
+static MultipartParser::Result FeedChunks(MultipartParser& parser,
+                                          const std::string& body, size_t max_chunk,
+                                          std::mt19937& rng) {
+  std::string pending;
+  size_t pos = 0;
+  MultipartParser::Result res = MultipartParser::Result::Pending;
+  while (pos < body.size() && res == MultipartParser::Result::Pending) {
+    size_t n = std::min(body.size() - pos, rng() % max_chunk + 1);
+    pending.append(body, pos, n);
+    pos += n;
+    size_t consumed = 0;
+    res = parser.Parse(pending.data(), pending.size(), consumed);
+    pending.erase(0, consumed);
+  }
+  return res;
+}
+
+TEST(MultipartTest, BoundaryMatcherTest) {
+  std::mt19937 rng(7);
+  BoundaryMatcher matcher("\r\n--ab");
+  for (int round = 0; round < 2000; round++) {
+    // a small alphabet makes partial matches frequent
+    std::string data(rng() % 64, ' ');
+    for (char& c : data) {
+      c = "\r\n-ab"[rng() % 5];
+    }
+    EXPECT_EQ(matcher.Find(data.data(), data.size()), data.find("\r\n--ab"));
+    size_t expected = 0;
+    for (size_t k = std::min<size_t>(5, data.size()); k > 0; k--) {
+      if (data.compare(data.size() - k, k, "\r\n--ab", k) == 0) {
+        expected = k;
+        break;
+      }
+    }
+    EXPECT_EQ(matcher.PartialMatch(data.data(), data.size()), expected);
+  }
+}
+
+TEST(MultipartTest, BoundaryParamTest) {
+  std::string boundary;
+  EXPECT_TRUE(MultipartBoundary("multipart/form-data; boundary=abc", boundary));
+  EXPECT_EQ(boundary, "abc");
+  EXPECT_TRUE(MultipartBoundary(
+      "Multipart/Form-Data; charset=utf-8; boundary=\"a b;c\"", boundary));
+  EXPECT_EQ(boundary, "a b;c");
+  EXPECT_FALSE(MultipartBoundary("multipart/form-data", boundary));
+  EXPECT_FALSE(MultipartBoundary("multipart/mixed; boundary=abc", boundary));
+  EXPECT_FALSE(MultipartBoundary("multipart/form-data; boundary=", boundary));
+  EXPECT_FALSE(MultipartBoundary(
+      "multipart/form-data; boundary=" + std::string(71, 'x'), boundary));
+}
+
+TEST(MultipartTest, ParseTest) {
+  std::mt19937 rng(11);
+  // whole body at once, byte by byte, and in random chunks
+  for (size_t max_chunk : {kBody.size(), size_t(1), size_t(3), size_t(17)}) {
+    MultipartParser parser("XyZ");
+    Collected c;
+    Collect(parser, c);
+    ASSERT_EQ(FeedChunks(parser, kBody, max_chunk, rng),
+              MultipartParser::Result::Complete);
+    EXPECT_TRUE(parser.Done());
+    ASSERT_EQ(c.parts.size(), 3u);
+    EXPECT_EQ(c.ended, 3);
+    EXPECT_EQ(c.parts[0].name, "title");
+    EXPECT_FALSE(c.parts[0].IsFile());
+    EXPECT_EQ(c.contents[0], "hello world");
+    EXPECT_EQ(c.parts[1].name, "file");
+    EXPECT_EQ(c.parts[1].filename, "a;b.txt");
+    EXPECT_EQ(c.parts[1].content_type, "text/plain");
+    EXPECT_EQ(c.contents[1], "line one\r\n--Xy-not-a-boundary\r\n--Xy");
+    EXPECT_EQ(c.contents[2], "");
+  }
+}
+
+TEST(MultipartTest, InvalidTest) {
+  auto parse = [](const std::string& body) {
+    MultipartParser parser("b", 64);
+    size_t consumed = 0;
+    return parser.Parse(body.data(), body.size(), consumed);
+  };
+  // garbage after the boundary
+  EXPECT_EQ(parse("--b x\r\n"), MultipartParser::Result::Invalid);
+  // header line without a colon
+  EXPECT_EQ(parse("--b\r\nbad header\r\n\r\n"), MultipartParser::Result::Invalid);
+  // headers over the limit
+  EXPECT_EQ(parse("--b\r\nX: " + std::string(100, 'x')),
+            MultipartParser::Result::Invalid);
+  // truncated
+  EXPECT_EQ(parse("--b\r\n\r\ndata"), MultipartParser::Result::Pending);
+
+  MultipartParser parser("b");
+  parser.SetOnPartData([](const char*, size_t) { return false; });
+  std::string body = "--b\r\n\r\ndata\r\n--b--";
+  size_t consumed = 0;
+  EXPECT_EQ(parser.Parse(body.data(), body.size(), consumed),
+            MultipartParser::Result::Invalid);
+}
+
+TEST(MultipartTest, RequestFormTest) {
+  Buffer rbuf;
+  HTTPRequest req(&rbuf);
+  req.SetMethod(HTTPMethod::Post);
+  req.HeaderRef()->Add("Content-Type", "multipart/form-data; boundary=XyZ");
+  ASSERT_TRUE(req.MultipartForm());
+
+  // the body arrives in two reads
+  size_t half = kBody.size() / 2;
+  rbuf.Append(kBody.substr(0, half));
+  EXPECT_EQ(req.FeedMultipart(rbuf, kBody.size()), StatusPrivatePending);
+  rbuf.Append(kBody.substr(half));
+  EXPECT_EQ(req.FeedMultipart(rbuf, kBody.size()), StatusPrivateComplete);
+  EXPECT_TRUE(rbuf.Empty());
+  EXPECT_EQ(req.ParseForm(), StatusPrivateDone);
+
+  EXPECT_EQ(req.Form().Get("title"), "hello world");
+  ASSERT_EQ(req.Files().size(), 1u);
+  const FormFile& file = req.Files()[0];
+  EXPECT_EQ(file.field, "file");
+  EXPECT_EQ(file.filename, "a;b.txt");
+  EXPECT_EQ(file.size, 35u);
+  std::ifstream in(file.path);
+  std::stringstream content;
+  content << in.rdbuf();
+  EXPECT_EQ(content.str(), "line one\r\n--Xy-not-a-boundary\r\n--Xy");
+
+  // spooled files are removed with the request
+  std::string path = file.path;
+  req.Reset();
+  struct stat st;
+  EXPECT_NE(stat(path.c_str(), &st), 0);
+}
+
+TEST(MultipartTest, RequestLimitTest) {
+  Buffer rbuf;
+  HTTPRequest req(&rbuf);
+  FormLimits limits;
+  limits.max_field_size = 4;
+  req.SetFormLimits(limits);
+  req.HeaderRef()->Add("Content-Type", "multipart/form-data; boundary=XyZ");
+  rbuf.Append(kBody);
+  EXPECT_EQ(req.FeedMultipart(rbuf, kBody.size()), StatusContentTooLarge);
+
+  // the body ends before the closing boundary
+  req.Reset();
+  req.HeaderRef()->Add("Content-Type", "multipart/form-data; boundary=XyZ");
+  std::string truncated = kBody.substr(0, 60);
+  rbuf.Append(truncated);
+  EXPECT_EQ(req.FeedMultipart(rbuf, truncated.size()), StatusBadRequest);
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,198 @@
+#include "net/http/open_file_cache.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <functional>
+#include <thread>
+
+namespace ahrimq {
+namespace http {
+
+OpenFileCache::File::~File() {
+  if (fd != -1) {
+    close(fd);
+  }
+}
+
+OpenFileCache::OpenFileCache(size_t max_files, size_t shards) {
+  if (shards == 0) {
+    shards = 1;
+  }
+  max_files_per_shard_ = std::max<size_t>(1, max_files / shards);
+  shards_.reserve(shards);
+  for (size_t i = 0; i < shards; i++) {
+    shards_.emplace_back(new Shard());
+    shards_.back()->table.store(new Table());
+  }
+}
+
+OpenFileCache::~OpenFileCache() {
+  for (auto& shard : shards_) {
+    delete shard->table.load();
+  }
+}
+
+OpenFileCache::Shard& OpenFileCache::ShardOf(const std::string& path) {
+  return *shards_[std::hash<std::string>()(path) % shards_.size()];
+}
+
+OpenFileCache::FilePtr OpenFileCache::Lookup(Shard& shard, const std::string& path) {
+  uint64_t parity = shard.epoch.load() & 1;
+  shard.readers[parity].fetch_add(1);
+  const Table* table = shard.table.load();
+  FilePtr file = nullptr;
+  auto it = table->find(path);
+  if (it != table->end()) {
+    file = it->second;
+    if (!file->referenced.load(std::memory_order_relaxed)) {
+      file->referenced.store(true, std::memory_order_relaxed);
+    }
+  }
+  shard.readers[parity].fetch_sub(1);
+  return file;
+}
+
+OpenFileCache::FilePtr OpenFileCache::Open(const std::string& path) {
+  Shard& shard = ShardOf(path);
+  FilePtr file = Lookup(shard, path);
+  if (file != nullptr) {
+    return file;
+  }
+
+  // open outside of the shard lock
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    return nullptr;
+  }
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    int saved = errno;
+    close(fd);
+    errno = saved;
+    return nullptr;
+  }
+  if (!S_ISREG(st.st_mode)) {
+    close(fd);
+    errno = ENOENT;
+    return nullptr;
+  }
+  auto opened = std::make_shared<File>(fd, st.st_size, path);
+
+  std::lock_guard<std::mutex> lck(shard.mtx);
+  const Table* cur = shard.table.load();
+  auto it = cur->find(path);
+  if (it != cur->end()) {
+    // opened concurrently, ours is closed when dropped
+    it->second->referenced.store(true, std::memory_order_relaxed);
+    return it->second;
+  }
+  Table* fresh = new Table(*cur);
+  while (fresh->size() >= max_files_per_shard_) {
+    EvictOne(shard, *fresh);
+  }
+  fresh->emplace(path, opened);
+  shard.ring.push_back(path);
+  size_.fetch_add(1, std::memory_order_relaxed);
+  Publish(shard, fresh);
+  return opened;
+}
+
+void OpenFileCache::Invalidate(const std::string& path) {
+  Shard& shard = ShardOf(path);
+  std::lock_guard<std::mutex> lck(shard.mtx);
+  const Table* cur = shard.table.load();
+  if (cur->count(path) == 0) {
+    return;
+  }
+  Table* fresh = new Table(*cur);
+  fresh->erase(path);
+  for (size_t i = 0; i < shard.ring.size(); i++) {
+    if (shard.ring[i] == path) {
+      shard.ring[i].swap(shard.ring.back());
+      shard.ring.pop_back();
+      break;
+    }
+  }
+  size_.fetch_sub(1, std::memory_order_relaxed);
+  Publish(shard, fresh);
+}
+
+size_t OpenFileCache::Sweep() {
+  size_t dropped = 0;
+  for (auto& s : shards_) {
+    Shard& shard = *s;
+    std::lock_guard<std::mutex> lck(shard.mtx);
+    const Table* cur = shard.table.load();
+    Table* fresh = nullptr;
+    for (size_t i = 0; i < shard.ring.size();) {
+      auto it = cur->find(shard.ring[i]);
+      if (it->second->referenced.exchange(false)) {
+        i++;
+        continue;
+      }
+      // not used since the previous sweep
+      if (fresh == nullptr) {
+        fresh = new Table(*cur);
+      }
+      fresh->erase(shard.ring[i]);
+      shard.ring[i].swap(shard.ring.back());
+      shard.ring.pop_back();
+      dropped++;
+    }
+    if (fresh != nullptr) {
+      Publish(shard, fresh);
+    }
+  }
+  size_.fetch_sub(dropped, std::memory_order_relaxed);
+  return dropped;
+}
+
+void OpenFileCache::Clear() {
+  for (auto& s : shards_) {
+    Shard& shard = *s;
+    std::lock_guard<std::mutex> lck(shard.mtx);
+    size_.fetch_sub(shard.ring.size(), std::memory_order_relaxed);
+    shard.ring.clear();
+    shard.hand = 0;
+    Publish(shard, new Table());
+  }
+}
+
+void OpenFileCache::Publish(Shard& shard, const Table* table) {
+  const Table* old = shard.table.exchange(table);
+  // A reader may have picked its parity before an earlier flip and still be
+  // about to load the old table, so both parities are drained in turn.
+  for (int i = 0; i < 2; i++) {
+    uint64_t parity = shard.epoch.fetch_add(1) & 1;
+    while (shard.readers[parity].load() != 0) {
+      std::this_thread::yield();
+    }
+  }
+  delete old;
+}
+
+void OpenFileCache::EvictOne(Shard& shard, Table& table) {
+  while (true) {
+    if (shard.hand >= shard.ring.size()) {
+      shard.hand = 0;
+    }
+    std::string& path = shard.ring[shard.hand];
+    auto it = table.find(path);
+    if (it->second->referenced.exchange(false)) {
+      // second chance
+      shard.hand++;
+      continue;
+    }
+    table.erase(it);
+    path.swap(shard.ring.back());
+    shard.ring.pop_back();
+    size_.fetch_sub(1, std::memory_order_relaxed);
+    return;
+  }
+}
+
+}  // namespace http
+}  // namespace ahrimq
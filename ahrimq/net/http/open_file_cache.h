@@ -0,0 +1,114 @@
+#ifndef _AHRIMQ_NET_HTTP_OPEN_FILE_CACHE_H_
+#define _AHRIMQ_NET_HTTP_OPEN_FILE_CACHE_H_
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "base/nocopyable.h"
+
+namespace ahrimq {
+namespace http {
+
+/// @brief OpenFileCache keeps file descriptors of served files open, keyed by path.
+///
+/// The cache is split into shards. Every shard publishes an immutable table that
+/// readers look up without taking any lock: a reader only announces itself in one
+/// of two per-shard counters (selected by the parity of the shard epoch) while it
+/// copies the file handle out of the table. Writers are serialized per shard; they
+/// publish a modified copy of the table, flip the epoch twice and wait for the
+/// readers of the old parities to leave before freeing the old table.
+///
+/// Files are refcounted: the descriptor is closed when the last handle is dropped,
+/// so a file evicted from the cache stays open for sends still using it. Eviction
+/// follows the CLOCK algorithm once a shard exceeds its share of the fd budget.
+class OpenFileCache : public NoCopyable {
+ public:
+  constexpr static size_t kDefaultMaxFiles = 1024;
+  constexpr static size_t kDefaultShards = 16;
+
+  /// @brief An opened file. The descriptor is closed on destruction.
+  struct File {
+    File(int f, size_t s, std::string p) : fd(f), size(s), path(std::move(p)) {}
+
+    ~File();
+
+    int fd;
+    size_t size;
+    std::string path;
+    // CLOCK reference bit, set on every lookup
+    mutable std::atomic<bool> referenced{true};
+  };
+  typedef std::shared_ptr<const File> FilePtr;
+
+  /// @brief Construct an open file cache.
+  /// @param max_files fd budget shared by all shards
+  /// @param shards number of shards
+  explicit OpenFileCache(size_t max_files = kDefaultMaxFiles,
+                         size_t shards = kDefaultShards);
+
+  ~OpenFileCache();
+
+  /// @brief Return the opened file of path, opening it on a miss.
+  /// @param path
+  /// @return nullptr if the file can not be opened (errno is kept) or is not a
+  /// regular file (errno is set to ENOENT)
+  FilePtr Open(const std::string& path);
+
+  /// @brief Drop path from the cache. Handles already given out stay valid.
+  /// @param path
+  void Invalidate(const std::string& path);
+
+  /// @brief Drop files which have not been looked up since the previous sweep.
+  /// @return the number of dropped files
+  size_t Sweep();
+
+  /// @brief Drop every file.
+  void Clear();
+
+  /// @brief Number of cached files.
+  size_t Size() const {
+    return size_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  typedef std::unordered_map<std::string, FilePtr> Table;
+
+  struct Shard {
+    // current table, immutable once published
+    std::atomic<const Table*> table{nullptr};
+    std::atomic<uint64_t> epoch{0};
+    std::atomic<uint64_t> readers[2] = {{0}, {0}};
+    // serializes writers
+    std::mutex mtx;
+    // CLOCK ring of cached paths and its hand, guarded by mtx
+    std::vector<std::string> ring;
+    size_t hand = 0;
+  };
+
+  Shard& ShardOf(const std::string& path);
+
+  FilePtr Lookup(Shard& shard, const std::string& path);
+
+  /// @brief Publish table and free the previous one once no reader can see it.
+  /// Requires shard.mtx.
+  void Publish(Shard& shard, const Table* table);
+
+  /// @brief Pick a victim with the CLOCK algorithm and remove it from table and
+  /// ring.
+  /// Requires shard.mtx.
+  void EvictOne(Shard& shard, Table& table);
+
+ private:
+  size_t max_files_per_shard_;
+  std::vector<std::unique_ptr<Shard>> shards_;
+  std::atomic<size_t> size_{0};
+};
+
+}  // namespace http
+}  // namespace ahrimq
+
+#endif  // _AHRIMQ_NET_HTTP_OPEN_FILE_CACHE_H_
@@ -0,0 +1,100 @@
+#include "ahrimq/net/http/open_file_cache.h"
+
+#include <gtest/gtest.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <thread>
+
+using namespace ahrimq;
+
+class OpenFileCacheTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    char tmpl[] = "/tmp/ahrimq_ofc_XXXXXX";
+    char* dir = mkdtemp(tmpl);
+    ASSERT_NE(dir, nullptr);
+    dir_ = dir;
+    for (int i = 0; i < 32; i++) {
+      std::string path = Path(i);
+      std::ofstream ofs(path);
+      ofs << std::string(i + 1, 'a');
+    }
+  }
+
+  void TearDown() override {
+    for (int i = 0; i < 32; i++) {
+      unlink(Path(i).c_str());
+    }
+    rmdir(dir_.c_str());
+  }
+
+  std::string Path(int i) const {
+    return dir_ + "/f" + std::to_string(i);
+  }
+
+  std::string dir_;
+};
+
+TEST_F(OpenFileCacheTest, OpenAndEvictTest) {
+  http::OpenFileCache cache(4, 1);
+  auto f0 = cache.Open(Path(0));
+  ASSERT_NE(f0, nullptr);
+  EXPECT_EQ(f0->size, 1u);
+  EXPECT_EQ(cache.Open(Path(0)), f0);
+  EXPECT_EQ(cache.Open(dir_ + "/missing"), nullptr);
+  EXPECT_EQ(errno, ENOENT);
+  EXPECT_EQ(cache.Open(dir_), nullptr);
+
+  for (int i = 1; i < 8; i++) {
+    ASSERT_NE(cache.Open(Path(i)), nullptr);
+  }
+  EXPECT_EQ(cache.Size(), 4u);
+  // an evicted file stays usable while a handle is held
+  struct stat st;
+  EXPECT_EQ(fstat(f0->fd, &st), 0);
+  char c;
+  EXPECT_EQ(pread(f0->fd, &c, 1, 0), 1);
+
+  // the first sweep clears the reference bits, the second one drops every file
+  // not looked up in between
+  cache.Sweep();
+  ASSERT_NE(cache.Open(Path(7)), nullptr);
+  cache.Sweep();
+  EXPECT_EQ(cache.Size(), 1u);
+  cache.Invalidate(Path(7));
+  EXPECT_EQ(cache.Size(), 0u);
+}
+
+TEST_F(OpenFileCacheTest, ConcurrentOpenTest) {
+  http::OpenFileCache cache(8, 2);
+  std::vector<std::thread> workers;
+  std::atomic<int> failures{0};
+  for (int t = 0; t < 4; t++) {
+    workers.emplace_back([&, t] {
+      for (int i = 0; i < 5000; i++) {
+        int k = (i * 7 + t) % 32;
+        auto f = cache.Open(Path(k));
+        struct stat st;
+        if (f == nullptr || fstat(f->fd, &st) != 0 ||
+            size_t(st.st_size) != f->size || f->size != size_t(k + 1)) {
+          failures++;
+        }
+        if (i % 1000 == 0) {
+          cache.Sweep();
+        }
+      }
+    });
+  }
+  for (auto& w : workers) {
+    w.join();
+  }
+  EXPECT_EQ(failures.load(), 0);
+  EXPECT_LE(cache.Size(), 8u);
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -41,6 +41,13 @@ static const char* DEFAULT_500_PAGE =
     "<h1>Internal Server Error</h1>"
     "<p>The server is not available now. Please try again later.</p>";
 
+static const char* DEFAULT_503_HTML = "503.html";
+static const char* DEFAULT_503_PAGE =
+    "<!DOCTYPE HTML>"
+    "<title>503 Service Unavailable</title>"
+    "<h1>Service Unavailable</h1>"
+    "<p>The server is too busy to handle the request, please try again later.</p>";
+
 static const char* DEFAULT_501_HTML = "501.html";
 static const char* DEFAULT_501_PAGE =
     "<!DOCTYPE HTML>"
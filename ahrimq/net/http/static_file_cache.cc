@@ -0,0 +1,466 @@
+#include "net/http/static_file_cache.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#include "base/time_utils.h"
+#include "mime/mime.h"
+
+namespace ahrimq {
+namespace http {
+
+std::string MakeETag(const struct stat& st) {
+  char buf[64];
+  int n = snprintf(buf, sizeof(buf), "\"%lx-%lx-%lx\"",
+                   static_cast<unsigned long>(st.st_ino),
+                   static_cast<unsigned long>(st.st_mtime),
+                   static_cast<unsigned long>(st.st_size));
+  return std::string(buf, n);
+}
+
+// Read exactly size bytes of fd into out.
+static bool ReadFully(int fd, size_t size, std::string& out) {
+  out.resize(size);
+  size_t total = 0;
+  while (total < size) {
+    ssize_t n = pread(fd, &out[total], size - total, total);
+    if (n == -1 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      break;
+    }
+    total += n;
+  }
+  return total == size;
+}
+
+static bool ReadFile(const std::string& path, size_t size, std::string& out) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    return false;
+  }
+  bool ok = ReadFully(fd, size, out);
+  close(fd);
+  return ok;
+}
+
+StaticFileCache::StaticFileCache(size_t max_file_size, size_t capacity,
+                                 size_t variant_capacity, size_t max_compress_size,
+                                 size_t max_entries)
+    : max_file_size_(max_file_size),
+      capacity_(capacity),
+      max_entries_(max_entries),
+      variant_capacity_(variant_capacity),
+      max_compress_size_(max_compress_size) {}
+
+StaticFileCache::~StaticFileCache() {
+  Stop();
+}
+
+bool StaticFileCache::Watch() {
+  if (watching_.load()) {
+    return true;
+  }
+  inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (inotify_fd_ == -1) {
+    return false;
+  }
+  wakeup_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (wakeup_fd_ == -1) {
+    close(inotify_fd_);
+    inotify_fd_ = -1;
+    return false;
+  }
+  watch_failed_.store(false, std::memory_order_release);
+  watching_.store(true, std::memory_order_release);
+  watcher_ = std::thread(&StaticFileCache::WatchLoop, this);
+  return true;
+}
+
+void StaticFileCache::Stop() {
+  if (!watching_.exchange(false)) {
+    return;
+  }
+  uint64_t one = 1;
+  ssize_t n = write(wakeup_fd_, &one, sizeof(one));
+  (void)n;
+  if (watcher_.joinable()) {
+    watcher_.join();
+  }
+  close(wakeup_fd_);
+  close(inotify_fd_);
+  wakeup_fd_ = -1;
+  inotify_fd_ = -1;
+  WriteLockGuard lck(mtx_);
+  entries_.clear();
+  bytes_ = 0;
+  variants_.clear();
+  variant_bytes_ = 0;
+  wd_dirs_.clear();
+  dir_wds_.clear();
+}
+
+StaticFileCache::EntryPtr StaticFileCache::Get(const std::string& path) {
+  if (!Watching()) {
+    return nullptr;
+  }
+  {
+    ReadLockGuard lck(mtx_);
+    auto it = entries_.find(path);
+    if (it != entries_.end()) {
+      return it->second;
+    }
+  }
+  return Load(path);
+}
+
+void StaticFileCache::Invalidate(const std::string& path) {
+  WriteLockGuard lck(mtx_);
+  epoch_++;
+  EraseLocked(path);
+}
+
+void StaticFileCache::Clear() {
+  WriteLockGuard lck(mtx_);
+  epoch_++;
+  entries_.clear();
+  bytes_ = 0;
+  variants_.clear();
+  variant_bytes_ = 0;
+}
+
+size_t StaticFileCache::Count() {
+  ReadLockGuard lck(mtx_);
+  return entries_.size();
+}
+
+size_t StaticFileCache::Bytes() {
+  ReadLockGuard lck(mtx_);
+  return bytes_;
+}
+
+size_t StaticFileCache::VariantBytes() {
+  ReadLockGuard lck(mtx_);
+  return variant_bytes_;
+}
+
+// requires mtx_ held for writing
+void StaticFileCache::EraseLocked(const std::string& path) {
+  auto entry = entries_.find(path);
+  if (entry != entries_.end()) {
+    bytes_ -= entry->second->body.size();
+    entries_.erase(entry);
+  }
+  auto erase_variants = [this](const std::string& p) {
+    auto it = variants_.find(p);
+    if (it == variants_.end()) {
+      return;
+    }
+    for (const auto& v : it->second.variants) {
+      if (v != nullptr) {
+        variant_bytes_ -= v->body.size();
+      }
+    }
+    variants_.erase(it);
+  };
+  erase_variants(path);
+  // a changed precompressed sibling invalidates the variants of its original
+  if (path.size() > 3 && path.compare(path.size() - 3, 3, ".gz") == 0) {
+    erase_variants(path.substr(0, path.size() - 3));
+  }
+}
+
+std::shared_ptr<StaticFileCache::Entry> StaticFileCache::MakeEntry(
+    const std::string& path, const struct stat& st) {
+  auto entry = std::make_shared<Entry>();
+  entry->size = st.st_size;
+  char date[time::kGMTTimeStringLen];
+  size_t date_len = time::FormatGMTTime(st.st_mtime, date);
+  entry->path = path;
+  entry->etag = MakeETag(st);
+  entry->last_modified.assign(date, date_len);
+  entry->mtime = st.st_mtime;
+  entry->content_type = mime::DecideMimeTypeFromExtension(path);
+  entry->validators.reserve(64);
+  entry->validators.append("ETag: ").append(entry->etag).append("\r\n");
+  entry->validators.append("Last-Modified: ")
+      .append(entry->last_modified)
+      .append("\r\n");
+  entry->head.reserve(128 + entry->validators.size());
+  entry->head.append("Content-Type: ").append(entry->content_type).append("\r\n");
+  entry->head.append("Content-Length: ")
+      .append(std::to_string(st.st_size))
+      .append("\r\n");
+  entry->head.append("Accept-Ranges: bytes\r\n");
+  entry->head.append(entry->validators);
+  return entry;
+}
+
+StaticFileCache::EntryPtr StaticFileCache::Describe(const std::string& path,
+                                                    const struct stat& st) {
+  return MakeEntry(path, st);
+}
+
+StaticFileCache::EntryPtr StaticFileCache::Load(const std::string& path) {
+  size_t slash = path.rfind('/');
+  std::string dir = slash == std::string::npos ? "." : path.substr(0, slash + 1);
+  uint64_t epoch;
+  {
+    // the directory has to be watched before the file is read, so that a write
+    // racing with the read below always bumps the epoch
+    WriteLockGuard lck(mtx_);
+    if (!WatchDir(dir)) {
+      return nullptr;
+    }
+    epoch = epoch_;
+  }
+
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    return nullptr;
+  }
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    int saved = errno;
+    close(fd);
+    errno = saved;
+    return nullptr;
+  }
+  if (!S_ISREG(st.st_mode)) {
+    // only regular files are served
+    close(fd);
+    errno = ENOENT;
+    return nullptr;
+  }
+  std::shared_ptr<Entry> entry = MakeEntry(path, st);
+  entry->has_body = entry->size <= max_file_size_;
+  if (entry->has_body && !ReadFully(fd, entry->size, entry->body)) {
+    // file shrunk while reading
+    close(fd);
+    errno = EAGAIN;
+    return nullptr;
+  }
+  close(fd);
+
+  WriteLockGuard lck(mtx_);
+  // entries without a body count against max_entries_ only, which bounds them
+  if (epoch != epoch_ || bytes_ + entry->body.size() > capacity_ ||
+      entries_.size() >= max_entries_) {
+    // invalidated while loading, or no room left: serve this once uncached
+    return entry;
+  }
+  auto res = entries_.emplace(path, entry);
+  if (!res.second) {
+    // someone else loaded it first
+    return res.first->second;
+  }
+  bytes_ += entry->body.size();
+  return entry;
+}
+
+StaticFileCache::VariantPtr StaticFileCache::GetVariant(const EntryPtr& entry,
+                                                       ContentCoding coding,
+                                                       int level) {
+  if (!Watching() || entry == nullptr || coding == ContentCoding::Identity) {
+    return nullptr;
+  }
+  size_t idx = static_cast<size_t>(coding);
+  uint64_t epoch;
+  {
+    ReadLockGuard lck(mtx_);
+    auto it = variants_.find(entry->path);
+    if (it != variants_.end() && it->second.tried[idx]) {
+      return it->second.variants[idx];
+    }
+    epoch = epoch_;
+  }
+
+  VariantPtr variant = LoadVariant(*entry, coding, level);
+
+  WriteLockGuard lck(mtx_);
+  auto cur = entries_.find(entry->path);
+  if (epoch != epoch_ || cur == entries_.end() || cur->second != entry) {
+    // entry is stale or was never cached, do not remember anything about it
+    return variant;
+  }
+  Variants& slot = variants_[entry->path];
+  if (slot.tried[idx]) {
+    return slot.variants[idx];
+  }
+  size_t bytes = variant != nullptr ? variant->body.size() : 0;
+  if (variant_bytes_ + bytes > variant_capacity_) {
+    return variant;
+  }
+  slot.tried[idx] = true;
+  slot.variants[idx] = variant;
+  variant_bytes_ += bytes;
+  return variant;
+}
+
+StaticFileCache::VariantPtr StaticFileCache::LoadVariant(const Entry& entry,
+                                                        ContentCoding coding,
+                                                        int level) {
+  if (entry.size == 0) {
+    return nullptr;
+  }
+  auto variant = std::make_shared<Variant>();
+  variant->coding = coding;
+  std::string suffix = std::string("-") + ContentCodingName(coding) + "\"";
+  struct stat st;
+  std::string sibling = entry.path + ".gz";
+  if (coding == ContentCoding::Gzip && stat(sibling.c_str(), &st) == 0 &&
+      S_ISREG(st.st_mode) && st.st_mtime >= entry.mtime &&
+      static_cast<size_t>(st.st_size) < entry.size) {
+    // a precompressed sibling older than the file is ignored
+    variant->etag = MakeETag(st);
+    variant->size = st.st_size;
+    if (variant->size > max_file_size_) {
+      variant->file = sibling;
+    } else if (!ReadFile(sibling, variant->size, variant->body)) {
+      variant->size = 0;
+      variant->body.clear();
+    }
+  }
+  if (variant->size == 0) {
+    std::string raw;
+    const std::string* src = &entry.body;
+    if (!entry.has_body) {
+      if (entry.size > max_compress_size_ ||
+          !ReadFile(entry.path, entry.size, raw)) {
+        return nullptr;
+      }
+      src = &raw;
+    }
+    thread_local Compressor compressor;
+    if (!compressor.Begin(coding, level) ||
+        !compressor.Compress(src->data(), src->size(), variant->body) ||
+        variant->body.size() >= entry.size) {
+      // not worth it
+      return nullptr;
+    }
+    variant->size = variant->body.size();
+    variant->etag = entry.etag;
+  }
+  variant->etag.replace(variant->etag.size() - 1, 1, suffix);
+  variant->validators.reserve(64);
+  variant->validators.append("ETag: ").append(variant->etag).append("\r\n");
+  variant->validators.append("Last-Modified: ")
+      .append(entry.last_modified)
+      .append("\r\n");
+  variant->head.reserve(128 + variant->validators.size());
+  variant->head.append("Content-Type: ").append(entry.content_type).append("\r\n");
+  variant->head.append("Content-Length: ")
+      .append(std::to_string(variant->size))
+      .append("\r\n");
+  variant->head.append("Content-Encoding: ")
+      .append(ContentCodingName(coding))
+      .append("\r\n");
+  variant->head.append(variant->validators);
+  return variant;
+}
+
+// requires mtx_ held for writing
+bool StaticFileCache::WatchDir(const std::string& dir) {
+  if (dir_wds_.count(dir) != 0) {
+    return true;
+  }
+  // IN_CREATE and IN_MOVED_TO catch files replaced by rename
+  uint32_t mask = IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_DELETE | IN_CREATE |
+                  IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF;
+  int wd = inotify_add_watch(inotify_fd_, dir.c_str(), mask);
+  if (wd == -1) {
+    return false;
+  }
+  wd_dirs_[wd].push_back(dir);
+  dir_wds_[dir] = wd;
+  return true;
+}
+
+void StaticFileCache::WatchLoop() {
+  alignas(struct inotify_event) char buf[4096];
+  struct pollfd fds[2];
+  fds[0].fd = inotify_fd_;
+  fds[0].events = POLLIN;
+  fds[1].fd = wakeup_fd_;
+  fds[1].events = POLLIN;
+  while (watching_.load(std::memory_order_acquire)) {
+    int ready = poll(fds, 2, -1);
+    if (ready == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      std::cerr << "static file watcher failed: " << strerror(errno) << std::endl;
+      // stop serving from the cache, nothing would invalidate it anymore
+      watch_failed_.store(true, std::memory_order_release);
+      WriteLockGuard lck(mtx_);
+      epoch_++;
+      entries_.clear();
+      bytes_ = 0;
+      variants_.clear();
+      variant_bytes_ = 0;
+      break;
+    }
+    if (fds[1].revents & POLLIN) {
+      break;
+    }
+    if (!(fds[0].revents & POLLIN)) {
+      continue;
+    }
+    ssize_t n;
+    while ((n = read(inotify_fd_, buf, sizeof(buf))) > 0) {
+      WriteLockGuard lck(mtx_);
+      epoch_++;
+      for (char* p = buf; p < buf + n;) {
+        auto* ev = reinterpret_cast<struct inotify_event*>(p);
+        p += sizeof(struct inotify_event) + ev->len;
+        uint32_t reset = IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF | IN_Q_OVERFLOW;
+        if (ev->mask & reset) {
+          // a watched directory went away or events were lost, start over
+          entries_.clear();
+          bytes_ = 0;
+          variants_.clear();
+          variant_bytes_ = 0;
+          if (on_change_ != nullptr) {
+            on_change_("");
+          }
+          if (ev->mask & IN_IGNORED) {
+            auto it = wd_dirs_.find(ev->wd);
+            if (it != wd_dirs_.end()) {
+              for (const auto& dir : it->second) {
+                dir_wds_.erase(dir);
+              }
+              wd_dirs_.erase(it);
+            }
+          }
+          continue;
+        }
+        if (ev->len == 0) {
+          continue;
+        }
+        auto it = wd_dirs_.find(ev->wd);
+        if (it == wd_dirs_.end()) {
+          continue;
+        }
+        for (const auto& dir : it->second) {
+          std::string path = dir + ev->name;
+          EraseLocked(path);
+          if (on_change_ != nullptr) {
+            on_change_(path);
+          }
+        }
+      }
+    }
+  }
+}
+
+}  // namespace http
+}  // namespace ahrimq
@@ -0,0 +1,213 @@
+#ifndef _AHRIMQ_NET_HTTP_STATIC_FILE_CACHE_H_
+#define _AHRIMQ_NET_HTTP_STATIC_FILE_CACHE_H_
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "base/mutexes.h"
+#include "base/nocopyable.h"
+#include "net/http/http_compress.h"
+
+namespace ahrimq {
+namespace http {
+
+/// @brief Render the entity tag of a file from its inode, modification time and
+/// size. The returned tag is quoted, e.g. "\"2a1f-6530b2c1-1f4\"".
+/// @param st
+/// @return
+std::string MakeETag(const struct stat& st);
+
+/// @brief StaticFileCache keeps small static files in memory together with their
+/// pre-rendered response header lines, so hot static assets are served without
+/// touching the filesystem. Files larger than the per-file limit only get their
+/// header lines cached, their body keeps going through the sendfile path.
+///
+/// Entries are invalidated by an inotify watcher on the directories of cached
+/// files. The cache only hands out entries while the watcher is running, otherwise
+/// Get always returns nullptr.
+///
+/// Encoded variants of cached files are kept in a second bounded table. A gzip
+/// variant comes from a fresh precompressed ".gz" sibling when one exists, other
+/// variants are compressed once on first use.
+class StaticFileCache : public NoCopyable {
+ public:
+  constexpr static size_t kDefaultMaxFileSize = 64 * 1024;
+  constexpr static size_t kDefaultCapacity = 64 * 1024 * 1024;
+  constexpr static size_t kDefaultVariantCapacity = 32 * 1024 * 1024;
+  constexpr static size_t kDefaultMaxCompressSize = 4 * 1024 * 1024;
+  constexpr static size_t kDefaultMaxEntries = 64 * 1024;
+
+  /// @brief A cached file. Entries are immutable once published.
+  struct Entry {
+    std::string path;
+    // false if the file is too large, body is empty and has to be sent from disk
+    bool has_body = false;
+    std::string body;
+    size_t size = 0;
+    // quoted entity tag, see MakeETag
+    std::string etag;
+    // IMF-fixdate of the modification time
+    std::string last_modified;
+    time_t mtime = 0;
+    std::string content_type;
+    // "Content-Type", "Content-Length", "Accept-Ranges", "ETag" and
+    // "Last-Modified" header lines
+    std::string head;
+    // "ETag" and "Last-Modified" header lines only
+    std::string validators;
+  };
+  typedef std::shared_ptr<const Entry> EntryPtr;
+
+  /// @brief An encoded representation of a cached file, immutable once published.
+  struct Variant {
+    ContentCoding coding = ContentCoding::Identity;
+    // encoded bytes, empty if file is set
+    std::string body;
+    // precompressed sibling too large to keep in memory, sent from disk
+    std::string file;
+    size_t size = 0;
+    // quoted entity tag, distinct from the one of the identity representation
+    std::string etag;
+    // "Content-Type", "Content-Length", "Content-Encoding", "ETag" and
+    // "Last-Modified" header lines
+    std::string head;
+    // "ETag" and "Last-Modified" header lines only
+    std::string validators;
+  };
+  typedef std::shared_ptr<const Variant> VariantPtr;
+
+  /// @brief Construct a static file cache.
+  /// @param max_file_size files larger than this are never cached
+  /// @param capacity total body bytes the cache may hold
+  /// @param variant_capacity total encoded bytes the cache may hold
+  /// @param max_compress_size files larger than this are only served encoded from
+  /// a precompressed sibling
+  /// @param max_entries files the cache may describe, including those too large
+  /// to keep their body
+  explicit StaticFileCache(size_t max_file_size = kDefaultMaxFileSize,
+                           size_t capacity = kDefaultCapacity,
+                           size_t variant_capacity = kDefaultVariantCapacity,
+                           size_t max_compress_size = kDefaultMaxCompressSize,
+                           size_t max_entries = kDefaultMaxEntries);
+
+  ~StaticFileCache();
+
+  /// @brief Callback invoked from the watcher thread with the path of a changed
+  /// file, or with an empty path when every file may have changed.
+  typedef std::function<void(const std::string&)> ChangeCallback;
+
+  /// @brief Set the callback for file changes, must be called before Watch().
+  /// @param cb
+  void SetOnChange(ChangeCallback cb) {
+    on_change_ = std::move(cb);
+  }
+
+  /// @brief Start the inotify watcher thread.
+  /// @return false if inotify is not available
+  bool Watch();
+
+  /// @brief Stop the watcher thread and drop every entry.
+  void Stop();
+
+  /// @brief Whether files are cached, false once the watcher thread failed as
+  /// changes would go unnoticed.
+  bool Watching() const {
+    return watching_.load(std::memory_order_acquire) &&
+           !watch_failed_.load(std::memory_order_acquire);
+  }
+
+  /// @brief Get the entry of path, loading it on a miss.
+  /// @param path full file path
+  /// @return nullptr if path is not a readable regular file (errno is kept) or the
+  /// cache is not running
+  EntryPtr Get(const std::string& path);
+
+  /// @brief Get entry encoded with coding. Failures and encodings that do not
+  /// shrink the file are remembered until the file changes.
+  /// @param entry an entry returned by Get
+  /// @param coding
+  /// @param level zlib level used when compressing on the fly
+  /// @return nullptr if no smaller encoded representation is available
+  VariantPtr GetVariant(const EntryPtr& entry, ContentCoding coding, int level);
+
+  /// @brief Build an entry holding only the header lines of a file, for files that
+  /// are served without the cache.
+  /// @param path
+  /// @param st stat of path
+  /// @return
+  static EntryPtr Describe(const std::string& path, const struct stat& st);
+
+  /// @brief Drop the entry of path if it exists.
+  /// @param path
+  void Invalidate(const std::string& path);
+
+  /// @brief Drop every entry.
+  void Clear();
+
+  /// @brief Number of cached files.
+  size_t Count();
+
+  /// @brief Total body bytes cached.
+  size_t Bytes();
+
+  /// @brief Total encoded bytes cached.
+  size_t VariantBytes();
+
+ private:
+  static std::shared_ptr<Entry> MakeEntry(const std::string& path,
+                                          const struct stat& st);
+
+  EntryPtr Load(const std::string& path);
+
+  VariantPtr LoadVariant(const Entry& entry, ContentCoding coding, int level);
+
+  void EraseLocked(const std::string& path);
+
+  bool WatchDir(const std::string& dir);
+
+  void WatchLoop();
+
+ private:
+  size_t max_file_size_;
+  size_t capacity_;
+  size_t max_entries_;
+  ReadWriteMutex mtx_;
+  std::unordered_map<std::string, EntryPtr> entries_;
+  size_t bytes_ = 0;
+  // bumped on every invalidation, a load that raced with one is not published
+  uint64_t epoch_ = 0;
+
+  struct Variants {
+    // nullptr with tried set: no smaller representation
+    VariantPtr variants[kContentCodingCount];
+    bool tried[kContentCodingCount] = {};
+  };
+  size_t variant_capacity_;
+  size_t max_compress_size_;
+  std::unordered_map<std::string, Variants> variants_;
+  size_t variant_bytes_ = 0;
+
+  int inotify_fd_ = -1;
+  int wakeup_fd_ = -1;
+  std::atomic<bool> watching_{false};
+  // the watcher thread exited on an error, Stop() still joins it
+  std::atomic<bool> watch_failed_{false};
+  std::thread watcher_;
+  // guarded by mtx_, one directory may be reached through several spellings
+  std::unordered_map<int, std::vector<std::string>> wd_dirs_;
+  std::unordered_map<std::string, int> dir_wds_;
+  ChangeCallback on_change_;
+};
+
+}  // namespace http
+}  // namespace ahrimq
+
+#endif  // _AHRIMQ_NET_HTTP_STATIC_FILE_CACHE_H_
@@ -0,0 +1,154 @@
+#include "ahrimq/net/http/static_file_cache.h"
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <thread>
+#include <vector>
+
+using namespace ahrimq;
+
+static std::string MakeTempDir() {
+  char tmpl[] = "/tmp/ahrimq_static_XXXXXX";
+  char* dir = mkdtemp(tmpl);
+  return dir == nullptr ? "" : std::string(dir) + "/";
+}
+
+static void WriteFile(const std::string& path, const std::string& content) {
+  std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+  ofs << content;
+}
+
+TEST(StaticFileCacheTest, GetAndInvalidateTest) {
+  std::string dir = MakeTempDir();
+  ASSERT_FALSE(dir.empty());
+  std::string path = dir + "index.html";
+  WriteFile(path, "<p>hello</p>");
+
+  http::StaticFileCache cache(1024);
+  // not watching, nothing is served
+  EXPECT_EQ(cache.Get(path), nullptr);
+  ASSERT_TRUE(cache.Watch());
+
+  auto entry = cache.Get(path);
+  ASSERT_NE(entry, nullptr);
+  EXPECT_TRUE(entry->has_body);
+  EXPECT_EQ(entry->body, "<p>hello</p>");
+  EXPECT_NE(entry->head.find("Content-Type: text/html"), std::string::npos);
+  EXPECT_NE(entry->head.find("Content-Length: 12\r\n"), std::string::npos);
+  EXPECT_NE(entry->head.find("ETag: " + entry->etag + "\r\n"), std::string::npos);
+  EXPECT_NE(entry->head.find("Last-Modified: " + entry->last_modified),
+            std::string::npos);
+  EXPECT_EQ(cache.Get(path), entry);
+  EXPECT_EQ(cache.Count(), 1u);
+  EXPECT_EQ(cache.Bytes(), 12u);
+
+  // modifying the file drops the entry
+  WriteFile(path, "<p>world!</p>");
+  for (int i = 0; i < 100 && cache.Count() != 0; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  EXPECT_EQ(cache.Count(), 0u);
+  entry = cache.Get(path);
+  ASSERT_NE(entry, nullptr);
+  EXPECT_EQ(entry->body, "<p>world!</p>");
+
+  // large files only keep header lines
+  std::string large = dir + "large.bin";
+  WriteFile(large, std::string(2048, 'x'));
+  entry = cache.Get(large);
+  ASSERT_NE(entry, nullptr);
+  EXPECT_FALSE(entry->has_body);
+  EXPECT_EQ(entry->size, 2048u);
+  EXPECT_NE(entry->head.find("Content-Length: 2048\r\n"), std::string::npos);
+  EXPECT_EQ(cache.Count(), 2u);
+
+  errno = 0;
+  EXPECT_EQ(cache.Get(dir + "missing.html"), nullptr);
+  EXPECT_EQ(errno, ENOENT);
+
+  cache.Stop();
+  unlink(path.c_str());
+  unlink(large.c_str());
+  rmdir(dir.c_str());
+}
+
+TEST(StaticFileCacheTest, VariantTest) {
+  std::string dir = MakeTempDir();
+  ASSERT_FALSE(dir.empty());
+  std::string js = dir + "app.js";
+  std::string json = dir + "data.json";
+  WriteFile(js, std::string(4096, 'a'));
+  WriteFile(json, std::string(4096, 'b'));
+  // a precompressed sibling wins over compressing on the fly
+  WriteFile(js + ".gz", "precompressed");
+
+  http::StaticFileCache cache(1024);
+  ASSERT_TRUE(cache.Watch());
+  auto entry = cache.Get(js);
+  ASSERT_NE(entry, nullptr);
+  auto variant = cache.GetVariant(entry, http::ContentCoding::Gzip, 6);
+  ASSERT_NE(variant, nullptr);
+  EXPECT_EQ(variant->body, "precompressed");
+  EXPECT_NE(variant->etag, entry->etag);
+  EXPECT_NE(variant->head.find("Content-Encoding: gzip\r\n"), std::string::npos);
+  EXPECT_NE(variant->head.find("Content-Type: text/javascript"), std::string::npos);
+  EXPECT_EQ(cache.GetVariant(entry, http::ContentCoding::Gzip, 6), variant);
+
+  // files larger than the body limit are compressed from disk
+  entry = cache.Get(json);
+  ASSERT_NE(entry, nullptr);
+  EXPECT_FALSE(entry->has_body);
+  variant = cache.GetVariant(entry, http::ContentCoding::Deflate, 6);
+  ASSERT_NE(variant, nullptr);
+  EXPECT_TRUE(variant->file.empty());
+  EXPECT_LT(variant->size, 4096u);
+  EXPECT_EQ(cache.VariantBytes(), 13 + variant->size);
+
+  // changing the sibling drops the variant of the original
+  WriteFile(js + ".gz", "precompressed again");
+  for (int i = 0; i < 100 && cache.VariantBytes() != variant->size; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  EXPECT_EQ(cache.VariantBytes(), variant->size);
+
+  cache.Stop();
+  unlink(js.c_str());
+  unlink((js + ".gz").c_str());
+  unlink(json.c_str());
+  rmdir(dir.c_str());
+}
+
+TEST(StaticFileCacheTest, MaxEntriesTest) {
+  std::string dir = MakeTempDir();
+  ASSERT_FALSE(dir.empty());
+  // files too large to keep their body count against the entry limit as well
+  std::vector<std::string> paths;
+  for (int i = 0; i < 4; i++) {
+    paths.push_back(dir + "large" + std::to_string(i) + ".bin");
+    WriteFile(paths.back(), std::string(2048, 'x'));
+  }
+  http::StaticFileCache cache(1024, 1 << 20, 1 << 20, 1 << 20, 2);
+  ASSERT_TRUE(cache.Watch());
+  for (const std::string& path : paths) {
+    auto entry = cache.Get(path);
+    ASSERT_NE(entry, nullptr);
+    EXPECT_FALSE(entry->has_body);
+  }
+  EXPECT_EQ(cache.Count(), 2u);
+  EXPECT_EQ(cache.Bytes(), 0u);
+
+  cache.Stop();
+  for (const std::string& path : paths) {
+    unlink(path.c_str());
+  }
+  rmdir(dir.c_str());
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -1,114 +1,250 @@
 #include "net/http/url.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstring>
+
 #include "base/str_utils.h"
 
 namespace ahrimq {
 namespace http {
 
-void URL::Query::Add(const std::string& key, const std::string& value) {
-  params_[key].emplace_back(value);
+// bytes UnEscape copies unchanged, '%' and '+' are handled on their own
+static const std::array<bool, 256>& URLPlainChars() {
+  static const std::array<bool, 256> table = []() {
+    std::array<bool, 256> t{};
+    for (int ch = 0; ch < 256; ch++) {
+      t[ch] = isalnum(ch) || (ch != 0 && strchr("-_.~:/?#[]@!$&'()*,;=", ch));
+    }
+    return t;
+  }();
+  return table;
+}
+
+// Return the length of the prefix of s that decodes to itself. In strict mode
+// bytes outside the url character set end the prefix too.
+template <bool strict>
+static size_t PlainPrefix(const char* s, size_t len) {
+  size_t i = 0;
+#ifdef __SSE2__
+  const __m128i percent = _mm_set1_epi8('%');
+  const __m128i plus = _mm_set1_epi8('+');
+  for (; i + 16 <= len; i += 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+    __m128i special =
+        _mm_or_si128(_mm_cmpeq_epi8(v, percent), _mm_cmpeq_epi8(v, plus));
+    if (strict) {
+      // printable ascii except the characters urls do not contain, bytes from
+      // 0x80 are negative and fail the range check
+      __m128i in_range = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(0x20)),
+                                       _mm_cmplt_epi8(v, _mm_set1_epi8(0x7f)));
+      special = _mm_or_si128(special, _mm_andnot_si128(in_range, _mm_set1_epi8(-1)));
+      for (char c : {'"', '<', '>', '\\', '^', '`', '{', '|', '}'}) {
+        special = _mm_or_si128(special, _mm_cmpeq_epi8(v, _mm_set1_epi8(c)));
+      }
+    }
+    int mask = _mm_movemask_epi8(special);
+    if (mask != 0) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+#endif
+  for (; i < len; i++) {
+    unsigned char ch = s[i];
+    if (ch == '%' || ch == '+' || (strict && !URLPlainChars()[ch])) {
+      break;
+    }
+  }
+  return i;
+}
+
+static int HexDigit(char ch) {
+  if (OnlyDigit(ch)) {
+    return ch - '0';
+  } else if (OnlyHexLowercase(ch)) {
+    return ch - 'a' + 10;
+  } else if (OnlyHexUppercase(ch)) {
+    return ch - 'A' + 10;
+  }
+  return -1;
+}
+
+// Decode s into out, which has room for len bytes, copying plain runs in bulk.
+// The number of bytes written is stored in n, also when decoding fails.
+template <bool strict>
+static bool Decode(const char* s, size_t len, char* out, size_t& n) {
+  n = 0;
+  size_t i = 0;
+  while (true) {
+    size_t plain = PlainPrefix<strict>(s + i, len - i);
+    memcpy(out + n, s + i, plain);
+    i += plain;
+    n += plain;
+    if (i == len) {
+      return true;
+    }
+    if (s[i] == '+') {
+      out[n++] = ' ';
+      i++;
+    } else if (s[i] == '%' && i + 2 < len) {
+      int hi = HexDigit(s[i + 1]);
+      int lo = HexDigit(s[i + 2]);
+      if (hi < 0 || lo < 0) {
+        return false;
+      }
+      out[n++] = static_cast<char>(hi << 4 | lo);
+      i += 3;
+    } else {
+      return false;
+    }
+  }
+}
+
+URL::Query::Query(const Query& other) {
+  *this = other;
 }
 
-void URL::Query::Set(const std::string& key, const std::string& value) {
-  if (params_.count(key) == 0) {
-    params_.insert({key, {value}});
-  } else {
-    params_[key].clear();
-    params_[key].emplace_back(value);
+URL::Query& URL::Query::operator=(const Query& other) {
+  if (this != &other) {
+    Clear();
+    other.Parse();
+    pairs_.reserve(other.pairs_.size());
+    for (const Pair& p : other.pairs_) {
+      pairs_.emplace_back(arena_.Copy(p.first), arena_.Copy(p.second));
+    }
+  }
+  return *this;
+}
+
+void URL::Query::Parse() const {
+  std::string_view raw = raw_;
+  raw_ = {};
+  while (!raw.empty()) {
+    // key=value&key=value
+    size_t amp = raw.find('&');
+    std::string_view item = raw.substr(0, amp);
+    raw.remove_prefix(amp == std::string_view::npos ? raw.size() : amp + 1);
+    size_t eq = item.find('=');
+    if (eq == std::string_view::npos) {
+      continue;
+    }
+    std::string_view kv[2] = {item.substr(0, eq), item.substr(eq + 1)};
+    for (std::string_view& part : kv) {
+      // parts without escapes are used in place
+      if (PlainPrefix<false>(part.data(), part.size()) != part.size()) {
+        char* out = arena_.AllocateChars(part.size());
+        size_t n;
+        // a malformed escape keeps the part decoded before it
+        Decode<false>(part.data(), part.size(), out, n);
+        part = std::string_view(out, n);
+      }
+    }
+    pairs_.emplace_back(kv[0], kv[1]);
   }
 }
 
-std::string URL::Query::Get(const std::string& key) const {
-  try {
-    return params_.at(key)[0];
-  } catch (std::exception& ex) {
-    return "";
+void URL::Query::Add(std::string_view key, std::string_view value) {
+  Parse();
+  pairs_.emplace_back(arena_.Copy(key), arena_.Copy(value));
+}
+
+void URL::Query::Set(std::string_view key, std::string_view value) {
+  Del(key);
+  Add(key, value);
+}
+
+std::string_view URL::Query::GetView(std::string_view key) const {
+  Parse();
+  for (const Pair& p : pairs_) {
+    if (p.first == key) {
+      return p.second;
+    }
   }
+  return {};
 }
 
-std::vector<std::string> URL::Query::Values(const std::string& key) const {
-  try {
-    return params_.at(key);
-  } catch (std::exception& ex) {
-    return {};
+std::vector<std::string> URL::Query::Values(std::string_view key) const {
+  Parse();
+  std::vector<std::string> r;
+  for (const Pair& p : pairs_) {
+    if (p.first == key) {
+      r.emplace_back(p.second);
+    }
   }
+  return r;
 }
 
-bool URL::Query::Has(const std::string& key) const {
-  return params_.count(key) != 0;
+bool URL::Query::Has(std::string_view key) const {
+  Parse();
+  for (const Pair& p : pairs_) {
+    if (p.first == key) {
+      return true;
+    }
+  }
+  return false;
 }
 
-void URL::Query::Del(const std::string& key) {
-  params_.erase(key);
+void URL::Query::Del(std::string_view key) {
+  Parse();
+  pairs_.erase(std::remove_if(pairs_.begin(), pairs_.end(),
+                              [key](const Pair& p) { return p.first == key; }),
+               pairs_.end());
 }
 
 void URL::Query::Clear() {
-  params_.clear();
+  pairs_.clear();
+  raw_ = {};
+  arena_.Reset();
 }
 
 std::vector<std::string> URL::Query::Keys() const {
+  Parse();
   std::vector<std::string> r;
-  r.reserve(params_.size());
-  for (auto&& k : params_) {
-    r.emplace_back(k.first);
+  for (const Pair& p : pairs_) {
+    if (std::find(r.begin(), r.end(), p.first) == r.end()) {
+      r.emplace_back(p.first);
+    }
   }
   return r;
 }
 
-void URL::Query::ParseString(const std::string& str, bool body) {
-  if (str.empty()) {
-    return;
-  }
-  size_t pos;
-  std::vector<std::string> q;
+void URL::Query::ParseString(std::string_view str, bool body) {
   if (!body) {
-    pos = str.find('?');
-    if (pos == std::string::npos) {
+    size_t pos = str.find('?');
+    if (pos == std::string_view::npos) {
       // no '?' found in url_, then we do not need to set query_
       return;
     }
-    // '?' found
-    // seperated by '&'
-    std::string raw_query = str.substr(pos + 1);
-    if (raw_query.empty()) {
-      return;
-    }
-    // key1=value1&key2=value2&...&keyN=valueN
-    StrSplit(raw_query, '&', q);
-  } else {
-    StrSplit(str, '&', q);
+    str.remove_prefix(pos + 1);
   }
-
-  // key=value
-  for (const auto& argp : q) {
-    pos = argp.find('=');
-    if (pos != std::string::npos) {
-      // set query items
-      // unescape the urlencoded content
-      std::string unescaped_key;
-      std::string unescaped_value;
-      URL::UnEscape(argp.substr(0, pos), unescaped_key);
-      URL::UnEscape(argp.substr(pos + 1), unescaped_value);
-      Add(unescaped_key, unescaped_value);
-    }
+  if (str.empty()) {
+    return;
   }
+  // pairs taken before are decoded first, raw_ holds one string at a time
+  Parse();
+  raw_ = arena_.Copy(str);
 }
 
 std::ostream& operator<<(std::ostream& os, const URL::Query& query) {
-  size_t k = 0;
-  for (const auto& item : query.params_) {
-    os << item.first << "=[";
-    for (size_t i = 0; i < item.second.size(); ++i) {
-      os << item.second[i];
-      if (i != item.second.size() - 1) {
-        os << ", ";
+  std::vector<std::string> keys = query.Keys();
+  for (size_t k = 0; k < keys.size(); k++) {
+    os << keys[k] << "=[";
+    bool first = true;
+    for (const auto& p : query.pairs_) {
+      if (p.first == keys[k]) {
+        os << (first ? "" : ", ") << p.second;
+        first = false;
       }
     }
     os << ']';
-    if (k != query.Size() - 1) {
+    if (k != keys.size() - 1) {
       os << ", ";
     }
-    k++;
   }
   return os;
 }
@@ -118,9 +254,6 @@ URL::URL(const std::string& url) : url_(url) {
 }
 
 std::string URL::StringWithQuery() const {
-  if (query_.Empty()) {
-    return url_;
-  }
   size_t pos = url_.find('?');
   if (pos == std::string::npos) {
     return url_;
@@ -129,7 +262,8 @@ std::string URL::StringWithQuery() const {
 }
 
 void URL::ParseQuery() {
-  // we need to parse url_ member here
+  // the pairs are only decoded when the query is read
+  query_.Clear();
   query_.ParseString(url_);
 }
 
@@ -159,76 +293,12 @@ void URL::Escape(const std::string& in, std::string& out) {
   }
 }
 
-bool URL::UnEscape(const std::string& in, std::string& out) {
-  out.clear();
-  out.reserve(in.size());
-  for (std::size_t i = 0; i < in.size(); ++i) {
-    switch (in[i]) {
-      // %xx: next two characters should be transformed
-      case '%':
-        if (i + 3 <= in.size()) { // out of range
-          unsigned int value = 0;
-          // convert the next 2 hexadecimal digits to deicmal
-          for (std::size_t j = i + 1; j <= i + 2; ++j) {
-            if (OnlyDigit(in[j])) {
-              value += in[j] - '0';
-            } else if (OnlyHexLowercase(in[j])) {
-              value += in[j] - 'a' + 10;
-            } else if (OnlyHexUppercase(in[j])) {
-              value += in[j] - 'A' + 10;
-            } else {
-              return false;
-            }
-            if (j == i + 1) {
-              value <<= 4;  // make it high 4-bit
-            }
-          }
-          // done convert %xx
-          out.push_back(static_cast<char>(value));
-          i += 2;
-        } else {
-          return false;
-        }
-        break;
-      // remain unchanged
-      case '-':
-      case '_':
-      case '.':
-      case '~':
-      case ':':
-      case '/':
-      case '?':
-      case '#':
-      case '[':
-      case ']':
-      case '@':
-      case '!':
-      case '$':
-      case '&':
-      case '\'':
-      case '(':
-      case ')':
-      case '*':
-      case ',':
-      case ';':
-      case '=':
-        out.push_back(in[i]);
-        break;
-      case '+':
-        out.push_back(' ');
-        break;
-
-      default:
-        // not alphabet and not number
-        if (!std::isalnum(in[i])) {
-          return false;
-        }
-        // remain unchanged
-        out.push_back(in[i]);
-        break;
-    }
-  }
-  return true;
+bool URL::UnEscape(std::string_view in, std::string& out) {
+  out.resize(in.size());
+  size_t n;
+  bool ok = Decode<true>(in.data(), in.size(), &out[0], n);
+  out.resize(n);
+  return ok;
 }
 
 }  // namespace http
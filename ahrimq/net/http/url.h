@@ -4,9 +4,12 @@
 #include <memory>
 #include <ostream>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 
+#include "base/arena.h"
+
 namespace ahrimq {
 namespace http {
 
@@ -17,75 +20,104 @@ class URL {
   /// request url. Those parameters are a list of key/value pairs separated with the
   /// '&' symbol. A URL instance contains a Query instance which is constructed when
   /// constructing or setting new string url.
+  ///
+  /// The query string is only split and decoded when the query is first read, so
+  /// requests whose handlers never look at it pay nothing but a copy. Keys and
+  /// values live in an arena owned by the query and are released together by
+  /// Clear(). Lookups scan the pairs in order, which beats hashing for the handful
+  /// of parameters a query usually has. Reading a query from several threads at
+  /// once is not safe before it has been parsed.
   class Query {
     friend class URL;
 
    public:
+    Query() = default;
+
+    Query(const Query& other);
+
+    Query& operator=(const Query& other);
+
     /// @brief Add value with given key.
     /// @param key
     /// @param value
-    void Add(const std::string& key, const std::string& value);
+    void Add(std::string_view key, std::string_view value);
 
     /// @brief  Set value with given key, original value will be overwritten.
     /// @param key
     /// @param value
-    void Set(const std::string& key, const std::string& value);
+    void Set(std::string_view key, std::string_view value);
 
     /// @brief Get the first value of given key, return "" if key not exists.
     /// @param key
     /// @return
-    std::string Get(const std::string& key) const;
+    std::string Get(std::string_view key) const {
+      return std::string(GetView(key));
+    }
+
+    /// @brief Get the first value of given key without copying it. The view is
+    /// valid until the query is modified or cleared.
+    /// @param key
+    /// @return an empty view if key not exists
+    std::string_view GetView(std::string_view key) const;
 
     /// @brief Get all values with given key.
     /// @param key
     /// @return
-    std::vector<std::string> Values(const std::string& key) const;
+    std::vector<std::string> Values(std::string_view key) const;
 
     /// @brief Check given key exists.
     /// @param key
     /// @return
-    bool Has(const std::string& key) const;
+    bool Has(std::string_view key) const;
 
     /// @brief Delete given key.
     /// @param key
-    void Del(const std::string& key);
+    void Del(std::string_view key);
 
     /// @brief Delete all key-values in query.
     void Clear();
 
-    /// @brief Get the number of pairs of key-value.
+    /// @brief Get the number of distinct keys.
     size_t Size() const {
-      return params_.size();
+      return Keys().size();
     }
 
     bool Empty() const {
-      return params_.empty();
+      Parse();
+      return pairs_.empty();
     }
 
+    /// @brief Get the distinct keys in the order they first appear.
+    /// @return
     std::vector<std::string> Keys() const;
 
-    void ParseString(const std::string& str, bool body = false);
+    /// @brief Take the pairs of str, which is decoded when the query is read.
+    /// @param str a url if body is false, otherwise an urlencoded form body
+    /// @param body
+    void ParseString(std::string_view str, bool body = false);
 
     friend std::ostream& operator<<(std::ostream& os, const Query& query);
 
    private:
-    std::unordered_map<std::string, std::vector<std::string>> params_;
+    typedef std::pair<std::string_view, std::string_view> Pair;
+
+    // split and decode raw_ into pairs_ if not done yet
+    void Parse() const;
+
+   private:
+    mutable Arena arena_{512};
+    mutable std::vector<Pair> pairs_;
+    // the undecoded pairs not parsed yet, kept in arena_
+    mutable std::string_view raw_;
   };
 
  public:
   explicit URL(const std::string& url = "/");
 
-  /// @brief Set new url string.
-  /// @param s
-  void Set(const std::string& s) {
-    url_ = s;
-    ParseQuery();
-  }
-
-  /// @brief Set new url string.
+  /// @brief Set new url string, reusing the storage of the previous one.
   /// @param s
-  void Set(std::string&& s) {
-    url_ = std::move(s);
+  void Set(std::string_view s) {
+    url_.assign(s.data(), s.size());
     ParseQuery();
   }
 
@@ -99,6 +131,14 @@ class URL {
   /// @return
   std::string StringWithQuery() const;
 
+  /// @brief Return a view of the path part of the url (everything before '?'). The
+  /// view is valid until the url is modified.
+  /// @return
+  std::string_view Path() const {
+    std::string_view v(url_);
+    return v.substr(0, v.find('?'));
+  }
+
   /// @brief Reset url instance
   void Reset() {
     url_ = "";
@@ -114,7 +154,7 @@ class URL {
   /// @brief Check if url has query parameters.
   /// @return
   bool HasQuery() const {
-    return query_.Empty();
+    return !query_.Empty();
   }
 
   friend std::ostream& operator<<(std::ostream& os, const URL& url);
@@ -129,8 +169,9 @@ class URL {
   /// @brief Decode in into out.
   /// @param in input strign to be decoded
   /// @param out decoded output string
-  /// @return
-  static bool UnEscape(const std::string& in, std::string& out);
+  /// @return false if in has a malformed escape or a character which is not
+  /// allowed in urls, out then holds the part decoded before it
+  static bool UnEscape(std::string_view in, std::string& out);
 
  private:
   /// @brief Parse url string and set query_ member.
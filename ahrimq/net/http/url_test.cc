@@ -2,6 +2,8 @@
 
 #include <gtest/gtest.h>
 
+#include <random>
+
 using namespace ahrimq::http;
 using namespace ahrimq;
 
@@ -41,6 +43,84 @@ TEST(URLTest, URLUnEscapeTest) {
   }
 }
 
+// byte at a time reference for the vectorized decoder
+static bool ReferenceUnEscape(const std::string& in, std::string& out) {
+  static const std::string allowed = "-_.~:/?#[]@!$&'()*,;=";
+  out.clear();
+  for (size_t i = 0; i < in.size(); i++) {
+    unsigned char ch = in[i];
+    if (ch == '%') {
+      if (i + 2 >= in.size() || !isxdigit(static_cast<unsigned char>(in[i + 1])) ||
+          !isxdigit(static_cast<unsigned char>(in[i + 2]))) {
+        return false;
+      }
+      out.push_back(static_cast<char>(std::stoi(in.substr(i + 1, 2), nullptr, 16)));
+      i += 2;
+    } else if (ch == '+') {
+      out.push_back(' ');
+    } else if (isalnum(ch) || (ch != 0 && allowed.find(ch) != std::string::npos)) {
+      out.push_back(ch);
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+TEST(URLTest, URLUnEscapeRandomTest) {
+  std::mt19937 rng(3);
+  const std::string alphabet = "abcXYZ019%+-_~&= <\"\\\x80\xff";
+  for (int round = 0; round < 5000; round++) {
+    // long runs of plain bytes go through the 16 byte blocks
+    std::string in(rng() % 80, 'a');
+    for (char& c : in) {
+      if (rng() % 8 == 0) {
+        c = alphabet[rng() % alphabet.size()];
+      }
+    }
+    std::string out, expect;
+    bool ok = URL::UnEscape(in, out);
+    ASSERT_EQ(ok, ReferenceUnEscape(in, expect)) << in;
+    if (ok) {
+      ASSERT_EQ(out, expect);
+    }
+  }
+}
+
+TEST(URLTest, QueryTest) {
+  URL url("/search?q=a+b%26c&tag=x&tag=y&flag&empty=&tag=z");
+  const URL::Query& q = url.GetQuery();
+  EXPECT_TRUE(url.HasQuery());
+  EXPECT_EQ(q.Get("q"), "a b&c");
+  EXPECT_EQ(q.Values("tag"), std::vector<std::string>({"x", "y", "z"}));
+  EXPECT_EQ(q.Keys(), std::vector<std::string>({"q", "tag", "empty"}));
+  EXPECT_TRUE(q.Has("empty"));
+  EXPECT_FALSE(q.Has("flag"));
+  EXPECT_EQ(q.Get("missing"), "");
+  EXPECT_TRUE(q.Values("missing").empty());
+  EXPECT_EQ(url.Path(), "/search");
+
+  // copies own their strings
+  URL::Query copy = q;
+  url.Set("/other?tag=w");
+  EXPECT_EQ(q.Values("tag"), std::vector<std::string>({"w"}));
+  EXPECT_EQ(copy.Get("q"), "a b&c");
+  copy.Set("tag", "v");
+  copy.Del("q");
+  EXPECT_EQ(copy.Values("tag"), std::vector<std::string>({"v"}));
+  EXPECT_FALSE(copy.Has("q"));
+
+  URL::Query form;
+  form.ParseString("a=1&b=%zz", true);
+  form.Add("c", "3");
+  form.ParseString("d=4", true);
+  EXPECT_EQ(form.Keys(), std::vector<std::string>({"a", "b", "c", "d"}));
+  // a malformed escape keeps what was decoded before it
+  EXPECT_EQ(form.Get("b"), "");
+  url.Reset();
+  EXPECT_FALSE(url.HasQuery());
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
@@ -0,0 +1,603 @@
+#include "net/http/websocket.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <sys/socket.h>
+
+#include <cstring>
+#include <unordered_map>
+
+namespace ahrimq {
+namespace http {
+
+// the GUID appended to Sec-WebSocket-Key (RFC 6455 section 1.3)
+static const char kWebSocketGUID[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+// frame header bits
+constexpr static uint8_t kFin = 0x80;
+constexpr static uint8_t kReserved = 0x70;
+constexpr static uint8_t kOpcodeMask = 0x0f;
+constexpr static uint8_t kMasked = 0x80;
+// payloads of control frames fit in the 7-bit length
+constexpr static size_t kMaxControlPayload = 125;
+
+static const char kBase64Chars[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static inline uint32_t RotateLeft(uint32_t v, int n) {
+  return (v << n) | (v >> (32 - n));
+}
+
+// SHA-1 (RFC 3174), only used for the handshake
+static void SHA1(std::string_view data, unsigned char digest[20]) {
+  uint32_t h[5] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0};
+  std::string msg(data);
+  uint64_t bits = uint64_t(data.size()) * 8;
+  msg.push_back(static_cast<char>(0x80));
+  while (msg.size() % 64 != 56) {
+    msg.push_back(0);
+  }
+  for (int shift = 56; shift >= 0; shift -= 8) {
+    msg.push_back(static_cast<char>(bits >> shift));
+  }
+  const unsigned char* p = reinterpret_cast<const unsigned char*>(msg.data());
+  for (size_t block = 0; block < msg.size(); block += 64) {
+    uint32_t w[80];
+    for (int i = 0; i < 16; i++) {
+      const unsigned char* q = p + block + i * 4;
+      w[i] = (uint32_t(q[0]) << 24) | (uint32_t(q[1]) << 16) |
+             (uint32_t(q[2]) << 8) | uint32_t(q[3]);
+    }
+    for (int i = 16; i < 80; i++) {
+      w[i] = RotateLeft(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+    for (int i = 0; i < 80; i++) {
+      uint32_t f, k;
+      if (i < 20) {
+        f = (b & c) | (~b & d);
+        k = 0x5a827999;
+      } else if (i < 40) {
+        f = b ^ c ^ d;
+        k = 0x6ed9eba1;
+      } else if (i < 60) {
+        f = (b & c) | (b & d) | (c & d);
+        k = 0x8f1bbcdc;
+      } else {
+        f = b ^ c ^ d;
+        k = 0xca62c1d6;
+      }
+      uint32_t t = RotateLeft(a, 5) + f + e + k + w[i];
+      e = d;
+      d = c;
+      c = RotateLeft(b, 30);
+      b = a;
+      a = t;
+    }
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+  }
+  for (int i = 0; i < 5; i++) {
+    digest[i * 4] = static_cast<unsigned char>(h[i] >> 24);
+    digest[i * 4 + 1] = static_cast<unsigned char>(h[i] >> 16);
+    digest[i * 4 + 2] = static_cast<unsigned char>(h[i] >> 8);
+    digest[i * 4 + 3] = static_cast<unsigned char>(h[i]);
+  }
+}
+
+static std::string Base64Encode(const unsigned char* data, size_t len) {
+  std::string out;
+  out.reserve((len + 2) / 3 * 4);
+  for (size_t i = 0; i < len; i += 3) {
+    uint32_t v = uint32_t(data[i]) << 16;
+    if (i + 1 < len) {
+      v |= uint32_t(data[i + 1]) << 8;
+    }
+    if (i + 2 < len) {
+      v |= data[i + 2];
+    }
+    out.push_back(kBase64Chars[(v >> 18) & 0x3f]);
+    out.push_back(kBase64Chars[(v >> 12) & 0x3f]);
+    out.push_back(i + 1 < len ? kBase64Chars[(v >> 6) & 0x3f] : '=');
+    out.push_back(i + 2 < len ? kBase64Chars[v & 0x3f] : '=');
+  }
+  return out;
+}
+
+std::string WebSocketAccept(std::string_view key) {
+  std::string input(key);
+  input.append(kWebSocketGUID);
+  unsigned char digest[20];
+  SHA1(input, digest);
+  return Base64Encode(digest, sizeof(digest));
+}
+
+bool ValidWebSocketKey(std::string_view key) {
+  // 16 bytes are 22 base64 characters and two of padding
+  if (key.size() != 24 || key[22] != '=' || key[23] != '=') {
+    return false;
+  }
+  for (size_t i = 0; i < 22; i++) {
+    if (key[i] == '\0' || strchr(kBase64Chars, key[i]) == nullptr) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void MaskWebSocketPayload(char* data, size_t len, const char key[4]) {
+  uint32_t key32;
+  memcpy(&key32, key, 4);
+  size_t i = 0;
+#ifdef __SSE2__
+  const __m128i mask = _mm_set1_epi32(static_cast<int>(key32));
+  for (; i + 64 <= len; i += 64) {
+    __m128i* p = reinterpret_cast<__m128i*>(data + i);
+    __m128i v0 = _mm_loadu_si128(p);
+    __m128i v1 = _mm_loadu_si128(p + 1);
+    __m128i v2 = _mm_loadu_si128(p + 2);
+    __m128i v3 = _mm_loadu_si128(p + 3);
+    _mm_storeu_si128(p, _mm_xor_si128(v0, mask));
+    _mm_storeu_si128(p + 1, _mm_xor_si128(v1, mask));
+    _mm_storeu_si128(p + 2, _mm_xor_si128(v2, mask));
+    _mm_storeu_si128(p + 3, _mm_xor_si128(v3, mask));
+  }
+  for (; i + 16 <= len; i += 16) {
+    __m128i* p = reinterpret_cast<__m128i*>(data + i);
+    _mm_storeu_si128(p, _mm_xor_si128(_mm_loadu_si128(p), mask));
+  }
+#endif
+  // i is a multiple of 4 here, so the key starts over
+  uint64_t key64 = (uint64_t(key32) << 32) | key32;
+  for (; i + 8 <= len; i += 8) {
+    uint64_t v;
+    memcpy(&v, data + i, 8);
+    v ^= key64;
+    memcpy(data + i, &v, 8);
+  }
+  for (; i < len; i++) {
+    data[i] ^= key[i & 3];
+  }
+}
+
+bool ValidUTF8(std::string_view data) {
+  const unsigned char* p = reinterpret_cast<const unsigned char*>(data.data());
+  size_t len = data.size();
+  size_t i = 0;
+  while (i < len) {
+    // ASCII runs are checked 8 bytes at a time
+    if (i + 8 <= len) {
+      uint64_t v;
+      memcpy(&v, p + i, 8);
+      if ((v & 0x8080808080808080ULL) == 0) {
+        i += 8;
+        continue;
+      }
+    }
+    unsigned char c = p[i];
+    if (c < 0x80) {
+      i++;
+      continue;
+    }
+    size_t n;
+    uint32_t cp;
+    if ((c & 0xe0) == 0xc0) {
+      n = 1;
+      cp = c & 0x1f;
+    } else if ((c & 0xf0) == 0xe0) {
+      n = 2;
+      cp = c & 0x0f;
+    } else if ((c & 0xf8) == 0xf0) {
+      n = 3;
+      cp = c & 0x07;
+    } else {
+      return false;
+    }
+    if (i + n >= len) {
+      // truncated sequence
+      return false;
+    }
+    for (size_t j = 1; j <= n; j++) {
+      if ((p[i + j] & 0xc0) != 0x80) {
+        return false;
+      }
+      cp = (cp << 6) | (p[i + j] & 0x3f);
+    }
+    // overlong forms, surrogates and code points past U+10FFFF
+    if ((n == 1 && cp < 0x80) || (n == 2 && cp < 0x800) ||
+        (n == 3 && cp < 0x10000) || cp > 0x10ffff ||
+        (cp >= 0xd800 && cp <= 0xdfff)) {
+      return false;
+    }
+    i += n + 1;
+  }
+  return true;
+}
+
+// Write the header of a server frame, which is never masked, and return its
+// size, at most 10 bytes.
+static size_t WriteFrameHeader(uint8_t head, size_t len, char* out) {
+  size_t n = 0;
+  out[n++] = static_cast<char>(head);
+  if (len < 126) {
+    out[n++] = static_cast<char>(len);
+  } else if (len <= 0xffff) {
+    out[n++] = 126;
+    out[n++] = static_cast<char>(len >> 8);
+    out[n++] = static_cast<char>(len);
+  } else {
+    out[n++] = 127;
+    for (int shift = 56; shift >= 0; shift -= 8) {
+      out[n++] = static_cast<char>(uint64_t(len) >> shift);
+    }
+  }
+  return n;
+}
+
+WebSocketFramePtr MakeWebSocketFrame(WebSocketOpcode opcode,
+                                     std::string_view payload) {
+  char head[10];
+  size_t n = WriteFrameHeader(kFin | static_cast<uint8_t>(opcode), payload.size(),
+                              head);
+  auto frame = std::make_shared<std::string>();
+  frame->reserve(n + payload.size());
+  frame->append(head, n);
+  frame->append(payload);
+  return frame;
+}
+
+WebSocketConn::WebSocketConn(ReactorConn* conn, const WebSocketLimits& limits,
+                             std::shared_ptr<const WebSocketHandlers> handlers)
+    : TCPConn(conn), limits_(limits), handlers_(std::move(handlers)) {
+  if (conn != nullptr) {
+    loop_ = conn->GetLoop();
+  }
+}
+
+WebSocketConn::~WebSocketConn() {}
+
+void WebSocketConn::Open() {
+  if (loop_ != nullptr && limits_.ping_interval_ms > 0) {
+    std::weak_ptr<WebSocketConn> weak = shared_from_this();
+    ping_timer_ = loop_->RunEvery(limits_.ping_interval_ms, [weak]() {
+      WebSocketConnPtr ws = weak.lock();
+      if (ws != nullptr) {
+        ws->OnPingTimer();
+      }
+    });
+  }
+  if (handlers_->on_open != nullptr) {
+    handlers_->on_open(shared_from_this());
+  }
+  Feed();
+}
+
+void WebSocketConn::Feed() {
+  // handlers may drop the last reference of the connection
+  WebSocketConnPtr self = shared_from_this();
+  feeding_ = true;
+  while (!closed_ && !close_received_ && !failed_) {
+    size_t avail = read_buf_.Size();
+    if (avail < 2) {
+      break;
+    }
+    const unsigned char* p =
+        reinterpret_cast<const unsigned char*>(read_buf_.BeginReadPointer());
+    uint8_t head = p[0];
+    if ((p[1] & kMasked) == 0) {
+      // clients must mask every frame
+      Fail(kWebSocketProtocolError);
+      break;
+    }
+    uint64_t len = p[1] & 0x7f;
+    size_t hlen = 2;
+    if (len == 126) {
+      hlen = 4;
+      if (avail < hlen) {
+        break;
+      }
+      len = (uint64_t(p[2]) << 8) | p[3];
+    } else if (len == 127) {
+      hlen = 10;
+      if (avail < hlen) {
+        break;
+      }
+      len = 0;
+      for (int i = 2; i < 10; i++) {
+        len = (len << 8) | p[i];
+      }
+    }
+    // the whole message must fit, the frame is held in the read buffer until it
+    // is complete
+    if (len > limits_.max_message_size ||
+        message_.size() + len > limits_.max_message_size) {
+      Fail(kWebSocketMessageTooBig);
+      break;
+    }
+    if (avail < hlen + 4 + len) {
+      break;
+    }
+    char* payload = read_buf_.BufferFront() + read_buf_.BeginRead() + hlen + 4;
+    MaskWebSocketPayload(payload, len, payload - 4);
+    heard_ = true;
+    ping_sent_ = false;
+    bool ok = OnFrame(head, payload, len);
+    read_buf_.ReaderIdxForward(hlen + 4 + len);
+    if (!ok) {
+      break;
+    }
+  }
+  if (read_buf_.Empty()) {
+    read_buf_.Reset();
+  }
+  feeding_ = false;
+}
+
+bool WebSocketConn::OnFrame(uint8_t head, char* payload, size_t len) {
+  if (head & kReserved) {
+    // no extension was negotiated
+    Fail(kWebSocketProtocolError);
+    return false;
+  }
+  bool fin = head & kFin;
+  auto opcode = static_cast<WebSocketOpcode>(head & kOpcodeMask);
+  std::string_view data(payload, len);
+  switch (opcode) {
+    case WebSocketOpcode::Close:
+    case WebSocketOpcode::Ping:
+    case WebSocketOpcode::Pong:
+      if (!fin || len > kMaxControlPayload) {
+        Fail(kWebSocketProtocolError);
+        return false;
+      }
+      return OnControlFrame(opcode, data);
+    case WebSocketOpcode::Text:
+    case WebSocketOpcode::Binary:
+      if (message_opcode_ != WebSocketOpcode::Continuation) {
+        // the previous message is not finished
+        Fail(kWebSocketProtocolError);
+        return false;
+      }
+      if (fin) {
+        // unfragmented, straight from the read buffer
+        DeliverMessage(opcode, data);
+        return !failed_;
+      }
+      message_opcode_ = opcode;
+      message_.assign(data);
+      return true;
+    case WebSocketOpcode::Continuation:
+      if (message_opcode_ == WebSocketOpcode::Continuation) {
+        Fail(kWebSocketProtocolError);
+        return false;
+      }
+      message_.append(data);
+      if (fin) {
+        opcode = message_opcode_;
+        message_opcode_ = WebSocketOpcode::Continuation;
+        DeliverMessage(opcode, message_);
+        message_.clear();
+        if (message_.capacity() > (64 << 10)) {
+          // do not keep the memory of a large message
+          std::string().swap(message_);
+        }
+      }
+      return !failed_;
+    default:
+      Fail(kWebSocketProtocolError);
+      return false;
+  }
+}
+
+bool WebSocketConn::OnControlFrame(WebSocketOpcode opcode,
+                                   std::string_view payload) {
+  if (opcode == WebSocketOpcode::Ping) {
+    if (!close_sent_) {
+      WriteFrame(kFin | static_cast<uint8_t>(WebSocketOpcode::Pong), payload);
+    }
+    return true;
+  }
+  if (opcode == WebSocketOpcode::Pong) {
+    return true;
+  }
+  // close
+  uint16_t code = kWebSocketNoStatus;
+  std::string_view reason;
+  if (payload.size() == 1) {
+    Fail(kWebSocketProtocolError);
+    return false;
+  }
+  if (payload.size() >= 2) {
+    code = (uint16_t(static_cast<unsigned char>(payload[0])) << 8) |
+           static_cast<unsigned char>(payload[1]);
+    reason = payload.substr(2);
+    bool valid = (code >= 1000 && code <= 1003) || (code >= 1007 && code <= 1011) ||
+                 (code >= 3000 && code <= 4999);
+    if (!valid) {
+      Fail(kWebSocketProtocolError);
+      return false;
+    }
+    if (!ValidUTF8(reason)) {
+      Fail(kWebSocketInvalidData);
+      return false;
+    }
+  }
+  close_received_ = true;
+  close_code_ = code;
+  close_reason_.assign(reason);
+  if (!close_sent_) {
+    // echo the status code
+    Close(code == kWebSocketNoStatus ? kWebSocketNormalClosure : code);
+  }
+  return false;
+}
+
+void WebSocketConn::DeliverMessage(WebSocketOpcode opcode,
+                                   std::string_view payload) {
+  if (opcode == WebSocketOpcode::Text && !ValidUTF8(payload)) {
+    Fail(kWebSocketInvalidData);
+    return;
+  }
+  if (close_sent_) {
+    // data after our close frame is ignored
+    return;
+  }
+  if (handlers_->on_message != nullptr) {
+    handlers_->on_message(shared_from_this(), opcode, payload);
+  }
+}
+
+void WebSocketConn::WriteFrame(uint8_t head, std::string_view payload) {
+  bool was_empty = write_buf_.Empty();
+  char header[10];
+  size_t n = WriteFrameHeader(head, payload.size(), header);
+  write_buf_.EnsureBytesForWrite(n + payload.size());
+  write_buf_.Append(header, n);
+  write_buf_.Append(payload.data(), payload.size());
+  Flush(was_empty);
+}
+
+void WebSocketConn::Flush(bool was_empty) {
+  if (write_buf_.Size() > limits_.max_write_buffer) {
+    // the peer does not keep up
+    Abort();
+    return;
+  }
+  // a non-empty write buffer is already watched, and Feed() is followed by the
+  // reactor watching it
+  if (was_empty && !feeding_ && conn_ != nullptr && !closed_) {
+    conn_->Resume();
+  }
+}
+
+bool WebSocketConn::Send(WebSocketOpcode opcode, std::string_view payload) {
+  bool control = static_cast<uint8_t>(opcode) & 0x8;
+  if (!Writable() || opcode == WebSocketOpcode::Close ||
+      opcode == WebSocketOpcode::Continuation ||
+      (control && payload.size() > kMaxControlPayload) ||
+      (!control && sending_fragments_)) {
+    return false;
+  }
+  WriteFrame(kFin | static_cast<uint8_t>(opcode), payload);
+  return true;
+}
+
+bool WebSocketConn::SendFragment(WebSocketOpcode opcode, std::string_view payload,
+                                 bool fin) {
+  if (!Writable() ||
+      (opcode != WebSocketOpcode::Text && opcode != WebSocketOpcode::Binary)) {
+    return false;
+  }
+  uint8_t head = fin ? kFin : 0;
+  if (!sending_fragments_) {
+    head |= static_cast<uint8_t>(opcode);
+  }
+  sending_fragments_ = !fin;
+  WriteFrame(head, payload);
+  return true;
+}
+
+bool WebSocketConn::SendFrame(const WebSocketFramePtr& frame) {
+  if (!Writable() || sending_fragments_) {
+    return false;
+  }
+  bool was_empty = write_buf_.Empty();
+  write_buf_.Append(frame->data(), frame->size());
+  Flush(was_empty);
+  return true;
+}
+
+void WebSocketConn::Close(uint16_t code, std::string_view reason) {
+  if (closed_ || close_sent_) {
+    return;
+  }
+  char payload[kMaxControlPayload];
+  payload[0] = static_cast<char>(code >> 8);
+  payload[1] = static_cast<char>(code);
+  size_t n = std::min(reason.size(), kMaxControlPayload - 2);
+  memcpy(payload + 2, reason.data(), n);
+  WriteFrame(kFin | static_cast<uint8_t>(WebSocketOpcode::Close),
+             std::string_view(payload, n + 2));
+  close_sent_ = true;
+}
+
+void WebSocketConn::Broadcast(const std::vector<WebSocketConnPtr>& conns,
+                              WebSocketOpcode opcode, std::string_view payload) {
+  if (conns.empty()) {
+    return;
+  }
+  WebSocketFramePtr frame = MakeWebSocketFrame(opcode, payload);
+  EventLoop* current = EventLoop::Current();
+  std::unordered_map<EventLoop*, std::vector<WebSocketConnPtr>> others;
+  for (const WebSocketConnPtr& conn : conns) {
+    if (conn->loop_ == current || conn->loop_ == nullptr) {
+      conn->SendFrame(frame);
+    } else {
+      others[conn->loop_].push_back(conn);
+    }
+  }
+  for (auto& entry : others) {
+    entry.first->QueueInLoop([frame, group = std::move(entry.second)]() {
+      for (const WebSocketConnPtr& conn : group) {
+        conn->SendFrame(frame);
+      }
+    });
+  }
+}
+
+void WebSocketConn::Fail(uint16_t code) {
+  failed_ = true;
+  close_code_ = code;
+  if (!close_sent_) {
+    Close(code);
+  }
+}
+
+void WebSocketConn::Abort() {
+  failed_ = true;
+  close_sent_ = true;
+  if (conn_ != nullptr && !closed_) {
+    // the reactor sees the end of the stream and closes the connection as usual
+    shutdown(conn_->GetFd(), SHUT_RDWR);
+  }
+}
+
+void WebSocketConn::OnPingTimer() {
+  if (closed_) {
+    return;
+  }
+  if (close_sent_ || (ping_sent_ && !heard_)) {
+    // no answer to our close frame or ping within one interval
+    Abort();
+    return;
+  }
+  if (!heard_) {
+    WriteFrame(kFin | static_cast<uint8_t>(WebSocketOpcode::Ping), {});
+    ping_sent_ = true;
+  }
+  heard_ = false;
+}
+
+void WebSocketConn::OnClosed() {
+  if (closed_) {
+    return;
+  }
+  closed_ = true;
+  status_ = Status::Closed;
+  if (ping_timer_ != 0 && loop_ != nullptr) {
+    loop_->CancelTimer(ping_timer_);
+  }
+  if (handlers_->on_close != nullptr) {
+    // the connection is still there, its name and addresses can be read
+    handlers_->on_close(shared_from_this(), close_code_, close_reason_);
+  }
+  conn_ = nullptr;
+}
+
+}  // namespace http
+}  // namespace ahrimq
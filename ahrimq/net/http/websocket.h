@@ -0,0 +1,253 @@
+#ifndef _AHRIMQ_NET_HTTP_WEBSOCKET_H_
+#define _AHRIMQ_NET_HTTP_WEBSOCKET_H_
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "net/eventloop.h"
+#include "net/http/http_request.h"
+#include "net/http/http_response.h"
+#include "net/http/http_router.h"
+#include "net/tcp/tcp_conn.h"
+
+namespace ahrimq {
+namespace http {
+
+class WebSocketConn;
+typedef std::shared_ptr<WebSocketConn> WebSocketConnPtr;
+
+/// @brief WebSocket frame opcodes (RFC 6455 section 5.2).
+enum class WebSocketOpcode : uint8_t {
+  Continuation = 0x0,
+  Text = 0x1,
+  Binary = 0x2,
+  Close = 0x8,
+  Ping = 0x9,
+  Pong = 0xa,
+};
+
+/// @brief WebSocket close status codes (RFC 6455 section 7.4.1).
+constexpr static uint16_t kWebSocketNormalClosure = 1000;
+constexpr static uint16_t kWebSocketGoingAway = 1001;
+constexpr static uint16_t kWebSocketProtocolError = 1002;
+constexpr static uint16_t kWebSocketUnsupportedData = 1003;
+// never sent, reported to on_close when the peer sent no status code
+constexpr static uint16_t kWebSocketNoStatus = 1005;
+// never sent, reported to on_close when the connection closed without a close
+// frame
+constexpr static uint16_t kWebSocketAbnormalClosure = 1006;
+constexpr static uint16_t kWebSocketInvalidData = 1007;
+constexpr static uint16_t kWebSocketPolicyViolation = 1008;
+constexpr static uint16_t kWebSocketMessageTooBig = 1009;
+constexpr static uint16_t kWebSocketInternalError = 1011;
+
+/// @brief Limits of the WebSocket connections of a server.
+struct WebSocketLimits {
+  // size of a message after its fragments are joined, larger ones close the
+  // connection with 1009
+  size_t max_message_size = 1 << 20;
+  // a connection silent for this long is pinged, and closed if it is still silent
+  // one more interval later, 0 disables pings
+  uint64_t ping_interval_ms = 30000;
+  // bytes waiting to be sent to a peer which does not read, beyond that the
+  // connection is dropped
+  size_t max_write_buffer = 8 << 20;
+};
+
+/// @brief A frame serialized once and shared by all connections it is sent to.
+typedef std::shared_ptr<const std::string> WebSocketFramePtr;
+
+/// @brief Callbacks of a WebSocket route. All of them run in the eventloop of the
+/// connection.
+struct WebSocketHandlers {
+  // decides on the upgrade request, accepts every request if empty. It may pick a
+  // subprotocol by setting Sec-WebSocket-Protocol on res, or refuse the request
+  // by returning false, with the status set on res or 403
+  std::function<bool(const HTTPRequest& req, HTTPResponse& res,
+                     const URLParams& params)>
+      on_upgrade;
+  // the handshake response is queued
+  std::function<void(const WebSocketConnPtr& conn)> on_open;
+  // a complete Text or Binary message, payload is valid during the call only
+  std::function<void(const WebSocketConnPtr& conn, WebSocketOpcode opcode,
+                     std::string_view payload)>
+      on_message;
+  // the connection is closed, with the status code the peer sent or 1006
+  std::function<void(const WebSocketConnPtr& conn, uint16_t code,
+                     std::string_view reason)>
+      on_close;
+};
+
+/// @brief Compute the Sec-WebSocket-Accept value for a Sec-WebSocket-Key.
+/// @param key
+/// @return
+std::string WebSocketAccept(std::string_view key);
+
+/// @brief Check if key is a valid Sec-WebSocket-Key, the base64 encoding of 16
+/// bytes.
+/// @param key
+/// @return
+bool ValidWebSocketKey(std::string_view key);
+
+/// @brief XOR data with the 4-byte masking key repeated, which masks and unmasks
+/// payloads alike. 16 bytes are done at a time where SSE2 is available.
+/// @param data
+/// @param len
+/// @param key
+void MaskWebSocketPayload(char* data, size_t len, const char key[4]);
+
+/// @brief Check if data is valid UTF-8, as Text messages must be.
+/// @param data
+/// @return
+bool ValidUTF8(std::string_view data);
+
+/// @brief Serialize an unfragmented server frame.
+/// @param opcode
+/// @param payload
+/// @return
+WebSocketFramePtr MakeWebSocketFrame(WebSocketOpcode opcode,
+                                     std::string_view payload);
+
+/// @brief WebSocketConn is a connection which switched from HTTP/1.1 to the
+/// WebSocket protocol. It takes over the connection and its buffers from the
+/// HTTP connection which handled the handshake. Frames are parsed from the read
+/// buffer, unmasked in place and handed to the handlers, and what is sent goes into
+/// the write buffer.
+///
+/// Except for Broadcast(), methods must be called in the eventloop of the
+/// connection.
+class WebSocketConn : public TCPConn,
+                      public std::enable_shared_from_this<WebSocketConn> {
+ public:
+  /// @brief Construct a WebSocket connection.
+  /// @param conn the connection, may be nullptr in tests
+  /// @param limits
+  /// @param handlers
+  WebSocketConn(ReactorConn* conn, const WebSocketLimits& limits,
+                std::shared_ptr<const WebSocketHandlers> handlers);
+
+  ~WebSocketConn();
+
+  /// @brief Start the ping timer, call on_open and process the frames which came
+  /// with the handshake.
+  void Open();
+
+  /// @brief Process the frames received so far, complete frames are consumed.
+  void Feed();
+
+  /// @brief Send an unfragmented message, or a ping or pong.
+  /// @param opcode
+  /// @param payload
+  /// @return false if the connection is closing, or for a message while a
+  /// fragmented one is being sent
+  bool Send(WebSocketOpcode opcode, std::string_view payload);
+
+  /// @brief Send one fragment of a message, so that a message can be streamed
+  /// before its size is known. The opcode of the first fragment is the one of the
+  /// message, the others are sent as continuations. Control frames may be sent
+  /// between fragments.
+  /// @param opcode Text or Binary
+  /// @param payload
+  /// @param fin true for the last fragment
+  /// @return false if the connection is closing
+  bool SendFragment(WebSocketOpcode opcode, std::string_view payload, bool fin);
+
+  /// @brief Send a frame serialized by MakeWebSocketFrame().
+  /// @param frame
+  /// @return false if the connection is closing or a fragmented message is being
+  /// sent
+  bool SendFrame(const WebSocketFramePtr& frame);
+
+  /// @brief Start the closing handshake. The connection is closed once the peer
+  /// answers, or after one ping interval.
+  /// @param code
+  /// @param reason at most 123 bytes
+  void Close(uint16_t code = kWebSocketNormalClosure, std::string_view reason = {});
+
+  /// @brief Send one message to many connections, from any thread. The frame is
+  /// serialized once and shared, connections of other eventloops get it through
+  /// one task per eventloop.
+  /// @param conns
+  /// @param opcode
+  /// @param payload
+  static void Broadcast(const std::vector<WebSocketConnPtr>& conns,
+                        WebSocketOpcode opcode, std::string_view payload);
+
+  /// @brief Check if the connection can be closed once the write buffer is flushed,
+  /// after the closing handshake or a protocol error.
+  /// @return
+  bool Finished() const {
+    return close_sent_ && (close_received_ || failed_);
+  }
+
+  /// @brief Check if messages can still be sent.
+  /// @return
+  bool Writable() const {
+    return !closed_ && !close_sent_;
+  }
+
+  /// @brief Get the eventloop of the connection.
+  /// @return nullptr in tests
+  EventLoop* GetLoop() const {
+    return loop_;
+  }
+
+  /// @brief The underlying connection was closed, report it to on_close.
+  void OnClosed();
+
+ private:
+  // append a frame to the write buffer and make sure it is written
+  void WriteFrame(uint8_t head, std::string_view payload);
+
+  // the write buffer grew, watch the connection for writing unless it already is
+  void Flush(bool was_empty);
+
+  // handle one complete frame, false once the connection failed
+  bool OnFrame(uint8_t head, char* payload, size_t len);
+
+  bool OnControlFrame(WebSocketOpcode opcode, std::string_view payload);
+
+  void DeliverMessage(WebSocketOpcode opcode, std::string_view payload);
+
+  // send a close frame with code and stop processing frames
+  void Fail(uint16_t code);
+
+  // drop the connection without a closing handshake
+  void Abort();
+
+  void OnPingTimer();
+
+ private:
+  WebSocketLimits limits_;
+  std::shared_ptr<const WebSocketHandlers> handlers_;
+  EventLoop* loop_ = nullptr;
+  TimerId ping_timer_ = 0;
+
+  // fragments of the message being received
+  std::string message_;
+  WebSocketOpcode message_opcode_ = WebSocketOpcode::Continuation;
+
+  // a fragmented message is being sent
+  bool sending_fragments_ = false;
+  // Feed() is running, the reactor watches the write buffer afterwards
+  bool feeding_ = false;
+  // something was received since the last tick of the ping timer
+  bool heard_ = true;
+  bool ping_sent_ = false;
+  bool close_sent_ = false;
+  bool close_received_ = false;
+  // a protocol error occurred
+  bool failed_ = false;
+  bool closed_ = false;
+  uint16_t close_code_ = kWebSocketAbnormalClosure;
+  std::string close_reason_;
+};
+
+}  // namespace http
+}  // namespace ahrimq
+
+#endif  // _AHRIMQ_NET_HTTP_WEBSOCKET_H_
@@ -0,0 +1,223 @@
+#include "ahrimq/net/http/websocket.h"
+
+#include <gtest/gtest.h>
+
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace ahrimq;
+using namespace ahrimq::http;
+
+static const char kKey[4] = {0x37, static_cast<char>(0xfa), 0x21, 0x3d};
+
+// A frame as a client sends it, masked with kKey.
+static std::string ClientFrame(uint8_t head, std::string payload) {
+  std::string out;
+  out.push_back(static_cast<char>(head));
+  size_t len = payload.size();
+  if (len < 126) {
+    out.push_back(static_cast<char>(0x80 | len));
+  } else if (len <= 0xffff) {
+    out.push_back(static_cast<char>(0x80 | 126));
+    out.push_back(static_cast<char>(len >> 8));
+    out.push_back(static_cast<char>(len));
+  } else {
+    out.push_back(static_cast<char>(0x80 | 127));
+    for (int shift = 56; shift >= 0; shift -= 8) {
+      out.push_back(static_cast<char>(uint64_t(len) >> shift));
+    }
+  }
+  out.append(kKey, 4);
+  for (size_t i = 0; i < len; i++) {
+    payload[i] ^= kKey[i % 4];
+  }
+  return out + payload;
+}
+
+static std::string CloseCode(uint16_t code) {
+  std::string out;
+  out.push_back(static_cast<char>(code >> 8));
+  out.push_back(static_cast<char>(code));
+  return out;
+}
+
+TEST(WebSocketTest, HandshakeTest) {
+  // RFC 6455 section 1.3
+  EXPECT_EQ(WebSocketAccept("dGhlIHNhbXBsZSBub25jZQ=="),
+            "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=");
+  EXPECT_TRUE(ValidWebSocketKey("dGhlIHNhbXBsZSBub25jZQ=="));
+  EXPECT_FALSE(ValidWebSocketKey("dGhlIHNhbXBsZSBub25jZQ="));
+  EXPECT_FALSE(ValidWebSocketKey("dGhlIHNhbXBsZSBub25j*Q=="));
+  EXPECT_FALSE(ValidWebSocketKey(""));
+}
+
+TEST(WebSocketTest, MaskTest) {
+  std::mt19937 rng(7);
+  for (size_t len = 0; len < 300; len++) {
+    std::string data(len, '\0');
+    for (char& c : data) {
+      c = static_cast<char>(rng());
+    }
+    std::string expected = data;
+    for (size_t i = 0; i < len; i++) {
+      expected[i] ^= kKey[i % 4];
+    }
+    std::string masked = data;
+    MaskWebSocketPayload(&masked[0], len, kKey);
+    ASSERT_EQ(masked, expected) << len;
+    MaskWebSocketPayload(&masked[0], len, kKey);
+    ASSERT_EQ(masked, data) << len;
+  }
+}
+
+TEST(WebSocketTest, UTF8Test) {
+  EXPECT_TRUE(ValidUTF8(""));
+  EXPECT_TRUE(ValidUTF8("plain ascii text, longer than eight bytes"));
+  EXPECT_TRUE(ValidUTF8("\xce\xba\xe1\xbd\xb9\xcf\x83\xce\xbc\xce\xb5"));
+  EXPECT_TRUE(ValidUTF8("\xf0\x9f\x98\x80 emoji"));
+  // truncated, overlong, surrogate and past U+10FFFF
+  EXPECT_FALSE(ValidUTF8("abc\xce"));
+  EXPECT_FALSE(ValidUTF8("\xc0\xaf"));
+  EXPECT_FALSE(ValidUTF8("\xed\xa0\x80"));
+  EXPECT_FALSE(ValidUTF8("\xf4\x90\x80\x80"));
+  EXPECT_FALSE(ValidUTF8("\xff"));
+}
+
+// A client driving a connection without a socket: frames are fed through the read
+// buffer and what the server sent is taken out of the write buffer.
+class WebSocketConnTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    auto handlers = std::make_shared<WebSocketHandlers>();
+    handlers->on_message = [this](const WebSocketConnPtr& conn,
+                                  WebSocketOpcode opcode, std::string_view payload) {
+      messages_.emplace_back(opcode, std::string(payload));
+    };
+    handlers->on_close = [this](const WebSocketConnPtr& conn, uint16_t code,
+                                std::string_view reason) {
+      close_code_ = code;
+    };
+    WebSocketLimits limits;
+    limits.max_message_size = 1024;
+    conn_ = std::make_shared<WebSocketConn>(nullptr, limits, handlers);
+    conn_->Open();
+  }
+
+  void Send(const std::string& bytes) {
+    conn_->GetReadBuffer().Append(bytes);
+    conn_->Feed();
+  }
+
+  std::string Sent() {
+    return conn_->GetWriteBuffer().ReadAllAsString();
+  }
+
+  WebSocketConnPtr conn_;
+  std::vector<std::pair<WebSocketOpcode, std::string>> messages_;
+  uint16_t close_code_ = 0;
+};
+
+TEST_F(WebSocketConnTest, MessageTest) {
+  // a frame arriving in pieces, then a fragmented message with a ping in between
+  std::string frame = ClientFrame(0x81, "hello");
+  Send(frame.substr(0, 3));
+  EXPECT_TRUE(messages_.empty());
+  Send(frame.substr(3) + ClientFrame(0x02, "ab") + ClientFrame(0x89, "p") +
+       ClientFrame(0x00, "cd") + ClientFrame(0x80, std::string(300, 'e')));
+  ASSERT_EQ(messages_.size(), 2u);
+  EXPECT_EQ(messages_[0].first, WebSocketOpcode::Text);
+  EXPECT_EQ(messages_[0].second, "hello");
+  EXPECT_EQ(messages_[1].first, WebSocketOpcode::Binary);
+  EXPECT_EQ(messages_[1].second, "abcd" + std::string(300, 'e'));
+  EXPECT_EQ(Sent(), std::string("\x8a\x01p", 3));
+
+  // server frames are not masked, lengths past 125 take 2 more bytes
+  ASSERT_TRUE(conn_->Send(WebSocketOpcode::Text, "hi"));
+  EXPECT_EQ(Sent(), "\x81\x02hi");
+  ASSERT_TRUE(conn_->Send(WebSocketOpcode::Binary, std::string(200, 'x')));
+  EXPECT_EQ(Sent(), std::string("\x82\x7e\x00\xc8", 4) + std::string(200, 'x'));
+
+  // a streamed message, data frames wait until it is finished
+  ASSERT_TRUE(conn_->SendFragment(WebSocketOpcode::Text, "a", false));
+  EXPECT_FALSE(conn_->Send(WebSocketOpcode::Text, "b"));
+  ASSERT_TRUE(conn_->Send(WebSocketOpcode::Ping, ""));
+  ASSERT_TRUE(conn_->SendFragment(WebSocketOpcode::Text, "c", true));
+  EXPECT_EQ(Sent(), std::string("\x01\x01" "a" "\x89\x00" "\x80\x01" "c", 8));
+}
+
+TEST_F(WebSocketConnTest, CloseTest) {
+  Send(ClientFrame(0x88, CloseCode(1001) + "bye") + ClientFrame(0x81, "late"));
+  EXPECT_TRUE(messages_.empty());
+  // the status code is echoed
+  EXPECT_EQ(Sent(), "\x88\x02" + CloseCode(1001));
+  EXPECT_TRUE(conn_->Finished());
+  EXPECT_FALSE(conn_->Send(WebSocketOpcode::Text, "x"));
+  conn_->OnClosed();
+  EXPECT_EQ(close_code_, 1001);
+}
+
+TEST_F(WebSocketConnTest, ServerCloseTest) {
+  conn_->Close(kWebSocketGoingAway, "restart");
+  EXPECT_EQ(Sent(), "\x88\x09" + CloseCode(1001) + "restart");
+  EXPECT_FALSE(conn_->Finished());
+  // messages crossing our close frame are dropped
+  Send(ClientFrame(0x81, "x") + ClientFrame(0x88, CloseCode(1001)));
+  EXPECT_TRUE(messages_.empty());
+  EXPECT_EQ(Sent(), "");
+  EXPECT_TRUE(conn_->Finished());
+}
+
+TEST_F(WebSocketConnTest, ErrorTest) {
+  struct {
+    std::string bytes;
+    uint16_t code;
+  } cases[] = {
+      // unmasked, reserved bits, unknown opcode, a lone continuation
+      {"\x81\x01x", kWebSocketProtocolError},
+      {ClientFrame(0xc1, "x"), kWebSocketProtocolError},
+      {ClientFrame(0x83, "x"), kWebSocketProtocolError},
+      {ClientFrame(0x80, "x"), kWebSocketProtocolError},
+      // a fragmented ping, a new message before the last one is finished
+      {ClientFrame(0x09, ""), kWebSocketProtocolError},
+      {ClientFrame(0x01, "a") + ClientFrame(0x81, "b"), kWebSocketProtocolError},
+      {ClientFrame(0x81, "\xff"), kWebSocketInvalidData},
+      {ClientFrame(0x88, CloseCode(1005)), kWebSocketProtocolError},
+      // too large at once, and in fragments
+      {ClientFrame(0x82, std::string(1025, 'x')), kWebSocketMessageTooBig},
+      {ClientFrame(0x02, std::string(1000, 'x')) +
+           ClientFrame(0x80, std::string(30, 'x')),
+       kWebSocketMessageTooBig},
+  };
+  for (const auto& c : cases) {
+    SetUp();
+    Send(c.bytes);
+    EXPECT_EQ(Sent(), "\x88\x02" + CloseCode(c.code)) << c.code;
+    EXPECT_TRUE(conn_->Finished());
+    EXPECT_TRUE(messages_.empty() || c.code == kWebSocketMessageTooBig);
+    messages_.clear();
+  }
+}
+
+TEST(WebSocketTest, BroadcastTest) {
+  auto handlers = std::make_shared<WebSocketHandlers>();
+  std::vector<WebSocketConnPtr> conns;
+  for (int i = 0; i < 3; i++) {
+    conns.push_back(std::make_shared<WebSocketConn>(nullptr, WebSocketLimits(),
+                                                    handlers));
+  }
+  conns[2]->Close();
+  conns[2]->GetWriteBuffer().Reset();
+  WebSocketConn::Broadcast(conns, WebSocketOpcode::Text, "news");
+  EXPECT_EQ(conns[0]->GetWriteBuffer().ReadAllAsString(), "\x81\x04news");
+  EXPECT_EQ(conns[1]->GetWriteBuffer().ReadAllAsString(), "\x81\x04news");
+  // closing connections are skipped
+  EXPECT_TRUE(conns[2]->GetWriteBuffer().Empty());
+  EXPECT_EQ(*MakeWebSocketFrame(WebSocketOpcode::Text, "news"), "\x81\x04news");
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -1,5 +1,7 @@
 #include "net/reactor.h"
 
+#include <algorithm>
+
 using namespace std::placeholders;  // _1, _2
 
 namespace ahrimq {
@@ -67,6 +69,12 @@ void Reactor::Stop() {
 
 void Reactor::CloseConnGuarded(ReactorConn* conn) {
   if (conn != nullptr) {
+    // the owner forgets the connection whatever the reason it is closed for, so
+    // that nothing refers to it once it is gone
+    if (ev_close_handler_ != nullptr) {
+      bool close_after = false;
+      ev_close_handler_(conn, close_after);
+    }
     // conn->loop_->epoller->DetachConn(conn); and close(conn->fd_); already done in
     // ReactorConn::~ReactorConn
     mtx_.lock();
@@ -209,13 +217,9 @@ void Reactor::Reader(ReactorConn* conn, bool& closed) {
   // size_t n = ReadToBuffer(fd, *rbuf, &rflag);  // FIXME bugs here
   if (n == 0 && rflag == READ_SOCKET_CLOSED) {
     // connection closed
-    if (ev_close_handler_ != nullptr) {
-      bool close_after = false;
-      ev_close_handler_(conn, close_after);
-      CloseConnGuarded(conn);
-      closed = true;
-      return;
-    }
+    CloseConnGuarded(conn);
+    closed = true;
+    return;
   } else {
     if (rflag == READ_PROCESS_ERROR) {
       CloseConnGuarded(conn);
@@ -233,27 +237,40 @@ void Reactor::Reader(ReactorConn* conn, bool& closed) {
         return;
       }
     }
-    if (conn->write_buf_->Size() > 0) {
+    if (conn->suspended_) {
+      // the owner re-arms the connection for reading once it is done with the
+      // request, what is queued before it is sent in the meantime
+      conn->Suspend();
+      return;
+    }
+    if (conn->OutputPending()) {
       conn->SetMaskWrite();
-      // every thread has its own epoller
-      conn->loop_->epoller->ModifyConn(conn);
+    } else {
+      // nothing to answer yet, wait for the rest of the request
+      conn->SetMaskRead();
     }
+    // every thread has its own epoller
+    conn->loop_->epoller->ModifyConn(conn);
   }
 }
 
-void Reactor::SendFileAndUpdate(ReactorConn* conn, int outfd) {
-  int infd = conn->file_state_.fd_ready_;
-  size_t offset = conn->file_state_.offset_;
-  size_t target_len = conn->file_state_.target_size_ - offset;
-  size_t file_sent_bytes = SendFile(infd, outfd, offset, target_len);
+size_t Reactor::SendFileAndUpdate(ReactorConn* conn, int outfd) {
+  ReactorConn::FileRegion& region = conn->files_.front();
+  size_t file_sent_bytes = SendFile(region.fd, outfd, region.offset, region.length);
   // update file state
-  conn->file_state_.offset_ += file_sent_bytes;
-  conn->file_state_.target_size_ -= file_sent_bytes;
+  region.offset += file_sent_bytes;
+  region.length -= file_sent_bytes;
+  return file_sent_bytes;
 }
 
 // ATTENTION: this method may be invoked in multiple threads
 bool Reactor::InvokeWriteDoneHandler(ReactorConn* conn, Buffer* wbuf) {
   bool closed = false;
+  if (conn->suspended_) {
+    // the owner is still answering a request and re-arms the connection once done
+    wbuf->Reset();
+    return closed;
+  }
   conn->SetMaskRead();
   // every thread has its own epoller
   conn->loop_->epoller->ModifyConn(conn);
@@ -271,7 +288,10 @@ bool Reactor::InvokeWriteDoneHandler(ReactorConn* conn, Buffer* wbuf) {
 
 // EPOLLOUT handler
 // ATTENTION!!: this method is called in multiple thread;
-// all we do in this method is to write out all bytes in conn->write_buf_
+// all we do in this method is to write out all bytes in conn->write_buf_ and then
+// the attached file. When the socket can not take everything, what is left is kept
+// and the connection waits for the next EPOLLOUT, without reading new requests in
+// the meantime.
 void Reactor::Writer(ReactorConn* conn, bool& closed) {
   int fd = conn->fd_;
   if (fd == -1) {
@@ -283,65 +303,75 @@ void Reactor::Writer(ReactorConn* conn, bool& closed) {
     std::cerr << "[" << conn->GetName() << "] wbuf is nullptr, invalid status!!\n";
     return;
   }
-  if (wbuf->Size() <= 0) {
+  if (!conn->OutputPending()) {
+    if (conn->suspended_) {
+      // only sending is watched until the owner resumes the connection
+      return;
+    }
+    // nothing to write
     conn->SetMaskRead();
     // every thread has its own epoller
     conn->loop_->epoller->ModifyConn(conn);
     return;
   }
-  size_t n = wbuf->Size();
-  if (n == 0) {  // write buffer is all sent, by file is partially sent
-    // check file is needed to send
-    if (conn->FileNeedSending()) {
-      // send file
-      SendFileAndUpdate(conn, fd);
-      if (conn->file_state_.target_size_ == 0) {
-        // we have already send all write buffer data and file has been sent
-        bool conn_closed = InvokeWriteDoneHandler(conn, wbuf);
-        if (conn->file_state_.close_after_) {
-          close(conn->file_state_.fd_ready_);  // close file
-        }
-        if (conn_closed) {  // close remote socket
+  while (true) {
+    // write the buffer up to the next file due, or all of it
+    ReactorConn::FileRegion* region =
+        conn->files_.empty() ? nullptr : &conn->files_.front();
+    size_t n = wbuf->Size();
+    if (region != nullptr) {
+      n = std::min(n, region->wbuf_bytes);
+    }
+    if (n > 0) {
+      errno = 0;
+      size_t nbytes = FixedSizeWriteFromBuf(
+          fd, static_cast<const char*>(wbuf->BeginReadPointer()), n);
+      // consume what has been sent so that it is never sent twice
+      wbuf->ReaderIdxForward(nbytes);
+      conn->WriteBufferSent(nbytes);
+      if (nbytes < n) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+          if (conn->suspended_) {
+            // the owner still refers to the connection, the error shows again
+            // once it resumes it
+            return;
+          }
+          // we consider this as an invalid state
+          CloseConnGuarded(conn);
           closed = true;
           return;
         }
+        conn->SetMaskWriteOnly();
+        conn->loop_->epoller->ModifyConn(conn);
+        return;
       }
     }
-  }
-  size_t nbytes = FixedSizeWriteFromBuf(
-      fd, static_cast<const char*>(wbuf->BeginReadPointer()), n);
-  if (nbytes > 0) {
-    if (nbytes == n) {
-      // all bytes have been sent
-      if (conn->FileNeedSending()) {
-        // file sending is needed
-        SendFileAndUpdate(conn, fd);
-        if (conn->file_state_.target_size_ == 0) {
-          // we have already send all write buffer data and file has been sent
-          bool conn_closed = InvokeWriteDoneHandler(conn, wbuf);
-          if (conn->file_state_.close_after_) {
-            close(conn->file_state_.fd_ready_);
-          }
-          if (conn_closed) {
-            closed = true;
-            return;
-          }
-        }
-      } else {
-        // we don't need to send file
-        if (InvokeWriteDoneHandler(conn, wbuf)) {
-          closed = true;
+    if (region == nullptr) {
+      break;
+    }
+    errno = 0;  // sendfile stops without error if the file shrunk
+    SendFileAndUpdate(conn, fd);
+    if (region->length > 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        if (conn->suspended_) {
           return;
         }
+        CloseConnGuarded(conn);
+        closed = true;
+        return;
       }
-    } else {
-      // write not fully sent, we have to consume partial content
-      wbuf->ReaderIdxForward(nbytes);
+      // file partially sent
+      conn->SetMaskWriteOnly();
+      conn->loop_->epoller->ModifyConn(conn);
+      return;
     }
+    if (region->close_after) {
+      close(region->fd);  // close file
+    }
+    conn->files_.pop_front();
   }
-  if (nbytes == 0 && wbuf->Size() != 0) {
-    // we condiser this as an invalid state
-    CloseConnGuarded(conn);
+  // we have already send all write buffer data and file has been sent
+  if (InvokeWriteDoneHandler(conn, wbuf)) {
     closed = true;
   }
 }
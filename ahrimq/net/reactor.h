@@ -76,7 +76,7 @@ class Reactor : public NoCopyable {
 
   void Reader(ReactorConn* conn, bool& closed);
 
-  void SendFileAndUpdate(ReactorConn* conn, int outfd);
+  size_t SendFileAndUpdate(ReactorConn* conn, int outfd);
 
   bool InvokeWriteDoneHandler(ReactorConn* conn, Buffer* wbuf);
 
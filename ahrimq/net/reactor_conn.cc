@@ -1,5 +1,7 @@
 #include "net/reactor_conn.h"
 
+#include <algorithm>
+
 namespace ahrimq {
 ReactorConn::ReactorConn(int fd, uint32_t mask, const EpollEventHandler& rhandler,
                          const EpollEventHandler& whandler, EventLoop* loop,
@@ -23,24 +25,84 @@ ReactorConn::~ReactorConn() {
 }
 
 bool ReactorConn::PutFile(int fd, bool closeafter) {
-  file_state_.fd_ready_ = fd;
   struct stat statbuf = {0};
   if (fstat(fd, &statbuf) == -1) {
     return false;
   }
-  file_state_.target_size_ = statbuf.st_size;
-  file_state_.filesize_ = statbuf.st_size;
-  file_state_.offset_ = 0;
-  file_state_.close_after_ = closeafter;
+  return PutFile(fd, 0, statbuf.st_size, closeafter);
+}
+
+bool ReactorConn::PutFile(int fd, size_t offset, size_t length, bool closeafter) {
+  struct stat statbuf = {0};
+  if (fstat(fd, &statbuf) == -1 || offset + length > size_t(statbuf.st_size)) {
+    return false;
+  }
+  if (length == 0) {
+    // nothing to send, but the descriptor is still handed over
+    if (closeafter) {
+      close(fd);
+    }
+    return true;
+  }
+  FileRegion region;
+  region.fd = fd;
+  region.offset = offset;
+  region.length = length;
+  region.wbuf_bytes = kAfterWriteBuffer;
+  region.close_after = closeafter;
+  region.filesize = statbuf.st_size;
+  files_.push_back(region);
   return true;
 }
 
+void ReactorConn::PutFileRegion(int fd, size_t offset, size_t length,
+                                std::shared_ptr<const void> holder) {
+  if (length == 0) {
+    return;
+  }
+  FileRegion region;
+  region.fd = fd;
+  region.offset = offset;
+  region.length = length;
+  region.wbuf_bytes = write_buf_ != nullptr ? write_buf_->Size() : 0;
+  region.holder = std::move(holder);
+  files_.push_back(std::move(region));
+}
+
+void ReactorConn::WriteBufferSent(size_t n) {
+  for (auto& region : files_) {
+    if (region.wbuf_bytes != kAfterWriteBuffer) {
+      region.wbuf_bytes -= std::min(n, region.wbuf_bytes);
+    }
+  }
+}
+
+void ReactorConn::Suspend() {
+  suspended_ = true;
+  if (OutputPending()) {
+    // answers queued before the suspended request still leave
+    SetMaskWriteOnly();
+    loop_->epoller->ModifyConn(this);
+  }
+}
+
+void ReactorConn::Resume() {
+  suspended_ = false;
+  if (OutputPending()) {
+    SetMaskWrite();
+  } else {
+    SetMaskRead();
+  }
+  loop_->epoller->ModifyConn(this);
+}
+
 void ReactorConn::ResetFileState() {
-  file_state_.fd_ready_ = -1;
-  file_state_.target_size_ = 0;
-  file_state_.offset_ = 0;
-  file_state_.close_after_ = false;
-  file_state_.filesize_ = 0;
+  for (const auto& region : files_) {
+    if (region.close_after) {
+      close(region.fd);
+    }
+  }
+  files_.clear();
 }
 
-}  // namespace ahrimq
\ No newline at end of file
+}  // namespace ahrimq
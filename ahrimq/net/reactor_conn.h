@@ -3,6 +3,8 @@
 
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <cstdint>
+#include <deque>
 #include <memory>
 #include <queue>
 
@@ -37,10 +39,16 @@ class ReactorConn : public NoCopyable {
     return fd_;
   }
 
-  std::string GetName() const {
+  const std::string& GetName() const {
     return name_;
   }
 
+  /// @brief Get the eventloop this connection belongs to.
+  /// @return
+  EventLoop* GetLoop() const {
+    return loop_;
+  }
+
   Buffer* GetReadBuffer() const {
     return read_buf_;
   }
@@ -57,20 +65,65 @@ class ReactorConn : public NoCopyable {
     write_buf_ = wbuf;
   }
 
-  /// @brief Attach a file to send every writing time.
+  /// @brief Queue a file to send once the write buffer was written.
   /// @param fd
   /// @param closeafter
   /// @return
   bool PutFile(int fd, bool closeafter = false);
 
+  /// @brief Queue bytes [offset, offset + length) of a file to send once the write
+  /// buffer was written.
+  /// @param fd
+  /// @param offset
+  /// @param length
+  /// @param closeafter
+  /// @return false if the range is not inside the file
+  bool PutFile(int fd, size_t offset, size_t length, bool closeafter = false);
+
+  /// @brief Queue bytes [offset, offset + length) of a file to send right after
+  /// what the write buffer holds now, before anything appended to it later. This
+  /// lets responses read from files and responses built in memory leave in the
+  /// order they were made. The file must stay open until the write handler ran.
+  /// @param fd
+  /// @param offset
+  /// @param length
+  /// @param holder kept until the bytes were sent, e.g. the owner of fd keeping
+  /// it open
+  void PutFileRegion(int fd, size_t offset, size_t length,
+                     std::shared_ptr<const void> holder = nullptr);
+
+  /// @brief Drop the files queued, closing those which should be closed after
+  /// sending.
   void ResetFileState();
 
   bool FileNeedSending() const {
-    return file_state_.fd_ready_ != -1 && file_state_.target_size_ > 0;
+    return !files_.empty();
   }
 
+  /// @brief Size of the file sent next, 0 if there is none.
+  /// @return
   size_t FileSize() const {
-    return file_state_.filesize_;
+    return files_.empty() ? 0 : files_.front().filesize;
+  }
+
+  /// @brief Stop reading from the connection once the current event is handled,
+  /// until Resume() is called. The owner uses this while it prepares a response
+  /// outside of the event handlers. What is queued for writing is still sent, call
+  /// this again after queueing more. Must be called in the thread of the eventloop.
+  void Suspend();
+
+  /// @brief Watch the connection again, for writing if there is anything to send
+  /// and for reading otherwise. Must be called in the thread of the eventloop.
+  void Resume();
+
+  bool Suspended() const {
+    return suspended_;
+  }
+
+  /// @brief Check if anything is queued for writing.
+  /// @return
+  bool OutputPending() const {
+    return (write_buf_ != nullptr && write_buf_->Size() > 0) || FileNeedSending();
   }
 
  private:
@@ -90,6 +143,14 @@ class ReactorConn : public NoCopyable {
     mask_ = EPOLLIN | EPOLLOUT | EPOLLONESHOT;
   }
 
+  void SetMaskWriteOnly() {
+    mask_ = EPOLLOUT | EPOLLONESHOT;
+  }
+
+  // n bytes of the write buffer were sent, which brings the files queued after
+  // them closer
+  void WriteBufferSent(size_t n);
+
  private:
   int fd_ = -1;
   // our interested events
@@ -110,14 +171,24 @@ class ReactorConn : public NoCopyable {
   std::string name_;
   // indicate connection is being watched or not
   bool watched_ = false;
-  // support sending file when write data out
-  struct {
-    int fd_ready_ = -1;
-    size_t offset_ = 0;
-    size_t target_size_ = 0;
-    bool close_after_ = false;  // close file descriptor after sending it
-    size_t filesize_ = 0;
-  } file_state_;
+  // only watched for writing while there is something to send, see Suspend()
+  bool suspended_ = false;
+  // a range of a file to send once wbuf_bytes more bytes of the write buffer
+  // were sent, or once all of it was sent for kAfterWriteBuffer
+  struct FileRegion {
+    int fd = -1;
+    // next file offset to send
+    size_t offset = 0;
+    // bytes left to send
+    size_t length = 0;
+    size_t wbuf_bytes = 0;
+    bool close_after = false;  // close file descriptor after sending it
+    size_t filesize = 0;
+    std::shared_ptr<const void> holder;
+  };
+  constexpr static size_t kAfterWriteBuffer = SIZE_MAX;
+  // files to send in order, interleaved with the write buffer
+  std::deque<FileRegion> files_;
 };
 
 typedef std::shared_ptr<ReactorConn> ReactorConnPtr;
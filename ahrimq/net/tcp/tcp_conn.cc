@@ -2,7 +2,10 @@
 
 namespace ahrimq {
 
-TCPConn::TCPConn(ReactorConn* conn) : read_buf_(32768), write_buf_(4096), conn_(conn) {
+TCPConn::TCPConn(ReactorConn* conn) : TCPConn(conn, 32768, 4096) {}
+
+TCPConn::TCPConn(ReactorConn* conn, size_t rbufsize, size_t wbufsize)
+    : read_buf_(rbufsize), write_buf_(wbufsize), conn_(conn) {
   if (conn != nullptr) {
     status_ = Status::Open;
     return;
@@ -38,6 +41,11 @@ void TCPConn::AppendWriteBuffer(const std::vector<char>& buf) {
   write_buf_.Append(buf.data(), buf.size());
 }
 
+void TCPConn::AppendFileRegion(int fd, size_t offset, size_t length,
+                               std::shared_ptr<const void> holder) {
+  conn_->PutFileRegion(fd, offset, length, std::move(holder));
+}
+
 void TCPConn::ResetReadBuffer() {
   read_buf_.Reset();
 }
@@ -13,6 +13,7 @@
 #include "base/nocopyable.h"
 #include "buffer/buffer.h"
 #include "net/addr.h"
+#include "net/coroutine.h"
 #include "net/epoller.h"
 #include "net/eventloop.h"
 #include "net/reactor_conn.h"
@@ -28,6 +29,9 @@ class TCPServer;
 
 typedef std::function<void(TCPConn*, Buffer&)> TCPMessageCallback;
 typedef std::function<void(TCPConn*)> TCPGenericCallback;
+#ifdef AHRIMQ_COROUTINES
+typedef std::function<coro::Task<void>(TCPConn*, Buffer&)> TCPMessageCoroutine;
+#endif
 
 /// @brief TCPConn represents a tcp connection instance
 class TCPConn : public NoCopyable {
@@ -42,6 +46,12 @@ class TCPConn : public NoCopyable {
 
   explicit TCPConn(ReactorConn* conn);
 
+  /// @brief Construct a tcp connection instance with given buffer sizes.
+  /// @param conn
+  /// @param rbufsize initial size of the read buffer
+  /// @param wbufsize initial size of the write buffer
+  TCPConn(ReactorConn* conn, size_t rbufsize, size_t wbufsize);
+
   virtual ~TCPConn();
 
   /// @brief retrieve all bytes from read buffer, this operation will consume all
@@ -74,6 +84,16 @@ class TCPConn : public NoCopyable {
   /// @param buf
   void AppendWriteBuffer(const std::vector<char>& buf);
 
+  /// @brief send bytes [offset, offset + length) of a file right after what the
+  /// write buffer holds now, without copying them into it. The file must stay open
+  /// until they were written out.
+  /// @param fd
+  /// @param offset
+  /// @param length
+  /// @param holder kept until the bytes were written out
+  void AppendFileRegion(int fd, size_t offset, size_t length,
+                        std::shared_ptr<const void> holder = nullptr);
+
   /// @brief reset read buffer of TCPConn instance
   void ResetReadBuffer();
 
@@ -160,6 +180,25 @@ class TCPConn : public NoCopyable {
     return conn_->GetName();
   }
 
+  /// @brief get the eventloop the connection is handled in
+  /// @return
+  EventLoop* GetLoop() const {
+    return conn_->GetLoop();
+  }
+
+  /// @brief stop reading from the connection once the current event is handled, so
+  /// that its requests are answered in order while one is answered outside of the
+  /// eventloop. Answers already queued are still sent, must be called in its
+  /// eventloop
+  void Suspend() {
+    conn_->Suspend();
+  }
+
+  /// @brief handle events of the connection again, must be called in its eventloop
+  void Resume() {
+    conn_->Resume();
+  }
+
  protected:
   // read buffer
   Buffer read_buf_;
@@ -120,7 +120,8 @@ void TCPServer::OnStreamClosed(ReactorConn* conn, bool& close_after) {
   mtx_.lock();
   TCPConnPtr tcpconn = tcpconns_[conn_name];
   if (tcpconn == nullptr) {
-    close_after = true;
+    // already closed
+    tcpconns_.erase(conn_name);
     mtx_.unlock();
     return;
   }
@@ -137,15 +138,21 @@ void TCPServer::OnStreamClosed(ReactorConn* conn, bool& close_after) {
 // we collect all bytes from fd buffer and invoke on_message_callback_
 // ATTENTION!! this method may be invoked in multiple threads
 void TCPServer::OnStreamReached(ReactorConn* conn, bool allread, bool& close_after) {
-  std::string conn_name = conn->GetName();
-  mtx_.lock();
-  TCPConnPtr tcpconn = tcpconns_[conn_name];
+  TCPConnPtr tcpconn = FindTCPConn(conn);
   if (tcpconn == nullptr) {
     close_after = true;
-    mtx_.unlock();
     return;
   }
-  mtx_.unlock();
+#ifdef AHRIMQ_COROUTINES
+  if (on_message_coro_ != nullptr) {
+    if (allread) {
+      // suspend first, the coroutine may finish before Spawn returns
+      conn->Suspend();
+      coro::Spawn(RunMessageCoroutine(tcpconn));
+    }
+    return;
+  }
+#endif
   if (on_message_cb_ != nullptr) {
     if (allread) {
       on_message_cb_(tcpconn.get(), tcpconn->read_buf_);
@@ -153,6 +160,28 @@ void TCPServer::OnStreamReached(ReactorConn* conn, bool allread, bool& close_aft
   }
 }
 
+#ifdef AHRIMQ_COROUTINES
+coro::Task<void> TCPServer::RunMessageCoroutine(TCPConnPtr tcpconn) {
+  try {
+    co_await on_message_coro_(tcpconn.get(), tcpconn->read_buf_);
+  } catch (const std::exception& ex) {
+    std::cerr << "[" << tcpconn->GetName() << "] message coroutine failed: "
+              << ex.what() << '\n';
+  }
+  // every awaitable resumes in the eventloop of the connection
+  tcpconn->conn_->Resume();
+}
+#endif
+
+TCPConnPtr TCPServer::FindTCPConn(ReactorConn* conn) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  auto it = tcpconns_.find(conn->GetName());
+  if (it == tcpconns_.end()) {
+    return nullptr;
+  }
+  return it->second;
+}
+
 // ATTENTION: this method may be invoked in multiple threads
 void TCPServer::OnStreamWritten(ReactorConn* conn, bool& close_after) {}
 
@@ -74,6 +74,16 @@ class TCPServer : public NoCopyable, public IServer {
     on_message_cb_ = std::move(cb);
   }
 
+#ifdef AHRIMQ_COROUTINES
+  /// @brief Set a coroutine handling incoming messages instead of the message
+  /// callback. The connection is not read while the coroutine runs, the next
+  /// message is handled once it finished.
+  /// @param cb coroutine function
+  void SetOnMessageCoroutine(TCPMessageCoroutine cb) {
+    on_message_coro_ = std::move(cb);
+  }
+#endif
+
   /// @brief Set connection closed callback function.
   /// @param cb
   void SetOnClosedCallback(TCPGenericCallback cb) {
@@ -99,6 +109,15 @@ class TCPServer : public NoCopyable, public IServer {
 
   void OnStreamWritten(ReactorConn* conn, bool& close_after) override;
 
+  /// @brief Find the TCPConn of a connection.
+  /// @param conn
+  /// @return nullptr if the connection is closed
+  TCPConnPtr FindTCPConn(ReactorConn* conn);
+
+#ifdef AHRIMQ_COROUTINES
+  coro::Task<void> RunMessageCoroutine(TCPConnPtr tcpconn);
+#endif
+
  private:
   // ReactorPtr reactor_;
   TCPServer::Config config_;
@@ -109,6 +128,9 @@ class TCPServer : public NoCopyable, public IServer {
   // user-specified callbacks
   TCPMessageCallback on_message_cb_;
   TCPGenericCallback on_closed_cb_;
+#ifdef AHRIMQ_COROUTINES
+  TCPMessageCoroutine on_message_coro_;
+#endif
 };
 
 typedef std::shared_ptr<TCPServer> TCPServerPtr;
@@ -0,0 +1,90 @@
+#ifndef _AHRIMQ_MPSC_QUEUE_HPP_
+#define _AHRIMQ_MPSC_QUEUE_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "base/nocopyable.h"
+
+namespace ahrimq {
+
+/// @brief MPSCQueue is an unbounded lock-free queue with many producers and a single
+/// consumer. Producers push onto a linked list with one compare-and-swap each, the
+/// consumer takes the whole list with a single exchange and puts it back into the
+/// order of the pushes, so it pays for one atomic operation per batch of values
+/// instead of one per value.
+///
+/// Push() tells whether the queue was empty, which is when a consumer sleeping on
+/// it has to be woken up: it only sleeps after it found the queue empty, and every
+/// value pushed after that finds it empty or behind a value which woke it.
+template <typename T>
+class MPSCQueue : public NoCopyable {
+ public:
+  MPSCQueue() = default;
+
+  ~MPSCQueue() {
+    Node* node = head_.load(std::memory_order_acquire);
+    while (node != nullptr) {
+      Node* next = node->next;
+      delete node;
+      node = next;
+    }
+  }
+
+  /// @brief Push a value, from any thread.
+  /// @param value
+  /// @return true if the queue was empty
+  bool Push(T value) {
+    Node* node = new Node{std::move(value), head_.load(std::memory_order_relaxed)};
+    while (!head_.compare_exchange_weak(node->next, node, std::memory_order_release,
+                                        std::memory_order_relaxed)) {
+    }
+    return node->next == nullptr;
+  }
+
+  /// @brief Take all values pushed so far, only called by the consumer.
+  /// @param out the values are appended to it, oldest first
+  /// @return number of values taken
+  size_t PopAll(std::vector<T>* out) {
+    Node* node = head_.exchange(nullptr, std::memory_order_acquire);
+    // the list runs from the newest value to the oldest
+    Node* reversed = nullptr;
+    size_t n = 0;
+    while (node != nullptr) {
+      Node* next = node->next;
+      node->next = reversed;
+      reversed = node;
+      node = next;
+      n++;
+    }
+    out->reserve(out->size() + n);
+    while (reversed != nullptr) {
+      Node* next = reversed->next;
+      out->push_back(std::move(reversed->value));
+      delete reversed;
+      reversed = next;
+    }
+    return n;
+  }
+
+  /// @brief Check if nothing is queued, which may change right away.
+  /// @return
+  bool Empty() const {
+    return head_.load(std::memory_order_acquire) == nullptr;
+  }
+
+ private:
+  struct Node {
+    T value;
+    Node* next;
+  };
+
+  // newest value first
+  std::atomic<Node*> head_{nullptr};
+};
+
+}  // namespace ahrimq
+
+#endif  // _AHRIMQ_MPSC_QUEUE_HPP_
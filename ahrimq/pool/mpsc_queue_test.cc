@@ -0,0 +1,57 @@
+#include "mpsc_queue.hpp"
+
+#include <gtest/gtest.h>
+
+#include <thread>
+#include <vector>
+
+using namespace ahrimq;
+
+TEST(MPSCQueueTest, OrderTest) {
+  MPSCQueue<int> que;
+  EXPECT_TRUE(que.Empty());
+  EXPECT_TRUE(que.Push(1));
+  EXPECT_FALSE(que.Push(2));
+  EXPECT_FALSE(que.Push(3));
+  std::vector<int> out;
+  EXPECT_EQ(que.PopAll(&out), 3u);
+  EXPECT_EQ(out, std::vector<int>({1, 2, 3}));
+  EXPECT_TRUE(que.Empty());
+  EXPECT_EQ(que.PopAll(&out), 0u);
+  EXPECT_TRUE(que.Push(4));
+}
+
+TEST(MPSCQueueTest, ProducersTest) {
+  const int producers = 4;
+  const int per_producer = 20000;
+  MPSCQueue<std::pair<int, int>> que;
+  std::vector<std::thread> threads;
+  for (int p = 0; p < producers; p++) {
+    threads.emplace_back([&que, p] {
+      for (int i = 0; i < per_producer; i++) {
+        que.Push({p, i});
+      }
+    });
+  }
+  // values of every producer come out in the order it pushed them
+  std::vector<int> next(producers, 0);
+  int taken = 0;
+  while (taken < producers * per_producer) {
+    std::vector<std::pair<int, int>> out;
+    que.PopAll(&out);
+    for (const auto& v : out) {
+      ASSERT_EQ(v.second, next[v.first]);
+      next[v.first]++;
+    }
+    taken += out.size();
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  EXPECT_TRUE(que.Empty());
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,90 @@
+#ifndef _AHRIMQ_SPSC_QUEUE_HPP_
+#define _AHRIMQ_SPSC_QUEUE_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "base/nocopyable.h"
+
+namespace ahrimq {
+
+/// @brief SPSCQueue is a bounded lock-free ring between one producer thread and one
+/// consumer thread. Each side owns one index and only reads the index of the
+/// other one when its cached copy says the ring is full or empty, so the two
+/// threads share a cache line only once per lap instead of once per value.
+///
+/// The capacity is rounded up to a power of two. T must be default constructible,
+/// slots keep the values moved out of them until they are reused.
+template <typename T>
+class SPSCQueue : public NoCopyable {
+ public:
+  /// @brief Construct a ring.
+  /// @param capacity number of values it holds at most
+  explicit SPSCQueue(size_t capacity) {
+    size_t n = 1;
+    while (n < capacity) {
+      n <<= 1;
+    }
+    slots_.resize(n);
+    mask_ = n - 1;
+  }
+
+  /// @brief Push a value, only called by the producer.
+  /// @param value left as it is if the ring is full
+  /// @return false if the ring is full
+  bool Push(T& value) {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_cache_ > mask_) {
+      head_cache_ = head_.load(std::memory_order_acquire);
+      if (tail - head_cache_ > mask_) {
+        return false;
+      }
+    }
+    slots_[tail & mask_] = std::move(value);
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  /// @brief Take the oldest value, only called by the consumer.
+  /// @param value output arg
+  /// @return false if the ring is empty
+  bool Pop(T* value) {
+    size_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_cache_) {
+      tail_cache_ = tail_.load(std::memory_order_acquire);
+      if (head == tail_cache_) {
+        return false;
+      }
+    }
+    *value = std::move(slots_[head & mask_]);
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  /// @brief Check if nothing is queued, from either side.
+  /// @return
+  bool Empty() const {
+    return head_.load(std::memory_order_acquire) ==
+           tail_.load(std::memory_order_acquire);
+  }
+
+  size_t Capacity() const {
+    return mask_ + 1;
+  }
+
+ private:
+  std::vector<T> slots_;
+  size_t mask_;
+  // consumer side
+  alignas(64) std::atomic<size_t> head_{0};
+  size_t tail_cache_ = 0;
+  // producer side
+  alignas(64) std::atomic<size_t> tail_{0};
+  size_t head_cache_ = 0;
+};
+
+}  // namespace ahrimq
+
+#endif  // _AHRIMQ_SPSC_QUEUE_HPP_
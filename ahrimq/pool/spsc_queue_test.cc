@@ -0,0 +1,57 @@
+#include "spsc_queue.hpp"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <thread>
+
+using namespace ahrimq;
+
+TEST(SPSCQueueTest, FullTest) {
+  SPSCQueue<std::string> que(3);
+  EXPECT_EQ(que.Capacity(), 4u);
+  EXPECT_TRUE(que.Empty());
+  for (int i = 0; i < 4; i++) {
+    std::string v = std::to_string(i);
+    EXPECT_TRUE(que.Push(v));
+  }
+  std::string v = "4";
+  EXPECT_FALSE(que.Push(v));
+  EXPECT_EQ(v, "4");
+  std::string out;
+  ASSERT_TRUE(que.Pop(&out));
+  EXPECT_EQ(out, "0");
+  EXPECT_TRUE(que.Push(v));
+  for (int i = 1; i <= 4; i++) {
+    ASSERT_TRUE(que.Pop(&out));
+    EXPECT_EQ(out, std::to_string(i));
+  }
+  EXPECT_FALSE(que.Pop(&out));
+  EXPECT_TRUE(que.Empty());
+}
+
+TEST(SPSCQueueTest, ThreadsTest) {
+  const int n = 200000;
+  SPSCQueue<int> que(64);
+  std::thread producer([&que] {
+    for (int i = 0; i < n; i++) {
+      while (!que.Push(i)) {
+        std::this_thread::yield();
+      }
+    }
+  });
+  for (int i = 0; i < n; i++) {
+    int v = -1;
+    while (!que.Pop(&v)) {
+      std::this_thread::yield();
+    }
+    ASSERT_EQ(v, i);
+  }
+  producer.join();
+  EXPECT_TRUE(que.Empty());
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
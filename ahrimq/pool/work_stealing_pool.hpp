@@ -0,0 +1,172 @@
+#ifndef _AHRIMQ_WORK_STEALING_POOL_HPP_
+#define _AHRIMQ_WORK_STEALING_POOL_HPP_
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "base/nocopyable.h"
+
+namespace ahrimq {
+
+/// @brief WorkStealingPool runs tasks on a fixed set of worker threads. Every
+/// worker owns a task deque: submitted tasks are spread over the deques round
+/// robin, a worker takes the oldest task of its own deque and, once that is empty,
+/// steals the newest task of another worker, so one slow task does not hold back
+/// the tasks queued behind it.
+///
+/// The number of queued (not yet started) tasks is bounded, Submit fails instead of
+/// queueing more, which lets callers shed load early.
+class WorkStealingPool : public NoCopyable {
+ public:
+  typedef std::function<void()> Task;
+
+  /// @brief Construct a pool and start its workers.
+  /// @param num_workers number of worker threads, 0 for one per cpu
+  /// @param max_pending maximum number of queued tasks
+  explicit WorkStealingPool(size_t num_workers = 0, size_t max_pending = 1024)
+      : max_pending_(max_pending) {
+    if (num_workers == 0) {
+      num_workers = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (size_t i = 0; i < num_workers; i++) {
+      workers_.emplace_back(new Worker());
+    }
+    for (size_t i = 0; i < num_workers; i++) {
+      threads_.emplace_back(&WorkStealingPool::Run, this, i);
+    }
+  }
+
+  ~WorkStealingPool() {
+    Stop();
+  }
+
+  /// @brief Queue a task.
+  /// @param task
+  /// @return false if the pool is stopped or max_pending tasks are already queued
+  bool Submit(Task task) {
+    if (stopped_.load(std::memory_order_acquire)) {
+      return false;
+    }
+    if (pending_.fetch_add(1) >= max_pending_) {
+      pending_.fetch_sub(1);
+      return false;
+    }
+    Worker& w = *workers_[next_.fetch_add(1, std::memory_order_relaxed) %
+                          workers_.size()];
+    {
+      std::lock_guard<std::mutex> lck(w.mtx);
+      w.tasks.push_back(std::move(task));
+    }
+    if (idle_.load() > 0) {
+      // taking the lock orders this wakeup after the idle check of the worker
+      std::lock_guard<std::mutex> lck(idle_mtx_);
+      idle_cond_.notify_one();
+    }
+    return true;
+  }
+
+  /// @brief Stop accepting tasks, run the queued ones and join the workers.
+  void Stop() {
+    if (stopped_.exchange(true)) {
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lck(idle_mtx_);
+      idle_cond_.notify_all();
+    }
+    for (auto& th : threads_) {
+      if (th.joinable()) {
+        th.join();
+      }
+    }
+  }
+
+  /// @brief Number of queued tasks.
+  size_t Pending() const {
+    return pending_.load(std::memory_order_relaxed);
+  }
+
+  size_t NumWorkers() const {
+    return workers_.size();
+  }
+
+  size_t MaxPending() const {
+    return max_pending_;
+  }
+
+ private:
+  struct Worker {
+    std::mutex mtx;
+    std::deque<Task> tasks;
+  };
+
+  bool Take(size_t self, Task& task) {
+    {
+      Worker& w = *workers_[self];
+      std::lock_guard<std::mutex> lck(w.mtx);
+      if (!w.tasks.empty()) {
+        task = std::move(w.tasks.front());
+        w.tasks.pop_front();
+        return true;
+      }
+    }
+    for (size_t i = 1; i < workers_.size(); i++) {
+      Worker& victim = *workers_[(self + i) % workers_.size()];
+      std::lock_guard<std::mutex> lck(victim.mtx);
+      if (!victim.tasks.empty()) {
+        task = std::move(victim.tasks.back());
+        victim.tasks.pop_back();
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void Run(size_t self) {
+    Task task;
+    while (true) {
+      if (Take(self, task)) {
+        pending_.fetch_sub(1);
+        task();
+        task = nullptr;
+        continue;
+      }
+      std::unique_lock<std::mutex> lck(idle_mtx_);
+      idle_.fetch_add(1);
+      // pending_ is raised before a task is pushed, so nothing queued is missed
+      idle_cond_.wait(lck, [this] {
+        return pending_.load() > 0 || stopped_.load(std::memory_order_acquire);
+      });
+      idle_.fetch_sub(1);
+      if (pending_.load() == 0 && stopped_.load(std::memory_order_acquire)) {
+        return;
+      }
+    }
+  }
+
+ private:
+  size_t max_pending_;
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::vector<std::thread> threads_;
+  // queued tasks, raised before a task is pushed and lowered when it is taken
+  std::atomic<size_t> pending_{0};
+  // round robin cursor of Submit
+  std::atomic<size_t> next_{0};
+  std::atomic<bool> stopped_{false};
+  // workers waiting for tasks
+  std::atomic<size_t> idle_{0};
+  std::mutex idle_mtx_;
+  std::condition_variable idle_cond_;
+};
+
+}  // namespace ahrimq
+
+#endif  // _AHRIMQ_WORK_STEALING_POOL_HPP_
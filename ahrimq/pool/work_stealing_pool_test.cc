@@ -0,0 +1,75 @@
+#include "work_stealing_pool.hpp"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+using namespace ahrimq;
+
+TEST(WorkStealingPoolTest, RunAllTest) {
+  std::atomic<int> sum{0};
+  {
+    WorkStealingPool pool(4);
+    EXPECT_EQ(pool.NumWorkers(), 4);
+    for (int i = 1; i <= 1000; i++) {
+      while (!pool.Submit([&sum, i] { sum.fetch_add(i); })) {
+        std::this_thread::yield();
+      }
+    }
+    // queued tasks are drained by Stop
+    pool.Stop();
+  }
+  EXPECT_EQ(sum.load(), 500500);
+}
+
+TEST(WorkStealingPoolTest, SaturateTest) {
+  WorkStealingPool pool(1, 2);
+  std::atomic<bool> release{false};
+  std::atomic<bool> started{false};
+  ASSERT_TRUE(pool.Submit([&] {
+    started = true;
+    while (!release) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }));
+  while (!started) {
+    std::this_thread::yield();
+  }
+  EXPECT_TRUE(pool.Submit([] {}));
+  EXPECT_TRUE(pool.Submit([] {}));
+  EXPECT_EQ(pool.Pending(), 2);
+  EXPECT_FALSE(pool.Submit([] {}));
+  release = true;
+  pool.Stop();
+  EXPECT_EQ(pool.Pending(), 0);
+  EXPECT_FALSE(pool.Submit([] {}));
+}
+
+TEST(WorkStealingPoolTest, StealTest) {
+  WorkStealingPool pool(2);
+  std::atomic<bool> release{false};
+  std::atomic<int> done{0};
+  // tasks land on both workers round robin, the first one blocks its worker so
+  // the other worker has to steal everything queued behind it
+  ASSERT_TRUE(pool.Submit([&] {
+    while (!release) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }));
+  for (int i = 0; i < 100; i++) {
+    ASSERT_TRUE(pool.Submit([&done] { done.fetch_add(1); }));
+  }
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (done.load() < 100 && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  EXPECT_EQ(done.load(), 100);
+  release = true;
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,387 @@
+#include "storage/commit_log.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "base/time_utils.h"
+
+namespace ahrimq {
+namespace storage {
+
+CommitLog::CommitLog(const std::string& dir, const LogConfig& config)
+    : dir_(dir), config_(config), wbuf_(config.write_buffer_size) {}
+
+CommitLog::~CommitLog() {
+  std::unique_lock<std::mutex> lock(mtx_);
+  if (!segments_.empty()) {
+    SyncLocked(lock);
+  }
+}
+
+// names of segment files are 20 digits followed by ".log"
+static bool ParseSegmentName(const char* name, uint64_t* base_offset) {
+  size_t len = strlen(name);
+  if (len != 24 || strcmp(name + 20, ".log") != 0) {
+    return false;
+  }
+  uint64_t v = 0;
+  for (int i = 0; i < 20; i++) {
+    if (name[i] < '0' || name[i] > '9') {
+      return false;
+    }
+    v = v * 10 + (name[i] - '0');
+  }
+  *base_offset = v;
+  return true;
+}
+
+bool CommitLog::Open() {
+  std::lock_guard<std::mutex> lock(mtx_);
+  if (mkdir(dir_.c_str(), 0755) == -1 && errno != EEXIST) {
+    std::cerr << "can not create " << dir_ << ": " << strerror(errno) << '\n';
+    return false;
+  }
+  DIR* d = opendir(dir_.c_str());
+  if (d == nullptr) {
+    std::cerr << "can not open " << dir_ << ": " << strerror(errno) << '\n';
+    return false;
+  }
+  std::vector<uint64_t> bases;
+  while (struct dirent* entry = readdir(d)) {
+    uint64_t base = 0;
+    if (ParseSegmentName(entry->d_name, &base)) {
+      bases.push_back(base);
+    }
+  }
+  closedir(d);
+  if (bases.empty()) {
+    bases.push_back(0);
+  }
+  std::sort(bases.begin(), bases.end());
+  for (size_t i = 0; i < bases.size(); i++) {
+    bool last = i + 1 == bases.size();
+    auto segment = std::make_shared<LogSegment>(
+        dir_, bases[i], config_.index_interval_bytes, config_.max_index_bytes);
+    if (!segment->Open(last)) {
+      segments_.clear();
+      return false;
+    }
+    if (!last) {
+      segment->SetNextOffset(bases[i + 1]);
+    }
+    segments_.emplace(bases[i], std::move(segment));
+  }
+  uint64_t now = time::GetCurrentMs();
+  next_offset_ = Active()->NextOffset();
+  synced_offset_ = next_offset_.load();
+  last_sync_ms_ = now;
+  active_since_ms_ = Active()->Size() > 0 ? Active()->FirstTimestamp() : now;
+  return true;
+}
+
+bool CommitLog::NeedRoll(size_t incoming, uint32_t incoming_records,
+                         uint64_t now_ms) const {
+  size_t size = Active()->Size() + wbuf_.Size();
+  if (size == 0) {
+    return false;
+  }
+  if (size + incoming > config_.segment_bytes || Active()->IndexFull()) {
+    return true;
+  }
+  // the last incoming record must still fit the relative offsets of the indexes
+  if (next_offset_ + incoming_records - 1 - Active()->BaseOffset() >
+      LogSegment::kMaxRelativeOffset) {
+    return true;
+  }
+  return config_.segment_ms > 0 && now_ms >= active_since_ms_ + config_.segment_ms;
+}
+
+bool CommitLog::Roll() {
+  // the old segment is complete, nothing is appended to it anymore
+  if (!FlushLocked() || !Active()->Sync() || !Active()->Seal()) {
+    return false;
+  }
+  synced_offset_ = next_offset_.load();
+  auto segment = std::make_shared<LogSegment>(
+      dir_, next_offset_, config_.index_interval_bytes, config_.max_index_bytes);
+  if (!segment->Open(true)) {
+    return false;
+  }
+  segments_.emplace(next_offset_.load(), std::move(segment));
+  return true;
+}
+
+bool CommitLog::PrepareAppend(size_t size, uint32_t records, uint64_t now_ms) {
+  if (NeedRoll(size, records, now_ms) && !Roll()) {
+    return false;
+  }
+  if (Active()->Size() + wbuf_.Size() == 0) {
+    active_since_ms_ = now_ms;
+  }
+  return true;
+}
+
+bool CommitLog::FinishAppend(std::unique_lock<std::mutex>& lock, size_t size,
+                             uint32_t records, uint64_t first_timestamp,
+                             uint64_t now_ms) {
+  if (wbuf_records_ == 0) {
+    wbuf_first_timestamp_ = first_timestamp;
+  }
+  wbuf_records_ += records;
+  next_offset_ += records;
+  unsynced_bytes_ += size;
+  if (config_.fsync_every_batch ||
+      (config_.fsync_interval_bytes > 0 &&
+       unsynced_bytes_ >= config_.fsync_interval_bytes) ||
+      (config_.fsync_interval_ms > 0 &&
+       now_ms >= last_sync_ms_ + config_.fsync_interval_ms)) {
+    return SyncLocked(lock);
+  }
+  if (wbuf_.Size() >= config_.write_buffer_size) {
+    return FlushLocked();
+  }
+  return true;
+}
+
+bool CommitLog::AppendBatch(const LogRecord* records, size_t n,
+                            uint64_t* base_offset) {
+  uint64_t now = time::GetCurrentMs();
+  size_t size = EncodedBatchSize(records, n);
+  std::unique_lock<std::mutex> lock(mtx_);
+  if (n == 0 || !PrepareAppend(size, static_cast<uint32_t>(n), now)) {
+    return false;
+  }
+  *base_offset = next_offset_;
+  EncodeBatch(records, n, next_offset_, Codec::None, wbuf_);
+  return FinishAppend(lock, size, static_cast<uint32_t>(n), records[0].timestamp,
+                      now);
+}
+
+bool CommitLog::AppendEncodedBatch(const char* batch, size_t len,
+                                   uint64_t* base_offset) {
+  BatchHeader header;
+  if (DecodeBatch(batch, len, &header, false) != len) {
+    return false;
+  }
+  uint64_t now = time::GetCurrentMs();
+  std::unique_lock<std::mutex> lock(mtx_);
+  if (!PrepareAppend(len, header.count, now)) {
+    return false;
+  }
+  *base_offset = next_offset_;
+  wbuf_.EnsureBytesForWrite(len);
+  char* p = wbuf_.BeginWritePointer();
+  memcpy(p, batch, len);
+  SetBatchBaseOffset(p, next_offset_);
+  wbuf_.WriterIdxForward(len);
+  return FinishAppend(lock, len, header.count, header.first_timestamp, now);
+}
+
+bool CommitLog::Append(uint64_t timestamp, std::string_view key,
+                       std::string_view value, uint64_t* offset) {
+  LogRecord record;
+  record.timestamp = timestamp;
+  record.key = key;
+  record.value = value;
+  return AppendBatch(&record, 1, offset);
+}
+
+bool CommitLog::Flush() {
+  std::lock_guard<std::mutex> lock(mtx_);
+  return FlushLocked();
+}
+
+bool CommitLog::FlushLocked() {
+  if (wbuf_.Empty()) {
+    return true;
+  }
+  bool ok = Active()->Write(wbuf_.BeginReadPointer(), wbuf_.Size(), wbuf_records_,
+                            wbuf_first_timestamp_);
+  wbuf_.Reset();
+  wbuf_records_ = 0;
+  return ok;
+}
+
+bool CommitLog::Sync() {
+  std::unique_lock<std::mutex> lock(mtx_);
+  return SyncLocked(lock);
+}
+
+bool CommitLog::SyncLocked(std::unique_lock<std::mutex>& lock) {
+  if (!FlushLocked()) {
+    return false;
+  }
+  last_sync_ms_ = time::GetCurrentMs();
+  if (unsynced_bytes_ == 0) {
+    return true;
+  }
+  // only the writer appends and rolls, so the segment stays the last one and
+  // nothing is appended while readers go on
+  LogSegment* segment = Active();
+  uint64_t synced = next_offset_;
+  unsynced_bytes_ = 0;
+  lock.unlock();
+  bool ok = segment->Sync();
+  lock.lock();
+  if (ok) {
+    synced_offset_.store(synced, std::memory_order_release);
+  }
+  return ok;
+}
+
+bool CommitLog::Tick() {
+  uint64_t now = time::GetCurrentMs();
+  std::unique_lock<std::mutex> lock(mtx_);
+  if (config_.segment_ms > 0 && NeedRoll(0, 0, now) && !Roll()) {
+    return false;
+  }
+  if (config_.fsync_interval_ms > 0 && unsynced_bytes_ > 0 &&
+      now >= last_sync_ms_ + config_.fsync_interval_ms) {
+    return SyncLocked(lock);
+  }
+  return true;
+}
+
+bool CommitLog::Read(uint64_t offset, size_t max_bytes, std::string* out) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  if (offset < StartOffsetLocked() || offset > next_offset_) {
+    return false;
+  }
+  if (offset == next_offset_) {
+    return true;
+  }
+  if (offset >= Active()->NextOffset() && !FlushLocked()) {
+    return false;
+  }
+  auto it = segments_.upper_bound(offset);
+  --it;
+  return it->second->Read(offset, max_bytes, out);
+}
+
+bool CommitLog::ReadSlices(uint64_t offset, size_t max_bytes,
+                           std::vector<LogSlice>* slices, uint64_t end_offset) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  if (offset < StartOffsetLocked() || offset > next_offset_) {
+    return false;
+  }
+  if (offset == next_offset_ || offset >= end_offset) {
+    return true;
+  }
+  auto it = segments_.upper_bound(offset);
+  --it;
+  size_t left = max_bytes;
+  for (; it != segments_.end(); ++it) {
+    // buffered records are sent from the file as well
+    if (it->second.get() == Active() && !FlushLocked()) {
+      return false;
+    }
+    if (offset >= it->second->NextOffset() || offset >= end_offset) {
+      break;
+    }
+    LogSlice slice;
+    if (!it->second->Slice(offset, left, &slice, end_offset)) {
+      return false;
+    }
+    slice.segment = it->second;
+    if (!slices->empty() && slice.length > left) {
+      break;
+    }
+    slices->push_back(slice);
+    left -= std::min(left, slice.length);
+    if (left == 0 || slice.position + slice.length < it->second->Size()) {
+      break;
+    }
+    offset = it->second->NextOffset();
+  }
+  return true;
+}
+
+bool CommitLog::OffsetForTimestamp(uint64_t timestamp, uint64_t* offset) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  if (!FlushLocked()) {
+    return false;
+  }
+  // timestamps are set by producers and need not grow with offsets, so segments
+  // are tried in order instead of being searched
+  for (auto& segment : segments_) {
+    if (segment.second->FindOffsetByTime(timestamp, offset)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+size_t CommitLog::DeleteOldSegments(uint64_t now_ms) {
+  // the age of a segment may take a scan of its file to find, which must not hold
+  // up appends and fetches
+  std::vector<std::shared_ptr<LogSegment>> expired;
+  if (config_.retention_ms > 0) {
+    std::vector<std::shared_ptr<LogSegment>> sealed;
+    {
+      std::lock_guard<std::mutex> lock(mtx_);
+      for (auto it = segments_.begin(); std::next(it) != segments_.end(); ++it) {
+        sealed.push_back(it->second);
+      }
+    }
+    for (auto& segment : sealed) {
+      uint64_t timestamp = 0;
+      // a segment of unknown age is kept, and so are the ones after it
+      if (!segment->MaxTimestamp(&timestamp) ||
+          timestamp + config_.retention_ms > now_ms) {
+        break;
+      }
+      expired.push_back(std::move(segment));
+    }
+  }
+  std::vector<std::shared_ptr<LogSegment>> old;
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    size_t size = wbuf_.Size();
+    for (const auto& segment : segments_) {
+      size += segment.second->Size();
+    }
+    while (segments_.size() > 1) {
+      const std::shared_ptr<LogSegment>& segment = segments_.begin()->second;
+      bool is_expired =
+          std::find(expired.begin(), expired.end(), segment) != expired.end();
+      bool excess = config_.retention_bytes > 0 &&
+                    size - segment->Size() >= config_.retention_bytes;
+      if (!is_expired && !excess) {
+        break;
+      }
+      size -= segment->Size();
+      old.push_back(std::move(segments_.begin()->second));
+      segments_.erase(segments_.begin());
+    }
+  }
+  for (const auto& segment : old) {
+    if (!segment->Remove()) {
+      std::cerr << "can not delete " << segment->Path() << ": " << strerror(errno)
+                << '\n';
+    }
+  }
+  return old.size();
+}
+
+uint64_t CommitLog::StartOffset() const {
+  std::lock_guard<std::mutex> lock(mtx_);
+  return StartOffsetLocked();
+}
+
+size_t CommitLog::Size() const {
+  std::lock_guard<std::mutex> lock(mtx_);
+  size_t size = wbuf_.Size();
+  for (const auto& segment : segments_) {
+    size += segment.second->Size();
+  }
+  return size;
+}
+
+}  // namespace storage
+}  // namespace ahrimq
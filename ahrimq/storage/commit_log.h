@@ -0,0 +1,249 @@
+#ifndef _AHRIMQ_STORAGE_COMMIT_LOG_H_
+#define _AHRIMQ_STORAGE_COMMIT_LOG_H_
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "base/nocopyable.h"
+#include "buffer/buffer.h"
+#include "storage/log_segment.h"
+
+namespace ahrimq {
+namespace storage {
+
+/// @brief Configuration of a commit log.
+struct LogConfig {
+  // a segment is rolled before it grows past this many bytes, at most 4GB
+  size_t segment_bytes = 1 << 30;
+  // a segment is rolled once its first record was appended this long ago, 0 never
+  // rolls by age
+  uint64_t segment_ms = 7 * 24 * 3600 * 1000ul;
+  // appended records are gathered in memory up to this many bytes before they are
+  // written to the segment
+  size_t write_buffer_size = 1 << 20;
+  // the log is synced to the disk at least every this many milliseconds, 0 leaves
+  // it to the operating system
+  uint64_t fsync_interval_ms = 1000;
+  // the log is synced to the disk after this many bytes were appended, 0 disables
+  // it
+  size_t fsync_interval_bytes = 0;
+  // every AppendBatch() is synced before it returns, which makes it durable
+  bool fsync_every_batch = false;
+  // a batch is added to the indexes of its segment after this many bytes of
+  // batches, which is how far a lookup scans at most
+  size_t index_interval_bytes = 4096;
+  // size of each index of the last segment, which is rolled once one is full
+  size_t max_index_bytes = 10 << 20;
+  // segments whose records are all older than this are deleted, 0 keeps them
+  uint64_t retention_ms = 7 * 24 * 3600 * 1000ul;
+  // the oldest segments are deleted while the others hold at least this many
+  // bytes, 0 keeps them
+  size_t retention_bytes = 0;
+};
+
+/// @brief CommitLog is the append-only log of one partition, a sequence of
+/// segments each holding the records of a contiguous range of offsets.
+///
+/// Records are appended in batches, which are stored and read back as they were
+/// encoded, so a batch a producer compressed is never recompressed. Batches are
+/// appended to the last segment through a write buffer, so that many small
+/// batches become few large sequential writes. Batches are visible to Read() once
+/// they were written to the segment, which Read() does itself when it asks for
+/// buffered ones. Segments are rolled when they would grow past
+/// segment_bytes or get older than segment_ms.
+///
+/// A commit log has a single writer thread, which appends, flushes and syncs it,
+/// while other threads read it. A sync does not hold up readers, the disk is
+/// flushed without holding the lock of the log.
+///
+/// Old segments are deleted by DeleteOldSegments(), from any thread, as
+/// retention_ms and retention_bytes allow. The last segment is never deleted, it
+/// only becomes old once it rolled. Slices hold on to their segment, so that
+/// fetches in progress still send a deleted one.
+class CommitLog : public NoCopyable {
+ public:
+  /// @brief Construct a commit log kept in dir, which is opened by Open().
+  /// @param dir
+  /// @param config
+  CommitLog(const std::string& dir, const LogConfig& config);
+
+  /// @brief Sync what was appended and close the segments.
+  ~CommitLog();
+
+  /// @brief Open the segments in the directory of the log, creating the directory
+  /// and a first segment if needed. Only the last segment is scanned, a torn write
+  /// at its end is cut off.
+  /// @return
+  bool Open();
+
+  /// @brief Append records as one uncompressed batch, they get consecutive
+  /// offsets.
+  /// @param records offsets of the records are ignored
+  /// @param n
+  /// @param base_offset output arg, offset of the first record
+  /// @return false if the records could not be written, the log should not be
+  /// appended to anymore
+  bool AppendBatch(const LogRecord* records, size_t n, uint64_t* base_offset);
+
+  /// @brief Append a batch encoded by a producer as it is, only its base offset is
+  /// set. Neither its crc nor its records are checked again, callers receiving it
+  /// check them with VerifyBatch().
+  /// @param batch
+  /// @param len
+  /// @param base_offset output arg, offset of the first record
+  /// @return false if batch is not one whole batch or could not be written
+  bool AppendEncodedBatch(const char* batch, size_t len, uint64_t* base_offset);
+
+  /// @brief Append one record.
+  /// @param timestamp
+  /// @param key
+  /// @param value
+  /// @param offset output arg, offset of the record
+  /// @return
+  bool Append(uint64_t timestamp, std::string_view key, std::string_view value,
+              uint64_t* offset);
+
+  /// @brief Write the buffered records to the last segment.
+  /// @return
+  bool Flush();
+
+  /// @brief Flush and sync the last segment to the disk.
+  /// @return
+  bool Sync();
+
+  /// @brief Sync if fsync_interval_ms passed since the last sync, and roll the last
+  /// segment if it is older than segment_ms. Called periodically by the owner, so
+  /// that records are synced in time when no more are appended.
+  /// @return
+  bool Tick();
+
+  /// @brief Read whole batches starting with the one holding offset, stopping
+  /// before max_bytes would be exceeded but always reading at least one batch.
+  /// Reads do not cross segments. The first batch may hold records before offset,
+  /// which the reader skips.
+  /// @param offset
+  /// @param max_bytes
+  /// @param out the batches are appended to it
+  /// @return false if offset is out of range, nothing is read if offset is the
+  /// next offset
+  bool Read(uint64_t offset, size_t max_bytes, std::string* out);
+
+  /// @brief Find the bytes of whole batches starting with the one holding offset in
+  /// the segment files, so that they are sent from there without being read.
+  /// Unlike Read(), the slices continue into the following segments until
+  /// max_bytes would be exceeded, the first slice always holds at least one batch.
+  /// @param offset
+  /// @param max_bytes
+  /// @param slices the slices are appended to it, in order
+  /// @param end_offset the slices end before it, which is the first offset of a
+  /// batch or past the log, e.g. so that only synced batches are found
+  /// @return false if offset is out of range, nothing is found if offset is the
+  /// next offset or not before end_offset
+  bool ReadSlices(uint64_t offset, size_t max_bytes, std::vector<LogSlice>* slices,
+                  uint64_t end_offset = UINT64_MAX);
+
+  /// @brief Find the first record whose timestamp is not before timestamp, which is
+  /// where a consumer seeking to that time starts.
+  /// @param timestamp
+  /// @param offset output arg
+  /// @return false if all records are older
+  bool OffsetForTimestamp(uint64_t timestamp, uint64_t* offset);
+
+  /// @brief Delete the oldest segments, except the last one, while their newest
+  /// record is older than retention_ms or the log is larger than retention_bytes
+  /// without them. A segment whose newest record is unknown is not deleted by age.
+  /// The ages are found and the files deleted without locking the log, which is
+  /// only locked while the segments are taken out of it.
+  /// @param now_ms
+  /// @return number of segments deleted
+  size_t DeleteOldSegments(uint64_t now_ms);
+
+  /// @brief Offset of the oldest record kept.
+  /// @return
+  uint64_t StartOffset() const;
+
+  /// @brief Offset the next record appended gets.
+  /// @return
+  uint64_t NextOffset() const {
+    return next_offset_.load(std::memory_order_acquire);
+  }
+
+  /// @brief Records before this offset are synced to the disk.
+  /// @return
+  uint64_t SyncedOffset() const {
+    return synced_offset_.load(std::memory_order_acquire);
+  }
+
+  /// @brief Number of segments.
+  /// @return
+  size_t Segments() const {
+    std::lock_guard<std::mutex> lock(mtx_);
+    return segments_.size();
+  }
+
+  /// @brief Bytes in segments and in the write buffer.
+  /// @return
+  size_t Size() const;
+
+ private:
+  LogSegment* Active() const {
+    return segments_.rbegin()->second.get();
+  }
+
+  // start a segment at next_offset_
+  bool Roll();
+
+  // incoming bytes would bring the last segment past its size, incoming records
+  // past the offsets its indexes can hold, it is too old or its indexes are full
+  bool NeedRoll(size_t incoming, uint32_t incoming_records, uint64_t now_ms) const;
+
+  // make room for a batch of size bytes and records, rolling the last segment if
+  // needed
+  bool PrepareAppend(size_t size, uint32_t records, uint64_t now_ms);
+
+  // count a batch of records appended to the write buffer, syncing or flushing as
+  // configured
+  bool FinishAppend(std::unique_lock<std::mutex>& lock, size_t size,
+                    uint32_t records, uint64_t first_timestamp, uint64_t now_ms);
+
+  // Flush() and Sync() with mtx_ held, SyncLocked() releases it while the disk is
+  // flushed
+  bool FlushLocked();
+  bool SyncLocked(std::unique_lock<std::mutex>& lock);
+
+  uint64_t StartOffsetLocked() const {
+    return segments_.begin()->second->BaseOffset();
+  }
+
+ private:
+  std::string dir_;
+  LogConfig config_;
+  // guards the members below but the atomic offsets
+  mutable std::mutex mtx_;
+  // segments by base offset, shared with the slices read from them
+  std::map<uint64_t, std::shared_ptr<LogSegment>> segments_;
+
+  // batches appended and not written yet
+  Buffer wbuf_;
+  uint64_t wbuf_records_ = 0;
+  uint64_t wbuf_first_timestamp_ = 0;
+
+  // when the last segment got its first record, for rolling by age
+  uint64_t active_since_ms_ = 0;
+
+  std::atomic<uint64_t> next_offset_{0};
+  std::atomic<uint64_t> synced_offset_{0};
+  // bytes appended since the last sync
+  size_t unsynced_bytes_ = 0;
+  uint64_t last_sync_ms_ = 0;
+};
+
+}  // namespace storage
+}  // namespace ahrimq
+
+#endif  // _AHRIMQ_STORAGE_COMMIT_LOG_H_
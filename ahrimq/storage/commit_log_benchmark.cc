@@ -0,0 +1,81 @@
+#include <benchmark/benchmark.h>
+#include <dirent.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <string>
+
+#include "ahrimq/storage/commit_log.h"
+
+using namespace ahrimq;
+using namespace ahrimq::storage;
+
+// Sequential append bandwidth of a commit log. Point AHRIMQ_BENCH_DIR at the disk
+// to measure, /tmp is used otherwise.
+
+static std::string MakeDir() {
+  const char* base = getenv("AHRIMQ_BENCH_DIR");
+  std::string tmpl = std::string(base != nullptr ? base : "/tmp") +
+                     "/ahrimq_log_bench_XXXXXX";
+  char* dir = mkdtemp(&tmpl[0]);
+  return dir != nullptr ? dir : "";
+}
+
+static void RemoveDir(const std::string& dir) {
+  DIR* d = opendir(dir.c_str());
+  while (struct dirent* entry = readdir(d)) {
+    unlink((dir + "/" + entry->d_name).c_str());
+  }
+  closedir(d);
+  rmdir(dir.c_str());
+}
+
+// args: value size, records per batch, sync every batch
+static void BM_CommitLogAppend(benchmark::State& state) {
+  std::string dir = MakeDir();
+  if (dir.empty()) {
+    state.SkipWithError("can not create the log directory");
+    return;
+  }
+  LogConfig config;
+  config.segment_bytes = 256 << 20;
+  config.fsync_every_batch = state.range(2) != 0;
+  std::string value(state.range(0), 'v');
+  std::vector<LogRecord> batch(state.range(1));
+  for (auto& record : batch) {
+    record.key = "key";
+    record.value = value;
+  }
+  size_t bytes = 0;
+  {
+    CommitLog log(dir, config);
+    if (!log.Open()) {
+      state.SkipWithError("can not open the log");
+      return;
+    }
+    for (auto _ : state) {
+      uint64_t base = 0;
+      if (!log.AppendBatch(batch.data(), batch.size(), &base)) {
+        state.SkipWithError("append failed");
+        break;
+      }
+    }
+    // what is still buffered counts as well
+    log.Sync();
+    bytes = log.Size();
+  }
+  state.SetBytesProcessed(bytes);
+  state.SetItemsProcessed(state.iterations() * batch.size());
+  RemoveDir(dir);
+}
+BENCHMARK(BM_CommitLogAppend)
+    ->Args({100, 1, 0})
+    ->Args({1024, 1, 0})
+    ->Args({1024, 64, 0})
+    ->Args({16384, 16, 0})
+    ->Args({1024, 64, 1})
+    ->Args({16384, 64, 1})
+    ->UseRealTime()
+    ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,441 @@
+#include "ahrimq/storage/commit_log.h"
+
+#include <dirent.h>
+#include <gtest/gtest.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ahrimq/base/crc32c.h"
+#include "ahrimq/storage/retention_task.h"
+
+using namespace ahrimq;
+using namespace ahrimq::storage;
+
+class CommitLogTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    char tmpl[] = "/tmp/ahrimq_log_XXXXXX";
+    char* dir = mkdtemp(tmpl);
+    ASSERT_NE(dir, nullptr);
+    dir_ = dir;
+    config_.segment_bytes = 4096;
+    config_.write_buffer_size = 1024;
+  }
+
+  void TearDown() override {
+    DIR* d = opendir(dir_.c_str());
+    while (struct dirent* entry = readdir(d)) {
+      unlink((dir_ + "/" + entry->d_name).c_str());
+    }
+    closedir(d);
+    rmdir(dir_.c_str());
+  }
+
+  // decode the records of the uncompressed batches read from the log
+  static std::vector<LogRecord> Decode(const std::string& data) {
+    std::vector<LogRecord> records;
+    BatchReader reader(data.data(), data.size());
+    LogRecord record;
+    while (reader.Next(&record)) {
+      records.push_back(record);
+    }
+    EXPECT_FALSE(reader.Failed());
+    return records;
+  }
+
+  std::string dir_;
+  LogConfig config_;
+};
+
+TEST(Crc32cTest, KnownValuesTest) {
+  EXPECT_EQ(Crc32c("", 0), 0u);
+  EXPECT_EQ(Crc32c("123456789", 9), 0xe3069283u);
+  std::string zeros(32, '\0');
+  EXPECT_EQ(Crc32c(zeros.data(), zeros.size()), 0x8a9136aau);
+  // extending matches computing at once, for any split
+  std::string data = "The quick brown fox jumps over the lazy dog";
+  uint32_t whole = Crc32c(data.data(), data.size());
+  EXPECT_EQ(whole, 0x22620404u);
+  for (size_t i = 0; i <= data.size(); i++) {
+    EXPECT_EQ(Crc32cExtend(Crc32c(data.data(), i), data.data() + i, data.size() - i),
+              whole);
+  }
+}
+
+TEST_F(CommitLogTest, AppendAndReadTest) {
+  CommitLog log(dir_, config_);
+  ASSERT_TRUE(log.Open());
+  EXPECT_EQ(log.NextOffset(), 0u);
+  for (int i = 0; i < 100; i++) {
+    uint64_t offset = 0;
+    std::string value = "value-" + std::to_string(i);
+    ASSERT_TRUE(log.Append(1000 + i, "key", value, &offset));
+    EXPECT_EQ(offset, uint64_t(i));
+  }
+  // 100 records of ~44 bytes do not fit into one 4KB segment
+  EXPECT_GT(log.Segments(), 1u);
+  EXPECT_EQ(log.StartOffset(), 0u);
+
+  // buffered records are read as well
+  for (uint64_t offset : {0, 42, 99}) {
+    std::string data;
+    ASSERT_TRUE(log.Read(offset, 1, &data));
+    auto records = Decode(data);
+    ASSERT_EQ(records.size(), 1u);
+    EXPECT_EQ(records[0].offset, offset);
+    EXPECT_EQ(records[0].timestamp, 1000 + offset);
+    EXPECT_EQ(records[0].key, "key");
+    EXPECT_EQ(records[0].value, "value-" + std::to_string(offset));
+  }
+  // reads stop at max_bytes and at the end of a segment
+  std::string data;
+  ASSERT_TRUE(log.Read(10, 300, &data));
+  auto records = Decode(data);
+  ASSERT_FALSE(records.empty());
+  EXPECT_LE(data.size(), 300u);
+  for (size_t i = 0; i < records.size(); i++) {
+    EXPECT_EQ(records[i].offset, 10 + i);
+  }
+  data.clear();
+  EXPECT_TRUE(log.Read(100, 300, &data));
+  EXPECT_TRUE(data.empty());
+  EXPECT_FALSE(log.Read(101, 300, &data));
+
+  // a batch gets consecutive offsets
+  LogRecord batch[3];
+  for (auto& record : batch) {
+    record.value = "batched";
+  }
+  uint64_t base = 0;
+  ASSERT_TRUE(log.AppendBatch(batch, 3, &base));
+  EXPECT_EQ(base, 100u);
+  EXPECT_EQ(log.NextOffset(), 103u);
+  ASSERT_TRUE(log.Sync());
+  EXPECT_EQ(log.SyncedOffset(), 103u);
+}
+
+TEST_F(CommitLogTest, RecoverTest) {
+  size_t segments = 0;
+  {
+    CommitLog log(dir_, config_);
+    ASSERT_TRUE(log.Open());
+    for (int i = 0; i < 200; i++) {
+      uint64_t offset = 0;
+      ASSERT_TRUE(log.Append(i, "", std::string(i % 50, 'x'), &offset));
+    }
+    segments = log.Segments();
+  }
+  {
+    CommitLog log(dir_, config_);
+    ASSERT_TRUE(log.Open());
+    EXPECT_EQ(log.Segments(), segments);
+    EXPECT_EQ(log.NextOffset(), 200u);
+    std::string data;
+    ASSERT_TRUE(log.Read(150, 1, &data));
+    EXPECT_EQ(Decode(data)[0].value, std::string(150 % 50, 'x'));
+    uint64_t offset = 0;
+    ASSERT_TRUE(log.Append(0, "", "after reopen", &offset));
+    EXPECT_EQ(offset, 200u);
+  }
+
+  // a torn write at the end of the last segment is cut off
+  DIR* d = opendir(dir_.c_str());
+  std::string last;
+  while (struct dirent* entry = readdir(d)) {
+    std::string name = entry->d_name;
+    if (name.size() > 4 && name.substr(name.size() - 4) == ".log" && name > last) {
+      last = name;
+    }
+  }
+  closedir(d);
+  std::string path = dir_ + "/" + last;
+  struct stat st {};
+  ASSERT_EQ(stat(path.c_str(), &st), 0);
+  ASSERT_EQ(truncate(path.c_str(), st.st_size - 3), 0);
+  {
+    CommitLog log(dir_, config_);
+    ASSERT_TRUE(log.Open());
+    EXPECT_EQ(log.NextOffset(), 200u);
+    std::string data;
+    ASSERT_TRUE(log.Read(199, 1 << 20, &data));
+    EXPECT_EQ(Decode(data).size(), 1u);
+  }
+}
+
+TEST_F(CommitLogTest, IndexTest) {
+  config_.segment_bytes = 32 << 10;
+  config_.index_interval_bytes = 256;
+  // timestamps grow with offsets, except for one record from the past
+  auto timestamp = [](uint64_t offset) -> uint64_t {
+    return offset == 500 ? 1 : 10000 + offset * 10;
+  };
+  for (int round = 0; round < 2; round++) {
+    CommitLog log(dir_, config_);
+    ASSERT_TRUE(log.Open());
+    if (round == 0) {
+      for (uint64_t i = 0; i < 2000; i++) {
+        uint64_t offset = 0;
+        ASSERT_TRUE(log.Append(timestamp(i), "", std::string(i % 64, 'x'), &offset));
+      }
+    }
+    ASSERT_EQ(log.NextOffset(), 2000u);
+    EXPECT_GT(log.Segments(), 2u);
+    for (uint64_t offset = 0; offset < 2000; offset += 37) {
+      std::string data;
+      ASSERT_TRUE(log.Read(offset, 1, &data));
+      auto records = Decode(data);
+      ASSERT_EQ(records.size(), 1u);
+      EXPECT_EQ(records[0].offset, offset);
+    }
+    uint64_t offset = 0;
+    ASSERT_TRUE(log.OffsetForTimestamp(0, &offset));
+    EXPECT_EQ(offset, 0u);
+    ASSERT_TRUE(log.OffsetForTimestamp(10000 + 1234 * 10, &offset));
+    EXPECT_EQ(offset, 1234u);
+    ASSERT_TRUE(log.OffsetForTimestamp(10000 + 1234 * 10 - 5, &offset));
+    EXPECT_EQ(offset, 1234u);
+    EXPECT_FALSE(log.OffsetForTimestamp(10000 + 2000 * 10, &offset));
+
+    // sealed indexes which went missing are rebuilt on their first lookup
+    std::string index = LogSegment::FilePath(dir_, 0);
+    index = index.substr(0, index.size() - 4) + ".index";
+    struct stat st {};
+    ASSERT_EQ(stat(index.c_str(), &st), 0);
+    EXPECT_GT(st.st_size, 0);
+    unlink(index.c_str());
+  }
+}
+
+TEST_F(CommitLogTest, SliceTest) {
+  config_.index_interval_bytes = 256;
+  CommitLog log(dir_, config_);
+  ASSERT_TRUE(log.Open());
+  for (int i = 0; i < 300; i++) {
+    uint64_t offset = 0;
+    ASSERT_TRUE(log.Append(i, "", std::string(i % 40, 'x'), &offset));
+  }
+  ASSERT_GT(log.Segments(), 2u);
+  // slices hold the bytes Read() reads, and go on into the following segments
+  for (uint64_t offset : {0, 77, 150, 299}) {
+    for (size_t max_bytes : {1, 500, 6000, 1 << 20}) {
+      std::vector<LogSlice> slices;
+      ASSERT_TRUE(log.ReadSlices(offset, max_bytes, &slices));
+      ASSERT_FALSE(slices.empty());
+      std::string data;
+      for (const LogSlice& slice : slices) {
+        std::string part(slice.length, '\0');
+        ASSERT_EQ(pread(slice.fd, part.data(), part.size(), slice.position),
+                  ssize_t(part.size()));
+        data += part;
+      }
+      auto records = Decode(data);
+      ASSERT_FALSE(records.empty());
+      EXPECT_TRUE(records.size() == 1 || data.size() <= max_bytes);
+      for (size_t i = 0; i < records.size(); i++) {
+        EXPECT_EQ(records[i].offset, offset + i);
+      }
+      if (max_bytes == 1 << 20) {
+        EXPECT_EQ(records.size(), 300 - offset);
+      }
+      std::string read;
+      ASSERT_TRUE(log.Read(offset, max_bytes, &read));
+      EXPECT_EQ(data.substr(0, read.size()), read);
+    }
+  }
+  // every record is a batch of its own, the slices end before end_offset
+  for (uint64_t end_offset : {1, 77, 78, 200, 299}) {
+    std::vector<LogSlice> slices;
+    ASSERT_TRUE(log.ReadSlices(10, 1 << 20, &slices, end_offset));
+    std::string data;
+    for (const LogSlice& slice : slices) {
+      std::string part(slice.length, '\0');
+      ASSERT_EQ(pread(slice.fd, part.data(), part.size(), slice.position),
+                ssize_t(part.size()));
+      data += part;
+    }
+    EXPECT_EQ(Decode(data).size(), end_offset > 10 ? end_offset - 10 : 0);
+  }
+  std::vector<LogSlice> slices;
+  EXPECT_TRUE(log.ReadSlices(300, 100, &slices));
+  EXPECT_TRUE(slices.empty());
+  EXPECT_FALSE(log.ReadSlices(301, 100, &slices));
+}
+
+TEST_F(CommitLogTest, EncodedBatchTest) {
+  CommitLog log(dir_, config_);
+  ASSERT_TRUE(log.Open());
+  uint64_t offset = 0;
+  ASSERT_TRUE(log.Append(1, "k", "single", &offset));
+  // a producer batch is stored as it was sent, with its base offset set
+  BatchBuilder builder(Codec::Zlib);
+  for (int i = 0; i < 10; i++) {
+    builder.Add(100 + i, "", std::string(200, 'a' + i));
+  }
+  Buffer batch;
+  ASSERT_TRUE(builder.Finish(batch));
+  std::string sent = batch.ReadAllAsString();
+  ASSERT_LT(sent.size(), 1000u);
+  uint64_t base = 0;
+  ASSERT_TRUE(log.AppendEncodedBatch(sent.data(), sent.size(), &base));
+  EXPECT_EQ(base, 1u);
+  EXPECT_EQ(log.NextOffset(), 11u);
+  EXPECT_FALSE(log.AppendEncodedBatch(sent.data(), sent.size() - 1, &base));
+
+  // reading from the middle of the batch returns all of it
+  std::string data;
+  ASSERT_TRUE(log.Read(5, 1, &data));
+  ASSERT_EQ(data.size(), sent.size());
+  EXPECT_EQ(data.substr(12), sent.substr(12));
+  BatchReader reader(data.data(), data.size());
+  LogRecord record;
+  for (uint64_t i = 0; i < 10; i++) {
+    ASSERT_TRUE(reader.Next(&record));
+    EXPECT_EQ(record.offset, 1 + i);
+    EXPECT_EQ(record.timestamp, 100 + i);
+    EXPECT_EQ(record.value, std::string(200, 'a' + i));
+  }
+  EXPECT_FALSE(reader.Next(&record));
+  EXPECT_FALSE(reader.Failed());
+  ASSERT_TRUE(log.OffsetForTimestamp(105, &offset));
+  EXPECT_EQ(offset, 6u);
+}
+
+TEST_F(CommitLogTest, RetentionBytesTest) {
+  config_.retention_ms = 0;
+  config_.retention_bytes = 8192;
+  CommitLog log(dir_, config_);
+  ASSERT_TRUE(log.Open());
+  for (int i = 0; i < 300; i++) {
+    uint64_t offset = 0;
+    ASSERT_TRUE(log.Append(i, "", std::string(40, 'x'), &offset));
+  }
+  size_t segments = log.Segments();
+  ASSERT_GT(segments, 4u);
+  std::vector<LogSlice> slices;
+  ASSERT_TRUE(log.ReadSlices(0, 100, &slices));
+  ASSERT_EQ(slices.size(), 1u);
+
+  size_t deleted = log.DeleteOldSegments(0);
+  EXPECT_GT(deleted, 0u);
+  EXPECT_EQ(log.Segments(), segments - deleted);
+  EXPECT_GE(log.Size(), 8192u);
+  EXPECT_LT(log.Size(), 8192u + 4096u);
+  EXPECT_GT(log.StartOffset(), 0u);
+  std::string data;
+  EXPECT_FALSE(log.Read(0, 100, &data));
+  EXPECT_TRUE(log.Read(log.StartOffset(), 100, &data));
+  EXPECT_EQ(log.DeleteOldSegments(0), 0u);
+
+  // the files are gone, but a slice taken before is still read
+  size_t files = 0;
+  DIR* d = opendir(dir_.c_str());
+  while (struct dirent* entry = readdir(d)) {
+    files += strstr(entry->d_name, ".log") != nullptr;
+  }
+  closedir(d);
+  EXPECT_EQ(files, log.Segments());
+  std::string part(slices[0].length, '\0');
+  ASSERT_EQ(pread(slices[0].fd, part.data(), part.size(), slices[0].position),
+            ssize_t(part.size()));
+  auto records = Decode(part);
+  ASSERT_FALSE(records.empty());
+  EXPECT_EQ(records[0].offset, 0u);
+}
+
+TEST_F(CommitLogTest, RetentionTimeTest) {
+  config_.retention_ms = 1000;
+  uint64_t now = 1000000;
+  uint64_t recent = 0;
+  {
+    CommitLog log(dir_, config_);
+    ASSERT_TRUE(log.Open());
+    for (int i = 0; i < 200; i++) {
+      uint64_t offset = 0;
+      ASSERT_TRUE(log.Append(now - 5000 + i, "", std::string(40, 'x'), &offset));
+    }
+    recent = log.NextOffset();
+    for (int i = 0; i < 100; i++) {
+      uint64_t offset = 0;
+      ASSERT_TRUE(log.Append(now, "", std::string(40, 'x'), &offset));
+    }
+  }
+  // the largest timestamps of the old segments are found in their time indexes
+  CommitLog log(dir_, config_);
+  ASSERT_TRUE(log.Open());
+  EXPECT_GT(log.DeleteOldSegments(now), 0u);
+  EXPECT_GT(log.StartOffset(), 0u);
+  EXPECT_LE(log.StartOffset(), recent);
+  std::string data;
+  ASSERT_TRUE(log.Read(log.StartOffset(), 1 << 20, &data));
+  auto records = Decode(data);
+  ASSERT_FALSE(records.empty());
+  EXPECT_EQ(records.back().timestamp, now);
+
+  // the last segment is kept however old it is
+  log.DeleteOldSegments(now + 10000);
+  EXPECT_EQ(log.Segments(), 1u);
+  EXPECT_EQ(log.NextOffset(), 300u);
+}
+
+TEST_F(CommitLogTest, RetentionTaskTest) {
+  config_.retention_ms = 1000;
+  CommitLog log(dir_, config_);
+  ASSERT_TRUE(log.Open());
+  for (int i = 0; i < 300; i++) {
+    uint64_t offset = 0;
+    ASSERT_TRUE(log.Append(i, "", std::string(40, 'x'), &offset));
+  }
+  ASSERT_GT(log.Segments(), 1u);
+  RetentionTask task(10);
+  task.Add(&log);
+  task.Start();
+  for (int i = 0; i < 500 && log.Segments() > 1; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  task.Stop();
+  EXPECT_EQ(log.Segments(), 1u);
+}
+
+TEST_F(CommitLogTest, RetentionUnknownAgeTest) {
+  config_.retention_ms = 1000;
+  {
+    CommitLog log(dir_, config_);
+    ASSERT_TRUE(log.Open());
+    for (int i = 0; i < 300; i++) {
+      uint64_t offset = 0;
+      ASSERT_TRUE(log.Append(i, "", std::string(40, 'x'), &offset));
+    }
+  }
+  // the indexes of the first segment can be neither loaded nor rebuilt
+  std::string index = dir_ + "/00000000000000000000.index";
+  std::string time_index = dir_ + "/00000000000000000000.timeindex";
+  ASSERT_EQ(unlink(index.c_str()), 0);
+  ASSERT_EQ(unlink(time_index.c_str()), 0);
+  ASSERT_EQ(mkdir(index.c_str(), 0755), 0);
+  ASSERT_EQ(mkdir(time_index.c_str(), 0755), 0);
+  CommitLog log(dir_, config_);
+  ASSERT_TRUE(log.Open());
+  size_t segments = log.Segments();
+  ASSERT_GT(segments, 2u);
+  RetentionTask task;
+  task.Add(&log);
+  // its age is unknown, it is kept and so are the newer ones
+  EXPECT_EQ(task.RunOnce(), 0u);
+  EXPECT_EQ(log.Segments(), segments);
+
+  ASSERT_EQ(rmdir(index.c_str()), 0);
+  ASSERT_EQ(rmdir(time_index.c_str()), 0);
+  EXPECT_EQ(task.RunOnce(), segments - 1);
+  EXPECT_EQ(log.Segments(), 1u);
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
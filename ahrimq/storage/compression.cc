@@ -0,0 +1,165 @@
+#include "storage/compression.h"
+
+#include <zlib.h>
+
+#ifdef AHRIMQ_HAVE_LZ4
+#include <lz4.h>
+#endif
+#ifdef AHRIMQ_HAVE_SNAPPY
+#include <snappy.h>
+#endif
+#ifdef AHRIMQ_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace ahrimq {
+namespace storage {
+
+// zstd level of the producer, fast enough to keep up with the network
+constexpr static int kZstdLevel = 3;
+
+const char* CodecName(Codec codec) {
+  switch (codec) {
+    case Codec::None:
+      return "none";
+    case Codec::Zlib:
+      return "zlib";
+    case Codec::Snappy:
+      return "snappy";
+    case Codec::LZ4:
+      return "lz4";
+    case Codec::Zstd:
+      return "zstd";
+  }
+  return "unknown";
+}
+
+bool CodecAvailable(Codec codec) {
+  switch (codec) {
+    case Codec::None:
+    case Codec::Zlib:
+      return true;
+#ifdef AHRIMQ_HAVE_SNAPPY
+    case Codec::Snappy:
+      return true;
+#endif
+#ifdef AHRIMQ_HAVE_LZ4
+    case Codec::LZ4:
+      return true;
+#endif
+#ifdef AHRIMQ_HAVE_ZSTD
+    case Codec::Zstd:
+      return true;
+#endif
+    default:
+      return false;
+  }
+}
+
+bool Compress(Codec codec, const char* data, size_t len, std::string* out) {
+  if (len > kMaxRawSize) {
+    // the batch could not be read back
+    return false;
+  }
+  size_t start = out->size();
+  switch (codec) {
+    case Codec::Zlib: {
+      uLongf n = compressBound(len);
+      out->resize(start + n);
+      if (compress2(reinterpret_cast<Bytef*>(&(*out)[start]), &n,
+                    reinterpret_cast<const Bytef*>(data), len,
+                    Z_DEFAULT_COMPRESSION) != Z_OK) {
+        break;
+      }
+      out->resize(start + n);
+      return true;
+    }
+#ifdef AHRIMQ_HAVE_SNAPPY
+    case Codec::Snappy: {
+      out->resize(start + snappy::MaxCompressedLength(len));
+      size_t n = 0;
+      snappy::RawCompress(data, len, &(*out)[start], &n);
+      out->resize(start + n);
+      return true;
+    }
+#endif
+#ifdef AHRIMQ_HAVE_LZ4
+    case Codec::LZ4: {
+      int bound = LZ4_compressBound(static_cast<int>(len));
+      out->resize(start + bound);
+      int n = LZ4_compress_default(data, &(*out)[start], static_cast<int>(len),
+                                   bound);
+      if (n <= 0) {
+        break;
+      }
+      out->resize(start + n);
+      return true;
+    }
+#endif
+#ifdef AHRIMQ_HAVE_ZSTD
+    case Codec::Zstd: {
+      size_t bound = ZSTD_compressBound(len);
+      out->resize(start + bound);
+      size_t n = ZSTD_compress(&(*out)[start], bound, data, len, kZstdLevel);
+      if (ZSTD_isError(n)) {
+        break;
+      }
+      out->resize(start + n);
+      return true;
+    }
+#endif
+    default:
+      break;
+  }
+  out->resize(start);
+  return false;
+}
+
+bool Decompress(Codec codec, const char* data, size_t len, size_t raw_len,
+                std::string* out) {
+  if (raw_len > kMaxRawSize) {
+    // a forged size must not make us allocate it
+    return false;
+  }
+  size_t start = out->size();
+  out->resize(start + raw_len);
+  char* dst = &(*out)[start];
+  bool ok = false;
+  switch (codec) {
+    case Codec::Zlib: {
+      uLongf n = raw_len;
+      ok = uncompress(reinterpret_cast<Bytef*>(dst), &n,
+                      reinterpret_cast<const Bytef*>(data), len) == Z_OK &&
+           n == raw_len;
+      break;
+    }
+#ifdef AHRIMQ_HAVE_SNAPPY
+    case Codec::Snappy: {
+      size_t n = 0;
+      ok = snappy::GetUncompressedLength(data, len, &n) && n == raw_len &&
+           snappy::RawUncompress(data, len, dst);
+      break;
+    }
+#endif
+#ifdef AHRIMQ_HAVE_LZ4
+    case Codec::LZ4:
+      ok = LZ4_decompress_safe(data, dst, static_cast<int>(len),
+                               static_cast<int>(raw_len)) == int(raw_len);
+      break;
+#endif
+#ifdef AHRIMQ_HAVE_ZSTD
+    case Codec::Zstd:
+      ok = ZSTD_decompress(dst, raw_len, data, len) == raw_len;
+      break;
+#endif
+    default:
+      break;
+  }
+  if (!ok) {
+    out->resize(start);
+  }
+  return ok;
+}
+
+}  // namespace storage
+}  // namespace ahrimq
@@ -0,0 +1,61 @@
+#ifndef _AHRIMQ_STORAGE_COMPRESSION_H_
+#define _AHRIMQ_STORAGE_COMPRESSION_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace ahrimq {
+namespace storage {
+
+/// @brief Codecs the records of a batch are compressed with. zlib is always
+/// available, the others only if their library was found when building.
+enum class Codec : uint8_t {
+  None = 0,
+  Zlib = 1,
+  Snappy = 2,
+  LZ4 = 3,
+  Zstd = 4,
+};
+
+constexpr static uint8_t kCodecCount = static_cast<uint8_t>(Codec::Zstd) + 1;
+
+/// @brief Largest size of the data of a batch before compression. The size is
+/// taken from the batch, so it is checked before the output is allocated.
+constexpr static size_t kMaxRawSize = 64 << 20;
+
+/// @brief Name of a codec, "unknown" if it is out of range.
+/// @param codec
+/// @return
+const char* CodecName(Codec codec);
+
+/// @brief Check if this build can compress and decompress with a codec.
+/// @param codec
+/// @return
+bool CodecAvailable(Codec codec);
+
+/// @brief Compress data, appending the result to out.
+/// @param codec must not be Codec::None
+/// @param data
+/// @param len
+/// @param out
+/// @return false if the codec is not available or fails, or len exceeds
+/// kMaxRawSize
+bool Compress(Codec codec, const char* data, size_t len, std::string* out);
+
+/// @brief Decompress data, appending the result to out.
+/// @param codec must not be Codec::None
+/// @param data
+/// @param len
+/// @param raw_len size of the data before it was compressed, the output is refused
+/// if it differs
+/// @param out
+/// @return false if the codec is not available, data is corrupted or raw_len
+/// exceeds kMaxRawSize
+bool Decompress(Codec codec, const char* data, size_t len, size_t raw_len,
+                std::string* out);
+
+}  // namespace storage
+}  // namespace ahrimq
+
+#endif  // _AHRIMQ_STORAGE_COMPRESSION_H_
@@ -0,0 +1,219 @@
+#include "storage/log_appender.h"
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <map>
+#include <utility>
+
+#include "base/time_utils.h"
+
+namespace ahrimq {
+namespace storage {
+
+static std::atomic<uint64_t> next_appender_id{1};
+
+static void Wakeup(int fd) {
+  uint64_t one = 1;
+  ssize_t n = write(fd, &one, sizeof(one));
+  (void)n;
+}
+
+LogAppender::LogAppender(const AppenderConfig& config)
+    : config_(config), id_(next_appender_id.fetch_add(1)) {
+  size_t n = std::max<size_t>(config_.num_writers, 1);
+  for (size_t i = 0; i < n; i++) {
+    writers_.emplace_back(new Writer());
+    writers_.back()->wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  }
+  for (auto& writer : writers_) {
+    writer->thread = std::thread(&LogAppender::Run, this, writer.get());
+  }
+}
+
+LogAppender::~LogAppender() {
+  Stop();
+  for (auto& writer : writers_) {
+    if (writer->wakeup_fd != -1) {
+      close(writer->wakeup_fd);
+    }
+  }
+}
+
+LogAppender::Handoff* LogAppender::GetHandoff(size_t owner) {
+  // a thread keeps appending to the same writers, so its handoffs are set up once
+  static thread_local std::map<std::pair<uint64_t, size_t>, Handoff*> handoffs;
+  Handoff*& handoff = handoffs[{id_, owner}];
+  if (handoff == nullptr) {
+    Writer* writer = writers_[owner].get();
+    std::lock_guard<std::mutex> lock(writer->handoffs_mtx);
+    writer->handoffs.emplace_back(new Handoff(config_.handoff_capacity));
+    handoff = writer->handoffs.back().get();
+    writer->num_handoffs.store(writer->handoffs.size(), std::memory_order_release);
+  }
+  return handoff;
+}
+
+bool LogAppender::Append(size_t owner, CommitLog* log, std::string batch,
+                         Callback done) {
+  if (stopped_.load(std::memory_order_acquire) || owner >= writers_.size()) {
+    return false;
+  }
+  Writer* writer = writers_[owner].get();
+  writer->pending_bytes.fetch_add(batch.size(), std::memory_order_relaxed);
+  Request request;
+  request.log = log;
+  request.batch = std::move(batch);
+  request.done = std::move(done);
+  if (!GetHandoff(owner)->Push(request)) {
+    writer->overflow.Push(std::move(request));
+  }
+  // pairs with the fence in Sleep(), either the writer finds the batch before it
+  // sleeps or this thread finds it sleeping
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (writer->sleeping.load(std::memory_order_relaxed) &&
+      writer->sleeping.exchange(false)) {
+    Wakeup(writer->wakeup_fd);
+  }
+  return true;
+}
+
+void LogAppender::Stop() {
+  if (stopped_.exchange(true)) {
+    return;
+  }
+  for (auto& writer : writers_) {
+    Wakeup(writer->wakeup_fd);
+  }
+  for (auto& writer : writers_) {
+    if (writer->thread.joinable()) {
+      writer->thread.join();
+    }
+  }
+  // batches queued while the writers were exiting
+  for (auto& writer : writers_) {
+    std::vector<Handoff*> handoffs;
+    std::vector<Request> left;
+    Collect(writer.get(), handoffs, &left);
+    for (Request& request : left) {
+      request.done(false, 0);
+    }
+  }
+}
+
+void LogAppender::Collect(Writer* writer, std::vector<Handoff*>& handoffs,
+                          std::vector<Request>* requests) {
+  if (writer->num_handoffs.load(std::memory_order_acquire) != handoffs.size()) {
+    std::lock_guard<std::mutex> lock(writer->handoffs_mtx);
+    handoffs.clear();
+    for (auto& handoff : writer->handoffs) {
+      handoffs.push_back(handoff.get());
+    }
+  }
+  Request request;
+  for (Handoff* handoff : handoffs) {
+    while (handoff->Pop(&request)) {
+      requests->push_back(std::move(request));
+    }
+  }
+  writer->overflow.PopAll(requests);
+}
+
+void LogAppender::Sleep(Writer* writer, const std::vector<Handoff*>& handoffs,
+                        int timeout_ms) {
+  writer->sleeping.store(true, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  bool idle = writer->overflow.Empty() &&
+              writer->num_handoffs.load(std::memory_order_acquire) ==
+                  handoffs.size() &&
+              std::all_of(handoffs.begin(), handoffs.end(),
+                          [](Handoff* handoff) { return handoff->Empty(); });
+  if (idle && !stopped_.load(std::memory_order_acquire)) {
+    struct pollfd pfd {};
+    pfd.fd = writer->wakeup_fd;
+    pfd.events = POLLIN;
+    if (poll(&pfd, 1, timeout_ms) > 0) {
+      uint64_t v = 0;
+      ssize_t n = read(writer->wakeup_fd, &v, sizeof(v));
+      (void)n;
+    }
+  }
+  writer->sleeping.store(false, std::memory_order_relaxed);
+}
+
+void LogAppender::Run(Writer* writer) {
+  std::vector<Handoff*> handoffs;
+  std::vector<Request> requests;
+  while (true) {
+    Collect(writer, handoffs, &requests);
+    if (requests.empty()) {
+      if (stopped_.load(std::memory_order_acquire)) {
+        break;
+      }
+      Sleep(writer, handoffs, -1);
+      continue;
+    }
+    if (config_.linger_ms > 0) {
+      uint64_t deadline = time::GetCurrentMs() + config_.linger_ms;
+      while (!stopped_.load(std::memory_order_acquire) &&
+             writer->pending_bytes.load(std::memory_order_relaxed) <
+                 config_.max_batch_bytes) {
+        uint64_t now = time::GetCurrentMs();
+        if (now >= deadline) {
+          break;
+        }
+        Sleep(writer, handoffs, static_cast<int>(deadline - now));
+        Collect(writer, handoffs, &requests);
+      }
+    }
+    Write(writer, requests);
+    requests.clear();
+  }
+}
+
+void LogAppender::Write(Writer* writer, std::vector<Request>& requests) {
+  size_t begin = 0;
+  size_t bytes = 0;
+  for (size_t i = 0; i < requests.size(); i++) {
+    bytes += requests[i].batch.size();
+    if (bytes >= config_.max_batch_bytes || i + 1 == requests.size()) {
+      WriteGroup(requests.data() + begin, i + 1 - begin);
+      writer->pending_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+      begin = i + 1;
+      bytes = 0;
+    }
+  }
+}
+
+void LogAppender::WriteGroup(Request* requests, size_t n) {
+  std::vector<uint64_t> offsets(n);
+  std::vector<bool> appended(n);
+  std::vector<CommitLog*> logs;
+  for (size_t i = 0; i < n; i++) {
+    Request& request = requests[i];
+    appended[i] = request.log->AppendEncodedBatch(
+        request.batch.data(), request.batch.size(), &offsets[i]);
+    if (appended[i] &&
+        std::find(logs.begin(), logs.end(), request.log) == logs.end()) {
+      logs.push_back(request.log);
+    }
+  }
+  // a group touches few logs, each is synced once for all of its batches
+  std::vector<CommitLog*> failed;
+  for (CommitLog* log : logs) {
+    if (!log->Sync()) {
+      failed.push_back(log);
+    }
+  }
+  for (size_t i = 0; i < n; i++) {
+    Request& request = requests[i];
+    bool ok = appended[i] && std::find(failed.begin(), failed.end(),
+                                       request.log) == failed.end();
+    request.done(ok, offsets[i]);
+  }
+}
+
+}  // namespace storage
+}  // namespace ahrimq
@@ -0,0 +1,135 @@
+#ifndef _AHRIMQ_STORAGE_LOG_APPENDER_H_
+#define _AHRIMQ_STORAGE_LOG_APPENDER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "base/nocopyable.h"
+#include "pool/mpsc_queue.hpp"
+#include "pool/spsc_queue.hpp"
+#include "storage/commit_log.h"
+
+namespace ahrimq {
+namespace storage {
+
+/// @brief Configuration of a log appender.
+struct AppenderConfig {
+  // once a batch is pending, the writer waits this long for more before it writes
+  // them, 0 writes at once. Batches queued while the writer syncs are grouped
+  // anyway.
+  uint64_t linger_ms = 0;
+  // the writer stops waiting once this many bytes are pending, and syncs after at
+  // most this many bytes
+  size_t max_batch_bytes = 1 << 20;
+  // writer threads, every log is owned by one of them
+  size_t num_writers = 1;
+  // batches a thread hands to a writer without waiting for it, more are handed
+  // over through a slower shared queue
+  size_t handoff_capacity = 1024;
+};
+
+/// @brief LogAppender appends encoded record batches to commit logs on writer
+/// threads of its own, so that the batches of many producers share a sync: a
+/// writer takes everything handed to it at once, appends it and syncs every log
+/// it appended to a single time before it reports the batches appended.
+///
+/// Every log is owned by one writer, the caller picks it, e.g. with
+/// Topic::Owner(), and keeps it. The owner is the single writer of the log, so
+/// logs owned by different writers are appended and synced in parallel. Every
+/// thread appending hands its batches to a writer through a ring of its own, set
+/// up on its first append to that writer.
+///
+/// Logs appended to through an appender must not be appended to otherwise. They
+/// are read concurrently as usual.
+class LogAppender : public NoCopyable {
+ public:
+  /// @brief Called on the writer thread once a batch was appended and synced.
+  /// ok is false if it was not, base_offset is the offset of its first record.
+  typedef std::function<void(bool ok, uint64_t base_offset)> Callback;
+
+  /// @brief Construct an appender and start its writers.
+  /// @param config
+  explicit LogAppender(const AppenderConfig& config = AppenderConfig());
+
+  /// @brief Stop the appender, see Stop().
+  ~LogAppender();
+
+  /// @brief Queue a batch encoded by a producer, from any thread. It is appended as
+  /// with CommitLog::AppendEncodedBatch(). The batches of a thread keep their
+  /// order unless its handoff ran full, a producer whose batches must stay in
+  /// order waits for one to be reported before it queues the next.
+  /// @param owner writer owning log, less than Writers()
+  /// @param log must outlive the appender
+  /// @param batch
+  /// @param done
+  /// @return false if the appender is stopped, done is not called then
+  bool Append(size_t owner, CommitLog* log, std::string batch, Callback done);
+
+  /// @brief Append and sync what is queued and stop the writers. Append() must not
+  /// be called anymore once Stop() was.
+  void Stop();
+
+  size_t Writers() const {
+    return writers_.size();
+  }
+
+ private:
+  struct Request {
+    CommitLog* log = nullptr;
+    std::string batch;
+    Callback done;
+  };
+
+  typedef SPSCQueue<Request> Handoff;
+
+  struct Writer {
+    // one handoff per appending thread, consumed by the writer
+    std::mutex handoffs_mtx;
+    std::vector<std::unique_ptr<Handoff>> handoffs;
+    std::atomic<size_t> num_handoffs{0};
+    // batches which did not fit into a full handoff
+    MPSCQueue<Request> overflow;
+    // bytes queued and not written yet
+    std::atomic<size_t> pending_bytes{0};
+    // the writer waits on wakeup_fd and wants to be woken up
+    std::atomic<bool> sleeping{false};
+    int wakeup_fd = -1;
+    std::thread thread;
+  };
+
+  // the handoff of the calling thread to a writer
+  Handoff* GetHandoff(size_t owner);
+
+  void Run(Writer* writer);
+
+  // take what was handed to the writer, oldest first per thread
+  void Collect(Writer* writer, std::vector<Handoff*>& handoffs,
+               std::vector<Request>* requests);
+
+  // wait until a batch is handed over or timeout_ms passed, -1 waits forever
+  void Sleep(Writer* writer, const std::vector<Handoff*>& handoffs, int timeout_ms);
+
+  // append requests to their logs, syncing every max_batch_bytes
+  void Write(Writer* writer, std::vector<Request>& requests);
+
+  // append a group of requests and sync their logs once
+  void WriteGroup(Request* requests, size_t n);
+
+ private:
+  AppenderConfig config_;
+  // tells the appenders apart in the handoffs cached by threads
+  uint64_t id_;
+  std::vector<std::unique_ptr<Writer>> writers_;
+  std::atomic<bool> stopped_{false};
+};
+
+}  // namespace storage
+}  // namespace ahrimq
+
+#endif  // _AHRIMQ_STORAGE_LOG_APPENDER_H_
@@ -0,0 +1,147 @@
+#include "ahrimq/storage/log_appender.h"
+
+#include <dirent.h>
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ahrimq/storage/topic.h"
+
+using namespace ahrimq;
+using namespace ahrimq::storage;
+
+class LogAppenderTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    char tmpl[] = "/tmp/ahrimq_appender_XXXXXX";
+    char* dir = mkdtemp(tmpl);
+    ASSERT_NE(dir, nullptr);
+    dir_ = dir;
+    // the appender syncs, the logs themselves never do
+    config_.fsync_interval_ms = 0;
+    config_.segment_bytes = 64 << 10;
+  }
+
+  void TearDown() override {
+    RemoveDir(dir_);
+  }
+
+  static void RemoveDir(const std::string& path) {
+    DIR* d = opendir(path.c_str());
+    if (d == nullptr) {
+      unlink(path.c_str());
+      return;
+    }
+    while (struct dirent* entry = readdir(d)) {
+      std::string name = entry->d_name;
+      if (name != "." && name != "..") {
+        RemoveDir(path + "/" + name);
+      }
+    }
+    closedir(d);
+    rmdir(path.c_str());
+  }
+
+  static std::string Batch(int n) {
+    BatchBuilder builder(Codec::None);
+    for (int i = 0; i < n; i++) {
+      builder.Add(i, "", std::string(100, 'v'));
+    }
+    Buffer out;
+    EXPECT_TRUE(builder.Finish(out));
+    return out.ReadAllAsString();
+  }
+
+  std::string dir_;
+  LogConfig config_;
+};
+
+TEST_F(LogAppenderTest, ProducersTest) {
+  struct {
+    uint64_t linger_ms;
+    size_t writers;
+  } cases[] = {{0, 1}, {2, 1}, {0, 3}};
+  for (const auto& c : cases) {
+    Topic topic(dir_ + "/" + std::to_string(c.linger_ms) + std::to_string(c.writers),
+                "topic", 4, config_);
+    ASSERT_TRUE(topic.Open());
+    AppenderConfig config;
+    config.linger_ms = c.linger_ms;
+    config.max_batch_bytes = 16 << 10;
+    config.num_writers = c.writers;
+    // small handoffs run full, the rest goes through the shared queue
+    config.handoff_capacity = 16;
+    LogAppender appender(config);
+    ASSERT_EQ(appender.Writers(), c.writers);
+
+    const int producers = 4;
+    const int per_producer = 200;
+    std::mutex mtx;
+    std::set<uint64_t> offsets[4];
+    std::atomic<int> done{0};
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; p++) {
+      threads.emplace_back([&, p] {
+        for (int i = 0; i < per_producer; i++) {
+          uint32_t partition = (p + i) % 4;
+          CommitLog* log = topic.Partition(partition);
+          auto callback = [&, log, partition](bool ok, uint64_t base) {
+            EXPECT_TRUE(ok);
+            // synced before it is reported
+            EXPECT_GE(log->SyncedOffset(), base + 3);
+            std::lock_guard<std::mutex> lock(mtx);
+            offsets[partition].insert(base);
+            done++;
+          };
+          ASSERT_TRUE(appender.Append(topic.Owner(partition, c.writers), log,
+                                      Batch(3), callback));
+        }
+      });
+    }
+    for (auto& t : threads) {
+      t.join();
+    }
+    appender.Stop();
+    EXPECT_EQ(done.load(), producers * per_producer);
+    // every batch got its own range of offsets
+    for (uint32_t partition = 0; partition < 4; partition++) {
+      CommitLog* log = topic.Partition(partition);
+      EXPECT_EQ(offsets[partition].size(), producers * per_producer / 4u);
+      EXPECT_EQ(log->NextOffset(), producers * per_producer / 4u * 3);
+      EXPECT_EQ(*offsets[partition].rbegin(), log->NextOffset() - 3);
+    }
+    EXPECT_EQ(topic.Partition(4), nullptr);
+    EXPECT_FALSE(appender.Append(0, topic.Partition(0), Batch(1), nullptr));
+  }
+}
+
+TEST_F(LogAppenderTest, InvalidBatchTest) {
+  CommitLog log(dir_ + "/log", config_);
+  ASSERT_TRUE(log.Open());
+  LogAppender appender;
+  std::string batch = Batch(2);
+  std::atomic<int> results{0};
+  ASSERT_TRUE(appender.Append(0, &log, batch.substr(1), [&](bool ok, uint64_t) {
+    EXPECT_FALSE(ok);
+    results++;
+  }));
+  ASSERT_TRUE(appender.Append(0, &log, batch, [&](bool ok, uint64_t base) {
+    EXPECT_TRUE(ok);
+    EXPECT_EQ(base, 0u);
+    results++;
+  }));
+  appender.Stop();
+  EXPECT_EQ(results.load(), 2);
+  EXPECT_EQ(log.SyncedOffset(), 2u);
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,178 @@
+#include "storage/log_index.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <iostream>
+
+namespace ahrimq {
+namespace storage {
+
+IndexFile::IndexFile(std::string path, size_t entry_size)
+    : path_(std::move(path)), entry_size_(entry_size) {}
+
+IndexFile::~IndexFile() {
+  Unmap();
+  if (fd_ != -1) {
+    if (writable_) {
+      // leave whole entries only, as Load() expects
+      if (ftruncate(fd_, entries_ * entry_size_) == -1) {
+        std::cerr << "can not truncate " << path_ << '\n';
+      }
+    }
+    close(fd_);
+  }
+}
+
+void IndexFile::Unmap() {
+  if (data_ != nullptr) {
+    munmap(data_, mapped_bytes_);
+    data_ = nullptr;
+    mapped_bytes_ = 0;
+  }
+}
+
+bool IndexFile::Create(size_t capacity_bytes) {
+  Unmap();
+  if (fd_ != -1) {
+    close(fd_);
+  }
+  fd_ = open(path_.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  capacity_ = capacity_bytes / entry_size_;
+  entries_ = 0;
+  mapped_bytes_ = capacity_ * entry_size_;
+  if (fd_ == -1 || mapped_bytes_ == 0 || ftruncate(fd_, mapped_bytes_) == -1) {
+    std::cerr << "can not create " << path_ << ": " << strerror(errno) << '\n';
+    capacity_ = 0;
+    return false;
+  }
+  void* p = mmap(nullptr, mapped_bytes_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  if (p == MAP_FAILED) {
+    std::cerr << "can not map " << path_ << ": " << strerror(errno) << '\n';
+    capacity_ = 0;
+    mapped_bytes_ = 0;
+    return false;
+  }
+  data_ = static_cast<char*>(p);
+  writable_ = true;
+  return true;
+}
+
+bool IndexFile::Load() {
+  fd_ = open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd_ == -1) {
+    return false;
+  }
+  struct stat st {};
+  if (fstat(fd_, &st) == -1 || st.st_size % entry_size_ != 0) {
+    return false;
+  }
+  entries_ = capacity_ = st.st_size / entry_size_;
+  writable_ = false;
+  if (st.st_size == 0) {
+    return true;
+  }
+  void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd_, 0);
+  if (p == MAP_FAILED) {
+    return false;
+  }
+  data_ = static_cast<char*>(p);
+  mapped_bytes_ = st.st_size;
+  return true;
+}
+
+bool IndexFile::Seal() {
+  if (!writable_) {
+    return true;
+  }
+  Unmap();
+  writable_ = false;
+  if (ftruncate(fd_, entries_ * entry_size_) == -1) {
+    return false;
+  }
+  close(fd_);
+  fd_ = -1;
+  return Load();
+}
+
+bool IndexFile::Remove() {
+  Unmap();
+  if (fd_ != -1) {
+    close(fd_);
+    fd_ = -1;
+  }
+  entries_ = capacity_ = 0;
+  return unlink(path_.c_str()) == 0 || errno == ENOENT;
+}
+
+void IndexFile::AppendEntry(const void* entry) {
+  memcpy(data_ + entries_ * entry_size_, entry, entry_size_);
+  entries_++;
+}
+
+// Index of the last of the n entries whose key is not after target, or n if the
+// first one is already after it. The search halves the range without branching on
+// the comparison, which becomes a conditional move, so that the lookups of the
+// mapped pages overlap instead of waiting on mispredicted branches.
+template <typename Entry, typename Key, typename Less>
+static size_t SearchLast(const Entry* entries, size_t n, Key target, Less less) {
+  if (n == 0 || less(target, entries[0])) {
+    return n;
+  }
+  const Entry* base = entries;
+  while (n > 1) {
+    size_t half = n / 2;
+    base = less(target, base[half]) ? base : base + half;
+    n -= half;
+  }
+  return base - entries;
+}
+
+bool OffsetIndex::Lookup(uint32_t relative_offset, OffsetIndexEntry* entry) const {
+  const OffsetIndexEntry* entries =
+      reinterpret_cast<const OffsetIndexEntry*>(Data());
+  size_t i = SearchLast(entries, Entries(), relative_offset,
+                        [](uint32_t target, const OffsetIndexEntry& e) {
+                          return target < e.relative_offset;
+                        });
+  if (i == Entries()) {
+    return false;
+  }
+  *entry = entries[i];
+  return true;
+}
+
+bool OffsetIndex::LookupPosition(uint32_t position, OffsetIndexEntry* entry) const {
+  const OffsetIndexEntry* entries =
+      reinterpret_cast<const OffsetIndexEntry*>(Data());
+  size_t i = SearchLast(entries, Entries(), position,
+                        [](uint32_t target, const OffsetIndexEntry& e) {
+                          return target < e.position;
+                        });
+  if (i == Entries()) {
+    return false;
+  }
+  *entry = entries[i];
+  return true;
+}
+
+bool TimeIndex::Lookup(uint64_t timestamp, TimeIndexEntry* entry) const {
+  const TimeIndexEntry* entries = reinterpret_cast<const TimeIndexEntry*>(Data());
+  // the last entry strictly before timestamp
+  size_t i = SearchLast(entries, Entries(), timestamp,
+                        [](uint64_t target, const TimeIndexEntry& e) {
+                          return target <= e.timestamp;
+                        });
+  if (i == Entries()) {
+    return false;
+  }
+  *entry = entries[i];
+  return true;
+}
+
+}  // namespace storage
+}  // namespace ahrimq
@@ -0,0 +1,161 @@
+#ifndef _AHRIMQ_STORAGE_LOG_INDEX_H_
+#define _AHRIMQ_STORAGE_LOG_INDEX_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "base/nocopyable.h"
+
+namespace ahrimq {
+namespace storage {
+
+/// @brief An entry of the offset index, the record at base offset +
+/// relative_offset starts at position of the segment file.
+struct OffsetIndexEntry {
+  uint32_t relative_offset;
+  uint32_t position;
+};
+
+/// @brief An entry of the time index, no record before base offset +
+/// relative_offset has a timestamp larger than timestamp.
+struct __attribute__((packed)) TimeIndexEntry {
+  uint64_t timestamp;
+  uint32_t relative_offset;
+};
+
+/// @brief IndexFile is a file of fixed size entries mapped into memory. Entries are
+/// kept in host byte order so that they are searched in place.
+///
+/// The file of the segment being appended to is preallocated to its capacity and
+/// cut to the entries it holds by Seal(), which maps it read only. A sealed file
+/// is mapped as it is.
+class IndexFile : public NoCopyable {
+ public:
+  /// @brief Construct an index kept in path, which is opened by Open().
+  /// @param path
+  /// @param entry_size
+  IndexFile(std::string path, size_t entry_size);
+
+  ~IndexFile();
+
+  /// @brief Map a file for appending, dropping what it held.
+  /// @param capacity_bytes size of the file, rounded down to whole entries
+  /// @return
+  bool Create(size_t capacity_bytes);
+
+  /// @brief Map a sealed file.
+  /// @return false if the file does not exist or does not hold whole entries
+  bool Load();
+
+  /// @brief Cut the file to its entries and map it read only.
+  /// @return
+  bool Seal();
+
+  /// @brief Drop the entries from the nth on.
+  /// @param n
+  void Truncate(size_t n) {
+    if (n < entries_) {
+      entries_ = n;
+    }
+  }
+
+  /// @brief Close and delete the file.
+  /// @return
+  bool Remove();
+
+  size_t Entries() const {
+    return entries_;
+  }
+
+  bool Full() const {
+    return entries_ >= capacity_;
+  }
+
+  bool Mapped() const {
+    return data_ != nullptr;
+  }
+
+  const std::string& Path() const {
+    return path_;
+  }
+
+ protected:
+  // append an entry, the index must not be full
+  void AppendEntry(const void* entry);
+
+  const char* Data() const {
+    return data_;
+  }
+
+ private:
+  void Unmap();
+
+ private:
+  std::string path_;
+  size_t entry_size_;
+  int fd_ = -1;
+  char* data_ = nullptr;
+  size_t mapped_bytes_ = 0;
+  size_t entries_ = 0;
+  // entries which fit into the mapped file
+  size_t capacity_ = 0;
+  bool writable_ = false;
+};
+
+/// @brief OffsetIndex maps offsets to positions in the segment file, for a sparse
+/// subset of the records.
+class OffsetIndex : public IndexFile {
+ public:
+  explicit OffsetIndex(std::string path)
+      : IndexFile(std::move(path), sizeof(OffsetIndexEntry)) {}
+
+  void Append(uint32_t relative_offset, uint32_t position) {
+    OffsetIndexEntry entry{relative_offset, position};
+    AppendEntry(&entry);
+  }
+
+  /// @brief Find the last entry whose offset is not after relative_offset.
+  /// @param relative_offset
+  /// @param entry output arg
+  /// @return false if there is none, the search starts at the front of the file
+  bool Lookup(uint32_t relative_offset, OffsetIndexEntry* entry) const;
+
+  /// @brief Find the last entry whose position is not after position.
+  /// @param position
+  /// @param entry output arg
+  /// @return false if there is none
+  bool LookupPosition(uint32_t position, OffsetIndexEntry* entry) const;
+
+  const OffsetIndexEntry& At(size_t i) const {
+    return reinterpret_cast<const OffsetIndexEntry*>(Data())[i];
+  }
+};
+
+/// @brief TimeIndex maps timestamps to offsets, for a sparse subset of the
+/// records.
+class TimeIndex : public IndexFile {
+ public:
+  explicit TimeIndex(std::string path)
+      : IndexFile(std::move(path), sizeof(TimeIndexEntry)) {}
+
+  void Append(uint64_t timestamp, uint32_t relative_offset) {
+    TimeIndexEntry entry{timestamp, relative_offset};
+    AppendEntry(&entry);
+  }
+
+  /// @brief Find the last entry whose timestamp is before timestamp.
+  /// @param timestamp
+  /// @param entry output arg
+  /// @return false if there is none, the search starts at the front of the file
+  bool Lookup(uint64_t timestamp, TimeIndexEntry* entry) const;
+
+  const TimeIndexEntry& At(size_t i) const {
+    return reinterpret_cast<const TimeIndexEntry*>(Data())[i];
+  }
+};
+
+}  // namespace storage
+}  // namespace ahrimq
+
+#endif  // _AHRIMQ_STORAGE_LOG_INDEX_H_
@@ -0,0 +1,435 @@
+#include "storage/log_segment.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+namespace ahrimq {
+namespace storage {
+
+// bytes read at a time while scanning a file
+constexpr static size_t kScanChunk = 1 << 20;
+// bytes read at a time while looking for a batch from an index entry on
+constexpr static size_t kLookupChunk = 64 << 10;
+
+static inline uint32_t ReadUInt32BE(const char* p) {
+  const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+  return (uint32_t(u[0]) << 24) | (uint32_t(u[1]) << 16) | (uint32_t(u[2]) << 8) |
+         uint32_t(u[3]);
+}
+
+namespace {
+
+// BatchScanner reads the batches of a file from a position on, through a window
+// of at least kScanChunk bytes.
+class BatchScanner {
+ public:
+  BatchScanner(int fd, size_t pos, size_t end, size_t chunk = kScanChunk)
+      : fd_(fd), pos_(pos), end_(end), chunk_(chunk) {}
+
+  // the header of the next batch and its size, false at the end of the file or at
+  // the first batch which is torn or corrupted
+  bool Next(BatchHeader* header, size_t* size, bool verify) {
+    if (!Ensure(4)) {
+      return false;
+    }
+    uint32_t length = ReadUInt32BE(Front());
+    if (length < kBatchHeaderSize - 4 || length > end_ - pos_ - 4 ||
+        !Ensure(size_t(length) + 4)) {
+      return false;
+    }
+    *size = DecodeBatch(Front(), size_t(length) + 4, header, verify);
+    if (*size == 0) {
+      return false;
+    }
+    last_ = Front();
+    pos_ += *size;
+    return true;
+  }
+
+  // bytes of the last batch returned, valid until the next one
+  const char* Last() const {
+    return last_;
+  }
+
+ private:
+  const char* Front() const {
+    return window_.data() + (pos_ - window_pos_);
+  }
+
+  // make sure the n bytes at pos_ are in the window
+  bool Ensure(size_t n) {
+    if (end_ - pos_ < n) {
+      return false;
+    }
+    if (pos_ >= window_pos_ && pos_ + n <= window_pos_ + window_.size()) {
+      return true;
+    }
+    window_.resize(std::min(std::max(n, chunk_), end_ - pos_));
+    window_pos_ = pos_;
+    size_t done = 0;
+    while (done < window_.size()) {
+      ssize_t r = pread(fd_, &window_[done], window_.size() - done, pos_ + done);
+      if (r < 0 && errno == EINTR) {
+        continue;
+      }
+      if (r <= 0) {
+        window_.resize(done);
+        return done >= n;
+      }
+      done += r;
+    }
+    return true;
+  }
+
+ private:
+  int fd_;
+  size_t pos_;
+  size_t end_;
+  size_t chunk_;
+  std::string window_;
+  size_t window_pos_ = 0;
+  const char* last_ = nullptr;
+};
+
+}  // namespace
+
+LogSegment::LogSegment(const std::string& dir, uint64_t base_offset,
+                       size_t index_interval_bytes, size_t max_index_bytes)
+    : path_(FilePath(dir, base_offset)),
+      base_offset_(base_offset),
+      next_offset_(base_offset),
+      offset_index_(path_.substr(0, path_.size() - 4) + ".index"),
+      time_index_(path_.substr(0, path_.size() - 4) + ".timeindex"),
+      index_interval_bytes_(index_interval_bytes),
+      max_index_bytes_(max_index_bytes) {}
+
+LogSegment::~LogSegment() {
+  if (fd_ != -1) {
+    close(fd_);
+  }
+}
+
+std::string LogSegment::FilePath(const std::string& dir, uint64_t base_offset) {
+  char name[32];
+  snprintf(name, sizeof(name), "%020" PRIu64 ".log", base_offset);
+  return dir + "/" + name;
+}
+
+bool LogSegment::Open(bool recover) {
+  fd_ = open(path_.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (fd_ == -1) {
+    std::cerr << "can not open " << path_ << ": " << strerror(errno) << '\n';
+    return false;
+  }
+  struct stat st {};
+  if (fstat(fd_, &st) == -1) {
+    return false;
+  }
+  size_ = st.st_size;
+  return recover ? Recover() : true;
+}
+
+bool LogSegment::Recover() {
+  if (!offset_index_.Create(max_index_bytes_) ||
+      !time_index_.Create(max_index_bytes_)) {
+    return false;
+  }
+  indexed_ = true;
+  scanned_ = true;
+  BatchScanner scanner(fd_, 0, size_);
+  BatchHeader header;
+  size_t size = 0;
+  uint64_t expected = base_offset_;
+  size_t valid = 0;
+  while (scanner.Next(&header, &size, true)) {
+    if (header.base_offset != expected) {
+      break;
+    }
+    if (expected == base_offset_) {
+      first_timestamp_ = header.first_timestamp;
+    }
+    // batches too far from the base offset are left to the scan of lookups
+    if (Indexable(header)) {
+      IndexBatch(header, valid, size);
+    }
+    expected = header.NextOffset();
+    valid += size;
+  }
+  next_offset_ = expected;
+  // the batches after the first bad one were never acknowledged as durable, they
+  // are dropped along with the torn write
+  if (valid < size_) {
+    std::cerr << "truncating " << path_ << " from " << size_ << " to " << valid
+              << " bytes\n";
+    if (ftruncate(fd_, valid) == -1) {
+      return false;
+    }
+    size_ = valid;
+  }
+  return true;
+}
+
+bool LogSegment::LoadIndexes() {
+  std::lock_guard<std::mutex> lock(index_mtx_);
+  if (indexed_) {
+    return true;
+  }
+  // sealed indexes are trusted if their last entries point into the file
+  if (offset_index_.Load() && time_index_.Load()) {
+    size_t n = offset_index_.Entries();
+    size_t m = time_index_.Entries();
+    if ((n == 0 || offset_index_.At(n - 1).position < size_) &&
+        (m == 0 || base_offset_ + time_index_.At(m - 1).relative_offset <
+                       next_offset_)) {
+      indexed_ = true;
+      return true;
+    }
+  }
+  std::cerr << "rebuilding the indexes of " << path_ << '\n';
+  if (!offset_index_.Create(max_index_bytes_) ||
+      !time_index_.Create(max_index_bytes_)) {
+    return false;
+  }
+  indexed_ = true;
+  scanned_ = true;
+  BatchScanner scanner(fd_, 0, size_);
+  BatchHeader header;
+  size_t size = 0;
+  size_t pos = 0;
+  // batches too far from the base offset are left to the scan of lookups
+  while (scanner.Next(&header, &size, false) && Indexable(header)) {
+    IndexBatch(header, pos, size);
+    pos += size;
+  }
+  return Seal();
+}
+
+bool LogSegment::Seal() {
+  // the largest timestamp ends the time index, so that it is known without a scan
+  // once the segment is reopened
+  size_t n = time_index_.Entries();
+  if (indexed_ && !time_index_.Full() && next_offset_ > base_offset_ &&
+      (n == 0 || max_timestamp_ > time_index_.At(n - 1).timestamp)) {
+    uint64_t relative = max_timestamp_offset_ - base_offset_;
+    time_index_.Append(max_timestamp_, static_cast<uint32_t>(relative));
+  }
+  return offset_index_.Seal() && time_index_.Seal();
+}
+
+bool LogSegment::MaxTimestamp(uint64_t* timestamp) {
+  size_t n = LoadIndexes() ? time_index_.Entries() : 0;
+  if (n == 0 && (!scanned_ || next_offset_ == base_offset_)) {
+    // max_timestamp_ was never set
+    return false;
+  }
+  *timestamp = n == 0 ? max_timestamp_
+                      : std::max(max_timestamp_, time_index_.At(n - 1).timestamp);
+  return true;
+}
+
+void LogSegment::IndexBatch(const BatchHeader& header, size_t position,
+                            size_t size) {
+  if (header.max_timestamp > max_timestamp_ || header.base_offset == base_offset_) {
+    max_timestamp_ = header.max_timestamp;
+    max_timestamp_offset_ = header.base_offset;
+  }
+  // the log rolls before a segment outgrows the 32 bit relative offsets
+  assert(Indexable(header));
+  if (bytes_since_index_ >= index_interval_bytes_ && !IndexFull()) {
+    offset_index_.Append(static_cast<uint32_t>(header.base_offset - base_offset_),
+                         static_cast<uint32_t>(position));
+    size_t n = time_index_.Entries();
+    if (n == 0 || max_timestamp_ > time_index_.At(n - 1).timestamp) {
+      uint64_t relative = max_timestamp_offset_ - base_offset_;
+      time_index_.Append(max_timestamp_, static_cast<uint32_t>(relative));
+    }
+    bytes_since_index_ = 0;
+  }
+  bytes_since_index_ += size;
+}
+
+bool LogSegment::Write(const char* data, size_t len, uint64_t records,
+                       uint64_t first_timestamp) {
+  size_t done = 0;
+  while (done < len) {
+    ssize_t n = pwrite(fd_, data + done, len - done, size_ + done);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      std::cerr << "can not write " << path_ << ": " << strerror(errno) << '\n';
+      // leave no partial record behind
+      if (done > 0 && ftruncate(fd_, size_) == -1) {
+        std::cerr << "can not truncate " << path_ << '\n';
+      }
+      return false;
+    }
+    done += n;
+  }
+  if (next_offset_ == base_offset_) {
+    first_timestamp_ = first_timestamp;
+  }
+  if (indexed_) {
+    // the batches were checked when they were appended
+    BatchHeader header;
+    for (size_t pos = 0; pos < len;) {
+      size_t size = DecodeBatch(data + pos, len - pos, &header, false);
+      IndexBatch(header, size_ + pos, size);
+      pos += size;
+    }
+  }
+  size_ += len;
+  next_offset_ += records;
+  return true;
+}
+
+bool LogSegment::Sync() {
+  if (fdatasync(fd_) == -1) {
+    std::cerr << "can not sync " << path_ << ": " << strerror(errno) << '\n';
+    return false;
+  }
+  return true;
+}
+
+bool LogSegment::FindPosition(uint64_t offset, size_t* pos) {
+  size_t start = 0;
+  OffsetIndexEntry entry;
+  // offsets past the segment start at its last index entry
+  uint64_t relative = std::min(offset - base_offset_, kMaxRelativeOffset);
+  if (LoadIndexes() &&
+      offset_index_.Lookup(static_cast<uint32_t>(relative), &entry)) {
+    start = entry.position;
+  }
+  BatchScanner scanner(fd_, start, size_, kLookupChunk);
+  BatchHeader header;
+  size_t size = 0;
+  size_t cur = start;
+  while (scanner.Next(&header, &size, false) && header.base_offset <= offset) {
+    if (offset < header.NextOffset()) {
+      *pos = cur;
+      return true;
+    }
+    cur += size;
+  }
+  return false;
+}
+
+bool LogSegment::FindOffsetByTime(uint64_t timestamp, uint64_t* offset) {
+  size_t start = 0;
+  TimeIndexEntry tentry;
+  if (LoadIndexes() && time_index_.Lookup(timestamp, &tentry)) {
+    // no record before tentry has a timestamp as large as the one searched
+    if (!FindPosition(base_offset_ + tentry.relative_offset, &start)) {
+      return false;
+    }
+  }
+  BatchScanner scanner(fd_, start, size_, kLookupChunk);
+  BatchHeader header;
+  size_t size = 0;
+  while (scanner.Next(&header, &size, false)) {
+    if (header.max_timestamp < timestamp) {
+      continue;
+    }
+    // the record is in this batch, unless the batch can not be decoded
+    BatchReader reader(scanner.Last(), size, false);
+    LogRecord record;
+    while (reader.Next(&record)) {
+      if (record.timestamp >= timestamp) {
+        *offset = record.offset;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+size_t LogSegment::RecordsEnd(size_t pos, size_t limit) {
+  // batches end at index entries, so only the bytes from the last entry before
+  // limit on are scanned
+  size_t start = pos;
+  OffsetIndexEntry entry;
+  if (LoadIndexes() &&
+      offset_index_.LookupPosition(static_cast<uint32_t>(limit), &entry) &&
+      entry.position > pos) {
+    start = entry.position;
+  }
+  BatchScanner scanner(fd_, start, size_, kLookupChunk);
+  BatchHeader header;
+  size_t size = 0;
+  size_t end = start;
+  while (scanner.Next(&header, &size, false)) {
+    if (end + size > limit) {
+      if (end == pos) {
+        end += size;
+      }
+      break;
+    }
+    end += size;
+  }
+  return end;
+}
+
+bool LogSegment::Slice(uint64_t offset, size_t max_bytes, LogSlice* slice,
+                       uint64_t end_offset) {
+  if (offset < base_offset_ || offset >= next_offset_) {
+    return false;
+  }
+  size_t pos = 0;
+  if (!FindPosition(offset, &pos)) {
+    return false;
+  }
+  size_t end = size_;
+  if (end_offset < next_offset_ && (!FindPosition(end_offset, &end) || end <= pos)) {
+    return false;
+  }
+  slice->fd = fd_;
+  slice->position = pos;
+  // a slice reaching the end of the file needs no scan for its last record
+  slice->length = end - pos;
+  if (slice->length > max_bytes) {
+    slice->length = RecordsEnd(pos, pos + max_bytes) - pos;
+  }
+  return true;
+}
+
+bool LogSegment::Read(uint64_t offset, size_t max_bytes, std::string* out) {
+  LogSlice slice;
+  if (!Slice(offset, max_bytes, &slice)) {
+    return false;
+  }
+  size_t start = out->size();
+  size_t total = slice.length;
+  out->resize(start + total);
+  size_t done = 0;
+  while (done < total) {
+    ssize_t n =
+        pread(fd_, &(*out)[start + done], total - done, slice.position + done);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      out->resize(start);
+      return false;
+    }
+    done += n;
+  }
+  return true;
+}
+
+bool LogSegment::Remove() {
+  bool ok = offset_index_.Remove();
+  ok = time_index_.Remove() && ok;
+  return unlink(path_.c_str()) == 0 && ok;
+}
+
+}  // namespace storage
+}  // namespace ahrimq
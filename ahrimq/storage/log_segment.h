@@ -0,0 +1,214 @@
+#ifndef _AHRIMQ_STORAGE_LOG_SEGMENT_H_
+#define _AHRIMQ_STORAGE_LOG_SEGMENT_H_
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+#include "base/nocopyable.h"
+#include "storage/log_index.h"
+#include "storage/record_batch.h"
+
+namespace ahrimq {
+namespace storage {
+
+class LogSegment;
+
+/// @brief Bytes of whole batches in a segment file, which are sent as they are
+/// stored.
+struct LogSlice {
+  int fd = -1;
+  size_t position = 0;
+  size_t length = 0;
+  // keeps fd open while the slice is sent, even if the segment is deleted
+  std::shared_ptr<const LogSegment> segment;
+};
+
+/// @brief LogSegment is one file of a commit log, holding the record batches of
+/// record_batch.h from its base offset on. Batches are only appended to the last
+/// segment of a log, the others are read only. The file is named after the base
+/// offset, zero padded to 20 digits, with a ".log" suffix.
+///
+/// Every index_interval_bytes a batch gets an entry in the offset index and in
+/// the time index of the segment, ".index" and ".timeindex" files next to it, so
+/// that the batch of an offset or timestamp is found by scanning at most that many
+/// bytes. The indexes of the last segment are rebuilt when it is recovered, those
+/// of the others are mapped on their first lookup and only rebuilt if missing.
+///
+/// A segment is not thread safe, but MaxTimestamp() of a segment which is no
+/// longer appended to may run along with its other lookups.
+class LogSegment : public NoCopyable {
+ public:
+  /// @brief The indexes hold offsets relative to the base offset in 32 bits, so
+  /// no record of a segment may be further than this from its base offset.
+  constexpr static uint64_t kMaxRelativeOffset = UINT32_MAX;
+
+  /// @brief Construct a segment, which is opened by Open().
+  /// @param dir directory of the log
+  /// @param base_offset offset of the first record
+  /// @param index_interval_bytes bytes of records between index entries
+  /// @param max_index_bytes size of the index files of the last segment
+  LogSegment(const std::string& dir, uint64_t base_offset,
+             size_t index_interval_bytes, size_t max_index_bytes);
+
+  ~LogSegment();
+
+  /// @brief Open the file of the segment, creating it if it does not exist.
+  /// @param recover scan the batches to find the next offset, cut off a torn write
+  /// at the end and rebuild the indexes, only needed for the last segment of a log
+  /// @return
+  bool Open(bool recover);
+
+  /// @brief Cut the indexes to their entries once nothing is appended anymore.
+  /// @return
+  bool Seal();
+
+  /// @brief Write whole batches at the end of the file.
+  /// @param data
+  /// @param len
+  /// @param records number of records in the batches
+  /// @param first_timestamp timestamp of the first record in data
+  /// @return
+  bool Write(const char* data, size_t len, uint64_t records,
+             uint64_t first_timestamp);
+
+  /// @brief Flush the data written to the disk.
+  /// @return
+  bool Sync();
+
+  /// @brief Read whole batches starting with the one holding offset, stopping
+  /// before max_bytes would be exceeded but always reading at least one batch.
+  /// @param offset
+  /// @param max_bytes
+  /// @param out the batches are appended to it
+  /// @return false if offset is not in the segment or the file can not be read
+  bool Read(uint64_t offset, size_t max_bytes, std::string* out);
+
+  /// @brief Find the bytes Read() would read, without reading them. The slice
+  /// refers to the file of the segment, which stays open until it is removed.
+  /// @param offset
+  /// @param max_bytes
+  /// @param slice output arg
+  /// @param end_offset the slice ends before the batch holding it
+  /// @return false if offset is not in the segment or not before that batch
+  bool Slice(uint64_t offset, size_t max_bytes, LogSlice* slice,
+             uint64_t end_offset = UINT64_MAX);
+
+  /// @brief Find the first record whose timestamp is not before timestamp.
+  /// @param timestamp
+  /// @param offset output arg
+  /// @return false if there is none in the segment
+  bool FindOffsetByTime(uint64_t timestamp, uint64_t* offset);
+
+  /// @brief Check if an index of the last segment ran out of room, which rolls it.
+  /// @return
+  bool IndexFull() const {
+    return offset_index_.Full() || time_index_.Full();
+  }
+
+  /// @brief Delete the file and its indexes. The file stays open until the segment
+  /// is destroyed, so that slices of it taken before are still sent.
+  /// @return
+  bool Remove();
+
+  uint64_t BaseOffset() const {
+    return base_offset_;
+  }
+
+  /// @brief Offset the next record appended to the segment gets. Only known for
+  /// segments which were recovered or written to.
+  /// @return
+  uint64_t NextOffset() const {
+    return next_offset_;
+  }
+
+  /// @brief Set the next offset of a segment which was not recovered, as the
+  /// base offset of the segment after it.
+  /// @param offset
+  void SetNextOffset(uint64_t offset) {
+    next_offset_ = offset;
+  }
+
+  /// @brief Size of the file.
+  /// @return
+  size_t Size() const {
+    return size_;
+  }
+
+  /// @brief Timestamp of the first record, 0 if the segment is empty.
+  /// @return
+  uint64_t FirstTimestamp() const {
+    return first_timestamp_;
+  }
+
+  /// @brief Largest timestamp of the records, which the last entry of the time
+  /// index holds once the segment was sealed.
+  /// @param timestamp output arg
+  /// @return false if it is unknown, as the indexes can not be loaded or rebuilt or
+  /// the segment is empty
+  bool MaxTimestamp(uint64_t* timestamp);
+
+  const std::string& Path() const {
+    return path_;
+  }
+
+  /// @brief Path of the file of a segment.
+  /// @param dir
+  /// @param base_offset
+  /// @return
+  static std::string FilePath(const std::string& dir, uint64_t base_offset);
+
+ private:
+  // scan the file, keeping the valid records at its front
+  bool Recover();
+
+  // map the indexes of a segment which was not recovered, or rebuild them
+  bool LoadIndexes();
+
+  // the records of the batch are within kMaxRelativeOffset of the base offset
+  bool Indexable(const BatchHeader& header) const {
+    return header.NextOffset() - 1 - base_offset_ <= kMaxRelativeOffset;
+  }
+
+  // index the batch at position, if it is due
+  void IndexBatch(const BatchHeader& header, size_t position, size_t size);
+
+  // find the file position of the batch holding offset, scanning from the closest
+  // index entry before it
+  bool FindPosition(uint64_t offset, size_t* pos);
+
+  // end of the last batch starting at pos which ends by limit, or of the batch at
+  // pos if it alone is larger
+  size_t RecordsEnd(size_t pos, size_t limit);
+
+ private:
+  std::string path_;
+  int fd_ = -1;
+  uint64_t base_offset_;
+  uint64_t next_offset_;
+  size_t size_ = 0;
+  uint64_t first_timestamp_ = 0;
+
+  OffsetIndex offset_index_;
+  TimeIndex time_index_;
+  size_t index_interval_bytes_;
+  size_t max_index_bytes_;
+  // guards mapping or rebuilding the indexes on the first lookup
+  std::mutex index_mtx_;
+  // the indexes are mapped and cover the records of the file
+  bool indexed_ = false;
+  // every batch of the file was indexed, so max_timestamp_ is known
+  bool scanned_ = false;
+  // bytes of batches since the last index entry
+  size_t bytes_since_index_ = 0;
+  // largest timestamp so far and the base offset of its batch
+  uint64_t max_timestamp_ = 0;
+  uint64_t max_timestamp_offset_ = 0;
+};
+
+}  // namespace storage
+}  // namespace ahrimq
+
+#endif  // _AHRIMQ_STORAGE_LOG_SEGMENT_H_
@@ -0,0 +1,299 @@
+#include "storage/offset_store.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "base/time_utils.h"
+
+namespace ahrimq {
+namespace storage {
+
+static inline void PutBigEndian16(char* p, uint16_t v) {
+  p[0] = static_cast<char>(v >> 8);
+  p[1] = static_cast<char>(v);
+}
+
+static inline void PutBigEndian32(char* p, uint32_t v) {
+  for (int i = 3; i >= 0; i--) {
+    p[i] = static_cast<char>(v);
+    v >>= 8;
+  }
+}
+
+static inline void PutBigEndian64(char* p, uint64_t v) {
+  for (int i = 7; i >= 0; i--) {
+    p[i] = static_cast<char>(v);
+    v >>= 8;
+  }
+}
+
+static inline uint64_t GetBigEndian64(const char* p) {
+  uint64_t v = 0;
+  for (int i = 0; i < 8; i++) {
+    v = (v << 8) | static_cast<uint8_t>(p[i]);
+  }
+  return v;
+}
+
+// a log directory holds segment and index files only
+static bool RemoveLogDir(const std::string& dir) {
+  DIR* d = opendir(dir.c_str());
+  if (d == nullptr) {
+    return errno == ENOENT;
+  }
+  while (struct dirent* entry = readdir(d)) {
+    if (entry->d_name[0] != '.') {
+      unlink((dir + "/" + entry->d_name).c_str());
+    }
+  }
+  closedir(d);
+  return rmdir(dir.c_str()) == 0;
+}
+
+static bool Exists(const std::string& path) {
+  struct stat st {};
+  return stat(path.c_str(), &st) == 0;
+}
+
+// append a record per key to log
+static bool AppendOffsets(CommitLog* log,
+                          const std::unordered_map<std::string, uint64_t>& offsets) {
+  uint64_t now = time::GetCurrentMs();
+  // values outlive the batch they are encoded into
+  std::vector<char> values(offsets.size() * 8);
+  std::vector<LogRecord> batch;
+  size_t i = 0;
+  for (const auto& entry : offsets) {
+    PutBigEndian64(&values[i * 8], entry.second);
+    LogRecord record;
+    record.timestamp = now;
+    record.key = entry.first;
+    record.value = std::string_view(&values[i * 8], 8);
+    batch.push_back(record);
+    i++;
+    if (batch.size() == 1000 || i == offsets.size()) {
+      uint64_t base = 0;
+      if (!log->AppendBatch(batch.data(), batch.size(), &base)) {
+        return false;
+      }
+      batch.clear();
+    }
+  }
+  return true;
+}
+
+OffsetStore::OffsetStore(const std::string& dir, const OffsetStoreConfig& config)
+    : dir_(dir), config_(config), log_config_(config.log) {
+  // commits are made on event loops, only Tick() waits for the disk
+  log_config_.fsync_interval_ms = 0;
+  log_config_.fsync_interval_bytes = 0;
+}
+
+OffsetStore::~OffsetStore() = default;
+
+std::string OffsetStore::Key(std::string_view group, std::string_view topic,
+                             uint32_t partition) {
+  std::string key(2 + group.size() + 2 + topic.size() + 4, '\0');
+  char* p = key.data();
+  PutBigEndian16(p, static_cast<uint16_t>(group.size()));
+  memcpy(p + 2, group.data(), group.size());
+  p += 2 + group.size();
+  PutBigEndian16(p, static_cast<uint16_t>(topic.size()));
+  memcpy(p + 2, topic.data(), topic.size());
+  p += 2 + topic.size();
+  PutBigEndian32(p, partition);
+  return key;
+}
+
+bool OffsetStore::Open() {
+  // a compaction writes the new log next to the old one, then swaps them
+  std::string compacting = dir_ + ".compacting";
+  std::string old = dir_ + ".old";
+  if (!RemoveLogDir(compacting)) {
+    return false;
+  }
+  if (Exists(old)) {
+    bool swapped = Exists(dir_);
+    if (!swapped && rename(old.c_str(), dir_.c_str()) == -1) {
+      return false;
+    }
+    if (swapped && !RemoveLogDir(old)) {
+      return false;
+    }
+  }
+  log_ = std::make_unique<CommitLog>(dir_, log_config_);
+  last_sync_ms_ = time::GetCurrentMs();
+  return log_->Open() && Load();
+}
+
+bool OffsetStore::Load() {
+  offsets_.clear();
+  uint64_t offset = log_->StartOffset();
+  while (offset < log_->NextOffset()) {
+    std::string data;
+    if (!log_->Read(offset, 1 << 20, &data)) {
+      return false;
+    }
+    uint64_t next = offset;
+    BatchReader reader(data.data(), data.size());
+    LogRecord record;
+    while (reader.Next(&record)) {
+      // the first batch may start before offset
+      if (record.offset < offset) {
+        continue;
+      }
+      if (record.value.size() == 8) {
+        offsets_[std::string(record.key)] = GetBigEndian64(record.value.data());
+      }
+      next = record.offset + 1;
+    }
+    if (reader.Failed() || next == offset) {
+      std::cerr << "can not load offsets from " << dir_ << '\n';
+      return false;
+    }
+    offset = next;
+  }
+  return true;
+}
+
+bool OffsetStore::Commit(std::string_view group, std::string_view topic,
+                         uint32_t partition, uint64_t offset) {
+  std::string key = Key(group, topic, partition);
+  char value[8];
+  PutBigEndian64(value, offset);
+  uint64_t log_offset = 0;
+  uint64_t now = time::GetCurrentMs();
+  std::lock_guard<std::mutex> lock(mtx_);
+  if (log_ == nullptr) {
+    // lost by a failed compaction, Open() recovers it
+    return false;
+  }
+  // a commit survives a crash of the broker, it is synced by Tick() or, with
+  // fsync_every_batch, right away
+  if (!log_->Append(now, key, std::string_view(value, sizeof(value)), &log_offset) ||
+      !log_->Flush()) {
+    return false;
+  }
+  unsynced_bytes_ += key.size() + sizeof(value);
+  if (compacting_) {
+    compact_tail_[key] = offset;
+  }
+  offsets_[std::move(key)] = offset;
+  return true;
+}
+
+bool OffsetStore::Fetch(std::string_view group, std::string_view topic,
+                        uint32_t partition, uint64_t* offset) const {
+  std::lock_guard<std::mutex> lock(mtx_);
+  auto it = offsets_.find(Key(group, topic, partition));
+  if (it == offsets_.end()) {
+    return false;
+  }
+  *offset = it->second;
+  return true;
+}
+
+uint64_t OffsetStore::LogRecords() const {
+  std::lock_guard<std::mutex> lock(mtx_);
+  return LogRecordsLocked();
+}
+
+uint64_t OffsetStore::LogRecordsLocked() const {
+  return log_ == nullptr ? 0 : log_->NextOffset() - log_->StartOffset();
+}
+
+bool OffsetStore::Tick() {
+  std::lock_guard<std::mutex> compact_lock(compact_mtx_);
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (log_ == nullptr || !log_->Tick()) {
+      return false;
+    }
+    uint64_t now = time::GetCurrentMs();
+    const LogConfig& log_config = config_.log;
+    if (unsynced_bytes_ > 0 &&
+        ((log_config.fsync_interval_ms > 0 &&
+          now >= last_sync_ms_ + log_config.fsync_interval_ms) ||
+         (log_config.fsync_interval_bytes > 0 &&
+          unsynced_bytes_ >= log_config.fsync_interval_bytes))) {
+      // commits wait meanwhile, the log is not appended to while it syncs
+      if (!log_->Sync()) {
+        return false;
+      }
+      last_sync_ms_ = now;
+      unsynced_bytes_ = 0;
+    }
+    uint64_t records = LogRecordsLocked();
+    if (records < config_.min_compact_records || records < 2 * offsets_.size()) {
+      return true;
+    }
+  }
+  return CompactLocked();
+}
+
+bool OffsetStore::Compact() {
+  std::lock_guard<std::mutex> compact_lock(compact_mtx_);
+  return CompactLocked();
+}
+
+bool OffsetStore::CompactLocked() {
+  std::string compacting = dir_ + ".compacting";
+  std::string old = dir_ + ".old";
+  if (!RemoveLogDir(compacting)) {
+    return false;
+  }
+  std::unordered_map<std::string, uint64_t> snapshot;
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (log_ == nullptr) {
+      return false;
+    }
+    snapshot = offsets_;
+    compacting_ = true;
+  }
+  // the snapshot is written without blocking commits
+  auto log = std::make_unique<CommitLog>(compacting, log_config_);
+  bool written = log->Open() && AppendOffsets(log.get(), snapshot) && log->Sync();
+  std::lock_guard<std::mutex> lock(mtx_);
+  compacting_ = false;
+  std::unordered_map<std::string, uint64_t> tail = std::move(compact_tail_);
+  compact_tail_.clear();
+  // the commits made meanwhile are in the old log, and are added to the new one
+  if (!written || !AppendOffsets(log.get(), tail) || !log->Sync()) {
+    return false;
+  }
+  log.reset();
+  log_.reset();
+  bool swapped = rename(dir_.c_str(), old.c_str()) == 0;
+  if (swapped && rename(compacting.c_str(), dir_.c_str()) == -1) {
+    swapped = false;
+    rename(old.c_str(), dir_.c_str());
+  }
+  if (!swapped) {
+    std::cerr << "can not replace " << dir_ << ": " << strerror(errno) << '\n';
+  } else {
+    RemoveLogDir(old);
+  }
+  // the old log is kept if the new one could not replace it
+  log_ = std::make_unique<CommitLog>(dir_, log_config_);
+  if (!log_->Open()) {
+    std::cerr << "can not reopen " << dir_ << ", offsets are not committed\n";
+    log_.reset();
+    return false;
+  }
+  if (swapped) {
+    // the new log was synced along with the commits of the tail
+    last_sync_ms_ = time::GetCurrentMs();
+    unsynced_bytes_ = 0;
+  }
+  return swapped;
+}
+
+}  // namespace storage
+}  // namespace ahrimq
@@ -0,0 +1,135 @@
+#ifndef _AHRIMQ_STORAGE_OFFSET_STORE_H_
+#define _AHRIMQ_STORAGE_OFFSET_STORE_H_
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "base/nocopyable.h"
+#include "storage/commit_log.h"
+
+namespace ahrimq {
+namespace storage {
+
+/// @brief Configuration of an offset store.
+struct OffsetStoreConfig {
+  // fsync_interval_ms and fsync_interval_bytes are applied by OffsetStore::Tick()
+  // instead of the commits
+  LogConfig log;
+  // the log is compacted once it holds at least this many records and at least
+  // half of them were overwritten by later commits
+  size_t min_compact_records = 10000;
+};
+
+/// @brief OffsetStore keeps the offsets consumer groups committed, in a log of its
+/// own whose records are keyed by group, topic and partition, so that the last
+/// record of a key holds its offset. A hash index of the last offsets is kept in
+/// memory and rebuilt from the log by Open(), a commit and a lookup are one hash
+/// map access each.
+///
+/// Once most records of the log were overwritten, Tick() compacts it: the last
+/// offsets are written to a fresh log, which replaces the old one by a rename, so
+/// that a crash leaves either of them. The fresh log is written from a snapshot of
+/// the offsets, commits go on meanwhile and are added to it before the swap.
+///
+/// An offset store is thread safe. Commits only write to the log, which Tick() syncs
+/// from the thread of the owner, so that only the commits and lookups made during
+/// a sync wait for the disk.
+class OffsetStore : public NoCopyable {
+ public:
+  /// @brief Construct a store kept in the log directory dir, which is opened by
+  /// Open().
+  /// @param dir
+  /// @param config
+  OffsetStore(const std::string& dir, const OffsetStoreConfig& config);
+
+  ~OffsetStore();
+
+  /// @brief Open the log and load the offsets it holds, finishing or dropping a
+  /// compaction a crash interrupted.
+  /// @return
+  bool Open();
+
+  /// @brief Store the offset a group committed for a partition.
+  /// @param group
+  /// @param topic
+  /// @param partition
+  /// @param offset
+  /// @return false if it could not be written, or the log could not be reopened
+  /// after a compaction
+  bool Commit(std::string_view group, std::string_view topic, uint32_t partition,
+              uint64_t offset);
+
+  /// @brief Look up the offset a group committed for a partition.
+  /// @param group
+  /// @param topic
+  /// @param partition
+  /// @param offset output arg
+  /// @return false if the group never committed one
+  bool Fetch(std::string_view group, std::string_view topic, uint32_t partition,
+             uint64_t* offset) const;
+
+  /// @brief Rewrite the log with the last offset of every key only.
+  /// @return
+  bool Compact();
+
+  /// @brief Sync the log if fsync_interval_ms passed since the last sync or
+  /// fsync_interval_bytes were committed, and compact it once most of its records
+  /// were overwritten. Called periodically by the owner, from a thread which may
+  /// wait for the disk, so that commits are synced in time.
+  /// @return
+  bool Tick();
+
+  /// @brief Number of keys with an offset.
+  /// @return
+  size_t Size() const {
+    std::lock_guard<std::mutex> lock(mtx_);
+    return offsets_.size();
+  }
+
+  /// @brief Number of records in the log.
+  /// @return
+  uint64_t LogRecords() const;
+
+ private:
+  // the key of a record, group and topic prefixed with their 2-byte length,
+  // followed by the partition
+  static std::string Key(std::string_view group, std::string_view topic,
+                         uint32_t partition);
+
+  // read the records of the log into offsets_
+  bool Load();
+
+  uint64_t LogRecordsLocked() const;
+
+  bool CompactLocked();
+
+ private:
+  std::string dir_;
+  OffsetStoreConfig config_;
+  // config_.log without the syncs by interval, which Tick() makes
+  LogConfig log_config_;
+  // held by a compaction, which is the only one replacing log_
+  std::mutex compact_mtx_;
+  // guards log_, offsets_, compact_tail_ and the sync state, and is held by every
+  // append and sync so that the log has a single writer at a time
+  mutable std::mutex mtx_;
+  std::unique_ptr<CommitLog> log_;
+  uint64_t last_sync_ms_ = 0;
+  // bytes of records committed since the last sync
+  size_t unsynced_bytes_ = 0;
+  // last offset by key
+  std::unordered_map<std::string, uint64_t> offsets_;
+  // a compaction is writing a snapshot of offsets_
+  bool compacting_ = false;
+  // offsets committed since the snapshot of the compaction, by key
+  std::unordered_map<std::string, uint64_t> compact_tail_;
+};
+
+}  // namespace storage
+}  // namespace ahrimq
+
+#endif  // _AHRIMQ_STORAGE_OFFSET_STORE_H_
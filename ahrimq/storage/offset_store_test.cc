@@ -0,0 +1,186 @@
+#include "ahrimq/storage/offset_store.h"
+
+#include <dirent.h>
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+using namespace ahrimq;
+using namespace ahrimq::storage;
+
+class OffsetStoreTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    char tmpl[] = "/tmp/ahrimq_offsets_XXXXXX";
+    char* dir = mkdtemp(tmpl);
+    ASSERT_NE(dir, nullptr);
+    root_ = dir;
+    dir_ = root_ + "/__consumer_offsets";
+    config_.log.fsync_interval_ms = 0;
+    config_.min_compact_records = 100;
+  }
+
+  void TearDown() override {
+    RemoveDir(root_);
+  }
+
+  static void RemoveDir(const std::string& path) {
+    DIR* d = opendir(path.c_str());
+    if (d == nullptr) {
+      unlink(path.c_str());
+      return;
+    }
+    while (struct dirent* entry = readdir(d)) {
+      std::string name = entry->d_name;
+      if (name != "." && name != "..") {
+        RemoveDir(path + "/" + name);
+      }
+    }
+    closedir(d);
+    rmdir(path.c_str());
+  }
+
+  std::string root_;
+  std::string dir_;
+  OffsetStoreConfig config_;
+};
+
+TEST_F(OffsetStoreTest, CommitTest) {
+  {
+    OffsetStore store(dir_, config_);
+    ASSERT_TRUE(store.Open());
+    uint64_t offset = 0;
+    EXPECT_FALSE(store.Fetch("g", "t", 0, &offset));
+    EXPECT_TRUE(store.Commit("g", "t", 0, 10));
+    EXPECT_TRUE(store.Commit("g", "t", 1, 20));
+    EXPECT_TRUE(store.Commit("g", "t", 0, 15));
+    // keys do not run into each other
+    EXPECT_TRUE(store.Commit("g", "t0", 0, 30));
+    EXPECT_TRUE(store.Commit("gt", "", 0, 40));
+    ASSERT_TRUE(store.Fetch("g", "t", 0, &offset));
+    EXPECT_EQ(offset, 15u);
+    EXPECT_EQ(store.Size(), 4u);
+    EXPECT_EQ(store.LogRecords(), 5u);
+  }
+  OffsetStore store(dir_, config_);
+  ASSERT_TRUE(store.Open());
+  uint64_t offset = 0;
+  ASSERT_TRUE(store.Fetch("g", "t", 0, &offset));
+  EXPECT_EQ(offset, 15u);
+  ASSERT_TRUE(store.Fetch("g", "t", 1, &offset));
+  EXPECT_EQ(offset, 20u);
+  ASSERT_TRUE(store.Fetch("g", "t0", 0, &offset));
+  EXPECT_EQ(offset, 30u);
+  ASSERT_TRUE(store.Fetch("gt", "", 0, &offset));
+  EXPECT_EQ(offset, 40u);
+  EXPECT_FALSE(store.Fetch("h", "t", 0, &offset));
+}
+
+TEST_F(OffsetStoreTest, CompactTest) {
+  {
+    OffsetStore store(dir_, config_);
+    ASSERT_TRUE(store.Open());
+    for (uint64_t i = 0; i < 1000; i++) {
+      ASSERT_TRUE(store.Commit("g", "t", i % 10, i));
+      ASSERT_TRUE(store.Tick());
+    }
+    EXPECT_EQ(store.Size(), 10u);
+    // compacted every 100 records
+    EXPECT_LT(store.LogRecords(), 100u);
+  }
+  OffsetStore store(dir_, config_);
+  ASSERT_TRUE(store.Open());
+  for (uint32_t p = 0; p < 10; p++) {
+    uint64_t offset = 0;
+    ASSERT_TRUE(store.Fetch("g", "t", p, &offset));
+    EXPECT_EQ(offset, 990u + p);
+  }
+  EXPECT_EQ(access((dir_ + ".old").c_str(), F_OK), -1);
+  EXPECT_EQ(access((dir_ + ".compacting").c_str(), F_OK), -1);
+}
+
+TEST_F(OffsetStoreTest, ConcurrentCompactTest) {
+  {
+    OffsetStore store(dir_, config_);
+    ASSERT_TRUE(store.Open());
+    std::atomic<bool> done{false};
+    std::thread compactor([&store, &done] {
+      while (!done.load()) {
+        EXPECT_TRUE(store.Compact());
+      }
+    });
+    // commits go on while the log is rewritten
+    for (uint64_t i = 0; i < 2000; i++) {
+      ASSERT_TRUE(store.Commit("g", "t", i % 10, i));
+    }
+    done.store(true);
+    compactor.join();
+  }
+  OffsetStore store(dir_, config_);
+  ASSERT_TRUE(store.Open());
+  EXPECT_EQ(store.Size(), 10u);
+  for (uint32_t p = 0; p < 10; p++) {
+    uint64_t offset = 0;
+    ASSERT_TRUE(store.Fetch("g", "t", p, &offset));
+    EXPECT_EQ(offset, 1990u + p);
+  }
+}
+
+TEST_F(OffsetStoreTest, TickTest) {
+  // every tick syncs, and nothing is compacted
+  config_.log.fsync_interval_bytes = 1;
+  config_.min_compact_records = 1 << 20;
+  {
+    OffsetStore store(dir_, config_);
+    ASSERT_TRUE(store.Open());
+    std::atomic<bool> done{false};
+    std::thread ticker([&store, &done] {
+      while (!done.load()) {
+        EXPECT_TRUE(store.Tick());
+      }
+    });
+    for (uint64_t i = 0; i < 2000; i++) {
+      ASSERT_TRUE(store.Commit("g", "t", i % 10, i));
+    }
+    done.store(true);
+    ticker.join();
+  }
+  OffsetStore store(dir_, config_);
+  ASSERT_TRUE(store.Open());
+  ASSERT_TRUE(store.Commit("g", "t", 0, 2000));
+  ASSERT_TRUE(store.Tick());
+  EXPECT_EQ(store.LogRecords(), 2001u);
+  // the records carry the time of their commit, so the segment is not too old
+  size_t segments = 0;
+  DIR* d = opendir(dir_.c_str());
+  ASSERT_NE(d, nullptr);
+  while (struct dirent* entry = readdir(d)) {
+    std::string name = entry->d_name;
+    segments += name.size() > 4 && name.substr(name.size() - 4) == ".log";
+  }
+  closedir(d);
+  EXPECT_EQ(segments, 1u);
+}
+
+TEST_F(OffsetStoreTest, RecoverTest) {
+  {
+    OffsetStore store(dir_, config_);
+    ASSERT_TRUE(store.Open());
+    ASSERT_TRUE(store.Commit("g", "t", 0, 7));
+  }
+  // a crash between the two renames of a compaction leaves the old log aside
+  ASSERT_EQ(rename(dir_.c_str(), (dir_ + ".old").c_str()), 0);
+  OffsetStore store(dir_, config_);
+  ASSERT_TRUE(store.Open());
+  uint64_t offset = 0;
+  ASSERT_TRUE(store.Fetch("g", "t", 0, &offset));
+  EXPECT_EQ(offset, 7u);
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
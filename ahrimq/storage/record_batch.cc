@@ -0,0 +1,338 @@
+#include "storage/record_batch.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "base/crc32c.h"
+
+namespace ahrimq {
+namespace storage {
+
+// positions of the header fields
+constexpr static size_t kBaseOffsetPos = 4;
+constexpr static size_t kCrcPos = 12;
+constexpr static size_t kMagicPos = 16;
+constexpr static size_t kAttributesPos = 17;
+constexpr static size_t kCountPos = 18;
+constexpr static size_t kFirstTimestampPos = 22;
+constexpr static size_t kMaxTimestampPos = 30;
+
+static inline uint32_t ReadUInt32BE(const char* p) {
+  const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+  return (uint32_t(u[0]) << 24) | (uint32_t(u[1]) << 16) | (uint32_t(u[2]) << 8) |
+         uint32_t(u[3]);
+}
+
+static inline uint64_t ReadUInt64BE(const char* p) {
+  return (uint64_t(ReadUInt32BE(p)) << 32) | ReadUInt32BE(p + 4);
+}
+
+static inline void WriteUInt32BE(char* p, uint32_t v) {
+  p[0] = static_cast<char>(v >> 24);
+  p[1] = static_cast<char>(v >> 16);
+  p[2] = static_cast<char>(v >> 8);
+  p[3] = static_cast<char>(v);
+}
+
+static inline void WriteUInt64BE(char* p, uint64_t v) {
+  WriteUInt32BE(p, static_cast<uint32_t>(v >> 32));
+  WriteUInt32BE(p + 4, static_cast<uint32_t>(v));
+}
+
+static inline size_t VarintSize(uint64_t v) {
+  size_t n = 1;
+  while (v >= 0x80) {
+    v >>= 7;
+    n++;
+  }
+  return n;
+}
+
+static inline char* PutVarint(char* p, uint64_t v) {
+  while (v >= 0x80) {
+    *p++ = static_cast<char>(v | 0x80);
+    v >>= 7;
+  }
+  *p++ = static_cast<char>(v);
+  return p;
+}
+
+static inline bool GetVarint(const char** p, const char* end, uint64_t* v) {
+  uint64_t result = 0;
+  for (int shift = 0; shift < 64 && *p < end; shift += 7) {
+    uint8_t byte = static_cast<uint8_t>(*(*p)++);
+    result |= uint64_t(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      *v = result;
+      return true;
+    }
+  }
+  return false;
+}
+
+// signed deltas of timestamps are mapped to small unsigned numbers
+static inline uint64_t ZigZag(int64_t v) {
+  return (uint64_t(v) << 1) ^ uint64_t(v >> 63);
+}
+
+static inline int64_t UnZigZag(uint64_t v) {
+  return int64_t(v >> 1) ^ -int64_t(v & 1);
+}
+
+// bytes of a record after its length
+static inline size_t RecordBodySize(uint64_t timestamp_delta, uint64_t offset_delta,
+                                    std::string_view key, std::string_view value) {
+  return VarintSize(timestamp_delta) + VarintSize(offset_delta) +
+         VarintSize(key.size()) + key.size() + VarintSize(value.size()) +
+         value.size();
+}
+
+static inline size_t RecordSize(uint64_t timestamp_delta, uint64_t offset_delta,
+                                std::string_view key, std::string_view value) {
+  size_t body = RecordBodySize(timestamp_delta, offset_delta, key, value);
+  return VarintSize(body) + body;
+}
+
+static char* PutRecord(char* p, uint64_t timestamp_delta, uint64_t offset_delta,
+                       std::string_view key, std::string_view value) {
+  p = PutVarint(p, RecordBodySize(timestamp_delta, offset_delta, key, value));
+  p = PutVarint(p, timestamp_delta);
+  p = PutVarint(p, offset_delta);
+  p = PutVarint(p, key.size());
+  memcpy(p, key.data(), key.size());
+  p = PutVarint(p + key.size(), value.size());
+  memcpy(p, value.data(), value.size());
+  return p + value.size();
+}
+
+// fill in the header of a batch of size bytes whose records follow it
+static void PutHeader(char* p, size_t size, uint64_t base_offset, Codec codec,
+                      uint32_t count, uint64_t first_timestamp,
+                      uint64_t max_timestamp) {
+  WriteUInt32BE(p, static_cast<uint32_t>(size - 4));
+  WriteUInt64BE(p + kBaseOffsetPos, base_offset);
+  p[kMagicPos] = static_cast<char>(kBatchMagic);
+  p[kAttributesPos] = static_cast<char>(codec);
+  WriteUInt32BE(p + kCountPos, count);
+  WriteUInt64BE(p + kFirstTimestampPos, first_timestamp);
+  WriteUInt64BE(p + kMaxTimestampPos, max_timestamp);
+  WriteUInt32BE(p + kCrcPos, Crc32c(p + kMagicPos, size - kMagicPos));
+}
+
+// append a batch of the encoded records raw, compressed with codec
+static bool AppendCompressed(Codec codec, const std::string& raw,
+                             uint64_t base_offset, uint32_t count,
+                             uint64_t first_timestamp, uint64_t max_timestamp,
+                             Buffer& out) {
+  std::string body(4, '\0');
+  WriteUInt32BE(&body[0], static_cast<uint32_t>(raw.size()));
+  if (!Compress(codec, raw.data(), raw.size(), &body)) {
+    return false;
+  }
+  size_t size = kBatchHeaderSize + body.size();
+  out.EnsureBytesForWrite(size);
+  char* p = out.BeginWritePointer();
+  memcpy(p + kBatchHeaderSize, body.data(), body.size());
+  PutHeader(p, size, base_offset, codec, count, first_timestamp, max_timestamp);
+  out.WriterIdxForward(size);
+  return true;
+}
+
+size_t DecodeBatch(const char* data, size_t len, BatchHeader* header, bool verify) {
+  if (len < kBatchHeaderSize) {
+    return 0;
+  }
+  uint32_t length = ReadUInt32BE(data);
+  if (length < kBatchHeaderSize - 4 || len - 4 < length) {
+    return 0;
+  }
+  size_t size = size_t(length) + 4;
+  uint8_t attributes = static_cast<uint8_t>(data[kAttributesPos]);
+  uint32_t count = ReadUInt32BE(data + kCountPos);
+  if (static_cast<uint8_t>(data[kMagicPos]) != kBatchMagic || count == 0 ||
+      (attributes & kBatchCodecMask) >= kCodecCount) {
+    return 0;
+  }
+  if (verify &&
+      Crc32c(data + kMagicPos, size - kMagicPos) != ReadUInt32BE(data + kCrcPos)) {
+    return 0;
+  }
+  header->base_offset = ReadUInt64BE(data + kBaseOffsetPos);
+  header->attributes = attributes;
+  header->count = count;
+  header->first_timestamp = ReadUInt64BE(data + kFirstTimestampPos);
+  header->max_timestamp = ReadUInt64BE(data + kMaxTimestampPos);
+  return size;
+}
+
+void SetBatchBaseOffset(char* batch, uint64_t base_offset) {
+  WriteUInt64BE(batch + kBaseOffsetPos, base_offset);
+}
+
+size_t EncodedBatchSize(const LogRecord* records, size_t n) {
+  size_t size = kBatchHeaderSize;
+  for (size_t i = 0; i < n; i++) {
+    int64_t delta = int64_t(records[i].timestamp - records[0].timestamp);
+    size += RecordSize(ZigZag(delta), i, records[i].key, records[i].value);
+  }
+  return size;
+}
+
+bool EncodeBatch(const LogRecord* records, size_t n, uint64_t base_offset,
+                 Codec codec, Buffer& out) {
+  if (n == 0 || !CodecAvailable(codec)) {
+    return false;
+  }
+  uint64_t first_timestamp = records[0].timestamp;
+  uint64_t max_timestamp = first_timestamp;
+  for (size_t i = 1; i < n; i++) {
+    max_timestamp = std::max(max_timestamp, records[i].timestamp);
+  }
+  size_t size = EncodedBatchSize(records, n);
+  std::string raw;
+  char* q = nullptr;
+  if (codec == Codec::None) {
+    // the records are encoded in place
+    out.EnsureBytesForWrite(size);
+    q = out.BeginWritePointer() + kBatchHeaderSize;
+  } else {
+    raw.resize(size - kBatchHeaderSize);
+    q = &raw[0];
+  }
+  for (size_t i = 0; i < n; i++) {
+    int64_t delta = int64_t(records[i].timestamp - first_timestamp);
+    q = PutRecord(q, ZigZag(delta), i, records[i].key, records[i].value);
+  }
+  if (codec != Codec::None) {
+    return AppendCompressed(codec, raw, base_offset, static_cast<uint32_t>(n),
+                            first_timestamp, max_timestamp, out);
+  }
+  PutHeader(out.BeginWritePointer(), size, base_offset, codec,
+            static_cast<uint32_t>(n), first_timestamp, max_timestamp);
+  out.WriterIdxForward(size);
+  return true;
+}
+
+BatchBuilder::BatchBuilder(Codec codec) : codec_(codec) {}
+
+void BatchBuilder::Add(uint64_t timestamp, std::string_view key,
+                       std::string_view value) {
+  if (count_ == 0) {
+    first_timestamp_ = max_timestamp_ = timestamp;
+  }
+  max_timestamp_ = std::max(max_timestamp_, timestamp);
+  uint64_t delta = ZigZag(int64_t(timestamp - first_timestamp_));
+  size_t start = records_.size();
+  records_.resize(start + RecordSize(delta, count_, key, value));
+  PutRecord(&records_[start], delta, count_, key, value);
+  count_++;
+}
+
+bool BatchBuilder::Finish(Buffer& out) {
+  if (count_ == 0 || !CodecAvailable(codec_)) {
+    return false;
+  }
+  if (codec_ != Codec::None) {
+    if (!AppendCompressed(codec_, records_, 0, count_, first_timestamp_,
+                          max_timestamp_, out)) {
+      return false;
+    }
+  } else {
+    size_t size = Size();
+    out.EnsureBytesForWrite(size);
+    char* p = out.BeginWritePointer();
+    memcpy(p + kBatchHeaderSize, records_.data(), records_.size());
+    PutHeader(p, size, 0, codec_, count_, first_timestamp_, max_timestamp_);
+    out.WriterIdxForward(size);
+  }
+  records_.clear();
+  count_ = 0;
+  return true;
+}
+
+BatchReader::BatchReader(const char* data, size_t len, bool verify)
+    : data_(data), len_(len), verify_(verify) {}
+
+bool BatchReader::NextBatch() {
+  if (pos_ == len_ || failed_) {
+    return false;
+  }
+  size_t size = DecodeBatch(data_ + pos_, len_ - pos_, &header_, verify_);
+  if (size == 0) {
+    failed_ = true;
+    return false;
+  }
+  const char* body = data_ + pos_ + kBatchHeaderSize;
+  size_t body_len = size - kBatchHeaderSize;
+  pos_ += size;
+  if (header_.GetCodec() == Codec::None) {
+    p_ = body;
+    end_ = body + body_len;
+  } else {
+    raw_.clear();
+    if (body_len < 4 || !Decompress(header_.GetCodec(), body + 4, body_len - 4,
+                                    ReadUInt32BE(body), &raw_)) {
+      failed_ = true;
+      return false;
+    }
+    p_ = raw_.data();
+    end_ = raw_.data() + raw_.size();
+  }
+  left_ = header_.count;
+  return true;
+}
+
+bool BatchReader::Next(LogRecord* record) {
+  if (left_ == 0) {
+    // the records fill their batch exactly
+    if (p_ != end_) {
+      failed_ = true;
+      return false;
+    }
+    if (!NextBatch()) {
+      return false;
+    }
+  }
+  uint64_t length = 0, timestamp_delta = 0, offset_delta = 0, key_len = 0,
+           value_len = 0;
+  const char* p = p_;
+  if (!GetVarint(&p, end_, &length) || length > size_t(end_ - p)) {
+    failed_ = true;
+    return false;
+  }
+  const char* end = p + length;
+  if (!GetVarint(&p, end, &timestamp_delta) || !GetVarint(&p, end, &offset_delta) ||
+      !GetVarint(&p, end, &key_len) || key_len > size_t(end - p)) {
+    failed_ = true;
+    return false;
+  }
+  record->key = std::string_view(p, key_len);
+  p += key_len;
+  if (!GetVarint(&p, end, &value_len) || value_len != size_t(end - p)) {
+    failed_ = true;
+    return false;
+  }
+  record->value = std::string_view(p, value_len);
+  record->offset = header_.base_offset + offset_delta;
+  record->timestamp = header_.first_timestamp + UnZigZag(timestamp_delta);
+  p_ = end;
+  left_--;
+  return true;
+}
+
+size_t VerifyBatch(const char* data, size_t len, BatchHeader* header) {
+  size_t size = DecodeBatch(data, len, header, true);
+  if (size == 0) {
+    return 0;
+  }
+  BatchReader reader(data, size, false);
+  LogRecord record;
+  uint64_t n = 0;
+  while (reader.Next(&record)) {
+    n++;
+  }
+  return !reader.Failed() && n == header->count ? size : 0;
+}
+
+}  // namespace storage
+}  // namespace ahrimq
@@ -0,0 +1,188 @@
+#ifndef _AHRIMQ_STORAGE_RECORD_BATCH_H_
+#define _AHRIMQ_STORAGE_RECORD_BATCH_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "base/nocopyable.h"
+#include "buffer/buffer.h"
+#include "storage/compression.h"
+
+namespace ahrimq {
+namespace storage {
+
+/// @brief Records are stored and sent in batches, each laid out as follows, the
+/// integers of the header are big-endian:
+///
+///   length(4) base offset(8) crc32c(4) magic(1) attributes(1) record count(4)
+///   first timestamp(8) max timestamp(8) records
+///
+/// length counts the bytes after itself. The crc covers the bytes from the magic
+/// on, so that the base offset is assigned by the log without touching the rest
+/// of the batch. The low 3 bits of attributes are the Codec of the records, which
+/// are prefixed by their uncompressed size(4) unless the codec is Codec::None.
+///
+/// Every record is packed with varints, relative to the header:
+///
+///   length timestamp delta(zigzag) offset delta key length key value length value
+///
+/// where length counts the bytes after itself.
+constexpr static size_t kBatchHeaderSize = 38;
+constexpr static uint8_t kBatchMagic = 1;
+constexpr static uint8_t kBatchCodecMask = 0x07;
+
+/// @brief A record, key and value point into the bytes it was decoded from.
+struct LogRecord {
+  uint64_t offset = 0;
+  // milliseconds since epoch
+  uint64_t timestamp = 0;
+  std::string_view key;
+  std::string_view value;
+};
+
+/// @brief The header of a batch.
+struct BatchHeader {
+  uint64_t base_offset = 0;
+  uint8_t attributes = 0;
+  uint32_t count = 0;
+  uint64_t first_timestamp = 0;
+  uint64_t max_timestamp = 0;
+
+  Codec GetCodec() const {
+    return static_cast<Codec>(attributes & kBatchCodecMask);
+  }
+
+  /// @brief Offset of the record after the batch.
+  /// @return
+  uint64_t NextOffset() const {
+    return base_offset + count;
+  }
+};
+
+/// @brief Decode the header of the batch at the front of data.
+/// @param data
+/// @param len
+/// @param header output arg
+/// @param verify check the crc of the batch
+/// @return the size of the batch, 0 if data does not start with a whole valid
+/// batch
+size_t DecodeBatch(const char* data, size_t len, BatchHeader* header,
+                   bool verify = true);
+
+/// @brief Decode the header of the batch at the front of data, check its crc and
+/// that its records fill it and match its record count. Batches from producers are
+/// checked this way, the log assigns offsets by the count.
+/// @param data
+/// @param len
+/// @param header output arg
+/// @return the size of the batch, 0 if data does not start with a whole valid
+/// batch
+size_t VerifyBatch(const char* data, size_t len, BatchHeader* header);
+
+/// @brief Overwrite the base offset of an encoded batch, its crc stays valid.
+/// @param batch
+/// @param base_offset
+void SetBatchBaseOffset(char* batch, uint64_t base_offset);
+
+/// @brief Size of the batch EncodeBatch() encodes without compression.
+/// @param records
+/// @param n
+/// @return
+size_t EncodedBatchSize(const LogRecord* records, size_t n);
+
+/// @brief Append records to out as one batch.
+/// @param records offsets of the records are ignored
+/// @param n at least 1
+/// @param base_offset
+/// @param codec
+/// @param out
+/// @return false if the codec is not available
+bool EncodeBatch(const LogRecord* records, size_t n, uint64_t base_offset,
+                 Codec codec, Buffer& out);
+
+/// @brief BatchBuilder gathers the records of a producer into a batch, which is
+/// compressed once as a whole when it is finished.
+class BatchBuilder : public NoCopyable {
+ public:
+  explicit BatchBuilder(Codec codec = Codec::None);
+
+  /// @brief Add a record.
+  /// @param timestamp
+  /// @param key
+  /// @param value
+  void Add(uint64_t timestamp, std::string_view key, std::string_view value);
+
+  /// @brief Number of records added.
+  /// @return
+  uint32_t Count() const {
+    return count_;
+  }
+
+  /// @brief Size of the batch before compression, to decide when to send it.
+  /// @return
+  size_t Size() const {
+    return kBatchHeaderSize + records_.size();
+  }
+
+  /// @brief Append the batch to out with base offset 0 and start a new one.
+  /// @param out
+  /// @return false if there are no records, the codec is not available or the
+  /// records of a compressed batch exceed kMaxRawSize
+  bool Finish(Buffer& out);
+
+ private:
+  Codec codec_;
+  // the encoded records
+  std::string records_;
+  uint32_t count_ = 0;
+  uint64_t first_timestamp_ = 0;
+  uint64_t max_timestamp_ = 0;
+};
+
+/// @brief BatchReader decodes the records of consecutive batches, decompressing
+/// them if needed. The key and value of a record point into the bytes read or
+/// into the reader, they stay valid until the reader moves to the next batch.
+class BatchReader : public NoCopyable {
+ public:
+  /// @brief Construct a reader of the batches in data.
+  /// @param data
+  /// @param len
+  /// @param verify check the crc of every batch
+  BatchReader(const char* data, size_t len, bool verify = true);
+
+  /// @brief Decode the next record.
+  /// @param record output arg
+  /// @return false at the end of the batches or if they are invalid
+  bool Next(LogRecord* record);
+
+  /// @brief Check if the bytes read were not whole valid batches.
+  /// @return
+  bool Failed() const {
+    return failed_;
+  }
+
+ private:
+  // start the batch at pos_
+  bool NextBatch();
+
+ private:
+  const char* data_;
+  size_t len_;
+  bool verify_;
+  size_t pos_ = 0;
+  bool failed_ = false;
+  BatchHeader header_;
+  // records of the current batch left to read
+  uint32_t left_ = 0;
+  const char* p_ = nullptr;
+  const char* end_ = nullptr;
+  // the records of a compressed batch
+  std::string raw_;
+};
+
+}  // namespace storage
+}  // namespace ahrimq
+
+#endif  // _AHRIMQ_STORAGE_RECORD_BATCH_H_
@@ -0,0 +1,149 @@
+#include "ahrimq/storage/record_batch.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "ahrimq/base/crc32c.h"
+
+using namespace ahrimq;
+using namespace ahrimq::storage;
+
+TEST(RecordBatchTest, CodecTest) {
+  std::string value;
+  for (int i = 0; i < 300; i++) {
+    value += "value-" + std::to_string(i % 7);
+  }
+  for (uint8_t c = 0; c < kCodecCount; c++) {
+    Codec codec = static_cast<Codec>(c);
+    BatchBuilder builder(codec);
+    if (!CodecAvailable(codec)) {
+      builder.Add(1, "", "");
+      Buffer out;
+      EXPECT_FALSE(builder.Finish(out)) << CodecName(codec);
+      continue;
+    }
+    // timestamps need not grow, deltas may be negative
+    uint64_t timestamps[] = {1000, 990, 5000, 1000};
+    for (int i = 0; i < 4; i++) {
+      builder.Add(timestamps[i], i % 2 == 0 ? "" : "key", value.substr(i * 100));
+    }
+    EXPECT_EQ(builder.Count(), 4u);
+    size_t raw_size = builder.Size();
+    Buffer out;
+    ASSERT_TRUE(builder.Finish(out)) << CodecName(codec);
+    std::string batch = out.ReadAllAsString();
+    EXPECT_EQ(builder.Count(), 0u);
+    if (codec != Codec::None) {
+      EXPECT_LT(batch.size(), raw_size) << CodecName(codec);
+    }
+
+    BatchHeader header;
+    ASSERT_EQ(DecodeBatch(batch.data(), batch.size(), &header), batch.size());
+    EXPECT_EQ(header.GetCodec(), codec);
+    EXPECT_EQ(header.count, 4u);
+    EXPECT_EQ(header.first_timestamp, 1000u);
+    EXPECT_EQ(header.max_timestamp, 5000u);
+    // the base offset is not covered by the crc
+    SetBatchBaseOffset(&batch[0], 42);
+    ASSERT_EQ(DecodeBatch(batch.data(), batch.size(), &header), batch.size());
+    EXPECT_EQ(header.NextOffset(), 46u);
+
+    std::string two = batch + batch;
+    BatchReader reader(two.data(), two.size());
+    LogRecord record;
+    for (int round = 0; round < 2; round++) {
+      for (int i = 0; i < 4; i++) {
+        ASSERT_TRUE(reader.Next(&record)) << CodecName(codec);
+        EXPECT_EQ(record.offset, 42u + i);
+        EXPECT_EQ(record.timestamp, timestamps[i]);
+        EXPECT_EQ(record.key, i % 2 == 0 ? "" : "key");
+        EXPECT_EQ(record.value, value.substr(i * 100));
+      }
+    }
+    EXPECT_FALSE(reader.Next(&record));
+    EXPECT_FALSE(reader.Failed());
+
+    // a flipped bit or a cut batch is refused
+    for (size_t pos : {size_t(16), size_t(20), batch.size() - 1}) {
+      std::string bad = batch;
+      bad[pos] ^= 1;
+      EXPECT_EQ(DecodeBatch(bad.data(), bad.size(), &header), 0u) << pos;
+    }
+    EXPECT_EQ(DecodeBatch(batch.data(), batch.size() - 1, &header), 0u);
+    BatchReader cut(batch.data(), batch.size() - 1);
+    EXPECT_FALSE(cut.Next(&record));
+    EXPECT_TRUE(cut.Failed());
+
+    if (codec != Codec::None) {
+      // the size before compression is checked before allocating it
+      std::string raw = "x";
+      EXPECT_FALSE(Decompress(codec, batch.data(), batch.size(), kMaxRawSize + 1,
+                              &raw));
+      EXPECT_EQ(raw, "x");
+    }
+  }
+}
+
+TEST(RecordBatchTest, EncodeTest) {
+  std::vector<LogRecord> records(3);
+  records[0].timestamp = 7;
+  records[1].timestamp = 5;
+  records[1].key = "k";
+  records[2].timestamp = 9;
+  records[2].value = std::string(1000, 'v');
+  Buffer out;
+  ASSERT_TRUE(EncodeBatch(records.data(), records.size(), 100, Codec::None, out));
+  EXPECT_EQ(out.Size(), EncodedBatchSize(records.data(), records.size()));
+  ASSERT_TRUE(EncodeBatch(records.data(), 1, 103, Codec::Zlib, out));
+  std::string data = out.ReadAllAsString();
+  BatchReader reader(data.data(), data.size());
+  LogRecord record;
+  for (uint64_t i = 0; i < 4; i++) {
+    ASSERT_TRUE(reader.Next(&record));
+    EXPECT_EQ(record.offset, 100 + i);
+    EXPECT_EQ(record.timestamp, records[i % 3].timestamp);
+    EXPECT_EQ(record.key, records[i % 3].key);
+    EXPECT_EQ(record.value, records[i % 3].value);
+  }
+  EXPECT_FALSE(reader.Next(&record));
+  EXPECT_FALSE(reader.Failed());
+}
+
+TEST(RecordBatchTest, VerifyTest) {
+  std::vector<LogRecord> records(2);
+  records[1].value = "v";
+  Buffer out;
+  ASSERT_TRUE(EncodeBatch(records.data(), records.size(), 0, Codec::None, out));
+  ASSERT_TRUE(EncodeBatch(records.data(), records.size(), 0, Codec::Zlib, out));
+  std::string data = out.ReadAllAsString();
+  BatchHeader header;
+  size_t first = VerifyBatch(data.data(), data.size(), &header);
+  ASSERT_EQ(first, EncodedBatchSize(records.data(), records.size()));
+  EXPECT_EQ(header.count, 2u);
+  EXPECT_EQ(VerifyBatch(data.data() + first, data.size() - first, &header),
+            data.size() - first);
+
+  // forge the record counts, keeping the crcs valid
+  for (size_t pos : {size_t(0), first}) {
+    for (uint32_t count : {1u, 3u, 0xffffffffu}) {
+      std::string batch = data.substr(pos, pos == 0 ? first : data.size() - first);
+      batch[18] = static_cast<char>(count >> 24);
+      batch[19] = static_cast<char>(count >> 16);
+      batch[20] = static_cast<char>(count >> 8);
+      batch[21] = static_cast<char>(count);
+      uint32_t crc = Crc32c(batch.data() + 16, batch.size() - 16);
+      for (int i = 0; i < 4; i++) {
+        batch[12 + i] = static_cast<char>(crc >> (24 - 8 * i));
+      }
+      EXPECT_EQ(DecodeBatch(batch.data(), batch.size(), &header), batch.size());
+      EXPECT_EQ(VerifyBatch(batch.data(), batch.size(), &header), 0u);
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,79 @@
+#include "storage/retention_task.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <chrono>
+
+#include "base/time_utils.h"
+
+namespace ahrimq {
+namespace storage {
+
+// nice value of the thread, which linux applies per thread
+constexpr static int kNice = 10;
+
+RetentionTask::RetentionTask(uint64_t check_interval_ms)
+    : check_interval_ms_(check_interval_ms) {}
+
+RetentionTask::~RetentionTask() {
+  Stop();
+}
+
+void RetentionTask::Add(CommitLog* log) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  logs_.push_back(log);
+}
+
+void RetentionTask::Start() {
+  std::lock_guard<std::mutex> lock(mtx_);
+  if (!thread_.joinable()) {
+    stopped_ = false;
+    thread_ = std::thread([this]() { Run(); });
+  }
+}
+
+void RetentionTask::Stop() {
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    stopped_ = true;
+  }
+  cv_.notify_all();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+size_t RetentionTask::RunOnce() {
+  std::vector<CommitLog*> logs;
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    logs = logs_;
+  }
+  uint64_t now = time::GetCurrentMs();
+  size_t deleted = 0;
+  for (CommitLog* log : logs) {
+    deleted += log->DeleteOldSegments(now);
+  }
+  return deleted;
+}
+
+void RetentionTask::Run() {
+  // a fetch may wait for an index rebuild of the task, which must keep running
+  sched_param param{};
+  pthread_setschedparam(pthread_self(), SCHED_BATCH, &param);
+  setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), kNice);
+  std::unique_lock<std::mutex> lock(mtx_);
+  while (!cv_.wait_for(lock, std::chrono::milliseconds(check_interval_ms_),
+                       [this]() { return stopped_; })) {
+    lock.unlock();
+    RunOnce();
+    lock.lock();
+  }
+}
+
+}  // namespace storage
+}  // namespace ahrimq
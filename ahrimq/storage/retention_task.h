@@ -0,0 +1,62 @@
+#ifndef _AHRIMQ_STORAGE_RETENTION_TASK_H_
+#define _AHRIMQ_STORAGE_RETENTION_TASK_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "base/nocopyable.h"
+#include "storage/commit_log.h"
+
+namespace ahrimq {
+namespace storage {
+
+/// @brief RetentionTask deletes the old segments of commit logs in the background,
+/// as configured for every log by its LogConfig, see CommitLog::DeleteOldSegments().
+///
+/// The task runs every check_interval_ms on a thread of its own, scheduled with
+/// the batch policy and a raised nice value so that it yields the CPU to the
+/// loops. Appends and fetches never wait for it but for taking a segment out of a
+/// log, or for a segment whose indexes it is rebuilding to find the segment age.
+/// The idle policy is not used, it could starve the task while fetches wait.
+class RetentionTask : public NoCopyable {
+ public:
+  /// @brief Construct a task, which is started by Start().
+  /// @param check_interval_ms
+  explicit RetentionTask(uint64_t check_interval_ms = 5 * 60 * 1000);
+
+  /// @brief Stop the task, see Stop().
+  ~RetentionTask();
+
+  /// @brief Have the task check a log, from any thread.
+  /// @param log must outlive the task
+  void Add(CommitLog* log);
+
+  /// @brief Start the thread of the task.
+  void Start();
+
+  /// @brief Stop the thread, waiting for the check it runs.
+  void Stop();
+
+  /// @brief Check every log once, in the calling thread.
+  /// @return number of segments deleted
+  size_t RunOnce();
+
+ private:
+  void Run();
+
+ private:
+  uint64_t check_interval_ms_;
+  std::mutex mtx_;
+  std::condition_variable cv_;
+  std::vector<CommitLog*> logs_;
+  bool stopped_ = false;
+  std::thread thread_;
+};
+
+}  // namespace storage
+}  // namespace ahrimq
+
+#endif  // _AHRIMQ_STORAGE_RETENTION_TASK_H_
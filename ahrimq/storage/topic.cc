@@ -0,0 +1,38 @@
+#include "storage/topic.h"
+
+#include <errno.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <iostream>
+
+namespace ahrimq {
+namespace storage {
+
+Topic::Topic(const std::string& dir, const std::string& name, uint32_t partitions,
+             const LogConfig& config)
+    : dir_(dir), name_(name), name_hash_(std::hash<std::string>()(name)) {
+  for (uint32_t i = 0; i < std::max(partitions, 1u); i++) {
+    logs_.emplace_back(
+        new CommitLog(dir + "/" + name + "-" + std::to_string(i), config));
+  }
+}
+
+bool Topic::Open() {
+  if (mkdir(dir_.c_str(), 0755) == -1 && errno != EEXIST) {
+    std::cerr << "can not create " << dir_ << ": " << strerror(errno) << '\n';
+    return false;
+  }
+  for (auto& log : logs_) {
+    if (!log->Open()) {
+      std::cerr << "can not open topic " << name_ << '\n';
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace storage
+}  // namespace ahrimq
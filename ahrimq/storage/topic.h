@@ -0,0 +1,70 @@
+#ifndef _AHRIMQ_STORAGE_TOPIC_H_
+#define _AHRIMQ_STORAGE_TOPIC_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base/nocopyable.h"
+#include "storage/commit_log.h"
+
+namespace ahrimq {
+namespace storage {
+
+/// @brief Topic is a named stream of records split into partitions, each a commit
+/// log of its own kept in "<name>-<partition>" in the directory of the topics.
+/// Records keep their order within a partition only, so partitions are appended
+/// to in parallel, each by the single writer owning it.
+class Topic : public NoCopyable {
+ public:
+  /// @brief Construct a topic, which is opened by Open().
+  /// @param dir directory of the topics
+  /// @param name
+  /// @param partitions number of partitions, at least 1
+  /// @param config configuration of the logs of the partitions
+  Topic(const std::string& dir, const std::string& name, uint32_t partitions,
+        const LogConfig& config);
+
+  /// @brief Open the logs of all partitions, creating those which do not exist and
+  /// the directory of the topics.
+  /// @return
+  bool Open();
+
+  const std::string& Name() const {
+    return name_;
+  }
+
+  uint32_t Partitions() const {
+    return static_cast<uint32_t>(logs_.size());
+  }
+
+  /// @brief Get the log of a partition.
+  /// @param partition
+  /// @return nullptr if there is no such partition
+  CommitLog* Partition(uint32_t partition) const {
+    return partition < logs_.size() ? logs_[partition].get() : nullptr;
+  }
+
+  /// @brief Pick the writer owning a partition, out of writers. The partitions of
+  /// a topic are spread over the writers round robin, starting at a writer picked
+  /// by the name, so that topics with few partitions do not all share the first
+  /// writers.
+  /// @param partition
+  /// @param writers
+  /// @return
+  size_t Owner(uint32_t partition, size_t writers) const {
+    return (name_hash_ + partition) % writers;
+  }
+
+ private:
+  std::string dir_;
+  std::string name_;
+  size_t name_hash_;
+  std::vector<std::unique_ptr<CommitLog>> logs_;
+};
+
+}  // namespace storage
+}  // namespace ahrimq
+
+#endif  // _AHRIMQ_STORAGE_TOPIC_H_
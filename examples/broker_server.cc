@@ -0,0 +1,272 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "ahrimq/broker/broker_server.h"
+#include "ahrimq/broker/fetch_waiters.h"
+#include "ahrimq/broker/group_coordinator.h"
+#include "ahrimq/storage/log_appender.h"
+#include "ahrimq/storage/offset_store.h"
+#include "ahrimq/storage/retention_task.h"
+#include "ahrimq/storage/topic.h"
+
+using namespace ahrimq;
+using namespace ahrimq::broker;
+using namespace ahrimq::storage;
+
+// fetches wait at most this long, whatever they ask for
+constexpr static uint64_t kMaxFetchWaitMs = 30000;
+
+// Produce: topic(string) partition(u32) record batch(bytes) -> base offset(u64)
+// Fetch: topic(string) partition(u32) offset(u64) max bytes(u32) [max wait
+// ms(u32) min bytes(u32)] -> record batches(bytes), as they are stored in the log
+// and sent from its segment files
+//
+// Batches are encoded by producers with storage::BatchBuilder, possibly
+// compressed, and stored and served without being decoded again. A produce is
+// answered once its batch was synced. Every partition is owned by one writer of a
+// LogAppender, which appends and syncs the batches all connections produced to
+// its partitions together.
+//
+// A fetch finding fewer than min bytes waits up to max wait ms for them to be
+// produced, parked on the FetchWaiters of its partition, which the produces
+// complete once their batches are synced. Fetches only see the batches the
+// produces reported this way, so a crash never takes back what was served.
+//
+// Consumer groups are coordinated as documented by broker::HandleGroupRequests(),
+// their offsets are kept in dir/__consumer_offsets.
+//
+// Old segments of a topic are deleted in the background as its retention.ms and
+// retention.bytes allow, its last segment once it is older than segment.ms and
+// rolled by a produce.
+//
+// usage: broker_server [dir] [topic:partitions[,option=value]...]...
+//   options: retention.ms, retention.bytes, segment.ms, segment.bytes
+int main(int argc, char** argv) {
+  BrokerServerConfig config;
+  config.ip = "127.0.0.1";
+  config.port = 9527;
+  std::string dir = argc > 1 ? argv[1] : "/tmp/ahrimq-broker";
+
+  LogConfig log_config;
+  // the appender syncs every group of batches
+  log_config.fsync_interval_ms = 0;
+  // topics are set up before the server runs and never change, so the loops look
+  // them up without locking
+  std::unordered_map<std::string, std::unique_ptr<Topic>> topics;
+  // fetches parked on every partition
+  std::unordered_map<CommitLog*, std::unique_ptr<FetchWaiters>> waiters;
+  // old segments are deleted every minute
+  RetentionTask retention(60 * 1000);
+  std::vector<std::string> specs(argv + std::min(argc, 2), argv + argc);
+  if (specs.empty()) {
+    specs.push_back("test:4");
+  }
+  for (const std::string& spec : specs) {
+    size_t comma = spec.find(',');
+    size_t colon = spec.substr(0, comma).find(':');
+    std::string name = spec.substr(0, std::min(colon, comma));
+    uint32_t partitions =
+        colon == std::string::npos ? 1 : std::atoi(spec.c_str() + colon + 1);
+    // the retention of a topic follows its name as key=value pairs
+    LogConfig topic_config = log_config;
+    while (comma != std::string::npos) {
+      size_t next = spec.find(',', comma + 1);
+      std::string option = spec.substr(comma + 1, next - comma - 1);
+      size_t eq = option.find('=');
+      std::string key = option.substr(0, eq);
+      uint64_t value = eq == std::string::npos
+                           ? 0
+                           : std::strtoull(option.c_str() + eq + 1, nullptr, 10);
+      if (key == "retention.ms") {
+        topic_config.retention_ms = value;
+      } else if (key == "retention.bytes") {
+        topic_config.retention_bytes = value;
+      } else if (key == "segment.ms") {
+        topic_config.segment_ms = value;
+      } else if (key == "segment.bytes") {
+        topic_config.segment_bytes = value;
+      } else {
+        std::cerr << "unknown option " << option << " of topic " << name << '\n';
+        return 1;
+      }
+      comma = next;
+    }
+    auto topic = std::make_unique<Topic>(dir, name, partitions, topic_config);
+    if (!topic->Open()) {
+      return 1;
+    }
+    // the topic opens at least one partition, whatever the count asked for
+    for (uint32_t i = 0; i < topic->Partitions(); i++) {
+      CommitLog* log = topic->Partition(i);
+      waiters[log] = std::make_unique<FetchWaiters>(log->NextOffset());
+      retention.Add(log);
+    }
+    topics[name] = std::move(topic);
+  }
+  retention.Start();
+
+  OffsetStore offsets(dir + "/__consumer_offsets", OffsetStoreConfig());
+  if (!offsets.Open()) {
+    return 1;
+  }
+  GroupCoordinator coordinator(
+      &offsets,
+      [&](const std::string& name) -> uint32_t {
+        auto it = topics.find(name);
+        return it == topics.end() ? 0 : it->second->Partitions();
+      },
+      GroupCoordinatorConfig());
+  // members which went away without leaving are dropped in the background
+  std::thread([&coordinator]() {
+    while (true) {
+      std::this_thread::sleep_for(std::chrono::seconds(1));
+      coordinator.Tick();
+    }
+  }).detach();
+
+  AppenderConfig appender_config;
+  appender_config.linger_ms = 1;
+  appender_config.num_writers = 4;
+  LogAppender appender(appender_config);
+
+  BrokerServer server(config);
+
+  // the topic of a request holding partition, or the error to answer with
+  auto find_topic = [&](std::string_view name, uint32_t partition,
+                        ErrorCode* err) -> Topic* {
+    auto it = topics.find(std::string(name));
+    if (it == topics.end()) {
+      *err = ErrorCode::UnknownTopic;
+      return nullptr;
+    }
+    if (it->second->Partition(partition) == nullptr) {
+      *err = ErrorCode::UnknownPartition;
+      return nullptr;
+    }
+    return it->second.get();
+  };
+
+  server.HandleDeferred(
+      Opcode::Produce,
+      [&](TCPConn* conn, const Frame& request, Responder responder) {
+        FrameReader reader(request.body);
+        std::string_view topic, batch;
+        uint32_t partition = 0;
+        BatchHeader header;
+        if (!reader.ReadString(&topic) || !reader.ReadUInt32(&partition) ||
+            !reader.ReadBytes(&batch) ||
+            VerifyBatch(batch.data(), batch.size(), &header) != batch.size()) {
+          responder.Respond(ErrorCode::InvalidRequest);
+          return;
+        }
+        ErrorCode err = ErrorCode::None;
+        Topic* t = find_topic(topic, partition, &err);
+        if (t == nullptr) {
+          responder.Respond(err);
+          return;
+        }
+        FetchWaiters* partition_waiters = waiters.at(t->Partition(partition)).get();
+        size_t bytes = batch.size();
+        uint32_t count = header.count;
+        auto done = [responder, partition_waiters, bytes, count](bool ok,
+                                                                 uint64_t offset) {
+          if (!ok) {
+            responder.Respond(ErrorCode::InternalError);
+            return;
+          }
+          responder.Respond(ErrorCode::None, [offset](FrameWriter& response) {
+            response.WriteUInt64(offset);
+          });
+          partition_waiters->Notify(bytes, offset + count);
+        };
+        size_t owner = t->Owner(partition, appender.Writers());
+        if (!appender.Append(owner, t->Partition(partition), std::string(batch),
+                             std::move(done))) {
+          // the appender is stopped and never calls done
+          responder.Respond(ErrorCode::InternalError);
+        }
+      });
+
+  // the batches of a partition from offset, read when the response is written
+  auto fetch_body = [](CommitLog* log, FetchWaiters* partition_waiters,
+                       uint64_t offset, uint32_t max_bytes) -> BodyWriter {
+    return [log, partition_waiters, offset, max_bytes](FrameWriter& response) {
+      std::vector<LogSlice> slices;
+      size_t total = 0;
+      uint64_t end_offset = 0;
+      partition_waiters->Appended(&end_offset);
+      if (log->ReadSlices(offset, max_bytes, &slices, end_offset)) {
+        for (const LogSlice& slice : slices) {
+          total += slice.length;
+        }
+      } else {
+        slices.clear();
+      }
+      // a segment deleted meanwhile stays open until its slice was sent
+      response.WriteUInt32(static_cast<uint32_t>(total));
+      for (const LogSlice& slice : slices) {
+        response.WriteFile(slice.fd, slice.position, slice.length, slice.segment);
+      }
+    };
+  };
+
+  server.HandleDeferred(
+      Opcode::Fetch, [&](TCPConn* conn, const Frame& request, Responder responder) {
+        FrameReader reader(request.body);
+        std::string_view topic;
+        uint32_t partition = 0;
+        uint64_t offset = 0;
+        uint32_t max_bytes = 0, max_wait_ms = 0, min_bytes = 0;
+        if (!reader.ReadString(&topic) || !reader.ReadUInt32(&partition) ||
+            !reader.ReadUInt64(&offset) || !reader.ReadUInt32(&max_bytes) ||
+            (reader.Remaining() > 0 &&
+             (!reader.ReadUInt32(&max_wait_ms) || !reader.ReadUInt32(&min_bytes)))) {
+          responder.Respond(ErrorCode::InvalidRequest);
+          return;
+        }
+        ErrorCode err = ErrorCode::None;
+        Topic* t = find_topic(topic, partition, &err);
+        if (t == nullptr) {
+          responder.Respond(err);
+          return;
+        }
+        CommitLog* log = t->Partition(partition);
+        FetchWaiters* partition_waiters = waiters.at(log).get();
+        // what the fetch finds counts for it, what is notified later for the wait
+        uint64_t end_offset = 0;
+        uint64_t seen = partition_waiters->Appended(&end_offset);
+        std::vector<LogSlice> slices;
+        if (!log->ReadSlices(offset, max_bytes, &slices, end_offset)) {
+          responder.Respond(ErrorCode::OffsetOutOfRange);
+          return;
+        }
+        size_t available = 0;
+        for (const LogSlice& slice : slices) {
+          available += slice.length;
+        }
+        BodyWriter body = fetch_body(log, partition_waiters, offset, max_bytes);
+        auto done = [responder, body](bool) {
+          responder.Respond(ErrorCode::None, body);
+        };
+        min_bytes = std::min(min_bytes, max_bytes);
+        uint64_t wait_ms = std::min<uint64_t>(max_wait_ms, kMaxFetchWaitMs);
+        if (available >= min_bytes || wait_ms == 0 ||
+            !partition_waiters->Wait(conn->GetLoop(), seen, min_bytes - available,
+                                     wait_ms, std::move(done))) {
+          responder.Respond(ErrorCode::None, std::move(body));
+        }
+      });
+
+  HandleGroupRequests(&server, &coordinator);
+
+  server.Run();
+
+  return 0;
+}
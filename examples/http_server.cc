@@ -1,5 +1,10 @@
 #include "net/http/http_server.h"
 
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
 #include "buffer/buffer.h"
 
 using namespace ahrimq;
@@ -67,6 +72,10 @@ std::string handler4(const http::HTTPRequest& req, http::HTTPResponse& res,
         ss << vs[0] << '\n';
       }
     }
+    // uploaded files of a multipart form
+    for (auto&& f : req.Files()) {
+      ss << f.field << ": " << f.filename << " (" << f.size << " bytes)\n";
+    }
     res.MakeContentPlainText(ss.str());
   } else {
     res.MakeContentPlainText("Form is empty\n");
@@ -119,7 +128,7 @@ std::string handler8(const http::HTTPRequest& req, http::HTTPResponse& res,
     // show cookie back
     ss << "I received your cookies, they are: \n";
     for (const auto& cookie : req.Cookies()) {
-      ss << cookie.Name() << " : " << cookie.Value() << '\n';
+      ss << cookie.name << " : " << cookie.value << '\n';
     }
   } else {
     // set cookie
@@ -140,6 +149,68 @@ std::string handler8(const http::HTTPRequest& req, http::HTTPResponse& res,
   return "";
 }
 
+// blocking handler, runs on the worker pool
+std::string handler9(const http::HTTPRequest& req, http::HTTPResponse& res,
+                     const http::URLParams& params) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  res.MakeContentPlainText("Slept for 200ms without blocking the eventloop\n");
+  res.SetStatus(http::StatusOK);
+  return "";
+}
+
+#ifdef AHRIMQ_COROUTINES
+coro::Task<std::string> Lookup(std::string key, uint64_t delay_ms) {
+  // stands for a call to another service
+  co_await coro::Sleep(delay_ms);
+  co_return key + " done in " + std::to_string(delay_ms) + "ms\n";
+}
+
+// fan-out handler, the lookups overlap and the eventloop keeps serving others
+coro::Task<std::string> handler10(const http::HTTPRequest& req,
+                                  http::HTTPResponse& res, http::URLParams params) {
+  std::vector<coro::Task<std::string>> lookups;
+  lookups.push_back(Lookup("users", 100));
+  lookups.push_back(Lookup("orders", 150));
+  lookups.push_back(Lookup("stock", 50));
+  std::string body;
+  for (const auto& part : co_await coro::WhenAll(std::move(lookups))) {
+    body += part;
+  }
+  res.MakeContentPlainText(body);
+  res.SetStatus(http::StatusOK);
+  co_return "";
+}
+#endif
+
+// chat room over WebSocket, every message is broadcast to all members
+static std::mutex chat_mtx;
+static std::vector<http::WebSocketConnPtr> chat_members;
+
+http::WebSocketHandlers ChatRoom() {
+  http::WebSocketHandlers handlers;
+  handlers.on_open = [](const http::WebSocketConnPtr& conn) {
+    std::lock_guard<std::mutex> lck(chat_mtx);
+    chat_members.push_back(conn);
+  };
+  handlers.on_message = [](const http::WebSocketConnPtr& conn,
+                           http::WebSocketOpcode opcode, std::string_view payload) {
+    std::vector<http::WebSocketConnPtr> members;
+    {
+      std::lock_guard<std::mutex> lck(chat_mtx);
+      members = chat_members;
+    }
+    http::WebSocketConn::Broadcast(members, opcode, payload);
+  };
+  handlers.on_close = [](const http::WebSocketConnPtr& conn, uint16_t code,
+                         std::string_view reason) {
+    std::lock_guard<std::mutex> lck(chat_mtx);
+    chat_members.erase(
+        std::remove(chat_members.begin(), chat_members.end(), conn),
+        chat_members.end());
+  };
+  return handlers;
+}
+
 int main(int argc, char** argv) {
   ahrimq::http::HTTPServerConfig config;
   config.port = 9527;
@@ -156,6 +227,11 @@ int main(int argc, char** argv) {
   r = server.Get("/index", handler6);
   r = server.Get("/people/{name}/{id}", handler7);
   r = server.Get("/cookies", handler8);
+  r = server.Get("/slow", handler9, http::ExecPolicy::Pool);
+  r = server.WebSocket("/chat", ChatRoom());
+#ifdef AHRIMQ_COROUTINES
+  r = server.Handle(http::HTTPMethod::Get, "/fanout", handler10);
+#endif
 
   server.Run();
 